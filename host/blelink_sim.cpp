@@ -0,0 +1,155 @@
+// ==============================================================================
+// blelink_sim - BLE link state machine checks (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -pthread -o blelink_sim host/blelink_sim.cpp
+//
+// Usage:
+//   blelink_sim [events]
+//
+// Replays scripted Bluedroid event sequences (first pairing, bonded
+// reconnect, auth failure, stale and out-of-order events) through
+// BleLinkState and checks the resulting states. Then one thread posts
+// random events, standing in for the BT task, while another reads snapshots
+// the way loop() does and checks they are never torn. Exit code 1 on failure.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+#include "BleLinkState.hpp"
+
+static int failures = 0;
+
+struct Step {
+    BleLinkInput input;
+    BleLinkStateId expected;
+};
+
+static void script(const char* name, const std::vector<Step>& steps) {
+    BleLinkState link;
+    uint32_t now = 1000;
+    for (size_t i = 0; i < steps.size(); i++) {
+        now += 10;
+        link.post(steps[i].input, now);
+        if (link.state() != steps[i].expected) {
+            printf("  FAIL %s step %zu (%s): in %s, expected %s\n", name, i,
+                bleLinkInputName(steps[i].input), bleLinkStateName(link.state()),
+                bleLinkStateName(steps[i].expected));
+            failures++;
+            return;
+        }
+    }
+    BleLinkSnapshot snap = link.snapshot();
+    printf("%-22s ok: %zu events, %u transitions, %u ignored, ends %s",
+        name, steps.size(), snap.generation, link.ignoredEvents(), bleLinkStateName(snap.state));
+    if (link.readies()) printf(", connect-to-ready %u ms", link.lastReadyLatency());
+    printf("\n");
+}
+
+static void scripts() {
+    script("first-pairing", {
+        {BLE_INPUT_ADV_STARTED, BLE_LINK_ADVERTISING},
+        {BLE_INPUT_CONNECTED, BLE_LINK_CONNECTING},
+        {BLE_INPUT_SUBSCRIBED, BLE_LINK_CONNECTING},     // CCCD written during pairing
+        {BLE_INPUT_AUTH_OK, BLE_LINK_READY},
+    });
+    script("bonded-reconnect", {
+        {BLE_INPUT_ADV_STARTED, BLE_LINK_ADVERTISING},
+        {BLE_INPUT_CONNECTED, BLE_LINK_CONNECTING},
+        {BLE_INPUT_AUTH_OK, BLE_LINK_ENCRYPTED},
+        {BLE_INPUT_SUBSCRIBED, BLE_LINK_READY},
+        {BLE_INPUT_AUTH_OK, BLE_LINK_READY},             // Re-encryption is ignored
+    });
+    script("auth-failure", {
+        {BLE_INPUT_ADV_STARTED, BLE_LINK_ADVERTISING},
+        {BLE_INPUT_CONNECTED, BLE_LINK_CONNECTING},
+        {BLE_INPUT_AUTH_FAILED, BLE_LINK_DISCONNECTING},
+        {BLE_INPUT_DISCONNECTED, BLE_LINK_ADVERTISING},
+        {BLE_INPUT_ADV_STARTED, BLE_LINK_ADVERTISING},
+    });
+    script("host-drops-link", {
+        {BLE_INPUT_ADV_STARTED, BLE_LINK_ADVERTISING},
+        {BLE_INPUT_CONNECTED, BLE_LINK_CONNECTING},
+        {BLE_INPUT_AUTH_OK, BLE_LINK_ENCRYPTED},
+        {BLE_INPUT_SUBSCRIBED, BLE_LINK_READY},
+        {BLE_INPUT_DISCONNECTED, BLE_LINK_ADVERTISING},
+    });
+    script("local-disconnect", {
+        {BLE_INPUT_ADV_STARTED, BLE_LINK_ADVERTISING},
+        {BLE_INPUT_CONNECTED, BLE_LINK_CONNECTING},
+        {BLE_INPUT_AUTH_OK, BLE_LINK_ENCRYPTED},
+        {BLE_INPUT_SUBSCRIBED, BLE_LINK_READY},
+        {BLE_INPUT_DISCONNECT_REQUESTED, BLE_LINK_DISCONNECTING},
+        {BLE_INPUT_SUBSCRIBED, BLE_LINK_DISCONNECTING},  // Late write is ignored
+        {BLE_INPUT_DISCONNECTED, BLE_LINK_ADVERTISING},
+    });
+    script("stale-events", {
+        {BLE_INPUT_AUTH_OK, BLE_LINK_OFF},
+        {BLE_INPUT_DISCONNECTED, BLE_LINK_OFF},
+        {BLE_INPUT_ADV_STARTED, BLE_LINK_ADVERTISING},
+        {BLE_INPUT_SUBSCRIBED, BLE_LINK_ADVERTISING},
+        {BLE_INPUT_CONNECTED, BLE_LINK_CONNECTING},
+        {BLE_INPUT_SUBSCRIBED, BLE_LINK_CONNECTING},
+        {BLE_INPUT_DISCONNECTED, BLE_LINK_ADVERTISING},
+        {BLE_INPUT_CONNECTED, BLE_LINK_CONNECTING},
+        {BLE_INPUT_AUTH_OK, BLE_LINK_ENCRYPTED},         // Previous link's CCCD doesn't count
+    });
+    script("advertising-stopped", {
+        {BLE_INPUT_ADV_STARTED, BLE_LINK_ADVERTISING},
+        {BLE_INPUT_ADV_STOPPED, BLE_LINK_OFF},
+        {BLE_INPUT_CONNECTED, BLE_LINK_CONNECTING},
+    });
+}
+
+// Random writer vs. snapshot reader
+static void stress(long events) {
+    BleLinkState link;
+    std::atomic<bool> done(false);
+    std::atomic<bool> started(false);
+    std::atomic<uint32_t> clock(1);
+    long torn = 0, reads = 0, readyChecks = 0;
+
+    std::thread reader([&]() {
+        uint32_t lastGeneration = 0;
+        started = true;
+        while (!done.load()) {
+            BleLinkSnapshot s = link.snapshot();
+            uint32_t now = clock.load();
+            reads++;
+            bool bad = s.state >= BLE_LINK_STATE_COUNT || s.generation < lastGeneration ||
+                       (s.generation > 0 && (s.enteredAt == 0 || s.enteredAt > now));
+            if (s.state == BLE_LINK_READY) {
+                readyChecks++;
+                bad = bad || s.readyAt != s.enteredAt || s.connectedAt > s.readyAt;
+            }
+            if (bad) torn++;
+            lastGeneration = s.generation;
+        }
+    });
+
+    while (!started.load()) std::this_thread::yield();
+    std::mt19937 rng(7);
+    for (long i = 0; i < events; i++) {
+        // The BT task posts in bursts; give the reader a chance to see every state
+        if (i % 1024 == 0) std::this_thread::yield();
+        // Timestamps only move forward, like millis()
+        uint32_t now = clock.fetch_add(1) + 1;
+        link.post((BleLinkInput)(rng() % BLE_INPUT_COUNT), now);
+    }
+    done = true;
+    reader.join();
+
+    printf("%-22s %ld events, %u transitions, %u ignored; %ld snapshots (%ld ready), %ld torn\n",
+        "stress", events, link.generation(), link.ignoredEvents(), reads, readyChecks, torn);
+    if (torn || readyChecks == 0) failures++;
+}
+
+int main(int argc, char** argv) {
+    scripts();
+    stress(argc > 1 ? atol(argv[1]) : 2000000);
+    printf("blelink_sim: %s (%d failures)\n", failures ? "FAILED" : "ok", failures);
+    return failures ? 1 : 0;
+}
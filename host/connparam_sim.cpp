@@ -0,0 +1,235 @@
+// ==============================================================================
+// connparam_sim - BLE connection parameter policy checks (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -o connparam_sim host/connparam_sim.cpp
+//
+// Runs ConnParamPolicy against a scripted central (mock GAP) through a set
+// of scenarios: cooperative, rejecting, silent and opinionated centrals, and
+// activity while a request is in flight. Prints one line per scenario and
+// exits 1 if any expectation fails.
+
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include "ConnParamPolicy.hpp"
+
+// How the scripted central answers requests
+enum CentralBehaviour {
+    CENTRAL_ACCEPT,         // Applies the request's maxInterval
+    CENTRAL_REJECT,         // Non-zero status
+    CENTRAL_SILENT,         // Never answers
+    CENTRAL_CLAMP_15MS      // Applies max(requested, 15 ms), keeps latency
+};
+
+struct PendingAnswer {
+    uint32_t at;
+    uint8_t status;
+    uint16_t interval;
+    uint16_t latency;
+};
+
+class MockGap : public ConnParamGap {
+public:
+    CentralBehaviour behaviour;
+    int rejectFirst;        // CENTRAL_ACCEPT after this many rejections
+    uint32_t now;
+    uint32_t answerDelay;
+    std::deque<PendingAnswer> answers;
+    int sent;
+    uint32_t lastSentAt;
+    ConnParams last;
+
+    MockGap() : behaviour(CENTRAL_ACCEPT), rejectFirst(0), now(0), answerDelay(50), sent(0),
+                lastSentAt(0) {
+        memset(&last, 0, sizeof(last));
+    }
+
+    bool requestConnParams(const ConnParams& params) override {
+        sent++;
+        lastSentAt = now;
+        last = params;
+        PendingAnswer a = {now + answerDelay, 0, params.maxInterval, params.latency};
+        if (rejectFirst > 0) {
+            rejectFirst--;
+            a.status = 0x3B;    // Unacceptable connection parameters
+        } else if (behaviour == CENTRAL_REJECT) {
+            a.status = 0x3B;
+        } else if (behaviour == CENTRAL_SILENT) {
+            return true;
+        } else if (behaviour == CENTRAL_CLAMP_15MS && a.interval < 12) {
+            a.interval = 12;
+        }
+        answers.push_back(a);
+        return true;
+    }
+
+    // Delivers due answers, like ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT
+    void deliver(ConnParamPolicy& policy) {
+        while (!answers.empty() && answers.front().at <= now) {
+            PendingAnswer a = answers.front();
+            answers.pop_front();
+            policy.onParamsUpdated(a.status, a.interval, a.latency, BLE_SUPERVISION_TIMEOUT, now);
+        }
+    }
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* scenario, const char* what) {
+    if (!ok) {
+        printf("  FAIL %s: %s\n", scenario, what);
+        failures++;
+    }
+}
+
+// Advances time in 5 ms loop() passes
+static void run(MockGap& gap, ConnParamPolicy& policy, uint32_t ms) {
+    for (uint32_t t = 0; t < ms; t += 5) {
+        gap.now += 5;
+        gap.deliver(policy);
+        policy.service(gap.now);
+    }
+}
+
+static void report(const char* name, const MockGap& gap, const ConnParamPolicy& policy) {
+    const ConnParamStats& s = policy.stats();
+    printf("%-22s %d requests: %u accepted, %u compromised, %u rejected, %u timeouts; "
+           "now %s at %.2f ms / latency %u; active %.1f s, idle %.1f s\n",
+        name, gap.sent, s.accepted, s.compromised, s.rejected, s.timeouts,
+        connParamModeName(policy.appliedMode()), policy.interval() * 1.25, policy.latency(),
+        s.activeMs / 1000.0, s.idleMs / 1000.0);
+}
+
+static void cooperative() {
+    const char* name = "cooperative";
+    MockGap gap;
+    ConnParamPolicy policy(&gap);
+    gap.now = 1000;
+    policy.onConnected(gap.now, 24, 0, 400);    // Opened at 30 ms
+
+    run(gap, policy, BLE_CONN_SETTLE_MS + 100);
+    expect(policy.appliedMode() == CONN_MODE_ACTIVE, name, "not active after settling");
+    expect(gap.last.maxInterval == BLE_ACTIVE_INTERVAL && gap.last.latency == 0, name,
+        "active request has wrong parameters");
+
+    // Typing keeps it active
+    for (int i = 0; i < 20; i++) {
+        policy.onActivity(gap.now);
+        run(gap, policy, 500);
+    }
+    expect(gap.sent == 1, name, "re-requested while already active");
+
+    // Idle back-off, then wake-up on the next touch
+    run(gap, policy, BLE_IDLE_AFTER_MS + 200);
+    expect(policy.appliedMode() == CONN_MODE_IDLE, name, "did not back off when idle");
+    expect(policy.latency() == BLE_IDLE_LATENCY, name, "idle latency not applied");
+    uint32_t touch = gap.now;
+    policy.onActivity(gap.now);
+    run(gap, policy, 200);
+    expect(policy.appliedMode() == CONN_MODE_ACTIVE, name, "did not wake up on touch");
+    expect(gap.sent == 3, name, "wrong number of requests");
+    expect(gap.lastSentAt == touch, name, "wake-up request not sent on the touch");
+    report(name, gap, policy);
+}
+
+static void rejectThenAccept() {
+    const char* name = "reject-then-accept";
+    MockGap gap;
+    ConnParamPolicy policy(&gap);
+    gap.rejectFirst = 2;
+    policy.onConnected(gap.now);
+    // Settle, then attempts 1 s and 2 s apart; idle back-off starts at 5 s
+    run(gap, policy, 4500);
+    expect(policy.appliedMode() == CONN_MODE_ACTIVE, name, "not active after retries");
+    expect(policy.stats().rejected == 2, name, "rejections not counted");
+    expect(gap.sent == 3, name, "wrong number of attempts");
+    report(name, gap, policy);
+}
+
+static void alwaysReject() {
+    const char* name = "always-reject";
+    MockGap gap;
+    ConnParamPolicy policy(&gap);
+    gap.behaviour = CENTRAL_REJECT;
+    policy.onConnected(gap.now);
+    run(gap, policy, 60000);
+    expect(policy.gaveUp() || policy.wantedMode() == CONN_MODE_IDLE, name, "kept retrying");
+    // One request plus retries for active, the same again for idle
+    expect(gap.sent <= 2 * (1 + BLE_CONN_UPDATE_RETRIES), name, "too many requests");
+    report(name, gap, policy);
+}
+
+static void silentCentral() {
+    const char* name = "silent";
+    MockGap gap;
+    ConnParamPolicy policy(&gap);
+    gap.behaviour = CENTRAL_SILENT;
+    policy.onConnected(gap.now);
+    run(gap, policy, 4000);
+    expect(policy.stats().timeouts >= 1, name, "lost answer not detected");
+    expect(gap.sent >= 2, name, "not retried after timeout");
+    report(name, gap, policy);
+}
+
+static void clampingCentral() {
+    const char* name = "clamps-to-15ms";
+    MockGap gap;
+    ConnParamPolicy policy(&gap);
+    gap.behaviour = CENTRAL_CLAMP_15MS;
+    policy.onConnected(gap.now);
+    for (int i = 0; i < 10; i++) {
+        policy.onActivity(gap.now);
+        run(gap, policy, 400);
+    }
+    expect(policy.stats().compromised == 1, name, "compromise not recorded");
+    expect(policy.appliedMode() == CONN_MODE_ACTIVE, name, "15 ms not treated as active");
+    expect(gap.sent == 1, name, "asked again after the central decided");
+    report(name, gap, policy);
+}
+
+static void activityDuringIdleRequest() {
+    const char* name = "touch-mid-request";
+    MockGap gap;
+    ConnParamPolicy policy(&gap);
+    gap.answerDelay = 300;
+    policy.onConnected(gap.now);
+    run(gap, policy, BLE_IDLE_AFTER_MS + 100);
+    expect(policy.isPending() && policy.wantedMode() == CONN_MODE_IDLE, name,
+        "idle request not in flight");
+    policy.onActivity(gap.now);
+    run(gap, policy, 1000);
+    expect(policy.appliedMode() == CONN_MODE_ACTIVE, name, "stale idle answer won");
+    report(name, gap, policy);
+}
+
+static void disconnectMidRequest() {
+    const char* name = "disconnect";
+    MockGap gap;
+    ConnParamPolicy policy(&gap);
+    gap.answerDelay = 500;
+    policy.onConnected(gap.now);
+    run(gap, policy, BLE_CONN_SETTLE_MS + 100);
+    policy.onDisconnected(gap.now);
+    run(gap, policy, 5000);
+    expect(!policy.isPending() && policy.appliedMode() == CONN_MODE_NONE, name,
+        "state survived the disconnect");
+    int sent = gap.sent;
+    policy.onConnected(gap.now);
+    run(gap, policy, BLE_CONN_SETTLE_MS + 1000);
+    expect(gap.sent == sent + 1 && policy.appliedMode() == CONN_MODE_ACTIVE, name,
+        "did not renegotiate after reconnect");
+    report(name, gap, policy);
+}
+
+int main() {
+    cooperative();
+    rejectThenAccept();
+    alwaysReject();
+    silentCentral();
+    clampingCentral();
+    activityDuringIdleRequest();
+    disconnectMidRequest();
+    printf("connparam_sim: %s (%d failures)\n", failures ? "FAILED" : "ok", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,1155 @@
+// ==============================================================================
+// device_sim - Discrete-event simulation of the whole pad (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -Ihost/shims -o device_sim host/device_sim.cpp
+//
+// Usage:
+//   device_sim                  run the built-in scenarios and check them
+//   device_sim <scenario>       run a scenario script and print its report
+//
+// Runs the firmware's own UI, gesture recognizer, profile store and edit
+// log, connection parameter policy, reconnect engine, host slots, held
+// keystrokes, report queue, macro executor and trackpad on a virtual clock
+// (Clock.hpp), wired up the way setup() in main.cpp does it and serviced by
+// the same loop glue (PadController.hpp). The ESP-IDF glue is replaced by
+// models (SimDevice is the controller's PadPlatform): a central that connects
+// after a delay that depends on the advertising phase and answers parameter
+// requests, a link that moves notifications at connection events and loses
+// packets at a given rate, a GT911 that reports scripted taps and swipes, and
+// the panel (the LovyanGFX shim's memory canvas).
+//
+// Nothing runs in real time. A loop() pass costs SIM_TOUCH_READ_US plus
+// SIM_PIXEL_NS per pixel drawn plus SIM_STACK_SEND_US per report handed to
+// the stack, then waits 5 ms like delay(5); stack events are applied between
+// passes. An hour of use simulates in well under a second.
+//
+// Scenario script (one command per line, # comments):
+//
+//   seed <n>                    random seed (taps, loss, connect delays)
+//   duration <s>                simulated time
+//   loss <p>                    per-packet loss probability on the link
+//   host-interval <ms>          shortest connection interval the central grants
+//   taps <mean gap ms>          random taps on buttons with a macro
+//   tap-length <ms>             how long each tap is held
+//   swipes <mean gap s>         random profile swipes
+//   outages <mean gap s> <ms>   radio outages (longer than 4 s drop the link)
+//   at <ms> tap <button>        one tap on a button of the current profile
+//   at <ms> hold <button> <ms>  touch a button for that long (FIRE_HOLD buttons
+//                               keep their key down meanwhile)
+//   at <ms> swipe left|right
+//   at <ms> outage <ms>
+//
+// Reported per scenario: loop work and period (worst case included),
+// touch-to-report latency, taps that fired nothing, macro completion times
+// (touch-down to the last report delivered to the central), held, replayed
+// and expired keystrokes, held buttons and how long the central saw keys
+// down, and link drops and reconnects.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <queue>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include <LovyanGFX.hpp>
+
+// What LGFX_Setup.hpp declares on the device
+class LGFX : public lgfx::LGFX_Device {
+public:
+    LGFX() : lgfx::LGFX_Device(480, 480) {}
+};
+
+#include "Clock.hpp"
+#include "Macros.hpp"
+#include "ProfileStore.hpp"
+#include "MacroPadUI.hpp"
+#include "BleLinkState.hpp"
+#include "ConnParamPolicy.hpp"
+#include "ReconnectEngine.hpp"
+#include "HostSlots.hpp"
+#include "HidTransport.hpp"
+#include "MacroExecutor.hpp"
+#include "ProfileLog.hpp"
+#include "PadController.hpp"
+#include "Metrics.hpp"
+
+// ==============================================================================
+// Cost Model
+// ==============================================================================
+
+// GT911 read over 400 kHz I2C at the start of each pass
+#ifndef SIM_TOUCH_READ_US
+#define SIM_TOUCH_READ_US           250
+#endif
+
+// Rest of an idle pass
+#ifndef SIM_LOOP_BASE_US
+#define SIM_LOOP_BASE_US            60
+#endif
+
+// CPU writes into the PSRAM framebuffer
+#ifndef SIM_PIXEL_NS
+#define SIM_PIXEL_NS                40
+#endif
+
+// One esp_ble_gatts_send_indicate() call
+#ifndef SIM_STACK_SEND_US
+#define SIM_STACK_SEND_US           40
+#endif
+
+#define SIM_LOOP_DELAY_US           5000    // delay(5) at the end of loop()
+#define SIM_PACKETS_PER_EVENT       4       // Notifications the central takes per event
+#define SIM_CONTROLLER_BUFFERS      8
+#define SIM_HOST_INITIAL_INTERVAL   24      // 30 ms until the policy asks for less
+#define SIM_HOST_INITIAL_TIMEOUT    500     // 5 s
+#define SIM_PARAM_UPDATE_EVENTS     6       // Request to new parameters, in connection events
+
+// ==============================================================================
+// Virtual Clock and Event Queue
+// ==============================================================================
+
+static uint64_t simUs = 0;
+static uint64_t pixelNsCarry = 0;
+
+static uint64_t simClock() { return simUs; }
+
+static void charge(uint32_t us) { simUs += us; }
+
+static void chargePixels(uint32_t pixels) {
+    pixelNsCarry += (uint64_t)pixels * SIM_PIXEL_NS;
+    simUs += pixelNsCarry / 1000;
+    pixelNsCarry %= 1000;
+}
+
+enum EventType : uint8_t {
+    EV_LOOP = 0,
+    EV_CONN_EVENT,
+    EV_HOST_CONNECT,
+    EV_HOST_AUTH,
+    EV_HOST_SUBSCRIBE,
+    EV_PARAMS_UPDATE,
+    EV_TOUCH_DOWN,
+    EV_TOUCH_MOVE,
+    EV_TOUCH_UP,
+    EV_OUTAGE_START,
+    EV_OUTAGE_END,
+    EV_TAP_GEN,
+    EV_SWIPE_GEN,
+    EV_OUTAGE_GEN
+};
+
+struct Event {
+    uint64_t at;
+    uint64_t seq;
+    EventType type;
+    uint32_t epoch;             // Link or advertising epoch the event belongs to
+    int32_t a;
+    int32_t b;
+};
+
+struct EventLater {
+    bool operator()(const Event& x, const Event& y) const {
+        return x.at != y.at ? x.at > y.at : x.seq > y.seq;
+    }
+};
+
+// xorshift64*: the same seed gives the same run
+struct SimRandom {
+    uint64_t s;
+
+    explicit SimRandom(uint64_t seed) : s(seed ? seed : 1) {}
+
+    uint64_t next() {
+        s ^= s >> 12;
+        s ^= s << 25;
+        s ^= s >> 27;
+        return s * 2685821657736338717ull;
+    }
+
+    double unit() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+    bool chance(double p) { return p > 0 && unit() < p; }
+    uint32_t range(uint32_t lo, uint32_t hi) { return lo + (uint32_t)(unit() * (hi - lo + 1)); }
+    uint64_t exponential(double mean) { return (uint64_t)(-mean * log(1.0 - unit())); }
+};
+
+// ==============================================================================
+// Scenario
+// ==============================================================================
+
+struct ScriptedAction {
+    uint32_t atMs;
+    EventType type;             // EV_TOUCH_DOWN (tap), EV_SWIPE_GEN (swipe), EV_OUTAGE_START
+    int32_t arg;
+    uint32_t lengthMs;          // Taps: how long the touch lasts, 0 = tap-length
+};
+
+struct Scenario {
+    std::string name;
+    uint64_t seed;
+    double durationS;
+    double loss;
+    float hostIntervalMs;
+    uint32_t tapGapMs;          // 0 = no random taps
+    uint32_t tapLengthMs;
+    uint32_t swipeGapS;
+    uint32_t outageGapS;
+    uint32_t outageMs;
+    std::vector<ScriptedAction> actions;
+
+    Scenario() : seed(1), durationS(60), loss(0), hostIntervalMs(7.5f), tapGapMs(0),
+                 tapLengthMs(80), swipeGapS(0), outageGapS(0), outageMs(0) {}
+};
+
+// ==============================================================================
+// Results
+// ==============================================================================
+
+struct Samples {
+    std::vector<uint32_t> v;
+
+    void add(uint32_t x) { v.push_back(x); }
+    size_t count() const { return v.size(); }
+
+    uint32_t at(double p) {
+        if (v.empty()) return 0;
+        size_t i = (size_t)(p * (v.size() - 1) + 0.5);
+        std::nth_element(v.begin(), v.begin() + i, v.end());
+        return v[i];
+    }
+
+    uint32_t max() const { return v.empty() ? 0 : *std::max_element(v.begin(), v.end()); }
+
+    uint64_t avg() const {
+        uint64_t sum = 0;
+        for (uint32_t x : v) sum += x;
+        return v.empty() ? 0 : sum / v.size();
+    }
+};
+
+struct SimResult {
+    double wallS;
+    uint32_t passes;
+    Samples loopWorkUs;
+    Samples loopPeriodUs;
+    Samples touchToReportUs;
+    Samples completionMs;
+    uint32_t taps;
+    uint32_t missedTaps;
+    uint32_t swipes;
+    uint32_t swipeMacros;       // Fired by the button a swipe started on
+    uint32_t macrosStarted;
+    uint32_t macrosCompleted;
+    uint32_t macrosLost;
+    uint32_t held;
+    uint32_t replayed;
+    uint32_t expired;
+    uint32_t holds;             // FIRE_HOLD buttons pressed
+    uint32_t forcedReleases;    // ...let go by the stuck-key guard
+    Samples keysDownMs;         // Central: from a key going down to all keys up
+    bool stuckKeys;             // Central still has keys down at the end, finger up
+    uint32_t outages;
+    uint32_t disconnects;
+    uint32_t reconnects;
+    uint32_t maxReconnectMs;
+    uint32_t paramUpdates;
+    uint32_t reportsDelivered;
+    uint32_t retransmits;
+    uint32_t stalls;
+    uint32_t maxStallMs;
+    float intervalMs;
+    uint32_t canvasChecksum;
+
+    SimResult() : wallS(0), passes(0), taps(0), missedTaps(0), swipes(0), swipeMacros(0),
+                  macrosStarted(0), macrosCompleted(0), macrosLost(0), held(0), replayed(0), expired(0),
+                  holds(0), forcedReleases(0), stuckKeys(false),
+                  outages(0), disconnects(0), reconnects(0), maxReconnectMs(0),
+                  paramUpdates(0), reportsDelivered(0), retransmits(0), stalls(0),
+                  maxStallMs(0), intervalMs(0), canvasChecksum(0) {}
+};
+
+// ==============================================================================
+// Simulated Device
+// ==============================================================================
+
+class SimDevice;
+static SimDevice* device = nullptr;
+
+// Notifications sit in the controller until a connection event moves them
+class SimBleTransport : public HidTransport {
+public:
+    std::deque<HidReport> inFlight;
+    bool linkUp;
+
+    SimBleTransport() : linkUp(false) {}
+
+    const char* name() const override { return "ble-sim"; }
+    bool begin() override { return true; }
+
+    int sendable() override {
+        int free = SIM_CONTROLLER_BUFFERS - (int)inFlight.size();
+        return free > 0 ? free : 0;
+    }
+
+    bool sendReport(const HidReport& report) override {
+        charge(SIM_STACK_SEND_US);
+        return HidTransport::sendReport(report);
+    }
+
+protected:
+    bool sendKeyboardReport(uint8_t modifiers, const uint8_t keys[6]) override {
+        if (!linkUp) return false;
+        HidReport r = HidReport::press(modifiers, KEY_NONE);
+        memcpy(r.keys, keys, 6);
+        inFlight.push_back(r);
+        return true;
+    }
+
+    bool sendConsumerReport(uint8_t low, uint8_t high) override {
+        if (!linkUp) return false;
+        inFlight.push_back(HidReport::mediaState(low, high));
+        return true;
+    }
+
+    uint32_t clockUs() override { return clockMicros(); }
+};
+
+class SimAdvertisingGap : public AdvertisingGap {
+public:
+    bool startAdvertising(AdvPhase phase, const BlePeer* peer) override;
+};
+
+class SimConnParamGap : public ConnParamGap {
+public:
+    bool requestConnParams(const ConnParams& params) override;
+};
+
+class SimHostLinkControl : public HostLinkControl {
+public:
+    bool disconnect() override;
+};
+
+#define SIM_PROFILE_LOG_BYTES       0x10000     // proflog partition in partitions.csv
+
+// One macro from touch-down (or the held press) to its last report at the central
+struct MacroTrack {
+    uint64_t pressedUs;
+    uint32_t endSeq;            // Queue sequence number of its last report
+};
+
+struct Tap {
+    uint64_t downUs;
+    bool fired;
+};
+
+class SimDevice : public PadPlatform {
+public:
+    const Scenario& sc;
+    SimRandom rng;
+    SimResult res;
+
+    std::priority_queue<Event, std::vector<Event>, EventLater> events;
+    uint64_t eventSeq;
+
+    // Firmware objects, as in main.cpp (USB is the stub: never attached)
+    LGFX tft;
+    BuiltinProfileSource builtinSource;
+    RamFlashRegion profileLogRegion;
+    ProfileLog profileLog;
+    LoggedProfileSource loggedSource;
+    ProfileStore profileStore;
+    MacroPadUI* ui;
+    BleLinkState bleLink;
+    SimConnParamGap connParamGap;
+    ConnParamPolicy connParams;
+    SimAdvertisingGap advertisingGap;
+    ReconnectEngine reconnect;
+    PendingKeystrokes pendingKeys;
+    HostSlotTable hostSlots;
+    SimHostLinkControl hostLinkControl;
+    HostSwitcher hostSwitcher;
+    SimBleTransport bleTransport;
+    UsbHidTransport usbTransport;
+    HidReportQueue hidReports;
+    MacroExecutor macroExecutor;
+    MotionCoalescer trackpad;
+    PadController pad;
+    uint64_t lastLoopUs;
+
+    // Link and central model
+    std::deque<BleLinkEvent> linkEvents;     // What the BT task hands loop()
+    BlePeer central;
+    uint32_t linkEpoch;
+    uint32_t advEpoch;
+    bool connected;
+    uint16_t interval;          // 1.25 ms units
+    uint16_t timeout;           // 10 ms units
+    uint64_t lastHeardUs;
+    bool radioUp;
+    uint64_t outageEndUs;
+    uint16_t hostMinInterval;
+    int paramRequests;
+
+    // Central's keyboard state
+    bool centralKeysDown;
+    uint64_t centralDownUs;
+
+    // Touch model
+    bool touching;
+    int32_t touchX;
+    int32_t touchY;
+    uint64_t touchDownUs;
+    uint64_t touchBusyUntilUs;  // Random taps and swipes wait for the finger to lift
+    int currentTap;             // Index into taps, -1 during a swipe
+    std::vector<Tap> taps;
+    std::vector<std::vector<int32_t>> buttonCenters;    // Per profile: x, y per button
+
+    // Macro completion tracking
+    std::deque<MacroTrack> tracks;
+    uint32_t lastEndSeq;
+    uint32_t retired;           // Reports delivered or lost, in queue order
+    uint32_t cancelledSeen;
+    uint32_t flushedSeen;
+
+    explicit SimDevice(const Scenario& scenario)
+        : sc(scenario), rng(scenario.seed), eventSeq(0), profileLogRegion(SIM_PROFILE_LOG_BYTES),
+          profileLog(&profileLogRegion), ui(nullptr), connParams(&connParamGap),
+          reconnect(&advertisingGap), hostSwitcher(&hostSlots, &reconnect, &hostLinkControl),
+          hidReports(&bleTransport), macroExecutor(&hidReports),
+          pad(this, &bleLink, &bleTransport, &usbTransport, &hidReports, &macroExecutor, &trackpad,
+              &connParams, &reconnect, &pendingKeys, &hostSlots, &hostSwitcher, &profileStore),
+          lastLoopUs(0),
+          linkEpoch(0), advEpoch(0), connected(false), interval(SIM_HOST_INITIAL_INTERVAL),
+          timeout(SIM_HOST_INITIAL_TIMEOUT), lastHeardUs(0), radioUp(true), outageEndUs(0),
+          hostMinInterval((uint16_t)(scenario.hostIntervalMs / 1.25f + 0.5f)), paramRequests(0),
+          centralKeysDown(false), centralDownUs(0), touching(false), touchX(0), touchY(0), touchDownUs(0), touchBusyUntilUs(0), currentTap(-1), lastEndSeq(0), retired(0), cancelledSeen(0), flushedSeen(0) {}
+
+    ~SimDevice() { delete ui; }
+
+    void schedule(uint64_t at, EventType type, uint32_t epoch = 0, int32_t a = 0, int32_t b = 0) {
+        Event e = {at, eventSeq++, type, epoch, a, b};
+        events.push(e);
+    }
+
+    uint64_t intervalUs() const { return (uint64_t)interval * 1250; }
+
+    // ==== Macro tracking ====
+
+    // Reports a macro expands to, from a scratch executor
+    static uint32_t reportsFor(const Macro& macro) {
+        struct CountingSink : public HidReportSink {
+            int sendable() override { return -1; }
+            bool sendReport(const HidReport&) override { return true; }
+            bool completesOnSend() const override { return true; }
+        };
+        static CountingSink sink;
+        static HidReportQueue queue(&sink);
+        static MacroExecutor executor(&queue);
+        queue.open();
+        uint32_t before = queue.stats().queued;
+        executor.enqueue(macro, false);
+        for (uint32_t now = 0; executor.isBusy(); now += 1000) {
+            executor.service(now);
+            queue.service(now);
+        }
+        return queue.stats().queued - before;
+    }
+
+    void retire(uint32_t n, bool delivered) {
+        retired += n;
+        while (!tracks.empty() && tracks.front().endSeq <= retired) {
+            if (delivered) {
+                res.macrosCompleted++;
+                res.completionMs.add((uint32_t)((simUs - tracks.front().pressedUs) / 1000));
+            } else {
+                res.macrosLost++;
+            }
+            tracks.pop_front();
+        }
+    }
+
+    // Follows cancellations and flushes after the executor or queue ran
+    void trackQueues() {
+        const HidReportQueueStats& qs = hidReports.stats();
+        if (qs.flushed != flushedSeen) {
+            retire(qs.flushed - flushedSeen, false);
+            flushedSeen = qs.flushed;
+        }
+        uint32_t cancelled = macroExecutor.stats().cancelled;
+        if (cancelled != cancelledSeen) {
+            for (uint32_t i = cancelledSeen; i < cancelled && !tracks.empty(); i++) {
+                tracks.pop_back();
+                res.macrosLost++;
+            }
+            cancelledSeen = cancelled;
+            lastEndSeq = qs.queued;
+        }
+    }
+
+    // ==== PadPlatform: the stack and LittleFS, and following macros ====
+
+    bool pollLinkEvent(BleLinkEvent& ev) override {
+        if (linkEvents.empty()) return false;
+        ev = linkEvents.front();
+        linkEvents.pop_front();
+        return true;
+    }
+
+    bool resolveBondedPeer(const BleLinkEvent& ev, BlePeer& peer) override {
+        (void)ev;
+        peer = central;
+        return true;
+    }
+
+    void removeBondedPeer(const BlePeer&) override {}
+    void saveHostSlots(const HostSlotTable&) override {}
+
+    void onTouchReportQueued(uint32_t latencyUs) override { res.touchToReportUs.add(latencyUs); }
+
+    // Touches are timed from touch-down, replays from the original press
+    void onMacroStarted(const Macro& macro, bool fromTouch, uint32_t pressedAtMs,
+                        uint32_t queuedBefore) override {
+        MacroTrack t;
+        t.pressedUs = fromTouch ? touchDownUs : (uint64_t)pressedAtMs * 1000;
+        t.endSeq = std::max(lastEndSeq, queuedBefore) + reportsFor(macro);
+        lastEndSeq = t.endSeq;
+        tracks.push_back(t);
+        res.macrosStarted++;
+    }
+
+    // Hold reports queued after `queued` go out ahead of the rest of any
+    // macro still expanding: its last report is that much later in the queue
+    void onHoldQueued(uint32_t queued) override {
+        uint32_t added = hidReports.stats().queued - queued;
+        if (added == 0) return;
+        for (MacroTrack& t : tracks) {
+            if (t.endSeq > queued) t.endSeq += added;
+        }
+        if (lastEndSeq > queued) lastEndSeq += added;
+    }
+
+    void onQueuesChanged() override { trackQueues(); }
+
+    // A button fired (or was pressed, for holds): the tap or swipe did something
+    void buttonFired() {
+        if (currentTap >= 0) taps[currentTap].fired = true;
+        else res.swipeMacros++;
+    }
+
+    void setup() {
+        setClockSource(simClock);
+        profileLog.mount(builtinSource.identity());
+        loggedSource.attach(&builtinSource, &profileLog);
+        profileStore.begin(&loggedSource);
+        pad.setProfileLog(&profileLog);
+
+        ui = new MacroPadUI(&tft, &profileStore);
+        pad.setUI(ui);
+        ui->setMacroCallback([](const Macro& m, int b) {
+            device->buttonFired();
+            device->pad.executeMacro(m, b);
+        });
+        ui->setHoldCallback([](const Macro& m, int b, bool down) {
+            if (down) device->buttonFired();
+            device->pad.holdMacro(m, b, down);
+        });
+        ui->setProfileChangeCallback([](int p) { device->pad.onProfileChanged(p); });
+        ui->setGestureCallback([](const GestureEvent& e) { device->pad.onGesture(e); });
+        ui->setTrackpad(&trackpad);
+        ui->init();
+
+        central.valid = true;
+        for (int i = 0; i < 6; i++) central.addr[i] = (uint8_t)(0xC0 + i);
+        BlePeer replaced;
+        hostSlots.assign(0, central, replaced);
+        ui->setHostSlot(hostSlots.active());
+        reconnect.begin(hostSlots.activePeer(), 0, clockMillis());
+        lastLoopUs = 0;
+        schedule(simUs, EV_LOOP);
+    }
+
+    void loopPass() {
+        uint64_t start = simUs;
+        if (lastLoopUs != 0) {
+            res.loopPeriodUs.add((uint32_t)(start - lastLoopUs));
+            metrics.observe(METRIC_LOOP_PERIOD_US, (uint32_t)(start - lastLoopUs));
+        }
+        lastLoopUs = start;
+
+        charge(SIM_TOUCH_READ_US);
+        ui->update();
+        pad.serviceBLELink();
+        profileStore.service();
+        pad.serviceProfileLog();
+        charge(SIM_LOOP_BASE_US);
+
+        metrics.set(METRIC_HID_QUEUE_DEPTH, hidReports.depth());
+        metrics.set(METRIC_MACRO_QUEUE_DEPTH, macroExecutor.queued());
+        pad.followLinkState();
+
+        res.passes++;
+        res.loopWorkUs.add((uint32_t)(simUs - start));
+        schedule(simUs + SIM_LOOP_DELAY_US, EV_LOOP);
+    }
+
+    // ==== Central and link ====
+
+    uint32_t connectDelayMs(AdvPhase phase) {
+        switch (phase) {
+            case ADV_PHASE_DIRECTED: return rng.range(2, 12);
+            case ADV_PHASE_FAST:     return rng.range(30, 250);
+            default:                 return rng.range(400, 2500);
+        }
+    }
+
+    void onStartAdvertising(AdvPhase phase) {
+        advEpoch++;
+        bleLink.post(BLE_INPUT_ADV_STARTED, clockMillis());
+        schedule(simUs + (uint64_t)connectDelayMs(phase) * 1000, EV_HOST_CONNECT, advEpoch, phase);
+    }
+
+    void onRequestConnParams(const ConnParams& p) {
+        paramRequests++;
+        uint16_t granted = std::max(p.minInterval, hostMinInterval);
+        if (granted > p.maxInterval) granted = hostMinInterval;   // Central's own value
+        schedule(simUs + SIM_PARAM_UPDATE_EVENTS * intervalUs(), EV_PARAMS_UPDATE, linkEpoch,
+                 granted, (int32_t)p.latency | (int32_t)p.timeout << 16);
+    }
+
+    // The central's view of the keyboard: how long keys stay down
+    void centralReceived(const HidReport& r) {
+        if (r.kind != HID_REPORT_KEYBOARD) return;
+        bool down = r.modifiers != 0 || r.keys[0] != KEY_NONE;
+        if (down && !centralKeysDown) centralDownUs = simUs;
+        if (!down && centralKeysDown) res.keysDownMs.add((uint32_t)((simUs - centralDownUs) / 1000));
+        centralKeysDown = down;
+    }
+
+    void postLinkEvent(BleLinkEventType type, uint16_t connInterval = 0, uint16_t connLatency = 0,
+                       uint16_t connTimeout = 0) {
+        BleLinkEvent ev = {type, 0, connInterval, connLatency, connTimeout, {0}, 0};
+        memcpy(ev.peer, central.addr, 6);
+        linkEvents.push_back(ev);
+    }
+
+    void linkDown() {
+        // The host lets go of everything the pad had down
+        centralReceived(HidReport::release());
+        connected = false;
+        linkEpoch++;
+        bleTransport.linkUp = false;
+        uint32_t lost = (uint32_t)bleTransport.inFlight.size();
+        bleTransport.inFlight.clear();
+        retire(lost, false);
+        bleLink.post(BLE_INPUT_DISCONNECTED, clockMillis());
+        postLinkEvent(BLE_LINK_DISCONNECTED);
+        res.disconnects++;
+    }
+
+    void connectionEvent() {
+        bool heard = radioUp && !rng.chance(sc.loss);
+        if (!heard) {
+            res.retransmits += bleTransport.inFlight.empty() ? 0 : 1;
+            if (simUs - lastHeardUs >= (uint64_t)timeout * 10000) {
+                linkDown();
+                return;
+            }
+        } else {
+            lastHeardUs = simUs;
+            for (int n = 0; n < SIM_PACKETS_PER_EVENT && !bleTransport.inFlight.empty(); n++) {
+                if (n > 0 && rng.chance(sc.loss)) {
+                    res.retransmits++;
+                    break;
+                }
+                centralReceived(bleTransport.inFlight.front());
+                bleTransport.inFlight.pop_front();
+                res.reportsDelivered++;
+                bleTransport.onCompleted();
+                hidReports.onSent(true);
+                retire(1, true);
+            }
+        }
+        schedule(simUs + intervalUs(), EV_CONN_EVENT, linkEpoch);
+    }
+
+    void hostConnect(const Event& e) {
+        if (e.epoch != advEpoch || connected || bleLink.state() != BLE_LINK_ADVERTISING) return;
+        if (!radioUp) {
+            uint64_t retryAt = outageEndUs + (uint64_t)connectDelayMs((AdvPhase)e.a) * 1000;
+            schedule(retryAt, EV_HOST_CONNECT, e.epoch, e.a);
+            return;
+        }
+        connected = true;
+        linkEpoch++;
+        interval = SIM_HOST_INITIAL_INTERVAL;
+        timeout = SIM_HOST_INITIAL_TIMEOUT;
+        lastHeardUs = simUs;
+        bleTransport.linkUp = true;
+        bleLink.post(BLE_INPUT_CONNECTED, clockMillis());
+        postLinkEvent(BLE_LINK_CONNECTED, interval, 0, timeout);
+        schedule(simUs + intervalUs(), EV_CONN_EVENT, linkEpoch);
+        schedule(simUs + 3 * intervalUs(), EV_HOST_AUTH, linkEpoch);
+        schedule(simUs + 4 * intervalUs(), EV_HOST_SUBSCRIBE, linkEpoch);
+    }
+
+    // ==== Touch ====
+
+    const std::vector<int32_t>& centersFor(int profile) {
+        if ((int)buttonCenters.size() <= profile) buttonCenters.resize(profile + 1);
+        std::vector<int32_t>& c = buttonCenters[profile];
+        if (!c.empty()) return c;
+
+        std::vector<int64_t> sx(BUTTON_COUNT, 0), sy(BUTTON_COUNT, 0), n(BUTTON_COUNT, 0);
+        for (int32_t y = 0; y < SCREEN_HEIGHT; y += 2) {
+            for (int32_t x = 0; x < SCREEN_WIDTH; x += 2) {
+                int b = ui->getButtonAt(x, y);
+                if (b < 0) continue;
+                sx[b] += x;
+                sy[b] += y;
+                n[b]++;
+            }
+        }
+        c.assign(BUTTON_COUNT * 2, -1);
+        for (int b = 0; b < BUTTON_COUNT; b++) {
+            if (n[b] == 0) continue;
+            c[b * 2] = (int32_t)(sx[b] / n[b]);
+            c[b * 2 + 1] = (int32_t)(sy[b] / n[b]);
+        }
+        return c;
+    }
+
+    // Buttons of the current profile a tap may go to: any macro but a host switch
+    int randomButton() {
+        const Profile& p = profileStore.get(ui->getCurrentProfileIndex());
+        int candidates[BUTTON_COUNT];
+        int count = 0;
+        for (int b = 0; b < p.gridRows * p.gridCols; b++) {
+            MacroType t = p.buttons[b].type;
+            if (t != MACRO_TYPE_NONE && t != MACRO_TYPE_HOST) candidates[count++] = b;
+        }
+        return count ? candidates[rng.next() % count] : -1;
+    }
+
+    void startTap(int button, uint32_t lengthMs) {
+        const std::vector<int32_t>& c = centersFor(ui->getCurrentProfileIndex());
+        if (button < 0 || button >= BUTTON_COUNT || c[button * 2] < 0) return;
+        res.taps++;
+        currentTap = (int)taps.size();
+        taps.push_back({simUs, false});
+        touchBusyUntilUs = simUs + (uint64_t)lengthMs * 1000;
+        int32_t x = c[button * 2] + (int32_t)rng.range(0, 6) - 3;
+        int32_t y = c[button * 2 + 1] + (int32_t)rng.range(0, 6) - 3;
+        schedule(simUs, EV_TOUCH_DOWN, 0, x, y);
+        schedule(simUs + (uint64_t)lengthMs * 1000, EV_TOUCH_UP);
+    }
+
+    // 300 px in 50 ms along the middle of the grid
+    void startSwipe(bool left) {
+        res.swipes++;
+        currentTap = -1;
+        touchBusyUntilUs = simUs + 60000;
+        int32_t x = left ? 390 : 90;
+        int32_t step = left ? -60 : 60;
+        schedule(simUs, EV_TOUCH_DOWN, 0, x, 240);
+        for (int i = 1; i <= 5; i++) {
+            schedule(simUs + (uint64_t)i * 10000, EV_TOUCH_MOVE, 0, x + step * i, 240);
+        }
+        schedule(simUs + 60000, EV_TOUCH_UP);
+    }
+
+    void startOutage(uint32_t ms) {
+        res.outages++;
+        radioUp = false;
+        outageEndUs = std::max(outageEndUs, simUs + (uint64_t)ms * 1000);
+        schedule(outageEndUs, EV_OUTAGE_END);
+    }
+
+    // ==== Run ====
+
+    void dispatch(const Event& e) {
+        switch (e.type) {
+            case EV_LOOP:
+                loopPass();
+                break;
+            case EV_CONN_EVENT:
+                if (e.epoch == linkEpoch && connected) connectionEvent();
+                break;
+            case EV_HOST_CONNECT:
+                hostConnect(e);
+                break;
+            case EV_HOST_AUTH:
+                if (e.epoch != linkEpoch || !connected) break;
+                bleLink.post(BLE_INPUT_AUTH_OK, clockMillis());
+                postLinkEvent(BLE_LINK_BONDED);
+                break;
+            case EV_HOST_SUBSCRIBE:
+                if (e.epoch == linkEpoch && connected) bleLink.post(BLE_INPUT_SUBSCRIBED, clockMillis());
+                break;
+            case EV_PARAMS_UPDATE:
+                if (e.epoch != linkEpoch || !connected) break;
+                interval = (uint16_t)e.a;
+                timeout = (uint16_t)(e.b >> 16);
+                res.paramUpdates++;
+                postLinkEvent(BLE_LINK_PARAMS_UPDATED, interval, (uint16_t)(e.b & 0xFFFF), timeout);
+                break;
+            case EV_TOUCH_DOWN:
+                touchDownUs = simUs;
+                touching = true;
+                // fall through
+            case EV_TOUCH_MOVE:
+                touchX = e.a;
+                touchY = e.b;
+                tft.setTouch(true, touchX, touchY);
+                break;
+            case EV_TOUCH_UP:
+                touching = false;
+                tft.setTouch(false);
+                break;
+            case EV_OUTAGE_START:
+                startOutage((uint32_t)e.a);
+                break;
+            case EV_OUTAGE_END:
+                if (simUs >= outageEndUs) radioUp = true;
+                break;
+            case EV_TAP_GEN:
+                if (e.a < 0 && simUs < touchBusyUntilUs + 100000) {
+                    schedule(touchBusyUntilUs + 100000, EV_TAP_GEN, 0, -1);
+                    break;
+                }
+                startTap(e.a >= 0 ? e.a : randomButton(),
+                         e.b > 0 ? (uint32_t)e.b : sc.tapLengthMs);
+                if (e.a < 0) {
+                    uint64_t gap = (uint64_t)sc.tapLengthMs + 150 + rng.exponential(sc.tapGapMs);
+                    schedule(simUs + gap * 1000, EV_TAP_GEN, 0, -1);
+                }
+                break;
+            case EV_SWIPE_GEN:
+                if (e.b && simUs < touchBusyUntilUs + 100000) {
+                    schedule(touchBusyUntilUs + 100000, EV_SWIPE_GEN, 0, e.a, 1);
+                    break;
+                }
+                startSwipe(e.a != 0);
+                if (e.b) schedule(simUs + rng.exponential(sc.swipeGapS * 1e6), EV_SWIPE_GEN, 0,
+                                  (int32_t)(rng.next() & 1), 1);
+                break;
+            case EV_OUTAGE_GEN:
+                startOutage(sc.outageMs);
+                schedule(simUs + (uint64_t)sc.outageMs * 1000 + rng.exponential(sc.outageGapS * 1e6),
+                         EV_OUTAGE_GEN);
+                break;
+        }
+    }
+
+    SimResult run() {
+        auto wallStart = std::chrono::steady_clock::now();
+        setup();
+
+        if (sc.tapGapMs) schedule(simUs + 2000000 + rng.exponential(sc.tapGapMs * 1000.0), EV_TAP_GEN, 0, -1);
+        if (sc.swipeGapS) schedule(simUs + rng.exponential(sc.swipeGapS * 1e6), EV_SWIPE_GEN, 0, 1, 1);
+        if (sc.outageGapS) schedule(simUs + rng.exponential(sc.outageGapS * 1e6), EV_OUTAGE_GEN);
+        for (const ScriptedAction& a : sc.actions) {
+            uint64_t at = (uint64_t)a.atMs * 1000;
+            if (a.type == EV_TOUCH_DOWN) schedule(at, EV_TAP_GEN, 0, a.arg, (int32_t)a.lengthMs);
+            else if (a.type == EV_SWIPE_GEN) schedule(at, EV_SWIPE_GEN, 0, a.arg, 0);
+            else schedule(at, EV_OUTAGE_START, 0, a.arg);
+        }
+
+        uint64_t endUs = (uint64_t)(sc.durationS * 1e6);
+        while (!events.empty() && events.top().at <= endUs) {
+            Event e = events.top();
+            events.pop();
+            if (e.at > simUs) simUs = e.at;
+            dispatch(e);
+        }
+
+        for (const Tap& t : taps) {
+            if (!t.fired) res.missedTaps++;
+        }
+        const PendingKeystrokeStats& ks = pendingKeys.stats();
+        res.held = ks.buffered;
+        res.replayed = ks.replayed;
+        res.expired = ks.expired + ks.dropped;
+        res.holds = macroExecutor.stats().holds;
+        res.forcedReleases = macroExecutor.stats().forcedReleases;
+        res.stuckKeys = centralKeysDown && !touching;
+        const ReconnectStats& rs = reconnect.stats();
+        res.reconnects = rs.reconnects;
+        res.maxReconnectMs = rs.maxReconnectMs;
+        res.stalls = hidReports.stats().stalls;
+        res.maxStallMs = hidReports.stats().maxStallMs;
+        res.intervalMs = connected ? interval * 1.25f : 0;
+        res.canvasChecksum = tft.checksum();
+
+        setClockSource(nullptr);
+        res.wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        return res;
+    }
+};
+
+bool SimAdvertisingGap::startAdvertising(AdvPhase phase, const BlePeer*) {
+    device->onStartAdvertising(phase);
+    return true;
+}
+
+bool SimConnParamGap::requestConnParams(const ConnParams& params) {
+    device->onRequestConnParams(params);
+    return true;
+}
+
+bool SimHostLinkControl::disconnect() {
+    if (device->connected) device->linkDown();
+    return true;
+}
+
+static SimResult simulate(const Scenario& sc) {
+    simUs = 0;
+    pixelNsCarry = 0;
+    metrics = MetricsRegistry();
+    SimDevice* d = new SimDevice(sc);
+    device = d;
+    d->tft.setDrawHook(chargePixels);
+    SimResult r = d->run();
+    device = nullptr;
+    delete d;
+    return r;
+}
+
+static void report(const Scenario& sc, SimResult& r) {
+    printf("== %s: %.0f s simulated in %.2f s (%.0fx)\n", sc.name.c_str(), sc.durationS, r.wallS,
+           r.wallS > 0 ? sc.durationS / r.wallS : 0);
+    printf("   loop      %lu passes, work avg %.2f ms, p99 %.2f ms, max %.2f ms; period max %.2f ms\n",
+           (unsigned long)r.passes, r.loopWorkUs.avg() / 1000.0, r.loopWorkUs.at(0.99) / 1000.0,
+           r.loopWorkUs.max() / 1000.0, r.loopPeriodUs.max() / 1000.0);
+    printf("   touch     %lu taps (%lu missed), %lu swipes (%lu fired a macro); touch-to-report "
+           "p50 %lu us, max %lu us\n",
+           (unsigned long)r.taps, (unsigned long)r.missedTaps, (unsigned long)r.swipes,
+           (unsigned long)r.swipeMacros,
+           (unsigned long)r.touchToReportUs.at(0.5), (unsigned long)r.touchToReportUs.max());
+    printf("   macros    %lu started, %lu completed, %lu lost; completion p50 %lu ms, p99 %lu ms, "
+           "max %lu ms\n",
+           (unsigned long)r.macrosStarted, (unsigned long)r.macrosCompleted,
+           (unsigned long)r.macrosLost, (unsigned long)r.completionMs.at(0.5),
+           (unsigned long)r.completionMs.at(0.99), (unsigned long)r.completionMs.max());
+    printf("   held      %lu keystrokes, %lu replayed, %lu expired\n", (unsigned long)r.held,
+           (unsigned long)r.replayed, (unsigned long)r.expired);
+    printf("   holds     %lu buttons held, %lu released by the guard; keys down p50 %lu ms, "
+           "max %lu ms%s\n",
+           (unsigned long)r.holds, (unsigned long)r.forcedReleases,
+           (unsigned long)r.keysDownMs.at(0.5), (unsigned long)r.keysDownMs.max(),
+           r.stuckKeys ? ", STUCK at the end" : "");
+    printf("   link      %lu outages, %lu drops, %lu reconnects (max %lu ms), %lu param updates, "
+           "interval %.2f ms\n",
+           (unsigned long)r.outages, (unsigned long)r.disconnects, (unsigned long)r.reconnects,
+           (unsigned long)r.maxReconnectMs, (unsigned long)r.paramUpdates, r.intervalMs);
+    printf("   hid       %lu reports delivered, %lu retransmissions, %lu stalls (max %lu ms)\n",
+           (unsigned long)r.reportsDelivered, (unsigned long)r.retransmits,
+           (unsigned long)r.stalls, (unsigned long)r.maxStallMs);
+}
+
+// ==============================================================================
+// Scenario Scripts
+// ==============================================================================
+
+static bool loadScenario(const char* path, Scenario& sc) {
+    FILE* f = fopen(path, "r");
+    if (f == nullptr) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+    sc.name = path;
+    char line[256];
+    int lineNo = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        lineNo++;
+        char* hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char cmd[32], what[32];
+        double v1 = 0, v2 = 0;
+        int n = sscanf(line, "%31s %lf %lf", cmd, &v1, &v2);
+        if (n <= 0) continue;
+
+        if (strcmp(cmd, "seed") == 0 && n >= 2) sc.seed = (uint64_t)v1;
+        else if (strcmp(cmd, "duration") == 0 && n >= 2) sc.durationS = v1;
+        else if (strcmp(cmd, "loss") == 0 && n >= 2) sc.loss = v1;
+        else if (strcmp(cmd, "host-interval") == 0 && n >= 2) sc.hostIntervalMs = (float)v1;
+        else if (strcmp(cmd, "taps") == 0 && n >= 2) sc.tapGapMs = (uint32_t)v1;
+        else if (strcmp(cmd, "tap-length") == 0 && n >= 2) sc.tapLengthMs = (uint32_t)v1;
+        else if (strcmp(cmd, "swipes") == 0 && n >= 2) sc.swipeGapS = (uint32_t)v1;
+        else if (strcmp(cmd, "outages") == 0 && n >= 3) {
+            sc.outageGapS = (uint32_t)v1;
+            sc.outageMs = (uint32_t)v2;
+        } else if (strcmp(cmd, "at") == 0 && n >= 2) {
+            char arg[32] = "";
+            if (sscanf(line, "%*s %*s %31s %31s", what, arg) < 1) {
+                ok = false;
+                break;
+            }
+            ScriptedAction a = {(uint32_t)v1, EV_TOUCH_DOWN, 0, 0};
+            if (strcmp(what, "tap") == 0) {
+                a.arg = atoi(arg);
+            } else if (strcmp(what, "hold") == 0) {
+                char length[32] = "";
+                if (sscanf(line, "%*s %*s %*s %*s %31s", length) < 1) {
+                    ok = false;
+                    break;
+                }
+                a.arg = atoi(arg);
+                a.lengthMs = (uint32_t)atoi(length);
+            } else if (strcmp(what, "swipe") == 0) {
+                a.type = EV_SWIPE_GEN;
+                a.arg = strcmp(arg, "left") == 0;
+            } else if (strcmp(what, "outage") == 0) {
+                a.type = EV_OUTAGE_START;
+                a.arg = atoi(arg);
+            } else {
+                ok = false;
+            }
+            if (ok) sc.actions.push_back(a);
+        } else {
+            ok = false;
+        }
+    }
+    fclose(f);
+    if (!ok) fprintf(stderr, "%s:%d: cannot parse this line\n", path, lineNo);
+    return ok;
+}
+
+// ==============================================================================
+// Built-in Scenarios
+// ==============================================================================
+
+static int failures = 0;
+
+static void expect(bool ok, const char* scenario, const char* what) {
+    if (!ok) {
+        printf("FAIL [%s] %s\n", scenario, what);
+        failures++;
+    }
+}
+
+static Scenario builtin(const char* name, double durationS, double loss, uint32_t tapGapMs) {
+    Scenario sc;
+    sc.name = name;
+    sc.durationS = durationS;
+    sc.loss = loss;
+    sc.tapGapMs = tapGapMs;
+    return sc;
+}
+
+// Clean link, steady typing and the odd profile swipe: every tap fires and
+// every macro reaches the central
+static void steady() {
+    Scenario sc = builtin("steady", 600, 0, 400);
+    sc.swipeGapS = 30;
+    SimResult r = simulate(sc);
+    report(sc, r);
+    expect(r.taps > 800, sc.name.c_str(), "too few taps generated");
+    expect(r.missedTaps == 0, sc.name.c_str(), "taps fired nothing");
+    expect(!r.stuckKeys, sc.name.c_str(), "keys left down on the central");
+    expect(r.macrosLost == 0 && r.disconnects == 0, sc.name.c_str(), "macros lost on a clean link");
+    expect(r.macrosStarted - r.macrosCompleted <= 1, sc.name.c_str(), "macros never completed");
+    expect(r.loopPeriodUs.max() < 40000, sc.name.c_str(), "loop stalled for 40 ms or more");
+    expect(r.intervalMs > 0 && r.paramUpdates > 0, sc.name.c_str(), "no parameter updates");
+
+    // Same seed, same run
+    SimResult again = simulate(sc);
+    expect(again.canvasChecksum == r.canvasChecksum && again.passes == r.passes &&
+           again.completionMs.avg() == r.completionMs.avg(), sc.name.c_str(),
+           "same seed gave a different run");
+}
+
+// 10% packet loss retransmits rather than drops: slower, nothing lost
+static void lossy() {
+    Scenario sc = builtin("lossy", 3600, 0.10, 500);
+    SimResult r = simulate(sc);
+    report(sc, r);
+    expect(r.retransmits > 0, sc.name.c_str(), "nothing was retransmitted");
+    expect(r.disconnects == 0, sc.name.c_str(), "link dropped on packet loss alone");
+    expect(r.missedTaps == 0 && r.macrosLost == 0, sc.name.c_str(), "macros lost");
+}
+
+// Outages past the supervision timeout drop the link; presses during the
+// reconnect are held and replayed or expire, and nothing stays in flight
+static void outages() {
+    Scenario sc = builtin("outages", 3600, 0.01, 300);
+    sc.outageGapS = 120;
+    sc.outageMs = 6000;
+    SimResult r = simulate(sc);
+    report(sc, r);
+    expect(r.outages > 10, sc.name.c_str(), "too few outages generated");
+    expect(r.disconnects > 0 && r.reconnects == r.disconnects, sc.name.c_str(),
+           "drops and reconnects do not match");
+    expect(r.held > 0 && r.replayed + r.expired <= r.held, sc.name.c_str(), "held keys not accounted");
+    expect(r.macrosStarted - r.macrosCompleted - r.macrosLost <= 1, sc.name.c_str(),
+           "macros neither completed nor lost");
+    expect(!r.stuckKeys, sc.name.c_str(), "keys left down on the central");
+}
+
+static bool anySampleIn(const Samples& s, uint32_t lo, uint32_t hi) {
+    for (uint32_t x : s.v) {
+        if (x >= lo && x <= hi) return true;
+    }
+    return false;
+}
+
+// MIR4's Jump (FIRE_HOLD): the central sees Space down for as long as the
+// finger is, and a link drop in the middle of a hold leaves nothing stuck
+static void holds() {
+    Scenario sc = builtin("holds", 60, 0, 0);
+    sc.actions = {
+        {3000, EV_SWIPE_GEN, 1, 0},             // General -> VS Code
+        {4000, EV_SWIPE_GEN, 1, 0},             // -> MIR4
+        {6000, EV_TOUCH_DOWN, 15, 2000},        // Jump, held 2 s
+        {10000, EV_TOUCH_DOWN, 15, 500},
+        {12000, EV_TOUCH_DOWN, 14, 0},          // Target (Tab): a plain tap
+        {15000, EV_TOUCH_DOWN, 15, 15000},      // Held through a link drop
+        {16000, EV_OUTAGE_START, 6000, 0}
+    };
+    SimResult r = simulate(sc);
+    report(sc, r);
+    expect(r.missedTaps == 0 && r.holds == 3, sc.name.c_str(), "holds not pressed");
+    expect(anySampleIn(r.keysDownMs, 2000, 2060) && anySampleIn(r.keysDownMs, 500, 560),
+           sc.name.c_str(), "keys not down for as long as the touch");
+    expect(r.disconnects == 1 && r.forcedReleases == 1, sc.name.c_str(),
+           "link drop did not end the hold");
+    expect(r.keysDownMs.max() < 10000 && !r.stuckKeys, sc.name.c_str(),
+           "keys left down on the central");
+}
+
+// A working day with everything at once, as fast as it simulates
+static void soak() {
+    Scenario sc = builtin("soak", 8 * 3600, 0.02, 1500);
+    sc.swipeGapS = 120;
+    sc.outageGapS = 1800;
+    sc.outageMs = 8000;
+    sc.hostIntervalMs = 15;
+    SimResult r = simulate(sc);
+    report(sc, r);
+    expect(r.missedTaps == 0, sc.name.c_str(), "taps fired nothing");
+    expect(!r.stuckKeys, sc.name.c_str(), "keys left down on the central");
+    expect(r.wallS < sc.durationS / 100, sc.name.c_str(), "simulated less than 100x real time");
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 2) {
+        Scenario sc;
+        if (!loadScenario(argv[1], sc)) return 2;
+        SimResult r = simulate(sc);
+        report(sc, r);
+        return 0;
+    }
+
+    steady();
+    lossy();
+    outages();
+    holds();
+    soak();
+    printf("device_sim: %s (%d failures)\n", failures ? "FAILED" : "ok", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,280 @@
+// ==============================================================================
+// gesture_sim - Gesture recognizer against synthetic touch streams (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -o gesture_sim host/gesture_sim.cpp
+//
+// Feeds scripted sample streams into GestureRecognizer at the GT911's poll
+// period, the way MacroPadUI::update() does: one sample per poll, touching
+// or not. Checks the events of taps, double-taps, long-presses, swipes by
+// distance and by velocity, and GT911 dropouts shorter than
+// TOUCH_DEBOUNCE_MS, and that every decision stays within
+// GESTURE_DECISION_BUDGET_MS of the physical edge.
+// Prints one line per scenario and exits 1 if any expectation fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "GestureRecognizer.hpp"
+
+#define SIM_POLL_MS     GESTURE_SAMPLE_PERIOD_MS
+#define SIM_IDLE_MS     100     // Polls without contact after each release
+
+struct Sample {
+    uint32_t ms;
+    bool touching;
+    int32_t x;
+    int32_t y;
+};
+
+// Builds a sample stream one poll at a time
+class Script {
+private:
+    std::vector<Sample> _samples;
+    uint32_t _now;
+
+public:
+    Script() : _now(0) {}
+
+    // Finger held at (x, y) for `ms`
+    Script& hold(int32_t x, int32_t y, uint32_t ms) {
+        return drag(x, y, x, y, ms);
+    }
+
+    // Finger moving from (x0, y0) to (x1, y1) over `ms`, one sample per poll
+    Script& drag(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t ms) {
+        for (uint32_t at = 0; at <= ms; at += SIM_POLL_MS) {
+            Sample s = {_now, true, x0 + (x1 - x0) * (int32_t)at / (int32_t)ms,
+                        y0 + (y1 - y0) * (int32_t)at / (int32_t)ms};
+            if (ms == 0) {
+                s.x = x1;
+                s.y = y1;
+            }
+            _samples.push_back(s);
+            _now += SIM_POLL_MS;
+        }
+        return *this;
+    }
+
+    // No contact reported for `ms`: a lift, or a dropout if shorter than the debounce
+    Script& gap(uint32_t ms) {
+        for (uint32_t at = 0; at < ms; at += SIM_POLL_MS) {
+            Sample s = {_now, false, 0, 0};
+            _samples.push_back(s);
+            _now += SIM_POLL_MS;
+        }
+        return *this;
+    }
+
+    Script& lift() { return gap(SIM_IDLE_MS); }
+
+    const std::vector<Sample>& samples() const { return _samples; }
+};
+
+struct Run {
+    std::vector<GestureEvent> events;
+    uint32_t maxLatency;
+    uint32_t overruns;
+};
+
+static Run run(const Script& script) {
+    GestureRecognizer gestures;
+    Run r;
+    for (const Sample& s : script.samples()) {
+        gestures.update(s.touching, s.x, s.y, s.ms);
+        GestureEvent e;
+        while (gestures.poll(e)) r.events.push_back(e);
+    }
+    r.maxLatency = gestures.maxDecisionLatency();
+    r.overruns = gestures.budgetOverruns();
+    return r;
+}
+
+static const char* eventName(GestureType type) {
+    switch (type) {
+        case GESTURE_NONE:       return "none";
+        case GESTURE_DOWN:       return "down";
+        case GESTURE_CANCEL:     return "cancel";
+        case GESTURE_TAP:        return "tap";
+        case GESTURE_DOUBLE_TAP: return "double";
+        case GESTURE_LONG_PRESS: return "long";
+        case GESTURE_SWIPE:      return "swipe";
+        case GESTURE_UP:         return "up";
+    }
+    return "?";
+}
+
+// Event types as text, e.g. "down tap up"
+static std::string sequence(const Run& r) {
+    std::string s;
+    for (const GestureEvent& e : r.events) {
+        if (!s.empty()) s += ' ';
+        s += eventName(e.type);
+    }
+    return s;
+}
+
+static const GestureEvent* find(const Run& r, GestureType type) {
+    for (const GestureEvent& e : r.events) {
+        if (e.type == type) return &e;
+    }
+    return nullptr;
+}
+
+static int failures = 0;
+
+static void expect(bool ok, const char* scenario, const char* what) {
+    if (!ok) {
+        printf("  FAIL %s: %s\n", scenario, what);
+        failures++;
+    }
+}
+
+// Every scenario: event sequence, and every decision within the budget
+static Run check(const char* name, const Script& script, const char* want) {
+    Run r = run(script);
+    std::string got = sequence(r);
+    if (got != want) {
+        printf("  FAIL %s: events \"%s\", want \"%s\"\n", name, got.c_str(), want);
+        failures++;
+    }
+    expect(r.maxLatency <= GESTURE_DECISION_BUDGET_MS && r.overruns == 0, name,
+        "decision latency over budget");
+    return r;
+}
+
+static void tap() {
+    const char* name = "tap";
+    Run r = check(name, Script().hold(100, 100, 80).lift(), "down tap up");
+    const GestureEvent* down = find(r, GESTURE_DOWN);
+    expect(down != nullptr && down->latency == 0, name, "down not decided on the first sample");
+    // Jitter inside the tap slop is still a tap
+    check(name, Script().drag(100, 100, 130, 120, 60).lift(), "down tap up");
+    printf("%-14s down in %lu ms, tap in %lu ms (budget %d ms)\n", name,
+        down ? (unsigned long)down->latency : 0ul,
+        find(r, GESTURE_TAP) ? (unsigned long)find(r, GESTURE_TAP)->latency : 0ul,
+        GESTURE_DECISION_BUDGET_MS);
+}
+
+static void doubleTap() {
+    const char* name = "double-tap";
+    check(name, Script().hold(200, 150, 60).gap(150).hold(205, 148, 60).lift(),
+          "down tap up down tap double up");
+    // Too slow, or too far from the first tap: two single taps
+    check(name, Script().hold(200, 150, 60).gap(DOUBLE_TAP_MS + 50).hold(200, 150, 60).lift(),
+          "down tap up down tap up");
+    check(name, Script().hold(200, 150, 60).gap(150).hold(300, 150, 60).lift(),
+          "down tap up down tap up");
+    // A third tap starts a new pair rather than doubling again
+    check(name, Script().hold(200, 150, 60).gap(100).hold(200, 150, 60).gap(100)
+                        .hold(200, 150, 60).lift(),
+          "down tap up down tap double up down tap up");
+    printf("%-14s within %d ms and %d px of the first tap\n", name, DOUBLE_TAP_MS,
+        SWIPE_THRESHOLD);
+}
+
+static void longPress() {
+    const char* name = "long-press";
+    Run r = check(name, Script().hold(240, 160, LONG_PRESS_MS + 200).lift(), "down long up");
+    const GestureEvent* e = find(r, GESTURE_LONG_PRESS);
+    expect(e != nullptr && e->latency < SIM_POLL_MS, name, "long-press decided late");
+    // Released just before the threshold: a tap
+    check(name, Script().hold(240, 160, LONG_PRESS_MS - 2 * SIM_POLL_MS).lift(), "down tap up");
+    // Moving off cancels it
+    check(name, Script().hold(240, 160, 200).drag(240, 160, 240, 220, 100)
+                        .hold(240, 220, LONG_PRESS_MS).lift(), "down cancel up");
+    printf("%-14s after %d ms, decided %lu ms after the threshold\n", name, LONG_PRESS_MS,
+        e ? (unsigned long)e->latency : 0ul);
+}
+
+static void distanceSwipe() {
+    const char* name = "swipe-dist";
+    // Slow (about 125 px/s) but far: a swipe by distance alone. Slower still and
+    // the finger would sit inside the tap slop long enough for a long-press.
+    Run r = check(name, Script().drag(100, 200, 100 + SWIPE_MIN_DISTANCE + 20, 200, 800).lift(),
+                  "down cancel swipe up");
+    const GestureEvent* e = find(r, GESTURE_SWIPE);
+    expect(e != nullptr && e->direction == SWIPE_RIGHT, name, "wrong direction");
+    expect(e != nullptr && e->velocity < SWIPE_MIN_VELOCITY, name, "drag was not slow");
+
+    const struct { int32_t dx, dy; SwipeDirection dir; } dirs[] = {
+        {-120, 0, SWIPE_LEFT}, {0, -120, SWIPE_UP}, {0, 120, SWIPE_DOWN}, {110, -60, SWIPE_RIGHT}
+    };
+    for (const auto& d : dirs) {
+        Run rd = run(Script().drag(240, 200, 240 + d.dx, 200 + d.dy, 300).lift());
+        const GestureEvent* s = find(rd, GESTURE_SWIPE);
+        expect(s != nullptr && s->direction == d.dir, name, "dominant axis picked wrong");
+    }
+    printf("%-14s %d px at %ld px/s, four directions\n", name, e ? e->dx : 0,
+        e ? (long)e->velocity : 0l);
+}
+
+static void velocitySwipe() {
+    const char* name = "swipe-flick";
+    // 70 px: past the tap slop, short of SWIPE_MIN_DISTANCE
+    int32_t dist = (SWIPE_THRESHOLD + SWIPE_MIN_DISTANCE) / 2 + 5;
+    Run fast = check(name, Script().drag(300, 200, 300 - dist, 200, 40).lift(),
+                     "down cancel swipe up");
+    const GestureEvent* e = find(fast, GESTURE_SWIPE);
+    expect(e != nullptr && e->direction == SWIPE_LEFT && e->velocity >= SWIPE_MIN_VELOCITY,
+        name, "flick not recognised by velocity");
+    // Same distance slowly, or a flick that stopped before lifting: no swipe
+    check(name, Script().drag(300, 200, 300 - dist, 200, 400).lift(), "down cancel up");
+    check(name, Script().drag(300, 200, 300 - dist, 200, 40).hold(300 - dist, 200, 100).lift(),
+          "down cancel up");
+    printf("%-14s %ld px at %ld px/s (min %d px/s)\n", name, (long)dist,
+        e ? (long)e->velocity : 0l, SWIPE_MIN_VELOCITY);
+}
+
+static void dropouts() {
+    const char* name = "dropout";
+    // One lost poll every 50 ms while held: still one tap
+    Script held;
+    for (int i = 0; i < 4; i++) held.hold(180, 180, 40).gap(SIM_POLL_MS);
+    held.hold(180, 180, 20).lift();
+    check(name, held, "down tap up");
+
+    // Dropouts during a long-press and a swipe do not split them either
+    check(name, Script().hold(180, 180, 300).gap(SIM_POLL_MS).hold(180, 180, 400).lift(),
+          "down long up");
+    check(name, Script().drag(100, 200, 160, 200, 60).gap(SIM_POLL_MS)
+                        .drag(170, 200, 240, 200, 60).lift(),
+          "down cancel swipe up");
+
+    // A gap as long as the debounce is a release: two contacts
+    check(name, Script().hold(180, 180, 40).gap(TOUCH_DEBOUNCE_MS + SIM_POLL_MS)
+                        .hold(180, 180, 40).lift(),
+          "down tap up down tap double up");
+    printf("%-14s gaps under %d ms bridged, longer ones release\n", name, TOUCH_DEBOUNCE_MS);
+}
+
+static void budget() {
+    const char* name = "budget";
+    // Everything above in one stream, on one recognizer
+    Script all;
+    all.hold(100, 100, 80).lift()
+       .hold(200, 150, 60).gap(150).hold(205, 148, 60).lift()
+       .hold(240, 160, LONG_PRESS_MS + 200).lift()
+       .drag(100, 200, 220, 200, 800).lift()
+       .drag(300, 200, 230, 200, 40).lift()
+       .hold(180, 180, 40).gap(SIM_POLL_MS).hold(180, 180, 40).lift();
+    Run r = run(all);
+    expect(r.maxLatency <= GESTURE_DECISION_BUDGET_MS, name, "max latency over budget");
+    expect(r.overruns == 0, name, "budget overruns");
+    printf("%-14s %zu events, max decision latency %lu ms of %d ms, %lu overruns\n", name,
+        r.events.size(), (unsigned long)r.maxLatency, GESTURE_DECISION_BUDGET_MS,
+        (unsigned long)r.overruns);
+}
+
+int main() {
+    tap();
+    doubleTap();
+    longPress();
+    distanceSwipe();
+    velocitySwipe();
+    dropouts();
+    budget();
+    printf("gesture_sim: %s (%d failures)\n", failures ? "FAILED" : "ok", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,250 @@
+// ==============================================================================
+// hidqueue_sim - HID report queue flow control and typing throughput (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -o hidqueue_sim host/hidqueue_sim.cpp
+//
+// Types a long text macro over a modelled BLE link: notifications go into
+// the stack's L2CAP queue, then into a few controller buffers, which the
+// host drains a limited number of packets per connection event. Compares
+// pushing every report straight into the stack (what BleKeyboard::print()
+// does) with HidReportQueue, for several connection intervals and host
+// packet limits, and checks a link drop mid-burst. Prints one line per
+// scenario and exits 1 if any expectation fails.
+
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "HidReportQueue.hpp"
+
+#define SIM_STEP_US         250
+#define SIM_CONF_US         500     // Notification accepted -> ESP_GATTS_CONF_EVT
+#define SIM_L2CAP_QUEUE     6       // Stack queue before notifications are refused
+#define SIM_CTRL_BUFFERS    8       // Controller ACL buffers for the link
+
+struct LinkParams {
+    const char* name;
+    uint32_t intervalUs;
+    int packetsPerEvent;        // Host's limit per connection event
+};
+
+// Stack + controller + host, as far as notifications are concerned
+class LinkModel : public HidReportSink {
+public:
+    LinkParams params;
+    uint64_t nowUs;
+    HidReportQueue* queue;      // Receives CONF events (nullptr: direct mode)
+
+    std::deque<HidReport> l2cap;
+    std::deque<HidReport> controller;
+    std::deque<uint64_t> confirms;      // Due CONF events
+    std::vector<HidReport> delivered;
+    uint64_t lastDeliveryUs;
+    uint32_t refused;           // Lost in the stack (congested)
+    uint64_t nextEventUs;
+
+    explicit LinkModel(const LinkParams& p)
+        : params(p), nowUs(0), queue(nullptr), lastDeliveryUs(0), refused(0),
+          nextEventUs(p.intervalUs) {}
+
+    int sendable() override {
+        return SIM_CTRL_BUFFERS - (int)controller.size() - (int)l2cap.size();
+    }
+
+    // Bluedroid accepts the call and reports the outcome in CONF; a full
+    // L2CAP queue means the notification is gone
+    bool sendReport(const HidReport& report) override {
+        if (l2cap.size() >= SIM_L2CAP_QUEUE) {
+            refused++;
+        } else {
+            l2cap.push_back(report);
+        }
+        confirms.push_back(nowUs + SIM_CONF_US);
+        return true;
+    }
+
+    void step() {
+        nowUs += SIM_STEP_US;
+        while (!l2cap.empty() && controller.size() < SIM_CTRL_BUFFERS) {
+            controller.push_back(l2cap.front());
+            l2cap.pop_front();
+        }
+        while (!confirms.empty() && confirms.front() <= nowUs) {
+            confirms.pop_front();
+            if (queue) queue->onSent(true);
+        }
+        if (nowUs >= nextEventUs) {
+            nextEventUs += params.intervalUs;
+            for (int i = 0; i < params.packetsPerEvent && !controller.empty(); i++) {
+                delivered.push_back(controller.front());
+                controller.pop_front();
+                lastDeliveryUs = nowUs;
+            }
+        }
+    }
+
+    bool idle() const { return l2cap.empty() && controller.empty() && confirms.empty(); }
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* scenario, const char* what) {
+    if (!ok) {
+        printf("  FAIL %s: %s\n", scenario, what);
+        failures++;
+    }
+}
+
+// Press/release pairs for `text`, as the text macro produces them
+static std::vector<HidReport> textReports(const char* text) {
+    std::vector<HidReport> out;
+    for (const char* c = text; *c; c++) {
+        uint8_t key, mods;
+        if (!asciiToHid(*c, key, mods)) continue;
+        out.push_back(HidReport::press(mods, key));
+        out.push_back(HidReport::release());
+    }
+    return out;
+}
+
+static bool sameReports(const std::vector<HidReport>& a, const std::vector<HidReport>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].modifiers != b[i].modifiers || memcmp(a[i].keys, b[i].keys, 6) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Characters the host actually typed: presses of the expected key
+static int typedChars(const std::vector<HidReport>& delivered) {
+    int chars = 0;
+    for (const HidReport& r : delivered) {
+        if (r.keys[0] != KEY_NONE) chars++;
+    }
+    return chars;
+}
+
+static std::string makeText(int chars) {
+    static const char* words = "The Quick brown fox: jumps {over} the lazy dog #42! ";
+    std::string text;
+    while ((int)text.size() < chars) text += words;
+    text.resize(chars);
+    return text;
+}
+
+// BleKeyboard::print(): every report straight into the stack, one per
+// notify() call (SIM_STEP_US each)
+static void runDirect(const LinkParams& p, const std::string& text) {
+    LinkModel link(p);
+    std::vector<HidReport> reports = textReports(text.c_str());
+    size_t next = 0;
+    while (next < reports.size() || !link.idle()) {
+        if (next < reports.size()) link.sendReport(reports[next++]);
+        link.step();
+    }
+
+    int chars = typedChars(link.delivered);
+    double secs = link.lastDeliveryUs / 1e6;
+    printf("%-14s direct  %4d/%zu chars typed, %4u reports lost, %6.1f chars/s\n",
+        p.name, chars, text.size(), (unsigned)link.refused, secs > 0 ? chars / secs : 0.0);
+}
+
+// HidReportQueue, with the producer waiting for space like MacroExecutor
+static void runQueued(const LinkParams& p, const std::string& text) {
+    LinkModel link(p);
+    HidReportQueue queue(&link);
+    link.queue = &queue;
+    queue.open();
+
+    std::vector<HidReport> reports = textReports(text.c_str());
+    size_t next = 0;
+    while (next < reports.size() || !queue.isEmpty() || !link.idle()) {
+        while (next < reports.size() && queue.space() > 0) queue.push(reports[next++]);
+        queue.service((uint32_t)(link.nowUs / 1000));
+        link.step();
+    }
+
+    const HidReportQueueStats& s = queue.stats();
+    int chars = typedChars(link.delivered);
+    double secs = link.lastDeliveryUs / 1e6;
+    double rate = secs > 0 ? chars / secs : 0.0;
+    // Two reports per character, packetsPerEvent reports per interval
+    double linkRate = p.packetsPerEvent * 1e6 / p.intervalUs / 2;
+    printf("%-14s queued  %4d/%zu chars typed, %4u reports lost, %6.1f chars/s "
+           "(%3.0f%% of link), max depth %lu, %lu stalls (max %lu ms)\n",
+        p.name, chars, text.size(), (unsigned)(link.refused + s.dropped), rate,
+        100.0 * rate / linkRate, (unsigned long)s.maxDepth, (unsigned long)s.stalls,
+        (unsigned long)s.maxStallMs);
+
+    expect(link.refused == 0 && s.dropped == 0 && s.stackErrors == 0, p.name, "reports lost");
+    expect(sameReports(link.delivered, reports), p.name, "host saw a different report stream");
+    expect(rate >= 0.8 * linkRate, p.name, "throughput under 80% of what the link allows");
+    expect(queue.credits() == HID_REPORT_CREDITS, p.name, "credits not all returned");
+}
+
+static void linkDropMidBurst() {
+    const char* name = "link-drop";
+    LinkParams p = {name, 15000, 4};
+    LinkModel link(p);
+    HidReportQueue queue(&link);
+    link.queue = &queue;
+    queue.open();
+
+    std::vector<HidReport> reports = textReports(makeText(200).c_str());
+    size_t next = 0;
+    while (link.nowUs < 100000) {
+        while (next < reports.size() && queue.space() > 0) queue.push(reports[next++]);
+        queue.service((uint32_t)(link.nowUs / 1000));
+        link.step();
+    }
+    int queued = queue.depth();
+    queue.close((uint32_t)(link.nowUs / 1000));
+    size_t sent = queue.stats().sent;
+    queue.service((uint32_t)(link.nowUs / 1000));
+    expect(queued > 0 && queue.stats().flushed == (uint32_t)queued, name,
+        "queued reports not flushed");
+    expect(queue.stats().sent == sent, name,
+        "sent after the link went down");
+    expect(!queue.isStalled(), name, "stall left open");
+    printf("%-14s %d reports flushed at disconnect, %lu sent before\n", name, queued,
+        (unsigned long)sent);
+}
+
+static void keyMaps() {
+    const char* name = "key-maps";
+    uint8_t key, mods, low, high;
+    expect(asciiToHid('a', key, mods) && key == KEY_A && mods == 0, name, "'a'");
+    expect(asciiToHid('A', key, mods) && key == KEY_A && mods == MODIFIER_SHIFT, name, "'A'");
+    expect(asciiToHid('~', key, mods) && key == KEY_TILDE && mods == MODIFIER_SHIFT, name, "'~'");
+    expect(asciiToHid('\n', key, mods) && key == KEY_ENTER, name, "newline");
+    expect(!asciiToHid('\x01', key, mods), name, "control character accepted");
+    int mapped = 0;
+    for (int c = 0x20; c <= 0x7E; c++) {
+        if (asciiToHid((char)c, key, mods) && key != KEY_NONE) mapped++;
+    }
+    expect(mapped == 95, name, "printable character without a key");
+    expect(mediaKeyBits(KEY_MEDIA_MUTE, low, high) && low == 16 && high == 0, name, "mute");
+    expect(!mediaKeyBits(KEY_A, low, high), name, "non-media key accepted");
+    printf("%-14s %d printable characters mapped\n", name, mapped);
+}
+
+int main() {
+    const LinkParams links[] = {
+        {"7.5ms x4", 7500, 4},      // Active policy, typical Windows/Android
+        {"15ms x6", 15000, 6},      // macOS/iOS floor
+        {"30ms x2", 30000, 2},      // Idle parameters, host limiting hard
+    };
+    std::string text = makeText(500);
+    for (const LinkParams& p : links) {
+        runDirect(p, text);
+        runQueued(p, text);
+    }
+    linkDropMidBurst();
+    keyMaps();
+    printf("hidqueue_sim: %s (%d failures)\n", failures ? "FAILED" : "ok", failures);
+    return failures ? 1 : 0;
+}
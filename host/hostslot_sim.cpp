@@ -0,0 +1,306 @@
+// ==============================================================================
+// hostslot_sim - BLE host slot switching checks (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -o hostslot_sim host/hostslot_sim.cpp
+//
+// Runs HostSwitcher and ReconnectEngine against a scripted radio with several
+// hosts that all try to (re)connect whenever the pad's advertising lets them:
+// switching between bonded hosts, a host sneaking back in mid-switch, pairing
+// into an empty slot, a target that never shows up, and the NVS table format.
+// Prints one line per scenario and exits 1 if any expectation fails.
+
+#include <stdio.h>
+#include <vector>
+#include "HostSlots.hpp"
+
+#define SIM_STEP_MS         5
+#define SIM_DISCONNECT_MS   30      // Disconnect request -> link gone
+#define SIM_CONNECT_MS      15      // Advertising seen -> CONNECT_IND
+#define SIM_ENCRYPT_MS      60      // Re-encryption with stored keys
+#define SIM_PAIR_MS         800     // First-time pairing
+#define SIM_SUBSCRIBE_MS    40      // Host enables report notifications
+
+struct SimHost {
+    BlePeer peer;
+    bool present;               // In range and trying to connect
+    bool bonded;                // Has keys for the pad
+};
+
+class ScriptedRadio : public AdvertisingGap, public HostLinkControl {
+public:
+    uint32_t now;
+    std::vector<SimHost> hosts;
+
+    // Advertising as the stack runs it
+    AdvPhase phase;
+    BlePeer target;             // Directed target or white-list entry
+    bool advertising;
+    uint32_t advSince;
+
+    // Link
+    BleLinkStateId state;
+    int linked;                 // Host on the link, -1 if none
+    uint32_t stateAt;
+    uint32_t disconnectAt;      // 0 = none pending
+    int disconnects;
+    bool raceOnDisconnect;      // A host connects before loop() can restart advertising
+
+    ScriptedRadio() : now(0), phase(ADV_PHASE_NONE), advertising(false), advSince(0),
+                      state(BLE_LINK_OFF), linked(-1), stateAt(0), disconnectAt(0),
+                      disconnects(0), raceOnDisconnect(false) {}
+
+    bool startAdvertising(AdvPhase p, const BlePeer* peer) override {
+        phase = p;
+        target = peer ? *peer : BlePeer();
+        advertising = state != BLE_LINK_CONNECTING && state != BLE_LINK_ENCRYPTED &&
+                      state != BLE_LINK_READY;
+        advSince = now;
+        if (advertising) state = BLE_LINK_ADVERTISING;
+        return true;
+    }
+
+    bool disconnect() override {
+        if (linked < 0) return false;
+        disconnects++;
+        disconnectAt = now + SIM_DISCONNECT_MS;
+        return true;
+    }
+
+    bool admits(int h) const {
+        if (!hosts[h].present) return false;
+        if (target.valid) return target.sameAs(hosts[h].peer);
+        return true;
+    }
+
+    // Advances one step; returns the host that finished pairing/encryption
+    // this step (the BONDED event), or -1
+    int step() {
+        now += SIM_STEP_MS;
+        if (disconnectAt && now >= disconnectAt) {
+            disconnectAt = 0;
+            linked = -1;
+            // BleKeyboard restarts open advertising from its disconnect callback
+            state = BLE_LINK_ADVERTISING;
+            phase = ADV_PHASE_FAST;
+            target = BlePeer();
+            advertising = true;
+            advSince = now - (raceOnDisconnect ? SIM_CONNECT_MS : 0);
+            raceOnDisconnect = false;
+        }
+        if (state == BLE_LINK_ADVERTISING && advertising && now - advSince >= SIM_CONNECT_MS) {
+            // Lowest index wins when several hosts are trying
+            for (size_t h = 0; h < hosts.size(); h++) {
+                if (admits((int)h)) {
+                    linked = (int)h;
+                    state = BLE_LINK_CONNECTING;
+                    stateAt = now;
+                    advertising = false;
+                    break;
+                }
+            }
+        } else if (state == BLE_LINK_CONNECTING) {
+            uint32_t needed = hosts[linked].bonded ? SIM_ENCRYPT_MS : SIM_PAIR_MS;
+            if (now - stateAt >= needed) {
+                hosts[linked].bonded = true;
+                state = BLE_LINK_ENCRYPTED;
+                stateAt = now;
+                return linked;
+            }
+        } else if (state == BLE_LINK_ENCRYPTED && now - stateAt >= SIM_SUBSCRIBE_MS) {
+            state = BLE_LINK_READY;
+            stateAt = now;
+        }
+        return -1;
+    }
+};
+
+struct Pad {
+    ScriptedRadio radio;
+    HostSlotTable table;
+    ReconnectEngine engine;
+    HostSwitcher switcher;
+    int refused;
+
+    Pad() : engine(&radio), switcher(&table, &engine, &radio), refused(0) {}
+
+    // One loop() pass: BONDED events, then engine and switcher
+    void pass() {
+        int bonded = radio.step();
+        if (bonded >= 0) {
+            BlePeer replaced;
+            if (switcher.onBonded(radio.hosts[bonded].peer, replaced) ==
+                HOST_BOND_REFUSED) {
+                refused++;
+            }
+        }
+        engine.service(radio.state, radio.now);
+        switcher.service(radio.state, radio.now);
+    }
+
+    void run(uint32_t ms) {
+        for (uint32_t t = 0; t < ms; t += SIM_STEP_MS) pass();
+    }
+
+    bool runUntilReady(uint32_t limit) {
+        for (uint32_t t = 0; t < limit; t += SIM_STEP_MS) {
+            pass();
+            if (radio.state == BLE_LINK_READY && !switcher.isSwitching()) return true;
+        }
+        return false;
+    }
+};
+
+static BlePeer makePeer(uint8_t last) {
+    BlePeer p;
+    const uint8_t addr[6] = {0xC0, 0xFF, 0xEE, 0x00, 0x00, last};
+    memcpy(p.addr, addr, sizeof(addr));
+    p.valid = true;
+    return p;
+}
+
+static int failures = 0;
+
+static void expect(bool ok, const char* scenario, const char* what) {
+    if (!ok) {
+        printf("  FAIL %s: %s\n", scenario, what);
+        failures++;
+    }
+}
+
+static void report(const char* name, const Pad& pad) {
+    const HostSwitchStats& s = pad.switcher.stats();
+    printf("%-22s %lu switches (%lu done, %lu timed out, %lu refused, %lu followed), "
+           "last %lu ms, max %lu ms, %d disconnects\n",
+        name, (unsigned long)s.switches, (unsigned long)s.completed, (unsigned long)s.timedOut,
+        (unsigned long)s.refused, (unsigned long)s.followed, (unsigned long)s.lastMs,
+        (unsigned long)s.maxMs, pad.radio.disconnects);
+}
+
+// Desktop in slot 0, laptop in slot 1, both bonded and in range
+static void setupTwoHosts(Pad& pad) {
+    SimHost desktop = {makePeer(1), true, true};
+    SimHost laptop = {makePeer(2), true, true};
+    pad.radio.hosts.push_back(desktop);
+    pad.radio.hosts.push_back(laptop);
+    BlePeer replaced;
+    pad.table.assign(0, desktop.peer, replaced);
+    pad.table.assign(1, laptop.peer, replaced);
+    pad.table.select(0);
+    pad.engine.begin(pad.table.activePeer(), 0, pad.radio.now);
+}
+
+static void switchBetweenBonded() {
+    const char* name = "switch-bonded";
+    Pad pad;
+    setupTwoHosts(pad);
+    expect(pad.runUntilReady(3000) && pad.radio.linked == 0, name, "desktop not connected");
+
+    for (int i = 0; i < 6; i++) {
+        pad.run(2000);
+        int target = (pad.table.active() + 1) % 2;
+        expect(pad.switcher.switchTo(target, pad.radio.now), name, "switch refused");
+        expect(pad.runUntilReady(3000), name, "switch never completed");
+        expect(pad.radio.linked == target, name, "wrong host on the link");
+        expect(pad.switcher.stats().lastMs < 1000, name, "switch took a second or more");
+    }
+    expect(pad.switcher.stats().completed == 6, name, "switches not counted");
+    expect(!pad.switcher.switchTo(pad.table.active(), pad.radio.now), name,
+        "switch to the connected host was not a no-op");
+    expect(!pad.engine.isExclusive(), name, "white list left on after the switch");
+    report(name, pad);
+}
+
+static void oldHostSneaksIn() {
+    const char* name = "old-host-refused";
+    Pad pad;
+    setupTwoHosts(pad);
+    pad.runUntilReady(3000);
+    pad.run(1000);
+    // The desktop gets back in on the stack's open advertising before
+    // loop() switches to directed advertising for the laptop
+    pad.radio.raceOnDisconnect = true;
+    pad.switcher.switchTo(1, pad.radio.now);
+    pad.run(SIM_DISCONNECT_MS + SIM_ENCRYPT_MS + 2 * SIM_STEP_MS);
+    expect(pad.refused == 1 && pad.radio.disconnects == 2, name,
+        "old host not refused mid-switch");
+    expect(pad.table.active() == 1, name, "active slot changed back");
+    expect(pad.runUntilReady(3000) && pad.radio.linked == 1, name, "laptop never connected");
+    report(name, pad);
+}
+
+static void pairIntoEmptySlot() {
+    const char* name = "pair-empty-slot";
+    Pad pad;
+    setupTwoHosts(pad);
+    pad.runUntilReady(3000);
+    // Tablet in pairing mode; the others would reconnect too if allowed
+    SimHost tablet = {makePeer(3), true, false};
+    pad.radio.hosts.insert(pad.radio.hosts.begin(), tablet);   // Wins open advertising
+    pad.radio.linked = 1;       // Desktop is now index 1
+    pad.switcher.switchTo(2, pad.radio.now);
+    expect(pad.runUntilReady(5000), name, "pairing never completed");
+    expect(pad.table.find(tablet.peer) == 2 && pad.table.active() == 2, name,
+        "new host not stored in the empty slot");
+    expect(pad.table.find(makePeer(1)) == 0 && pad.table.find(makePeer(2)) == 1, name,
+        "other slots disturbed");
+    report(name, pad);
+}
+
+static void targetAway() {
+    const char* name = "target-away";
+    Pad pad;
+    setupTwoHosts(pad);
+    pad.runUntilReady(3000);
+    pad.radio.hosts[1].present = false;
+    pad.switcher.switchTo(1, pad.radio.now);
+    pad.run(HOST_SWITCH_TIMEOUT_MS - 100);
+    expect(pad.radio.linked < 0 && pad.radio.target.sameAs(makePeer(2)), name,
+        "white list did not keep the desktop out");
+    pad.run(2000);
+    expect(pad.switcher.stats().timedOut == 1, name, "timeout not recorded");
+    expect(pad.radio.linked == 0 && pad.table.active() == 0, name,
+        "did not follow the desktop after the timeout");
+    report(name, pad);
+}
+
+static void replaceSlot() {
+    const char* name = "replace-slot";
+    HostSlotTable table;
+    BlePeer replaced;
+    table.assign(0, makePeer(1), replaced);
+    expect(!replaced.valid, name, "empty slot reported a replaced host");
+    table.assign(0, makePeer(1), replaced);
+    expect(!replaced.valid, name, "same host reported as replaced");
+    table.assign(0, makePeer(9), replaced);
+    expect(replaced.sameAs(makePeer(1)), name, "displaced host not reported");
+    printf("%-22s ok\n", name);
+}
+
+static void tableFormat() {
+    const char* name = "nvs-format";
+    HostSlotTable table, copy;
+    BlePeer replaced;
+    table.assign(0, makePeer(1), replaced);
+    table.assign(2, makePeer(3), replaced);
+    table.select(2);
+    uint8_t blob[HOST_SLOTS_BLOB_BYTES];
+    table.serialize(blob);
+    expect(copy.deserialize(blob), name, "round trip rejected");
+    expect(copy.active() == 2 && copy.peer(0).sameAs(makePeer(1)) && copy.isEmpty(1) &&
+           copy.peer(2).sameAs(makePeer(3)), name, "round trip changed the table");
+    blob[HOST_SLOTS_BLOB_BYTES - 1] = HOST_SLOT_COUNT;
+    expect(!copy.deserialize(blob), name, "bad active slot accepted");
+    printf("%-22s %d bytes for %d slots\n", name, HOST_SLOTS_BLOB_BYTES, HOST_SLOT_COUNT);
+}
+
+int main() {
+    switchBetweenBonded();
+    oldHostSneaksIn();
+    pairIntoEmptySlot();
+    targetAway();
+    replaceSlot();
+    tableFormat();
+    printf("hostslot_sim: %s (%d failures)\n", failures ? "FAILED" : "ok", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,513 @@
+// ==============================================================================
+// keymap_sim - Keyboard layout round trips (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -o keymap_sim host/keymap_sim.cpp
+//
+// Types text macros through MacroExecutor for each keyboard layout and
+// Unicode input, and reads the reports back with a model of the host: its
+// keymap (written out here row by row, the way the OS layouts list them,
+// independently of the firmware's tables), dead keys and the Windows,
+// macOS and Linux Unicode entry methods. Every printable Latin-1 character
+// and the euro sign must come out as typed, or, where the layout has no key
+// for it and no Unicode input is set, not at all. Also checks that the
+// firmware can type everything the host layout has a key for, whole
+// strings mixing dead keys and Unicode input, and UTF-8 truncation and
+// malformed input. Prints one line per scenario and exits 1 if any
+// expectation fails.
+
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "KeyboardLayout.hpp"
+#include "MacroExecutor.hpp"
+
+static int failures = 0;
+
+static void expect(bool ok, const char* scenario, const char* what) {
+    if (!ok) {
+        printf("FAIL [%s] %s\n", scenario, what);
+        failures++;
+    }
+}
+
+static std::string utf8(const std::u32string& s) {
+    std::string out;
+    for (char32_t c : s) {
+        if (c < 0x80) {
+            out += (char)c;
+        } else if (c < 0x800) {
+            out += (char)(0xC0 | (c >> 6));
+            out += (char)(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            out += (char)(0xE0 | (c >> 12));
+            out += (char)(0x80 | ((c >> 6) & 0x3F));
+            out += (char)(0x80 | (c & 0x3F));
+        } else {
+            out += (char)(0xF0 | (c >> 18));
+            out += (char)(0x80 | ((c >> 12) & 0x3F));
+            out += (char)(0x80 | ((c >> 6) & 0x3F));
+            out += (char)(0x80 | (c & 0x3F));
+        }
+    }
+    return out;
+}
+
+static std::string describe(const std::u32string& s) {
+    std::string out;
+    char buf[16];
+    for (char32_t c : s) {
+        snprintf(buf, sizeof(buf), c < 0x7F && c >= 0x20 ? "%c" : "<U+%04X>", (unsigned)c);
+        out += buf;
+    }
+    return out;
+}
+
+// ==============================================================================
+// Pad: text macro -> reports
+// ==============================================================================
+
+class RecordingSink : public HidReportSink {
+public:
+    std::vector<HidReport> reports;
+
+    int sendable() override { return -1; }
+    bool completesOnSend() const override { return true; }
+
+    bool sendReport(const HidReport& report) override {
+        reports.push_back(report);
+        return true;
+    }
+};
+
+static std::vector<HidReport> typeText(const std::string& text, const TextInput& input,
+                                       MacroExecStats* statsOut = nullptr) {
+    RecordingSink sink;
+    HidReportQueue queue(&sink);
+    MacroExecutor executor(&queue);
+    queue.open();
+    executor.enqueue(Macro::textMacro("Text", text.c_str()), false, input);
+    for (uint32_t now = 0; executor.isBusy(); now++) {
+        executor.service(now);
+        queue.service(now);
+    }
+    if (statsOut) *statsOut = executor.stats();
+    return sink.reports;
+}
+
+// ==============================================================================
+// Host model: reports -> text
+// ==============================================================================
+
+enum HostOs { OS_WINDOWS, OS_MACOS, OS_LINUX };
+
+class HostModel {
+private:
+    struct Level {
+        char32_t ch;
+        bool dead;
+    };
+
+    // (usage, level) -> character; level 0 plain, 1 Shift, 2 AltGr
+    std::map<std::pair<uint8_t, int>, Level> _keys;
+    HostOs _os;
+    bool _unicode;              // The OS's Unicode entry is enabled
+
+    uint8_t _prevKey;
+    uint8_t _prevMods;
+    char32_t _dead;
+    bool _hexMode;              // Linux: after Ctrl+Shift+U
+    std::string _entry;         // Digits of a Unicode entry in progress
+    std::u32string _out;
+
+    static char32_t compose(char32_t accent, char32_t base) {
+        static const struct {
+            char32_t accent;
+            const char32_t* pairs;
+        } TABLE[] = {
+            {U'^', U"aâeêiîoôuûAÂEÊIÎOÔUÛ"},
+            {U'´', U"aáeéiíoóuúyýAÁEÉIÍOÓUÚYÝ"},
+            {U'`', U"aàeèiìoòuùAÀEÈIÌOÒUÙ"}
+        };
+        for (const auto& t : TABLE) {
+            if (t.accent != accent) continue;
+            for (const char32_t* p = t.pairs; *p; p += 2) {
+                if (p[0] == base) return p[1];
+            }
+        }
+        return 0;
+    }
+
+    void emit(char32_t c) { _out += c; }
+
+    void commitEntry() {
+        if (_entry.empty()) return;
+        if (_os == OS_WINDOWS) {
+            // Alt+0nnn: Windows-1252
+            static const char32_t HIGH[] =
+                U"€\uFFFD‚ƒ„…†‡ˆ‰Š‹Œ\uFFFDŽ\uFFFD\uFFFD‘’“”•–—˜™š›œ\uFFFDžŸ";
+            unsigned long code = strtoul(_entry.c_str(), nullptr, 10);
+            if (_entry[0] != '0' || code > 255) emit(0xFFFD);
+            else emit(code >= 0x80 && code < 0xA0 ? HIGH[code - 0x80] : (char32_t)code);
+        } else {
+            // UTF-16 code units, 4 hex digits each
+            std::u32string units;
+            for (size_t i = 0; i + 4 <= _entry.size(); i += 4) {
+                units += (char32_t)strtoul(_entry.substr(i, 4).c_str(), nullptr, 16);
+            }
+            if (_entry.size() % 4 != 0) emit(0xFFFD);
+            for (size_t i = 0; i < units.size(); i++) {
+                if (units[i] >= 0xD800 && units[i] < 0xDC00 && i + 1 < units.size()) {
+                    emit(0x10000 + ((units[i] - 0xD800) << 10) + (units[i + 1] - 0xDC00));
+                    i++;
+                } else {
+                    emit(units[i]);
+                }
+            }
+        }
+        _entry.clear();
+    }
+
+    const Level* lookup(uint8_t usage, int level) const {
+        auto it = _keys.find(std::make_pair(usage, level));
+        return it == _keys.end() ? nullptr : &it->second;
+    }
+
+    void keyDown(uint8_t usage, uint8_t mods) {
+        if (_unicode && _os == OS_LINUX) {
+            if (usage == KEY_U && mods == (MODIFIER_CTRL | MODIFIER_SHIFT)) {
+                _hexMode = true;
+                return;
+            }
+            if (_hexMode) {
+                const Level* l = lookup(usage, mods & MODIFIER_SHIFT ? 1 : 0);
+                if (usage == KEY_SPACE) {
+                    unsigned long cp = strtoul(_entry.c_str(), nullptr, 16);
+                    _entry.clear();
+                    emit((char32_t)cp);
+                    _hexMode = false;
+                } else if (l && ((l->ch >= '0' && l->ch <= '9') || (l->ch >= 'a' && l->ch <= 'f'))) {
+                    _entry += (char)l->ch;
+                } else {
+                    emit(0xFFFD);
+                }
+                return;
+            }
+        }
+        if (_unicode && _os == OS_MACOS && (mods & MODIFIER_ALT)) {
+            const Level* l = lookup(usage, 0);
+            if (l && ((l->ch >= '0' && l->ch <= '9') || (l->ch >= 'a' && l->ch <= 'f'))) {
+                _entry += (char)l->ch;
+            } else {
+                emit(0xFFFD);
+            }
+            return;
+        }
+        if (_unicode && _os == OS_WINDOWS && (mods & MODIFIER_ALT)) {
+            if (usage >= KEY_KP_1 && usage <= KEY_KP_0) {
+                _entry += usage == KEY_KP_0 ? '0' : (char)('1' + usage - KEY_KP_1);
+            } else {
+                emit(0xFFFD);
+            }
+            return;
+        }
+        if (mods & ~(MODIFIER_SHIFT | MODIFIER_ALTGR)) {
+            emit(0xFFFD);
+            return;
+        }
+
+        int level = mods & MODIFIER_ALTGR ? 2 : mods & MODIFIER_SHIFT ? 1 : 0;
+        if ((mods & MODIFIER_ALTGR) && (mods & MODIFIER_SHIFT)) level = -1;
+        const Level* l = lookup(usage, level);
+        if (l == nullptr) {
+            emit(0xFFFD);
+            return;
+        }
+        if (l->dead) {
+            if (_dead) emit(_dead);
+            _dead = l->ch;
+            return;
+        }
+        if (_dead) {
+            char32_t accent = _dead;
+            _dead = 0;
+            if (l->ch == U' ') {
+                emit(accent);
+                return;
+            }
+            char32_t composed = compose(accent, l->ch);
+            if (composed) {
+                emit(composed);
+                return;
+            }
+            emit(accent);
+        }
+        emit(l->ch);
+    }
+
+public:
+    HostModel(KeyboardLayout layout, HostOs os, bool unicode)
+        : _os(os), _unicode(unicode), _prevKey(0), _prevMods(0), _dead(0), _hexMode(false) {
+        static const std::vector<uint8_t> ROW_E = {KEY_TILDE, KEY_1, KEY_2, KEY_3, KEY_4, KEY_5,
+                                                   KEY_6, KEY_7, KEY_8, KEY_9, KEY_0, KEY_MINUS,
+                                                   KEY_EQUAL};
+        static const std::vector<uint8_t> ROW_D = {KEY_Q, KEY_W, KEY_E, KEY_R, KEY_T, KEY_Y,
+                                                   KEY_U, KEY_I, KEY_O, KEY_P, KEY_LEFT_BRACE,
+                                                   KEY_RIGHT_BRACE, KEY_BACKSLASH};
+        static const std::vector<uint8_t> ROW_C = {KEY_A, KEY_S, KEY_D, KEY_F, KEY_G, KEY_H,
+                                                   KEY_J, KEY_K, KEY_L, KEY_SEMICOLON, KEY_QUOTE,
+                                                   KEY_NON_US_HASH};
+        static const std::vector<uint8_t> ROW_B = {KEY_NON_US_BACKSLASH, KEY_Z, KEY_X, KEY_C,
+                                                   KEY_V, KEY_B, KEY_N, KEY_M, KEY_COMMA,
+                                                   KEY_PERIOD, KEY_SLASH};
+
+        add(KEY_ENTER, 0, U'\n');
+        add(KEY_TAB, 0, U'\t');
+        add(KEY_BACKSPACE, 0, U'\b');
+        add(KEY_SPACE, 0, U' ');
+        add(KEY_SPACE, 1, U' ');
+
+        // macOS's Unicode Hex Input source is a US layout
+        if (os == OS_MACOS && unicode) layout = KEYBOARD_LAYOUT_US;
+
+        switch (layout) {
+            case KEYBOARD_LAYOUT_UK:
+                row(ROW_E, U"`1234567890-=", U"¬!\"£$%^&*()_+");
+                row(ROW_D, U"qwertyuiop[]", U"QWERTYUIOP{}");
+                row(ROW_C, U"asdfghjkl;'#", U"ASDFGHJKL:@~");
+                row(ROW_B, U"\\zxcvbnm,./", U"|ZXCVBNM<>?");
+                add(KEY_TILDE, 2, U'¦');
+                add(KEY_4, 2, U'€');
+                break;
+
+            case KEYBOARD_LAYOUT_DE:
+                row(ROW_E, U"^1234567890ß´", U"°!\"§$%&/()=?`");
+                row(ROW_D, U"qwertzuiopü+", U"QWERTZUIOPÜ*");
+                row(ROW_C, U"asdfghjklöä#", U"ASDFGHJKLÖÄ'");
+                row(ROW_B, U"<yxcvbnm,.-", U">YXCVBNM;:_");
+                add(KEY_2, 2, U'²');
+                add(KEY_3, 2, U'³');
+                add(KEY_7, 2, U'{');
+                add(KEY_8, 2, U'[');
+                add(KEY_9, 2, U']');
+                add(KEY_0, 2, U'}');
+                add(KEY_MINUS, 2, U'\\');
+                add(KEY_Q, 2, U'@');
+                add(KEY_E, 2, U'€');
+                add(KEY_RIGHT_BRACE, 2, U'~');
+                add(KEY_NON_US_BACKSLASH, 2, U'|');
+                add(KEY_M, 2, U'µ');
+                _keys[std::make_pair((uint8_t)KEY_TILDE, 0)].dead = true;
+                _keys[std::make_pair((uint8_t)KEY_EQUAL, 0)].dead = true;
+                _keys[std::make_pair((uint8_t)KEY_EQUAL, 1)].dead = true;
+                break;
+
+            default:
+                row(ROW_E, U"`1234567890-=", U"~!@#$%^&*()_+");
+                row(ROW_D, U"qwertyuiop[]\\", U"QWERTYUIOP{}|");
+                row(std::vector<uint8_t>(ROW_C.begin(), ROW_C.end() - 1), U"asdfghjkl;'",
+                    U"ASDFGHJKL:\"");
+                row(std::vector<uint8_t>(ROW_B.begin() + 1, ROW_B.end()), U"zxcvbnm,./",
+                    U"ZXCVBNM<>?");
+                break;
+        }
+    }
+
+    void add(uint8_t usage, int level, char32_t ch) {
+        _keys[std::make_pair(usage, level)] = Level{ch, false};
+    }
+
+    void row(const std::vector<uint8_t>& usages, const char32_t* plain, const char32_t* shifted) {
+        for (size_t i = 0; i < usages.size() && plain[i]; i++) {
+            add(usages[i], 0, plain[i]);
+            add(usages[i], 1, shifted[i]);
+        }
+    }
+
+    // Every character the layout types, directly or through a dead key
+    std::u32string repertoire() const {
+        std::u32string out;
+        std::u32string accents;
+        for (const auto& k : _keys) {
+            if (k.second.dead) accents += k.second.ch;
+            else out += k.second.ch;
+        }
+        for (char32_t accent : accents) {
+            out += accent;
+            for (char32_t base = 0x20; base < 0x7F; base++) {
+                char32_t c = compose(accent, base);
+                if (c) out += c;
+            }
+        }
+        return out;
+    }
+
+    std::u32string decode(const std::vector<HidReport>& reports) {
+        _out.clear();
+        _prevKey = _prevMods = 0;
+        _dead = 0;
+        _hexMode = false;
+        _entry.clear();
+        for (const HidReport& r : reports) {
+            if (r.kind != HID_REPORT_KEYBOARD) continue;
+            if (r.keys[0] != KEY_NONE && r.keys[0] != _prevKey) keyDown(r.keys[0], r.modifiers);
+            if ((_os == OS_MACOS || _os == OS_WINDOWS) && (_prevMods & MODIFIER_ALT) &&
+                !(r.modifiers & MODIFIER_ALT)) {
+                commitEntry();
+            }
+            _prevKey = r.keys[0];
+            _prevMods = r.modifiers;
+        }
+        if (_prevKey != KEY_NONE || _prevMods != 0) emit(0xFFFD);  // Something left held
+        if (_dead) emit(_dead);
+        return _out;
+    }
+};
+
+// ==============================================================================
+// Scenarios
+// ==============================================================================
+
+// Printable Latin-1 and the euro sign
+static std::u32string printable() {
+    std::u32string s;
+    for (char32_t c = 0x20; c < 0x7F; c++) s += c;
+    for (char32_t c = 0xA0; c <= 0xFF; c++) s += c;
+    s += U'€';
+    return s;
+}
+
+struct Combo {
+    const char* name;
+    KeyboardLayout layout;
+    UnicodeInput unicode;
+    HostOs os;
+};
+
+static const Combo COMBOS[] = {
+    {"us/none", KEYBOARD_LAYOUT_US, UNICODE_INPUT_NONE, OS_WINDOWS},
+    {"uk/none", KEYBOARD_LAYOUT_UK, UNICODE_INPUT_NONE, OS_WINDOWS},
+    {"de/none", KEYBOARD_LAYOUT_DE, UNICODE_INPUT_NONE, OS_WINDOWS},
+    {"us/windows", KEYBOARD_LAYOUT_US, UNICODE_INPUT_WINDOWS, OS_WINDOWS},
+    {"uk/windows", KEYBOARD_LAYOUT_UK, UNICODE_INPUT_WINDOWS, OS_WINDOWS},
+    {"de/windows", KEYBOARD_LAYOUT_DE, UNICODE_INPUT_WINDOWS, OS_WINDOWS},
+    {"us/macos", KEYBOARD_LAYOUT_US, UNICODE_INPUT_MACOS, OS_MACOS},
+    {"us/linux", KEYBOARD_LAYOUT_US, UNICODE_INPUT_LINUX, OS_LINUX},
+    {"uk/linux", KEYBOARD_LAYOUT_UK, UNICODE_INPUT_LINUX, OS_LINUX},
+    {"de/linux", KEYBOARD_LAYOUT_DE, UNICODE_INPUT_LINUX, OS_LINUX}
+};
+
+// Each printable character on its own: typed exactly, or skipped and counted
+static void everyCharacter(const Combo& c) {
+    TextInput input(c.layout, c.unicode);
+    HostModel host(c.layout, c.os, c.unicode != UNICODE_INPUT_NONE);
+    const Keymap& map = keymapFor(c.layout);
+    int direct = 0, dead = 0, unicode = 0, skipped = 0;
+    std::string bad;
+
+    for (char32_t ch : printable()) {
+        MacroExecStats stats;
+        std::u32string typed = host.decode(typeText(utf8(std::u32string(1, ch)), input, &stats));
+        const KeymapEntry* e = map.find(ch);
+        if (e != nullptr) {
+            e->deadKey != KEY_NONE ? dead++ : direct++;
+        } else if (stats.unmapped == 0) {
+            unicode++;
+        } else {
+            skipped++;
+        }
+
+        bool ok = stats.unmapped ? typed.empty() : typed == std::u32string(1, ch);
+        if (!ok && bad.size() < 200) {
+            bad += " " + describe(std::u32string(1, ch)) + "->" + describe(typed);
+        }
+    }
+
+    printf("%-12s %3d direct, %2d dead key, %3d unicode, %3d skipped\n", c.name, direct, dead,
+           unicode, skipped);
+    std::string what = "characters mistyped:" + bad;
+    expect(bad.empty(), c.name, what.c_str());
+    expect(direct + dead >= 95, c.name, "printable ASCII not all on keys");
+    if (c.unicode != UNICODE_INPUT_NONE) expect(skipped == 0, c.name, "characters skipped");
+}
+
+// The firmware keymap types everything the host layout has a key for
+static void repertoire(KeyboardLayout layout) {
+    const char* name = keyboardLayoutName(layout);
+    HostModel host(layout, OS_WINDOWS, false);
+    const Keymap& map = keymapFor(layout);
+    std::string missing;
+    for (char32_t ch : host.repertoire()) {
+        if (map.find(ch) == nullptr) missing += " " + describe(std::u32string(1, ch));
+    }
+    printf("%-12s %zu characters on the host layout\n", (std::string(name) + "/keys").c_str(),
+           host.repertoire().size());
+    std::string what = "host layout characters missing:" + missing;
+    expect(missing.empty(), name, what.c_str());
+}
+
+static void roundTrip(const Combo& c, const std::u32string& text) {
+    HostModel host(c.layout, c.os, c.unicode != UNICODE_INPUT_NONE);
+    std::u32string typed = host.decode(typeText(utf8(text), TextInput(c.layout, c.unicode)));
+    if (typed != text) {
+        std::string what = "typed " + describe(typed);
+        expect(false, c.name, what.c_str());
+    }
+}
+
+// Whole strings: dead keys next to their base letters, AltGr, Unicode input
+static void strings() {
+    const std::u32string latin = U"Grüße aus Köln: 50 € für ^a, `e und ´i! [x] {y} @z | ~ \\";
+    const std::u32string world = U"naïve café — 中文 😀 Ωmega";
+    for (const Combo& c : COMBOS) {
+        if (c.unicode == UNICODE_INPUT_LINUX || c.unicode == UNICODE_INPUT_MACOS) {
+            roundTrip(c, latin);
+            roundTrip(c, world);
+        } else if (c.unicode == UNICODE_INPUT_WINDOWS) {
+            roundTrip(c, latin);
+            roundTrip(c, U"naïve café — “quoted” ‰ Œuvre");
+        } else if (c.layout == KEYBOARD_LAYOUT_DE) {
+            roundTrip(c, U"Grüße: ^a `e ´i âêî áéí àèì µ² {[]} @€ |<>");
+        }
+    }
+    printf("strings      ok\n");
+}
+
+// Long text is cut at a character boundary; malformed UTF-8 is skipped
+static void utf8Edges() {
+    const char* name = "utf8";
+    TextInput input(KEYBOARD_LAYOUT_DE, UNICODE_INPUT_NONE);
+    HostModel host(KEYBOARD_LAYOUT_DE, OS_WINDOWS, false);
+
+    std::u32string text(MACRO_EXEC_TEXT_BYTES - 1, U'a');
+    text += U"éé";
+    MacroExecStats stats;
+    std::u32string typed = host.decode(typeText(utf8(text), input, &stats));
+    expect(stats.truncated == 1, name, "long text not truncated");
+    expect(typed == std::u32string(MACRO_EXEC_TEXT_BYTES - 1, U'a'), name,
+           "truncated inside a UTF-8 sequence");
+    expect(stats.unmapped == 0, name, "truncation left a partial character");
+
+    typed = host.decode(typeText("a\xC3" "b\xFF" "c\xE2\x82", input, &stats));
+    expect(typed == U"abc", name, "malformed UTF-8 not skipped");
+    expect(stats.unmapped == 3, name, "malformed sequences not counted");
+
+    // The build default applies to profiles that leave it unset
+    TextInput fallback(KEYBOARD_LAYOUT_DEFAULT, UNICODE_INPUT_DEFAULT);
+    expect(fallback.layout == KEYBOARD_LAYOUT && fallback.unicode == UNICODE_INPUT, name,
+           "DEFAULT not resolved to the build's layout");
+    printf("utf8         ok\n");
+}
+
+int main() {
+    for (const Combo& c : COMBOS) everyCharacter(c);
+    repertoire(KEYBOARD_LAYOUT_US);
+    repertoire(KEYBOARD_LAYOUT_UK);
+    repertoire(KEYBOARD_LAYOUT_DE);
+    strings();
+    utf8Edges();
+    printf("keymap_sim: %s (%d failures)\n", failures ? "FAILED" : "ok", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,382 @@
+// ==============================================================================
+// logdecode - Binary log decoder (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -pthread -o logdecode host/logdecode.cpp
+//
+// Usage:
+//   logdecode [capture]          Decode a raw serial capture (default stdin)
+//   logdecode selftest [records] Round-trip, stress and cost checks
+//
+// Reads the device's serial output - log text and COBS frames mixed - and
+// prints the text as-is and every FRAME_LOG record formatted with the
+// catalog in src/LogCatalog.hpp. Live:
+//
+//   stty -F /dev/ttyACM0 921600 raw && ./logdecode < /dev/ttyACM0
+//
+// Dropped records are reported where the device's count goes up, and in
+// the summary on stderr.
+//
+// selftest formats records through BinaryLog and compares them with
+// snprintf, then has several threads log into one ring while another
+// drains it into frames and decodes them: every record must arrive intact
+// and in order per thread, or be counted as dropped. Also reports the cost
+// of a LOG() call against formatting the same message. Prints one line per
+// scenario and exits 1 if any expectation fails.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+static uint32_t hostMicros() {
+    using namespace std::chrono;
+    return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+#define LOG_CLOCK_US()  hostMicros()
+#define LOG_MIN_LEVEL   LOG_SEV_DEBUG
+
+#include "BinaryLog.hpp"
+#include "SerialProtocol.hpp"
+
+// ==============================================================================
+// Decoder
+// ==============================================================================
+class LogStreamPrinter {
+private:
+    FrameDecoder _decoder;
+    FILE* _out;
+    uint32_t _dropped;
+    uint32_t _records;
+    uint32_t _frames;
+
+    void text(const uint8_t* data, size_t len) {
+        fwrite(data, 1, len, _out);
+    }
+
+    void frame() {
+        if (_decoder.type() != FRAME_LOG || _decoder.length() < 4) return;
+        const uint8_t* p = _decoder.payload();
+        size_t len = _decoder.length();
+        uint32_t dropped = readU32(p);
+        if (dropped > _dropped) {
+            fprintf(_out, "[%lu log records dropped]\n", (unsigned long)(dropped - _dropped));
+            _dropped = dropped;
+        }
+        _frames++;
+        for (size_t at = 4; at < len; ) {
+            char line[256];
+            size_t n = logFormatRecord(p + at, len - at, line, sizeof(line));
+            if (n == 0) break;
+            uint32_t us = readU32(p + at + 4);
+            fprintf(_out, "[%5lu.%06lu] %s %s\n", (unsigned long)(us / 1000000),
+                (unsigned long)(us % 1000000), logLevelName(p[at + 2]), line);
+            _records++;
+            at += n;
+        }
+    }
+
+public:
+    explicit LogStreamPrinter(FILE* out) : _out(out), _dropped(0), _records(0), _frames(0) {}
+
+    void feed(const uint8_t* data, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            // A segment that doesn't decode as a frame is log text
+            std::string segment;
+            if (data[i] == 0 && _decoder.pendingLength() > 0) {
+                segment.assign((const char*)_decoder.pending(), _decoder.pendingLength());
+            }
+            if (_decoder.feed(data[i])) {
+                frame();
+            } else if (!segment.empty()) {
+                text((const uint8_t*)segment.data(), segment.size());
+            }
+        }
+    }
+
+    // Text after the last delimiter
+    void flush() {
+        text(_decoder.pending(), _decoder.pendingLength());
+    }
+
+    uint32_t records() const { return _records; }
+    uint32_t dropped() const { return _dropped; }
+    uint32_t frames() const { return _frames; }
+};
+
+static int decode(FILE* in) {
+    LogStreamPrinter printer(stdout);
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        printer.feed(buf, n);
+        fflush(stdout);
+    }
+    printer.flush();
+    fprintf(stderr, "logdecode: %lu records in %lu frames, %lu dropped on the device\n",
+        (unsigned long)printer.records(), (unsigned long)printer.frames(),
+        (unsigned long)printer.dropped());
+    return 0;
+}
+
+// ==============================================================================
+// Self-test
+// ==============================================================================
+static int failures = 0;
+
+static void expect(bool ok, const char* scenario, const char* what) {
+    if (!ok) {
+        printf("  FAIL %s: %s\n", scenario, what);
+        failures++;
+    }
+}
+
+// Drains `log` into one record and formats it
+static std::string roundTrip(BinaryLog& log) {
+    uint8_t payload[SERIAL_PROTOCOL_MAX_PAYLOAD];
+    size_t n = log.takeBatch(payload, sizeof(payload));
+    if (n <= 4) return "<none>";
+    char line[256];
+    if (logFormatRecord(payload + 4, n - 4, line, sizeof(line)) != n - 4) return "<bad length>";
+    return line;
+}
+
+template <typename... Args>
+static void checkFormat(const char* scenario, LogMessageId id, const Args&... args) {
+    static BinaryLog log;
+    log.write(id, 0, args...);
+    std::string got = roundTrip(log);
+    char want[256];
+    snprintf(want, sizeof(want), logFormatOf(id), args...);
+    expect(got == want, scenario, (got + " != " + want).c_str());
+}
+
+static void formats() {
+    const char* name = "formats";
+    char label[8] = "Copy";
+    checkFormat(name, LOG_MACRO_EXEC, label, 2);
+    checkFormat(name, LOG_MACRO_DROPPED, "Paste", -1);
+    checkFormat(name, LOG_BLE_PARAMS, "updated", 7.5, 0, 400);
+    checkFormat(name, LOG_GESTURE_SWIPE, 3, -850, 42u);
+    checkFormat(name, LOG_HEAP, 123456u, 8000000u);
+
+    // Strings are capped, missing arguments show as "?"
+    static BinaryLog log;
+    log.write(LOG_HID_OUTPUT, 0, "a-very-long-transport-name-well-past-the-cap");
+    std::string got = roundTrip(log);
+    expect(got == "HID output: a-very-long-transport-name-well-", name, got.c_str());
+    log.write(LOG_HEAP, 0, 5u);
+    got = roundTrip(log);
+    expect(got == "Heap: 5 free, PSRAM: ? free", name, got.c_str());
+
+    // Through the macro and the global ring, as the firmware logs
+    LOG(LOG_HID_OUTPUT, "usb");
+    got = roundTrip(binaryLog);
+    expect(got == "HID output: usb", name, got.c_str());
+
+    // Level filtering happens at compile time
+    expect(logLevelOf(LOG_GESTURE_LONG) == LOG_SEV_DEBUG &&
+        logLevelOf(LOG_MACRO_DROPPED) == LOG_SEV_WARN, name, "catalog levels");
+    printf("%-12s %d messages in the catalog, record header %d bytes\n", name,
+        (int)LOG_MESSAGE_COUNT, LOG_RECORD_HEADER);
+}
+
+// Threads log while the reader drains into frames, as on the device
+static void stress(int perThread) {
+    const char* name = "stress";
+    const int writers = 3;
+    static BinaryLog log;
+    std::atomic<bool> done(false);
+    std::vector<std::vector<uint32_t>> seen(writers);
+    uint32_t frames = 0, lastDropped = 0;
+    bool droppedMonotonic = true;
+
+    std::thread reader([&]() {
+        FrameDecoder decoder;
+        uint8_t payload[SERIAL_PROTOCOL_MAX_PAYLOAD];
+        uint8_t frame[SERIAL_FRAME_MAX_ENCODED];
+        for (;;) {
+            bool finished = done.load();
+            size_t n = log.takeBatch(payload, sizeof(payload));
+            if (n == 0) {
+                if (finished) break;
+                std::this_thread::yield();
+                continue;
+            }
+            size_t len = encodeFrame(FRAME_LOG, 0, payload, n, frame);
+            for (size_t i = 0; i < len; i++) {
+                if (!decoder.feed(frame[i])) continue;
+                frames++;
+                const uint8_t* p = decoder.payload();
+                uint32_t dropped = readU32(p);
+                if (dropped < lastDropped) droppedMonotonic = false;
+                lastDropped = dropped;
+                for (size_t at = 4; at < decoder.length(); ) {
+                    char line[256];
+                    size_t rn = logFormatRecord(p + at, decoder.length() - at, line, sizeof(line));
+                    if (rn == 0) break;
+                    unsigned thread, seq;
+                    if (readU16(p + at) == LOG_HEAP && sscanf(line, "Heap: %u free, PSRAM: %u free",
+                                                               &thread, &seq) == 2 &&
+                        thread < (unsigned)writers) {
+                        seen[thread].push_back(seq);
+                    }
+                    at += rn;
+                }
+            }
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < writers; t++) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < perThread; i++) {
+                log.write(LOG_HEAP, (uint32_t)i, (unsigned)t, (unsigned)i);
+                if (i % 16 == 15) std::this_thread::yield();    // Tasks log in bursts
+            }
+        });
+    }
+    for (std::thread& t : threads) t.join();
+    done.store(true);
+    reader.join();
+
+    BinaryLogStats s = log.stats();
+    size_t received = 0;
+    bool ordered = true;
+    for (int t = 0; t < writers; t++) {
+        received += seen[t].size();
+        for (size_t i = 1; i < seen[t].size(); i++) {
+            if (seen[t][i] <= seen[t][i - 1]) ordered = false;
+        }
+    }
+    expect(received == s.records, name, "records lost or invented");
+    expect(received + s.dropped == (size_t)writers * perThread, name, "writes unaccounted for");
+    expect(ordered, name, "records out of order within a thread");
+    expect(droppedMonotonic && lastDropped == s.dropped, name, "dropped count in frames");
+    expect(s.maxUsed <= LOG_RING_BYTES && log.used() == 0, name, "ring accounting");
+    printf("%-12s %d writers x %d: %zu received in %lu frames, %lu dropped, ring max %lu/%d B\n",
+        name, writers, perThread, received, (unsigned long)frames, (unsigned long)s.dropped,
+        (unsigned long)s.maxUsed, LOG_RING_BYTES);
+}
+
+// Ring full: the caller is told at once and the count goes up
+static void overflow() {
+    const char* name = "overflow";
+    static BinaryLog log;
+    int accepted = 0;
+    for (int i = 0; i < 1000; i++) {
+        if (log.write(LOG_MACRO_EXEC, 0, "Overflow", i)) accepted++;
+    }
+    BinaryLogStats s = log.stats();
+    expect(accepted > 0 && s.dropped == (uint32_t)(1000 - accepted), name, "drops miscounted");
+
+    uint8_t payload[SERIAL_PROTOCOL_MAX_PAYLOAD];
+    size_t n = log.takeBatch(payload, sizeof(payload));
+    expect(n > 4 && readU32(payload) == s.dropped, name, "frame does not carry the drop count");
+    while (log.takeBatch(payload, sizeof(payload)) > 0) {
+    }
+    expect(log.write(LOG_MACRO_EXEC, 0, "Again", 1), name, "no room after draining");
+    printf("%-12s %d of 1000 accepted into %d bytes, %lu dropped\n", name, accepted,
+        LOG_RING_BYTES, (unsigned long)s.dropped);
+}
+
+// Text and frames interleaved on one port, as the decoder reads them
+static void stream() {
+    const char* name = "stream";
+    static BinaryLog log;
+    std::vector<uint8_t> capture;
+    auto text = [&](const char* t) { capture.insert(capture.end(), t, t + strlen(t)); };
+    auto frame = [&]() {
+        uint8_t payload[SERIAL_PROTOCOL_MAX_PAYLOAD];
+        uint8_t encoded[SERIAL_FRAME_MAX_ENCODED];
+        size_t n = log.takeBatch(payload, sizeof(payload));
+        size_t len = encodeFrame(FRAME_LOG, 0, payload, n, encoded);
+        capture.insert(capture.end(), encoded, encoded + len);
+    };
+
+    text("Setup complete!\n");
+    log.write(LOG_MACRO_EXEC, 1500000, "Copy", 1);
+    log.write(LOG_HID_OUTPUT, 1500250, "bluedroid");
+    frame();
+    text("BLE: Stable connection\n");
+    for (int i = 0; i < 2000 && log.write(LOG_HEAP, 2000000, 1u, 2u); i++) {
+    }
+    log.write(LOG_HEAP, 2000000, 1u, 2u);
+    frame();
+
+    char* out = nullptr;
+    size_t outLen = 0;
+    FILE* f = open_memstream(&out, &outLen);
+    LogStreamPrinter printer(f);
+    printer.feed(capture.data(), capture.size());
+    printer.flush();
+    fclose(f);
+    std::string s(out, outLen);
+    free(out);
+
+    expect(s.find("Setup complete!\n[    1.500000] I Executing macro: Copy (type=1)\n"
+                  "[    1.500250] I HID output: bluedroid\n") == 0, name, "first frame");
+    expect(s.find("BLE: Stable connection\n[2 log records dropped]\n[    2.000000] I Heap:") !=
+        std::string::npos, name, "text or drop report");
+    expect(printer.frames() == 2 && printer.dropped() == 2, name, "frame or drop count");
+    printf("%-12s %zu bytes captured, %lu records in %lu frames\n", name, capture.size(),
+        (unsigned long)printer.records(), (unsigned long)printer.frames());
+}
+
+// What the caller pays: LOG() against snprintf of the same message
+static void cost(int count) {
+    const char* name = "cost";
+    static BinaryLog log;
+    uint8_t payload[SERIAL_PROTOCOL_MAX_PAYLOAD];
+    char line[128];
+    using clock = std::chrono::steady_clock;
+
+    uint64_t logNs = 0, printNs = 0;
+    volatile size_t sink = 0;
+    for (int i = 0; i < count; i++) {
+        auto t0 = clock::now();
+        log.write(LOG_MACRO_EXEC, (uint32_t)i, "Copy", i);
+        auto t1 = clock::now();
+        sink = sink + (size_t)snprintf(line, sizeof(line), "Executing macro: %s (type=%d)\n", "Copy", i);
+        auto t2 = clock::now();
+        logNs += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        printNs += std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+        if (log.used() > LOG_RING_BYTES / 2) {
+            while (log.takeBatch(payload, sizeof(payload)) > 0) {
+            }
+        }
+    }
+    (void)sink;
+    // On the device printf then also waits ~11 us per character for the UART
+    printf("%-12s LOG() %.0f ns, snprintf %.0f ns per message (host); UART at %d baud "
+           "adds %.0f us per line\n",
+        name, (double)logNs / count, (double)printNs / count, SERIAL_PROTOCOL_BAUD,
+        30 * 10 * 1e6 / SERIAL_PROTOCOL_BAUD);
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "selftest") == 0) {
+        int records = argc > 2 ? atoi(argv[2]) : 100000;
+        formats();
+        stress(records);
+        overflow();
+        stream();
+        cost(100000);
+        printf("logdecode: %s (%d failures)\n", failures ? "FAILED" : "ok", failures);
+        return failures ? 1 : 0;
+    }
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-')) {
+        fprintf(stderr, "usage: logdecode [capture] | logdecode selftest [records]\n");
+        return 2;
+    }
+    FILE* in = argc == 2 ? fopen(argv[1], "rb") : stdin;
+    if (!in) {
+        fprintf(stderr, "logdecode: cannot open %s\n", argv[1]);
+        return 1;
+    }
+    return decode(in);
+}
@@ -0,0 +1,570 @@
+// ==============================================================================
+// macroexec_sim - Macro execution against a mock HID transport (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -o macroexec_sim host/macroexec_sim.cpp
+//
+// Runs MacroExecutor and HidReportQueue the way loop() does, on top of a
+// mock HidTransport that records every report with its send time and
+// completes notifications after a fixed delay. Checks the report stream of
+// each macro type, combo hold and sequence gaps, queued and rejected jobs,
+// cancelling a running text macro, a link drop mid-macro, held buttons
+// (FIRE_HOLD), the transport's latency accounting, and the job scheduler:
+// combos pre-empting a long text, priority order, the cancel gesture and
+// per-job wait/run times. Prints one line per scenario and exits 1 if any
+// expectation fails.
+
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "BleLinkState.hpp"
+#include "HidTransport.hpp"
+#include "MacroExecutor.hpp"
+
+#define SIM_STEP_US         250
+#define SIM_COMPLETE_US     1250    // Send -> completion event
+
+struct SentReport {
+    uint64_t atUs;
+    HidReport report;
+};
+
+class MockHidTransport : public HidTransport {
+public:
+    uint64_t nowUs;
+    BleLinkState* link;
+    HidReportQueue* queue;
+    std::vector<SentReport> sent;
+    std::deque<uint64_t> completions;
+
+    explicit MockHidTransport(BleLinkState* l) : nowUs(0), link(l), queue(nullptr) {}
+
+    const char* name() const override { return "mock"; }
+
+    bool begin() override {
+        link->post(BLE_INPUT_ADV_STARTED, (uint32_t)(nowUs / 1000));
+        return true;
+    }
+
+    int sendable() override { return -1; }
+
+    // Connection events, as a stack's callbacks would post them
+    void connect() {
+        uint32_t now = (uint32_t)(nowUs / 1000);
+        link->post(BLE_INPUT_CONNECTED, now);
+        link->post(BLE_INPUT_AUTH_OK, now);
+        link->post(BLE_INPUT_SUBSCRIBED, now);
+    }
+
+    void drop() {
+        completions.clear();
+        link->post(BLE_INPUT_DISCONNECTED, (uint32_t)(nowUs / 1000));
+    }
+
+    void step() {
+        nowUs += SIM_STEP_US;
+        while (!completions.empty() && completions.front() <= nowUs) {
+            completions.pop_front();
+            onCompleted();
+            queue->onSent(true);
+        }
+    }
+
+protected:
+    bool sendKeyboardReport(uint8_t modifiers, const uint8_t keys[6]) override {
+        if (!link->isReady()) return false;
+        SentReport s;
+        s.atUs = nowUs;
+        s.report = HidReport::press(modifiers, KEY_NONE);
+        memcpy(s.report.keys, keys, 6);
+        sent.push_back(s);
+        completions.push_back(nowUs + SIM_COMPLETE_US);
+        return true;
+    }
+
+    bool sendConsumerReport(uint8_t low, uint8_t high) override {
+        if (!link->isReady()) return false;
+        SentReport s;
+        s.atUs = nowUs;
+        s.report = HidReport::mediaState(low, high);
+        sent.push_back(s);
+        completions.push_back(nowUs + SIM_COMPLETE_US);
+        return true;
+    }
+
+    uint32_t clockUs() override { return (uint32_t)nowUs; }
+};
+
+// Transport, queue and executor wired like main.cpp
+struct Pad {
+    BleLinkState link;
+    MockHidTransport transport;
+    HidReportQueue queue;
+    MacroExecutor executor;
+    int touchReports;
+
+    Pad() : transport(&link), queue(&transport), executor(&queue), touchReports(0) {
+        transport.queue = &queue;
+        transport.begin();
+        transport.connect();
+    }
+
+    uint32_t nowMs() const { return (uint32_t)(transport.nowUs / 1000); }
+
+    // One loop() pass
+    void pass() {
+        uint32_t now = nowMs();
+        if (link.isReady() != queue.isOpen()) {
+            if (link.isReady()) {
+                queue.open();
+            } else {
+                executor.cancel(false);
+                queue.close(now);
+                transport.onLinkLost();
+            }
+        }
+        executor.service(now);
+        queue.service(now);
+        while (executor.takeTouchReport()) touchReports++;
+        transport.step();
+    }
+
+    void run(uint32_t ms) {
+        for (uint32_t t = 0; t < ms * 1000; t += SIM_STEP_US) pass();
+    }
+
+    bool runUntilIdle(uint32_t limitMs) {
+        for (uint32_t t = 0; t < limitMs * 1000; t += SIM_STEP_US) {
+            pass();
+            if (!executor.isBusy() && queue.isEmpty() && transport.completions.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* scenario, const char* what) {
+    if (!ok) {
+        printf("  FAIL %s: %s\n", scenario, what);
+        failures++;
+    }
+}
+
+static bool isKey(const HidReport& r, uint8_t modifiers, uint8_t key) {
+    return r.kind == HID_REPORT_KEYBOARD && r.modifiers == modifiers && r.keys[0] == key;
+}
+
+static bool isRelease(const HidReport& r) { return isKey(r, MODIFIER_NONE, KEY_NONE); }
+
+// Text the host would see: shifted letters upper case, '?' for anything else
+static std::string typed(const std::vector<SentReport>& sent) {
+    std::string out;
+    for (const SentReport& s : sent) {
+        const HidReport& r = s.report;
+        if (r.kind != HID_REPORT_KEYBOARD || r.keys[0] == KEY_NONE) continue;
+        char c = '?';
+        for (int ch = 0x20; ch <= 0x7E; ch++) {
+            uint8_t key, mods;
+            if (asciiToHid((char)ch, key, mods) && key == r.keys[0] && mods == r.modifiers) {
+                c = (char)ch;
+                break;
+            }
+        }
+        if (r.keys[0] == KEY_ENTER) c = '\n';
+        out += c;
+    }
+    return out;
+}
+
+static void keyMacro() {
+    const char* name = "key";
+    Pad pad;
+    pad.executor.enqueue(Macro::singleKey("Esc", "Esc", KEY_ESC), true);
+    expect(pad.runUntilIdle(100), name, "did not finish");
+    const std::vector<SentReport>& s = pad.transport.sent;
+    expect(s.size() == 2 && isKey(s[0].report, 0, KEY_ESC) && isRelease(s[1].report), name,
+        "wrong reports");
+    expect(pad.touchReports == 1, name, "touch report not signalled once");
+    printf("%-16s %zu reports, first after %llu us\n", name, s.size(),
+        (unsigned long long)(s.empty() ? 0 : s[0].atUs));
+}
+
+static void comboHold() {
+    const char* name = "combo-hold";
+    Pad pad;
+    pad.executor.enqueue(Macro::combo("Copy", "Ctrl+C", MODIFIER_CTRL, KEY_C), true);
+    expect(pad.runUntilIdle(200), name, "did not finish");
+    const std::vector<SentReport>& s = pad.transport.sent;
+    expect(s.size() == 2 && isKey(s[0].report, MODIFIER_CTRL, KEY_C) && isRelease(s[1].report),
+        name, "wrong reports");
+    uint64_t heldUs = s.size() == 2 ? s[1].atUs - s[0].atUs : 0;
+    expect(heldUs >= MACRO_COMBO_HOLD_MS * 1000, name, "released before the hold time");
+    printf("%-16s held %llu us\n", name, (unsigned long long)heldUs);
+}
+
+static void sequenceGaps() {
+    const char* name = "sequence-gaps";
+    Pad pad;
+    const uint8_t keys[] = {KEY_H, KEY_I, KEY_ENTER};
+    pad.executor.enqueue(Macro::sequence("Hi", "Seq", MODIFIER_NONE, keys, 3), true);
+    expect(pad.runUntilIdle(500), name, "did not finish");
+    const std::vector<SentReport>& s = pad.transport.sent;
+    expect(typed(s) == "hi\n" && s.size() == 6, name, "wrong reports");
+    uint64_t minGapUs = UINT64_MAX;
+    for (size_t i = 2; i < s.size(); i += 2) {
+        uint64_t gap = s[i].atUs - s[i - 1].atUs;
+        if (gap < minGapUs) minGapUs = gap;
+    }
+    expect(minGapUs >= MACRO_SEQUENCE_GAP_MS * 1000, name, "keys closer than the gap");
+    printf("%-16s min gap %llu us\n", name, (unsigned long long)minGapUs);
+}
+
+static void textAndMedia() {
+    const char* name = "text-media";
+    Pad pad;
+    pad.executor.enqueue(Macro::textMacro("Sig", "Hi, {Bob}!\n"), true);
+    pad.executor.enqueue(Macro::media("Mute", KEY_MEDIA_MUTE), true);
+    expect(pad.runUntilIdle(500), name, "did not finish");
+    const std::vector<SentReport>& s = pad.transport.sent;
+    expect(typed(s) == "Hi, {Bob}!\n", name, "typed text differs");
+    size_t n = s.size();
+    // Both are queued before the first pass: the media key goes first
+    expect(n >= 2 && s[0].report.kind == HID_REPORT_MEDIA && s[0].report.media[0] == 16 &&
+           s[1].report.media[0] == 0, name, "media press/release missing");
+    expect(pad.touchReports == 2, name, "touch report not signalled per macro");
+    printf("%-16s %zu reports, \"Hi, {Bob}!\" typed\n", name, n);
+}
+
+static void queuedAndRejected() {
+    const char* name = "job-queue";
+    Pad pad;
+    std::string longText(200, 'x');
+    pad.executor.enqueue(Macro::textMacro("Long", longText.c_str()), true);
+    for (int i = 0; i < MACRO_EXEC_QUEUE; i++) {
+        pad.executor.enqueue(Macro::singleKey("A", "A", KEY_A), true);
+    }
+    expect(pad.executor.stats().rejected == 1, name, "full job queue accepted a macro");
+    // A single pass never blocks: it returns once the text is far enough ahead
+    pad.pass();
+    expect(pad.queue.depth() == MACRO_BULK_AHEAD - HID_REPORT_CREDITS &&
+           pad.executor.isBusy(), name, "first pass did not stop the text ahead");
+    expect(pad.runUntilIdle(2000), name, "did not finish");
+    std::string t = typed(pad.transport.sent);
+    expect(t == "aaa" + longText, name, "jobs out of order or lost");
+    expect(pad.executor.stats().completed == MACRO_EXEC_QUEUE, name, "completions not counted");
+    printf("%-16s %zu chars in order, %lu rejected\n", name, t.size(),
+        (unsigned long)pad.executor.stats().rejected);
+}
+
+static void cancelText() {
+    const char* name = "cancel";
+    Pad pad;
+    std::string longText(200, 'y');
+    pad.executor.enqueue(Macro::textMacro("Long", longText.c_str()), true);
+    pad.run(20);
+    pad.executor.cancel(true);
+    expect(pad.runUntilIdle(500), name, "did not settle");
+    const std::vector<SentReport>& s = pad.transport.sent;
+    size_t n = s.size();
+    expect(n > 0 && n < longText.size() * 2, name, "cancel did not stop the text");
+    expect(n >= 2 && isRelease(s[n - 2].report) && s[n - 1].report.kind == HID_REPORT_MEDIA &&
+           s[n - 1].report.media[0] == 0, name, "no releases after cancel");
+    printf("%-16s stopped after %zu of %zu chars\n", name, typed(s).size(), longText.size());
+}
+
+static void linkDrop() {
+    const char* name = "link-drop";
+    Pad pad;
+    std::string longText(200, 'z');
+    pad.executor.enqueue(Macro::textMacro("Long", longText.c_str()), true);
+    pad.run(20);
+    pad.transport.drop();
+    pad.run(10);
+    expect(!pad.executor.isBusy() && pad.queue.isEmpty(), name, "macro survived the link");
+    size_t before = pad.transport.sent.size();
+    pad.transport.connect();
+    pad.run(50);
+    expect(pad.transport.sent.size() == before, name, "old macro resumed on the new link");
+    pad.executor.enqueue(Macro::singleKey("A", "A", KEY_A), true);
+    expect(pad.runUntilIdle(100) && pad.transport.sent.size() == before + 2, name,
+        "new link not usable");
+    printf("%-16s %lu reports flushed, %lu jobs cancelled\n", name,
+        (unsigned long)pad.queue.stats().flushed, (unsigned long)pad.executor.stats().cancelled);
+}
+
+static void truncatedText() {
+    const char* name = "truncate";
+    Pad pad;
+    std::string longText(MACRO_EXEC_TEXT_BYTES + 10, 'q');
+    pad.executor.enqueue(Macro::textMacro("Long", longText.c_str()), false);
+    expect(pad.runUntilIdle(5000), name, "did not finish");
+    expect(typed(pad.transport.sent).size() == MACRO_EXEC_TEXT_BYTES, name, "not truncated");
+    expect(pad.executor.stats().truncated == 1 && pad.touchReports == 0, name,
+        "truncation or replay counted wrong");
+    printf("%-16s %d of %zu chars typed\n", name, MACRO_EXEC_TEXT_BYTES, longText.size());
+}
+
+static void transportLatency() {
+    const char* name = "latency";
+    Pad pad;
+    pad.executor.enqueue(Macro::textMacro("Abc", "abcdef"), true);
+    pad.runUntilIdle(200);
+    HidTransportStats ts = pad.transport.stats();
+    expect(ts.reports == 12 && ts.completions == 12, name, "reports or completions miscounted");
+    expect(ts.maxLatencyUs >= SIM_COMPLETE_US && ts.maxLatencyUs < SIM_COMPLETE_US + 2 * SIM_STEP_US,
+        name, "latency off");
+    printf("%-16s %lu reports, avg %lu us, max %lu us (%s)\n", name, (unsigned long)ts.reports,
+        (unsigned long)(ts.totalLatencyUs / ts.completions), (unsigned long)ts.maxLatencyUs,
+        pad.transport.name());
+}
+
+static bool hasKey(const HidReport& r, uint8_t key) {
+    for (int i = 0; i < 6; i++) {
+        if (r.keys[i] == key) return true;
+    }
+    return false;
+}
+
+static const Macro HOLD_SPACE = Macro::singleKey("Jump", "Space", KEY_SPACE).firedOn(FIRE_HOLD);
+static const Macro HOLD_TALK =
+    Macro::combo("Talk", "Ctrl+F13", MODIFIER_CTRL, KEY_F13).firedOn(FIRE_HOLD);
+
+// Down for as long as it is held: one report each way
+static void holdKey() {
+    const char* name = "hold";
+    Pad pad;
+    expect(pad.executor.hold(15, HOLD_SPACE), name, "hold refused");
+    pad.run(500);
+    pad.executor.release(15);
+    expect(pad.runUntilIdle(100), name, "did not settle");
+    const std::vector<SentReport>& s = pad.transport.sent;
+    expect(s.size() == 2 && isKey(s[0].report, 0, KEY_SPACE) && isRelease(s[1].report), name,
+        "wrong reports");
+    uint64_t heldUs = s.size() == 2 ? s[1].atUs - s[0].atUs : 0;
+    expect(heldUs >= 500000 && heldUs < 501000, name, "not held for as long as the touch");
+    expect(pad.touchReports == 1 && pad.executor.stats().holds == 1 && !pad.executor.isHolding(),
+        name, "hold accounting off");
+    printf("%-16s held %llu us, %zu reports\n", name, (unsigned long long)heldUs, s.size());
+}
+
+// Holds are merged into one keyboard state: a report only when it changes,
+// and a macro typed meanwhile keeps them down
+static void holdMerge() {
+    const char* name = "hold-merge";
+    Pad pad;
+    MacroExecutor& ex = pad.executor;
+    ex.hold(1, HOLD_TALK);                          // Ctrl+F13
+    ex.hold(2, HOLD_SPACE);                         // + Space
+    ex.hold(3, HOLD_SPACE);                         // Same key again: no report
+    ex.release(2);                                  // Still held by 3: no report
+    pad.run(10);
+    size_t held = pad.transport.sent.size();
+    expect(held == 2, name, "unchanged state sent again");
+    ex.enqueue(Macro::textMacro("ab", "ab"), true);
+    expect(pad.runUntilIdle(200), name, "text did not finish");
+    const std::vector<SentReport>& s = pad.transport.sent;
+    bool kept = s.size() == held + 4;
+    for (size_t i = held; i < s.size(); i++) {
+        const HidReport& r = s[i].report;
+        kept = kept && r.modifiers == MODIFIER_CTRL && hasKey(r, KEY_F13) && hasKey(r, KEY_SPACE);
+    }
+    expect(kept, name, "text let go of the held keys");
+    ex.release(3);
+    ex.release(1);
+    expect(pad.runUntilIdle(100), name, "did not settle");
+    size_t n = s.size();
+    expect(n == held + 6 && isKey(s[n - 2].report, MODIFIER_CTRL, KEY_F13) &&
+           !hasKey(s[n - 2].report, KEY_SPACE) && isRelease(s[n - 1].report), name,
+           "releases not diffed");
+    printf("%-16s %zu reports for 3 holds, 4 releases and 2 typed characters\n", name, n);
+}
+
+static void holdMedia() {
+    const char* name = "hold-media";
+    Pad pad;
+    pad.executor.hold(0, Macro::media("Vol +", KEY_MEDIA_VOLUME_UP).firedOn(FIRE_HOLD));
+    pad.run(300);
+    pad.executor.release(0);
+    expect(pad.runUntilIdle(100), name, "did not settle");
+    const std::vector<SentReport>& s = pad.transport.sent;
+    expect(s.size() == 2 && s[0].report.kind == HID_REPORT_MEDIA && s[0].report.media[0] == 32 &&
+           s[1].report.media[0] == 0, name, "consumer press/release wrong");
+    expect(!pad.executor.hold(1, Macro::textMacro("T", "x")), name, "text macro held");
+    for (int i = 0; i < MACRO_HOLD_MAX; i++) pad.executor.hold(i, HOLD_SPACE);
+    expect(!pad.executor.hold(MACRO_HOLD_MAX, HOLD_SPACE), name, "more than MACRO_HOLD_MAX held");
+    printf("%-16s %zu reports, %d holds at most\n", name, s.size(), MACRO_HOLD_MAX);
+}
+
+// Stuck-key guard: a profile switch, a cancel or a link drop lets go
+static void holdGuard() {
+    const char* name = "hold-guard";
+    Pad pad;
+    MacroExecutor& ex = pad.executor;
+    const std::vector<SentReport>& s = pad.transport.sent;
+
+    ex.hold(4, HOLD_TALK);
+    ex.releaseHolds();
+    expect(pad.runUntilIdle(100) && s.size() == 2 && isRelease(s[1].report), name,
+        "releaseHolds() sent no release");
+
+    ex.hold(4, HOLD_TALK);                          // Still queued: discarded
+    ex.cancel(true);
+    expect(pad.runUntilIdle(100) && s.size() == 4 && isRelease(s[2].report), name,
+        "cancel(true) sent no release");
+
+    ex.hold(4, HOLD_TALK);
+    pad.run(10);
+    pad.transport.drop();
+    pad.run(10);
+    expect(!ex.isHolding(), name, "hold survived the link");
+    pad.transport.connect();
+    pad.run(10);
+    size_t before = s.size();
+    ex.release(4);                                  // Finger lifted after the reconnect
+    pad.run(10);
+    expect(s.size() == before, name, "release of a dropped hold was sent");
+    expect(ex.stats().forcedReleases == 3, name, "forced releases miscounted");
+
+    // A hold while the report queue is full goes out with the next report
+    std::string longText(100, 'x');
+    ex.enqueue(Macro::textMacro("Long", longText.c_str()), true);
+    pad.pass();
+    ex.hold(5, HOLD_SPACE);
+    expect(pad.runUntilIdle(2000), name, "did not finish");
+    expect(typed(s).size() > longText.size() && hasKey(s.back().report, KEY_SPACE), name,
+        "hold lost behind a full queue");
+    printf("%-16s %lu holds released by the guard\n", name,
+        (unsigned long)ex.stats().forcedReleases);
+}
+
+// Reports up to and including the first that matches, from `from`
+static size_t indexOf(const std::vector<SentReport>& s, size_t from, uint8_t modifiers,
+                      uint8_t key) {
+    for (size_t i = from; i < s.size(); i++) {
+        if (isKey(s[i].report, modifiers, key)) return i;
+    }
+    return s.size();
+}
+
+static void preemption() {
+    const char* name = "preempt";
+    Pad pad;
+    std::string longText(200, 'x');
+    pad.executor.enqueue(Macro::textMacro("Long", longText.c_str()), true);
+    pad.run(30);
+    size_t before = pad.transport.sent.size();
+    uint64_t pressedUs = pad.transport.nowUs;
+    pad.executor.enqueue(Macro::combo("Copy", "Ctrl+C", MODIFIER_CTRL, KEY_C), true);
+    expect(pad.runUntilIdle(2000), name, "did not finish");
+    const std::vector<SentReport>& s = pad.transport.sent;
+    size_t at = indexOf(s, before, MODIFIER_CTRL, KEY_C);
+    // Behind at most what the text had queued and the rest of its character
+    expect(at < s.size() && at - before <= MACRO_BULK_AHEAD + 2, name,
+        "combo waited behind more than MACRO_BULK_AHEAD reports");
+    expect(at + 1 < s.size() && isRelease(s[at + 1].report) && isRelease(s[at - 1].report), name,
+        "combo not sent between characters");
+    // Typed text without the combo: the text is intact and in order
+    std::vector<SentReport> text(s);
+    if (at + 1 < text.size()) text.erase(text.begin() + at, text.begin() + at + 2);
+    expect(typed(text) == longText, name, "text damaged by the combo");
+    const MacroExecStats& st = pad.executor.stats();
+    expect(st.preempted == 1 && st.completed == 2, name, "pre-emption not counted");
+    printf("%-16s combo sent %zu reports and %llu us after the press, %zu chars into the text\n",
+        name, at - before, (unsigned long long)(s[at].atUs - pressedUs), typed(s).find('?'));
+}
+
+static void priorityOrder() {
+    const char* name = "priority";
+    Pad pad;
+    MacroExecutor& ex = pad.executor;
+    const uint8_t keys[] = {KEY_H, KEY_I};
+    ex.enqueue(Macro::textMacro("T", "ab"), true);
+    ex.enqueue(Macro::sequence("S", "Seq", MODIFIER_NONE, keys, 2), true);
+    ex.enqueue(Macro::textMacro("U", "cd"), true);
+    ex.enqueue(Macro::textMacro("V", "ef"), true);
+    expect(ex.queued() == MACRO_EXEC_QUEUE - 1 && ex.stats().rejected == 1, name,
+        "bulk jobs took the last slot");
+    ex.enqueue(Macro::singleKey("Z", "Z", KEY_Z), true);
+    expect(ex.queued() == MACRO_EXEC_QUEUE, name, "last slot not kept for an interactive job");
+    expect(pad.runUntilIdle(1000), name, "did not finish");
+    const std::vector<SentReport>& s = pad.transport.sent;
+    expect(typed(s) == "zabhicd", name, "not interactive first, then in order");
+    printf("%-16s %s\n", name, typed(s).c_str());
+}
+
+static void cancelRunning() {
+    const char* name = "cancel-running";
+    Pad pad;
+    MacroExecutor& ex = pad.executor;
+    std::string longText(200, 'y');
+    ex.enqueue(Macro::textMacro("Long", longText.c_str()), true);
+    ex.enqueue(Macro::textMacro("Next", "ok"), true);
+    ex.hold(15, HOLD_SPACE);
+    pad.run(30);
+    expect(ex.cancelRunning() == 1, name, "did not drop just the running job");
+    expect(ex.queued() == 1 && !ex.isHolding(), name, "queued job lost or hold kept");
+    expect(pad.runUntilIdle(500), name, "did not settle");
+    const std::vector<SentReport>& s = pad.transport.sent;
+    size_t n = s.size();
+    std::string t = typed(s);
+    expect(t.size() < longText.size() && t.substr(t.size() - 2) == "ok", name,
+        "text not stopped or the next job did not run");
+    // Releases first, then the job that had not started
+    expect(n >= 6 && isRelease(s[n - 6].report) && s[n - 5].report.kind == HID_REPORT_MEDIA &&
+           s[n - 5].report.media[0] == 0, name, "keys not released");
+    expect(!hasKey(s[n - 4].report, KEY_SPACE), name, "hold still down after cancel");
+    expect(ex.stats().cancelled == 1 && ex.stats().forcedReleases == 1 && ex.cancelRunning() == 0,
+        name, "cancel miscounted");
+    printf("%-16s stopped after %zu of %zu chars, next job typed\n", name, t.size() - 2,
+        longText.size());
+}
+
+static void jobTiming() {
+    const char* name = "job-timing";
+    Pad pad;
+    MacroExecutor& ex = pad.executor;
+    std::string longText(100, 'x');
+    ex.enqueue(Macro::textMacro("Long", longText.c_str()), true);
+    pad.run(20);
+    ex.enqueue(Macro::combo("Copy", "Ctrl+C", MODIFIER_CTRL, KEY_C), true);
+    expect(pad.runUntilIdle(2000), name, "did not finish");
+    MacroJobTiming first = MacroJobTiming(), second = MacroJobTiming(), none;
+    bool gotBoth = ex.takeFinished(first) && ex.takeFinished(second);
+    expect(gotBoth && !ex.takeFinished(none), name, "finished jobs not handed out once");
+    expect(first.type == MACRO_TYPE_COMBO && second.type == MACRO_TYPE_TEXT, name,
+        "not in completion order");
+    expect(first.waitMs < 10 && first.runMs >= MACRO_COMBO_HOLD_MS, name, "combo times off");
+    expect(second.waitMs == 0 && second.runMs > 20 + first.runMs, name, "text times off");
+    const MacroExecStats& st = ex.stats();
+    expect(st.maxRunMs == second.runMs && st.totalWaitMs == first.waitMs, name,
+        "stats disagree with takeFinished()");
+    printf("%-16s combo waited %lu ms, ran %lu ms; text ran %lu ms\n", name,
+        (unsigned long)first.waitMs, (unsigned long)first.runMs, (unsigned long)second.runMs);
+}
+
+int main() {
+    keyMacro();
+    comboHold();
+    sequenceGaps();
+    textAndMedia();
+    queuedAndRejected();
+    cancelText();
+    linkDrop();
+    truncatedText();
+    transportLatency();
+    holdKey();
+    holdMerge();
+    holdMedia();
+    holdGuard();
+    preemption();
+    priorityOrder();
+    cancelRunning();
+    jobTiming();
+    printf("macroexec_sim: %s (%d failures)\n", failures ? "FAILED" : "ok", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,896 @@
+// ==============================================================================
+// macropadctl - Serial profile protocol client (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -pthread -o macropadctl host/macropadctl.cpp -lutil
+//
+// Usage:
+//   macropadctl [-p port] [-b baud] info
+//   macropadctl [-p port] [-b baud] ping [count]
+//   macropadctl [-p port] [-b baud] upload <bundle.bin>
+//   macropadctl [-p port] [-b baud] set <profile> <button> <label> <sublabel> <mods> <key>...
+//   macropadctl [-p port] [-b baud] text <profile> <button> <label> <text>
+//   macropadctl [-p port] [-b baud] clear <profile> <button>
+//   macropadctl [-p port] [-b baud] metrics [snapshot-file]
+//   macropadctl metrics-diff <before> <after>
+//   macropadctl loopback [bundle-kb] [patches] [corrupt-every]
+//
+// Defaults: -p /dev/ttyUSB0 -b 921600 (SERIAL_PROTOCOL_BAUD). Keys and
+// modifiers are HID codes / MODIFIER_* masks, decimal or 0x-prefixed.
+// metrics prints the device's metrics registry (src/Metrics.hpp) and can
+// save the snapshot as text; metrics-diff compares two saved snapshots and
+// shows what happened in between: counter deltas, gauge changes, and
+// count, mean and percentiles of the histogram samples taken in between.
+//
+// Device log lines arriving between frames, and FRAME_LOG records (decoded
+// with src/LogCatalog.hpp), are echoed to stderr.
+//
+// loopback runs the device side of the protocol (upload reassembly and a
+// ProfileLog on a RAM flash region) in a thread on the other end of a pty,
+// then reports upload throughput and patch-apply latency. With corrupt-every
+// N, every Nth frame to the device has a byte flipped to exercise resends.
+// Exit code 1 if the uploaded image or any patch does not arrive intact.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Macros.hpp"
+#include "ProfileBundle.hpp"
+#include "ProfileLog.hpp"
+#include "SerialProtocol.hpp"
+#include "BinaryLog.hpp"
+#include "Metrics.hpp"
+
+#define CTL_ACK_TIMEOUT_MS  300
+#define CTL_MAX_RESENDS     10
+
+static uint64_t nowMicros() {
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool writeAll(int fd, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static speed_t baudConstant(int baud) {
+    switch (baud) {
+        case 115200:  return B115200;
+        case 230400:  return B230400;
+        case 460800:  return B460800;
+        case 921600:  return B921600;
+        case 1500000: return B1500000;
+        case 2000000: return B2000000;
+    }
+    return 0;
+}
+
+static int openPort(const char* path, int baud) {
+    speed_t speed = baudConstant(baud);
+    if (speed == 0) {
+        fprintf(stderr, "macropadctl: unsupported baud rate %d\n", baud);
+        return -1;
+    }
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        fprintf(stderr, "macropadctl: cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~CRTSCTS;
+    tcsetattr(fd, TCSANOW, &tio);
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+// ==============================================================================
+// Windowed Client
+// ==============================================================================
+struct Ack {
+    uint8_t status;
+    uint32_t deviceUs;      // Time the device spent handling the request
+    uint64_t rttUs;
+};
+
+class ProtocolClient {
+private:
+    struct Pending {
+        uint8_t seq;
+        uint8_t type;
+        std::vector<uint8_t> frame;
+        uint64_t sentAt;    // First transmission
+        uint64_t lastSend;
+        int resends;
+    };
+
+    int _fd;
+    FrameDecoder _decoder;
+    uint8_t _nextSeq;
+    std::vector<Pending> _pending;
+    int _window;
+    bool _failed;
+    Ack _lastAck;
+    ProtocolInfo _info;
+    bool _haveInfo;
+    uint32_t _resends;
+    bool _echoText;
+    std::vector<uint8_t> _reply;        // Payload of the last data reply
+
+    void echoText(const uint8_t* text, size_t len) {
+        if (!_echoText || len == 0) return;
+        fprintf(stderr, "device: ");
+        fwrite(text, 1, len, stderr);
+        if (text[len - 1] != '\n') fputc('\n', stderr);
+    }
+
+    void echoLog() {
+        if (!_echoText || _decoder.length() < 4) return;
+        for (size_t at = 4; at < _decoder.length(); ) {
+            char line[256];
+            size_t n = logFormatRecord(_decoder.payload() + at, _decoder.length() - at, line,
+                                       sizeof(line));
+            if (n == 0) break;
+            fprintf(stderr, "device: %s\n", line);
+            at += n;
+        }
+    }
+
+    void handleFrame() {
+        uint8_t seq = _decoder.seq();
+        auto it = std::find_if(_pending.begin(), _pending.end(),
+                               [seq](const Pending& p) { return p.seq == seq; });
+        if (it == _pending.end()) return;     // Ack for a request already resent and acked
+
+        if (_decoder.type() == FRAME_INFO_REPLY && _decoder.length() >= sizeof(ProtocolInfo)) {
+            memcpy(&_info, _decoder.payload(), sizeof(_info));
+            _haveInfo = true;
+            _lastAck.status = STATUS_OK;
+            _lastAck.deviceUs = 0;
+        } else if (_decoder.type() == FRAME_METRICS_REPLY) {
+            _reply.assign(_decoder.payload(), _decoder.payload() + _decoder.length());
+            _lastAck.status = STATUS_OK;
+            _lastAck.deviceUs = 0;
+        } else if (_decoder.type() == FRAME_ACK && _decoder.length() >= 6) {
+            _lastAck.status = _decoder.payload()[0];
+            _lastAck.deviceUs = readU32(_decoder.payload() + 2);
+        } else {
+            return;
+        }
+        _lastAck.rttUs = nowMicros() - it->sentAt;
+        if (_lastAck.status != STATUS_OK) {
+            fprintf(stderr, "macropadctl: request 0x%02X (seq %u) failed: %s\n",
+                it->type, it->seq, frameStatusName(_lastAck.status));
+            _failed = true;
+        }
+
+        // The device handles frames in arrival order: anything sent before the
+        // acked frame and still unacked was lost, so resend it without waiting
+        uint64_t ackedSend = it->lastSend;
+        _pending.erase(it);
+        uint64_t now = nowMicros();
+        for (Pending& p : _pending) {
+            if (p.lastSend > ackedSend) break;
+            p.lastSend = now;
+            _resends++;
+            writeAll(_fd, p.frame.data(), p.frame.size());
+        }
+    }
+
+    // Reads whatever arrives within `timeoutMs` and resends overdue requests
+    void pump(int timeoutMs) {
+        struct pollfd pfd = {_fd, POLLIN, 0};
+        if (poll(&pfd, 1, timeoutMs) > 0) {
+            uint8_t buf[1024];
+            ssize_t n = read(_fd, buf, sizeof(buf));
+            for (ssize_t i = 0; i < n; i++) {
+                // A segment that doesn't decode as a frame is log text
+                std::string text;
+                if (buf[i] == 0 && _decoder.pendingLength() > 0) {
+                    text.assign((const char*)_decoder.pending(), _decoder.pendingLength());
+                }
+                if (_decoder.feed(buf[i])) {
+                    if (_decoder.type() == FRAME_LOG) echoLog();
+                    else handleFrame();
+                } else if (!text.empty()) {
+                    echoText((const uint8_t*)text.data(), text.size());
+                }
+            }
+        }
+
+        // Go-back-N: once the oldest request times out, resend everything
+        // still outstanding in order
+        uint64_t now = nowMicros();
+        if (!_pending.empty() && now - _pending.front().lastSend > CTL_ACK_TIMEOUT_MS * 1000ull) {
+            for (Pending& p : _pending) {
+                if (++p.resends > CTL_MAX_RESENDS) {
+                    fprintf(stderr, "macropadctl: no response to request 0x%02X\n", p.type);
+                    _failed = true;
+                    _pending.clear();
+                    return;
+                }
+                p.lastSend = now;
+                _resends++;
+                writeAll(_fd, p.frame.data(), p.frame.size());
+            }
+        }
+    }
+
+public:
+    explicit ProtocolClient(int fd)
+        : _fd(fd), _nextSeq(0), _window(SERIAL_PROTOCOL_WINDOW), _failed(false), _haveInfo(false),
+          _resends(0), _echoText(true) {
+        memset(&_info, 0, sizeof(_info));
+        memset(&_lastAck, 0, sizeof(_lastAck));
+    }
+
+    void setEchoText(bool echo) { _echoText = echo; }
+    bool failed() const { return _failed; }
+    uint32_t resends() const { return _resends; }
+    const Ack& lastAck() const { return _lastAck; }
+    const ProtocolInfo& info() const { return _info; }
+    bool haveInfo() const { return _haveInfo; }
+
+    // Queues a request, waiting for room in the window first
+    bool send(uint8_t type, const void* payload, size_t len) {
+        while ((int)_pending.size() >= _window && !_failed) pump(CTL_ACK_TIMEOUT_MS);
+        if (_failed) return false;
+
+        Pending p;
+        p.seq = _nextSeq++;
+        p.type = type;
+        p.frame.resize(SERIAL_FRAME_MAX_ENCODED);
+        p.frame.resize(encodeFrame(type, p.seq, payload, len, p.frame.data()));
+        p.sentAt = p.lastSend = nowMicros();
+        p.resends = 0;
+        if (!writeAll(_fd, p.frame.data(), p.frame.size())) {
+            _failed = true;
+            return false;
+        }
+        _pending.push_back(std::move(p));
+        return true;
+    }
+
+    // Waits until every request has been acked
+    bool drain() {
+        while (!_pending.empty() && !_failed) pump(CTL_ACK_TIMEOUT_MS);
+        return !_failed;
+    }
+
+    bool request(uint8_t type, const void* payload = nullptr, size_t len = 0) {
+        return send(type, payload, len) && drain();
+    }
+
+    // Learns the device's window and limits
+    bool connect() {
+        if (!request(FRAME_INFO)) return false;
+        if (!_haveInfo || _info.version != SERIAL_PROTOCOL_VERSION) {
+            fprintf(stderr, "macropadctl: device speaks protocol %u, expected %u\n",
+                _info.version, SERIAL_PROTOCOL_VERSION);
+            return false;
+        }
+        _window = _info.window;
+        return true;
+    }
+
+    bool upload(const std::vector<uint8_t>& image) {
+        uint32_t header[2] = {(uint32_t)image.size(), bundleCrc32(image.data(), image.size())};
+        if (!request(FRAME_BUNDLE_BEGIN, header, sizeof(header))) return false;
+
+        uint8_t chunk[SERIAL_PROTOCOL_MAX_PAYLOAD];
+        for (size_t off = 0; off < image.size(); off += SERIAL_BUNDLE_CHUNK) {
+            size_t n = std::min((size_t)SERIAL_BUNDLE_CHUNK, image.size() - off);
+            uint32_t o = (uint32_t)off;
+            memcpy(chunk, &o, 4);
+            memcpy(chunk + 4, &image[off], n);
+            if (!send(FRAME_BUNDLE_DATA, chunk, 4 + n)) return false;
+        }
+        return drain();
+    }
+
+    bool setButton(uint16_t profile, uint8_t button, const Macro& m) {
+        uint8_t payload[SERIAL_PROTOCOL_MAX_PAYLOAD];
+        size_t n = encodeButtonPayload(profile, button, m, payload, sizeof(payload));
+        if (n == 0) {
+            fprintf(stderr, "macropadctl: button strings too long for one frame\n");
+            return false;
+        }
+        return send(FRAME_BUTTON_SET, payload, n);
+    }
+
+    bool clearButton(uint16_t profile, uint8_t button) {
+        uint8_t payload[3];
+        memcpy(payload, &profile, 2);
+        payload[2] = button;
+        return send(FRAME_BUTTON_CLEAR, payload, sizeof(payload));
+    }
+
+    // Reads the whole registry, a page per request; returns the page count
+    int fetchMetrics(MetricValue* out, uint32_t& uptimeMs) {
+        uint8_t first = 0;
+        int pages = 0;
+        while (first < METRIC_COUNT) {
+            _reply.clear();
+            if (!request(FRAME_METRICS, &first, 1) || _reply.empty()) return 0;
+            uint8_t next;
+            if (!decodeMetricsPage(_reply.data(), _reply.size(), out, next, uptimeMs) ||
+                next <= first) {
+                fprintf(stderr, "macropadctl: device metrics catalog differs from this build\n");
+                return 0;
+            }
+            first = next;
+            pages++;
+        }
+        return pages;
+    }
+};
+
+// ==============================================================================
+// Metrics Snapshots
+// ==============================================================================
+struct MetricsSnapshot {
+    uint32_t uptimeMs;
+    MetricValue m[METRIC_COUNT];
+
+    MetricsSnapshot() : uptimeMs(0) {}
+};
+
+// One line per metric: name value min max sum buckets...
+static bool saveSnapshot(const char* path, const MetricsSnapshot& snap) {
+    FILE* f = fopen(path, "w");
+    if (f == nullptr) return false;
+    fprintf(f, "uptime_ms %lu\n", (unsigned long)snap.uptimeMs);
+    for (int id = 0; id < METRIC_COUNT; id++) {
+        const MetricValue& m = snap.m[id];
+        fprintf(f, "%s %lu %lu %lu %llu", metricName(id), (unsigned long)m.value,
+            (unsigned long)m.min, (unsigned long)m.max, (unsigned long long)m.sum);
+        for (int b = 0; b < METRIC_BUCKETS; b++) fprintf(f, " %lu", (unsigned long)m.buckets[b]);
+        fputc('\n', f);
+    }
+    fclose(f);
+    return true;
+}
+
+static bool loadSnapshot(const char* path, MetricsSnapshot& snap) {
+    FILE* f = fopen(path, "r");
+    if (f == nullptr) return false;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        char* p = line;
+        char* name = strsep(&p, " \n");
+        if (name == nullptr || p == nullptr) continue;
+        if (strcmp(name, "uptime_ms") == 0) {
+            snap.uptimeMs = (uint32_t)strtoul(p, nullptr, 10);
+            continue;
+        }
+        int id = 0;
+        while (id < METRIC_COUNT && strcmp(metricName(id), name) != 0) id++;
+        if (id == METRIC_COUNT) continue;       // Metric from another build
+        MetricValue& m = snap.m[id];
+        m.value = (uint32_t)strtoul(p, &p, 10);
+        m.min = (uint32_t)strtoul(p, &p, 10);
+        m.max = (uint32_t)strtoul(p, &p, 10);
+        m.sum = strtoull(p, &p, 10);
+        for (int b = 0; b < METRIC_BUCKETS; b++) m.buckets[b] = (uint32_t)strtoul(p, &p, 10);
+    }
+    fclose(f);
+    return true;
+}
+
+static void printHistogram(const char* name, const MetricValue& m) {
+    if (m.value == 0) {
+        printf("  %-24s  no samples\n", name);
+        return;
+    }
+    printf("  %-24s  n %-8lu mean %-8.0f p50 <%-7lu p90 <%-7lu p99 <%-7lu max %lu\n", name,
+        (unsigned long)m.value, (double)m.sum / m.value, (unsigned long)m.percentile(0.5) + 1,
+        (unsigned long)m.percentile(0.9) + 1, (unsigned long)m.percentile(0.99) + 1,
+        (unsigned long)m.max);
+}
+
+static void printSnapshot(const MetricsSnapshot& snap) {
+    printf("uptime %lu.%03lu s\n", (unsigned long)(snap.uptimeMs / 1000),
+        (unsigned long)(snap.uptimeMs % 1000));
+    for (int id = 0; id < METRIC_COUNT; id++) {
+        const MetricValue& m = snap.m[id];
+        switch (metricKindOf(id)) {
+            case METRIC_COUNTER:
+                printf("  %-24s  %lu\n", metricName(id), (unsigned long)m.value);
+                break;
+            case METRIC_GAUGE:
+                if (m.min > m.max) {
+                    printf("  %-24s  not sampled\n", metricName(id));
+                } else {
+                    printf("  %-24s  %-10lu low %-10lu high %lu\n", metricName(id),
+                        (unsigned long)m.value, (unsigned long)m.min, (unsigned long)m.max);
+                }
+                break;
+            case METRIC_HISTOGRAM:
+                printHistogram(metricName(id), m);
+                break;
+        }
+    }
+}
+
+// Histograms and counters as deltas, gauges as before -> after
+static void printDiff(const MetricsSnapshot& a, const MetricsSnapshot& b) {
+    printf("interval %.3f s\n", ((double)b.uptimeMs - a.uptimeMs) / 1000);
+    for (int id = 0; id < METRIC_COUNT; id++) {
+        const MetricValue& x = a.m[id];
+        const MetricValue& y = b.m[id];
+        switch (metricKindOf(id)) {
+            case METRIC_COUNTER:
+                printf("  %-24s  %+ld (%lu -> %lu)\n", metricName(id),
+                    (long)y.value - (long)x.value, (unsigned long)x.value, (unsigned long)y.value);
+                break;
+            case METRIC_GAUGE:
+                printf("  %-24s  %lu -> %lu (%+ld), low %lu -> %lu\n", metricName(id),
+                    (unsigned long)x.value, (unsigned long)y.value, (long)y.value - (long)x.value,
+                    (unsigned long)x.min, (unsigned long)y.min);
+                break;
+            case METRIC_HISTOGRAM: {
+                MetricValue d;
+                d.value = y.value - x.value;
+                d.sum = y.sum - x.sum;
+                d.max = y.max;      // Only the overall max is kept
+                for (int k = 0; k < METRIC_BUCKETS; k++) d.buckets[k] = y.buckets[k] - x.buckets[k];
+                printHistogram(metricName(id), d);
+                break;
+            }
+        }
+    }
+}
+
+// ==============================================================================
+// Loopback Device
+// ==============================================================================
+// The device half of the protocol, as main.cpp wires it, minus the flash job:
+// uploads are reassembled and validated, patches land in a ProfileLog.
+class LoopbackDevice : public SerialProtocolHandler {
+private:
+    BundleUpload _upload;
+    RamFlashRegion _flash;
+    ProfileLog* _log;
+
+public:
+    std::vector<uint8_t> installed;
+    MetricsRegistry registry;       // Device thread only
+
+    // Every metric has data, so a snapshot takes several pages
+    LoopbackDevice() : _flash(0x10000) {
+        _log = new ProfileLog(&_flash);
+        _log->mount(0x1234);
+        for (int id = 0; id < METRIC_COUNT; id++) {
+            for (uint32_t v = 1; v < 0x1000000; v = v * 3 + id) {
+                if (metricKindOf(id) == METRIC_COUNTER) registry.add((MetricId)id, v);
+                else if (metricKindOf(id) == METRIC_GAUGE) registry.set((MetricId)id, v);
+                else registry.observe((MetricId)id, v);
+            }
+        }
+    }
+    ~LoopbackDevice() { delete _log; }
+
+    const ProfileLog& log() const { return *_log; }
+
+    FrameStatus onBundleBegin(uint32_t size, uint32_t crc) override {
+        return _upload.begin(size, crc);
+    }
+
+    FrameStatus onBundleData(uint32_t offset, const uint8_t* data, size_t len) override {
+        return _upload.data(offset, data, len);
+    }
+
+    FrameStatus onBundleEnd() override {
+        FrameStatus status = _upload.finish();
+        if (status == STATUS_OK) installed.swap(_upload.image());
+        _upload.reset();
+        return status;
+    }
+
+    FrameStatus onButtonSet(uint16_t profile, uint8_t button, const Macro& macro) override {
+        if (profile >= PROFILE_COUNT) return STATUS_BAD_REQUEST;
+        if (!_log->setButton(profile, button, macro)) return STATUS_REJECTED;
+        _log->service();
+        return STATUS_OK;
+    }
+
+    FrameStatus onButtonClear(uint16_t profile, uint8_t button) override {
+        if (profile >= PROFILE_COUNT) return STATUS_BAD_REQUEST;
+        if (!_log->clearButton(profile, button)) return STATUS_REJECTED;
+        _log->service();
+        return STATUS_OK;
+    }
+
+    void onInfo(ProtocolInfo& info) override {
+        info.profileCount = PROFILE_COUNT;
+        info.editedButtons = (uint16_t)_log->editCount();
+    }
+
+    size_t onMetrics(uint8_t first, uint8_t* out, size_t cap) override {
+        return registry.encodePage(first, (uint32_t)(nowMicros() / 1000), out, cap);
+    }
+};
+
+struct LoopbackLink {
+    int fd;
+    int corruptEvery;
+    uint32_t framesIn;
+    uint32_t corrupted;
+};
+
+static void loopbackWrite(const uint8_t* data, size_t len, void* context) {
+    writeAll(static_cast<LoopbackLink*>(context)->fd, data, len);
+}
+
+static uint32_t loopbackMicros() {
+    return (uint32_t)nowMicros();
+}
+
+static void runDevice(LoopbackDevice* device, LoopbackLink* link, std::atomic<bool>* stop) {
+    SerialProtocolServer server(device, loopbackWrite, link, loopbackMicros);
+    uint8_t buf[1024];
+    uint32_t lastPass = loopbackMicros();
+    while (!stop->load()) {
+        uint32_t pass = loopbackMicros();
+        device->registry.observe(METRIC_LOOP_PERIOD_US, pass - lastPass);
+        lastPass = pass;
+        struct pollfd pfd = {link->fd, POLLIN, 0};
+        if (poll(&pfd, 1, 20) <= 0) continue;
+        ssize_t n = read(link->fd, buf, sizeof(buf));
+        if (n <= 0) continue;
+
+        // Damage the last body byte of every Nth frame
+        for (ssize_t i = 0; i < n; i++) {
+            if (buf[i] != 0 || i == 0 || buf[i - 1] == 0) continue;
+            link->framesIn++;
+            if (link->corruptEvery > 0 && link->framesIn % link->corruptEvery == 0) {
+                buf[i - 1] ^= 0x01;
+                if (buf[i - 1] == 0) buf[i - 1] = 0x02;
+                link->corrupted++;
+            }
+        }
+        server.feed(buf, (size_t)n);
+    }
+}
+
+// Built-in profiles repeated under new names until the bundle reaches `bytes`
+static std::vector<uint8_t> syntheticBundle(size_t bytes) {
+    std::vector<std::string> names;
+    ProfileBundleBuilder builder;
+    std::vector<uint8_t> image;
+    for (int i = 0; ; i++) {
+        Profile p = BUILTIN_PROFILES[i % PROFILE_COUNT];
+        names.push_back(std::string(p.name) + " " + std::to_string(i));
+        p.name = names.back().c_str();
+        builder.addProfile(p);
+        if (i % 16 == 15) {
+            std::vector<uint8_t> built = builder.build();
+            if (built.size() > bytes) break;
+            image.swap(built);
+        }
+    }
+    return image;
+}
+
+static double percentile(std::vector<uint64_t> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    return (double)v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+static int loopback(int bundleKb, int patches, int corruptEvery) {
+    int master, slave;
+    if (openpty(&master, &slave, nullptr, nullptr, nullptr) != 0) {
+        fprintf(stderr, "macropadctl: openpty failed: %s\n", strerror(errno));
+        return 1;
+    }
+    struct termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+
+    LoopbackDevice device;
+    LoopbackLink link = {slave, corruptEvery, 0, 0};
+    std::atomic<bool> stop(false);
+    std::thread deviceThread(runDevice, &device, &link, &stop);
+
+    ProtocolClient client(master);
+    int failures = 0;
+    if (!client.connect()) failures++;
+
+    // Full bundle upload
+    std::vector<uint8_t> image = syntheticBundle((size_t)bundleKb * 1024);
+    uint64_t start = nowMicros();
+    bool uploaded = failures == 0 && client.upload(image) && client.request(FRAME_BUNDLE_END);
+    double seconds = (nowMicros() - start) / 1e6;
+    if (!uploaded || device.installed != image) {
+        printf("upload: FAILED\n");
+        failures++;
+    } else {
+        size_t frames = (image.size() + SERIAL_BUNDLE_CHUNK - 1) / SERIAL_BUNDLE_CHUNK;
+        printf("upload:  %zu bytes in %.3f s = %.0f KB/s (%zu frames, window %d)\n",
+            image.size(), seconds, image.size() / seconds / 1024, frames, SERIAL_PROTOCOL_WINDOW);
+
+        // What the same frames cost on the real UART (8N1: 10 bits per byte)
+        uint8_t frame[SERIAL_FRAME_MAX_ENCODED];
+        size_t wire = encodeFrame(FRAME_BUNDLE_DATA, 0, &image[0], SERIAL_PROTOCOL_MAX_PAYLOAD, frame);
+        double lineRate = SERIAL_PROTOCOL_BAUD / 10.0;
+        printf("         %.1f%% framing efficiency, line-limited to %.0f KB/s at %d baud\n",
+            100.0 * SERIAL_BUNDLE_CHUNK / wire, lineRate * SERIAL_BUNDLE_CHUNK / wire / 1024,
+            SERIAL_PROTOCOL_BAUD);
+    }
+
+    // Patches one at a time: send -> applied to the log -> ack
+    std::vector<uint64_t> rtt, applied;
+    char label[16];
+    for (int i = 0; i < patches && !client.failed(); i++) {
+        snprintf(label, sizeof(label), "P%d", i);
+        Macro m = Macro::combo(label, "Patched", MODIFIER_CTRL, KEY_A + i % 26);
+        if (!client.setButton((uint16_t)(i % PROFILE_COUNT), (uint8_t)(i % 16), m) ||
+            !client.drain()) {
+            break;
+        }
+        rtt.push_back(client.lastAck().rttUs);
+        applied.push_back(client.lastAck().deviceUs);
+    }
+
+    // Pipelined patches, a full window in flight
+    std::map<std::pair<int, int>, std::string> expected;
+    start = nowMicros();
+    for (int i = 0; i < patches && !client.failed(); i++) {
+        snprintf(label, sizeof(label), "Q%d", i);
+        int profile = i % PROFILE_COUNT, button = (i * 7) % 16;
+        client.setButton((uint16_t)profile, (uint8_t)button,
+                         Macro::singleKey(label, "Pipelined", KEY_B));
+        expected[std::make_pair(profile, button)] = label;
+    }
+    client.drain();
+    double pipelined = (nowMicros() - start) / 1e6;
+
+    // The last pipelined value of every touched button must be in the log
+    for (const auto& e : expected) {
+        Profile p;
+        device.log().apply(e.first.first, p);
+        const char* got = p.buttons[e.first.second].label;
+        if (got == nullptr || e.second != got) {
+            printf("patch: profile %d button %d is \"%s\", expected \"%s\"\n",
+                e.first.first, e.first.second, got ? got : "", e.second.c_str());
+            failures++;
+            break;
+        }
+    }
+    if (client.failed()) failures++;
+
+    if (!rtt.empty()) {
+        printf("patch:   %zu sequential, round trip p50 %.0f us, p99 %.0f us, max %.0f us\n",
+            rtt.size(), percentile(rtt, 0.5), percentile(rtt, 0.99), percentile(rtt, 1.0));
+        printf("         applied on device in p50 %.0f us, max %.0f us\n",
+            percentile(applied, 0.5), percentile(applied, 1.0));
+        printf("         %d pipelined in %.3f s = %.0f patches/s\n",
+            patches, pipelined, patches / pipelined);
+    }
+    // Metrics snapshot over several pages, equal to what the device froze
+    MetricsSnapshot snap;
+    int pages = failures == 0 ? client.fetchMetrics(snap.m, snap.uptimeMs) : 0;
+    bool same = pages > 1;
+    for (int id = 0; id < METRIC_COUNT && same; id++) {
+        const MetricValue& want = device.registry.frozen((MetricId)id);
+        const MetricValue& got = snap.m[id];
+        same = got.value == want.value && got.sum == want.sum && got.max == want.max &&
+               memcmp(got.buckets, want.buckets, sizeof(got.buckets)) == 0 &&
+               (metricKindOf(id) != METRIC_GAUGE || got.min == want.min);
+    }
+    if (!same) {
+        printf("metrics: FAILED (%d pages)\n", pages);
+        failures++;
+    } else {
+        const MetricValue& loop = snap.m[METRIC_LOOP_PERIOD_US];
+        printf("metrics: %d metrics in %d pages, device loop p50 <%lu us over %lu passes\n",
+            (int)METRIC_COUNT, pages, (unsigned long)loop.percentile(0.5) + 1,
+            (unsigned long)loop.value);
+    }
+
+    printf("link:    %u frames to device, %u corrupted, %u resends\n",
+        link.framesIn, link.corrupted, client.resends());
+
+    stop = true;
+    deviceThread.join();
+    close(master);
+    close(slave);
+    printf("loopback: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
+
+// ==============================================================================
+// Commands
+// ==============================================================================
+static int parseNumber(const char* s) {
+    return (int)strtol(s, nullptr, 0);
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& out) {
+    FILE* f = fopen(path, "rb");
+    if (f == nullptr) return false;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+static int usage() {
+    fprintf(stderr,
+        "usage: macropadctl [-p port] [-b baud] info\n"
+        "       macropadctl [-p port] [-b baud] ping [count]\n"
+        "       macropadctl [-p port] [-b baud] upload <bundle.bin>\n"
+        "       macropadctl [-p port] [-b baud] set <profile> <button> <label> <sublabel> "
+        "<mods> <key>...\n"
+        "       macropadctl [-p port] [-b baud] text <profile> <button> <label> <text>\n"
+        "       macropadctl [-p port] [-b baud] clear <profile> <button>\n"
+        "       macropadctl [-p port] [-b baud] metrics [snapshot-file]\n"
+        "       macropadctl metrics-diff <before> <after>\n"
+        "       macropadctl loopback [bundle-kb] [patches] [corrupt-every]\n");
+    return 2;
+}
+
+static int runCommand(ProtocolClient& client, int argc, char** argv) {
+    const char* cmd = argv[0];
+    if (!client.connect()) return 1;
+
+    if (strcmp(cmd, "info") == 0) {
+        const ProtocolInfo& info = client.info();
+        printf("protocol %u, window %u, %u byte payloads, max bundle %lu bytes\n",
+            info.version, info.window, info.maxPayload, (unsigned long)info.maxBundle);
+        printf("%u profiles (showing %u), bundle crc %08lX, %u edited buttons\n",
+            info.profileCount, info.currentProfile, (unsigned long)info.bundleCrc,
+            info.editedButtons);
+        return 0;
+    }
+
+    if (strcmp(cmd, "ping") == 0) {
+        int count = argc > 1 ? parseNumber(argv[1]) : 10;
+        std::vector<uint64_t> rtt;
+        for (int i = 0; i < count; i++) {
+            if (!client.request(FRAME_PING)) return 1;
+            rtt.push_back(client.lastAck().rttUs);
+        }
+        printf("%d pings: p50 %.0f us, max %.0f us\n",
+            count, percentile(rtt, 0.5), percentile(rtt, 1.0));
+        return 0;
+    }
+
+    if (strcmp(cmd, "upload") == 0 && argc == 2) {
+        std::vector<uint8_t> image;
+        if (!readFile(argv[1], image)) {
+            fprintf(stderr, "macropadctl: cannot read %s\n", argv[1]);
+            return 1;
+        }
+        ProfileBundleView view;
+        BundleError err = view.open(image.data(), image.size());
+        if (err != BUNDLE_OK) {
+            fprintf(stderr, "macropadctl: %s: %s\n", argv[1], bundleErrorName(err));
+            return 1;
+        }
+        uint64_t start = nowMicros();
+        if (!client.upload(image) || !client.request(FRAME_BUNDLE_END)) return 1;
+        double seconds = (nowMicros() - start) / 1e6;
+        printf("uploaded %zu bytes (%u profiles) in %.2f s = %.1f KB/s, %u resends; "
+               "device is flashing it\n",
+            image.size(), view.profileCount(), seconds, image.size() / seconds / 1024,
+            client.resends());
+        return 0;
+    }
+
+    if ((strcmp(cmd, "set") == 0 && argc >= 7) || (strcmp(cmd, "text") == 0 && argc == 5)) {
+        Macro m;
+        if (cmd[0] == 's') {
+            uint8_t keys[6] = {0};
+            int count = std::min(argc - 6, 6);
+            for (int i = 0; i < count; i++) keys[i] = (uint8_t)parseNumber(argv[6 + i]);
+            uint8_t mods = (uint8_t)parseNumber(argv[5]);
+            if (count > 1) {
+                m = Macro::sequence(argv[3], argv[4], mods, keys, (uint8_t)count);
+            } else if (mods) {
+                m = Macro::combo(argv[3], argv[4], mods, keys[0]);
+            } else {
+                m = Macro::singleKey(argv[3], argv[4], keys[0]);
+            }
+        } else {
+            m = Macro::textMacro(argv[3], argv[4]);
+        }
+        uint64_t start = nowMicros();
+        if (!client.setButton((uint16_t)parseNumber(argv[1]), (uint8_t)parseNumber(argv[2]), m) ||
+            !client.drain()) {
+            return 1;
+        }
+        printf("applied in %lu us (device %lu us)\n",
+            (unsigned long)(nowMicros() - start), (unsigned long)client.lastAck().deviceUs);
+        return 0;
+    }
+
+    if (strcmp(cmd, "clear") == 0 && argc == 3) {
+        if (!client.clearButton((uint16_t)parseNumber(argv[1]), (uint8_t)parseNumber(argv[2])) ||
+            !client.drain()) {
+            return 1;
+        }
+        printf("cleared\n");
+        return 0;
+    }
+
+    if (strcmp(cmd, "metrics") == 0 && argc <= 2) {
+        MetricsSnapshot snap;
+        if (client.fetchMetrics(snap.m, snap.uptimeMs) == 0) return 1;
+        printSnapshot(snap);
+        if (argc == 2 && !saveSnapshot(argv[1], snap)) {
+            fprintf(stderr, "macropadctl: cannot write %s\n", argv[1]);
+            return 1;
+        }
+        return 0;
+    }
+
+    return usage();
+}
+
+int main(int argc, char** argv) {
+    const char* port = "/dev/ttyUSB0";
+    int baud = SERIAL_PROTOCOL_BAUD;
+    int i = 1;
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (strcmp(argv[i], "-p") == 0) port = argv[i + 1];
+        else if (strcmp(argv[i], "-b") == 0) baud = parseNumber(argv[i + 1]);
+        else return usage();
+    }
+    if (i >= argc) return usage();
+
+    if (strcmp(argv[i], "loopback") == 0) {
+        return loopback(argc > i + 1 ? parseNumber(argv[i + 1]) : 64,
+                        argc > i + 2 ? parseNumber(argv[i + 2]) : 200,
+                        argc > i + 3 ? parseNumber(argv[i + 3]) : 0);
+    }
+
+    if (strcmp(argv[i], "metrics-diff") == 0) {
+        MetricsSnapshot before, after;
+        if (argc != i + 3 || !loadSnapshot(argv[i + 1], before) ||
+            !loadSnapshot(argv[i + 2], after)) {
+            return usage();
+        }
+        printDiff(before, after);
+        return 0;
+    }
+
+    int fd = openPort(port, baud);
+    if (fd < 0) return 1;
+    ProtocolClient client(fd);
+    int result = runCommand(client, argc - i, argv + i);
+    close(fd);
+    return result;
+}
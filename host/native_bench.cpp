@@ -0,0 +1,354 @@
+// ==============================================================================
+// native_bench - Host microbenchmarks of the UI and macro code (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -Ihost/shims -o native_bench host/native_bench.cpp
+//   or: pio run -e native && .pio/build/native/program
+//
+// Usage:
+//   native_bench [filter]                 run the benchmarks whose name contains `filter`
+//   native_bench compare base new [pct]   compare two saved runs (default threshold 10%)
+//
+// Compiles the firmware's own MacroPadUI, profile store, report queue and
+// macro executor against the shims in host/shims: a memory canvas stands in
+// for the panel and a counting transport for the HID stack.
+//
+// Each benchmark is calibrated to run for BENCH_TARGET_MS, then timed
+// BENCH_TRIALS times; the median and the fastest trial are reported. Output
+// is one line per benchmark, always in the same order and format:
+//
+//   name=<bench> ns_per_op=<median> min_ns_per_op=<fastest> iterations=<n> check=<hex>
+//
+// `check` is a checksum of what the first BENCH_CHECK_OPS operations
+// produced (the canvas, for rendering). It does not depend on timing, so
+// when it differs between two commits the code does something different,
+// not just faster or slower. `compare` prints the change per benchmark and
+// exits 1 if any got slower than the threshold; it goes by the fastest
+// trial, which scheduler noise only ever pushes up.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include <LovyanGFX.hpp>
+
+// What LGFX_Setup.hpp declares on the device
+class LGFX : public lgfx::LGFX_Device {
+public:
+    LGFX() : lgfx::LGFX_Device(480, 480) {}
+};
+
+#include "Macros.hpp"
+#include "ProfileStore.hpp"
+#include "MacroPadUI.hpp"
+#include "HidTransport.hpp"
+#include "MacroExecutor.hpp"
+
+#define BENCH_TARGET_MS     20
+#define BENCH_TRIALS        7
+#define BENCH_CHECK_OPS     256
+
+static uint32_t fold(uint32_t h, uint32_t v) {
+    return (h ^ v) * 16777619u;
+}
+
+// ==============================================================================
+// Fixtures
+// ==============================================================================
+
+// Accepts everything at once, like the USB transport with the host polling
+// faster than reports arrive; hashes what it is given
+class BenchTransport : public HidTransport {
+public:
+    uint32_t hash;
+
+    BenchTransport() : hash(2166136261u) {}
+
+    const char* name() const override { return "bench"; }
+    bool begin() override { return true; }
+    int sendable() override { return -1; }
+    bool completesOnSend() const override { return true; }
+
+    bool sendReport(const HidReport& report) override {
+        if (!HidTransport::sendReport(report)) return false;
+        onCompleted();
+        return true;
+    }
+
+protected:
+    bool sendKeyboardReport(uint8_t modifiers, const uint8_t keys[6]) override {
+        hash = fold(hash, modifiers);
+        for (int i = 0; i < 6; i++) hash = fold(hash, keys[i]);
+        return true;
+    }
+
+    bool sendConsumerReport(uint8_t low, uint8_t high) override {
+        hash = fold(fold(hash, low), high);
+        return true;
+    }
+
+    uint32_t clockUs() override { return 0; }
+};
+
+// The built-ins served through the cache, as imported profiles are
+class CopiedProfileSource : public BuiltinProfileSource {
+public:
+    const Profile* resident(int) const override { return nullptr; }
+};
+
+static LGFX tft;
+static BuiltinProfileSource builtinSource;
+static CopiedProfileSource copiedSource;
+static ProfileStore store;
+static ProfileStore copiedStore;
+static MacroPadUI* ui = nullptr;
+
+static BenchTransport transport;
+static HidReportQueue reports(&transport);
+static MacroExecutor executor(&reports);
+static uint32_t execNowMs = 0;
+
+// Touch points spread over the whole panel (header and footer included)
+static int32_t touchX[1024];
+static int32_t touchY[1024];
+
+static void setupFixtures() {
+    store.begin(&builtinSource);
+    copiedStore.begin(&copiedSource);
+    static MacroPadUI instance(&tft, &store);
+    ui = &instance;
+    ui->init();
+
+    uint32_t seed = 12345;
+    for (int i = 0; i < 1024; i++) {
+        seed = seed * 1103515245u + 12345u;
+        touchX[i] = (seed >> 8) % SCREEN_WIDTH;
+        seed = seed * 1103515245u + 12345u;
+        touchY[i] = (seed >> 8) % SCREEN_HEIGHT;
+    }
+
+    reports.open();
+}
+
+// What sendMacro() and serviceMacros() in main.cpp do, run to completion.
+// The clock jumps past every hold and gap, so only the expansion is timed.
+// Returns a hash of this macro's reports alone, so `check` does not depend
+// on how many runs calibration made before it.
+static uint32_t runMacro(const Macro& macro) {
+    transport.hash = 2166136261u;
+    executor.enqueue(macro, true);
+    do {
+        executor.service(execNowMs);
+        reports.service(execNowMs);
+        while (executor.takeTouchReport()) {}
+        execNowMs += MACRO_COMBO_HOLD_MS + MACRO_SEQUENCE_GAP_MS;
+    } while (executor.isBusy() || !reports.isEmpty());
+    return transport.hash;
+}
+
+// ==============================================================================
+// Benchmarks
+// ==============================================================================
+
+static const uint8_t SEQUENCE_KEYS[] = {KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F};
+static const Macro MACRO_KEY = Macro::singleKey("Key", "A", KEY_A);
+static const Macro MACRO_COMBO = Macro::combo("Copy", "Ctrl+C", MODIFIER_CTRL, KEY_C);
+static const Macro MACRO_SEQUENCE = Macro::sequence("Seq", "A-F", MODIFIER_NONE, SEQUENCE_KEYS, 6);
+static const Macro MACRO_MEDIA = Macro::media("Vol +", KEY_MEDIA_VOLUME_UP);
+static const Macro MACRO_TEXT = Macro::textMacro(
+    "Text", "The quick brown fox jumps over the lazy dog, 0123456789 times!");
+
+// Successor of hidToBleKey(): character to HID usage and shift
+static uint32_t benchAsciiToHid(uint32_t i) {
+    uint8_t key = 0, modifiers = 0;
+    asciiToHid((char)(0x20 + i % 95), key, modifiers);
+    return key | modifiers << 8;
+}
+
+static uint32_t benchHitTest(uint32_t i) {
+    return (uint32_t)(ui->getButtonAt(touchX[i % 1024], touchY[i % 1024]) + 1);
+}
+
+static uint32_t benchButtonLayout(uint32_t i) {
+    ui->updateButtonLayout();
+    return (uint32_t)(ui->getButtonAt(touchX[i % 1024], touchY[i % 1024]) + 1);
+}
+
+static uint32_t benchProfileTable(uint32_t i) {
+    const Profile& p = getAllProfiles()[i % PROFILE_COUNT];
+    const Macro& m = p.buttons[i % (p.gridRows * p.gridCols)];
+    return (uint32_t)m.type | (uint32_t)m.keys[0] << 8 | (uint32_t)strlen(m.label) << 16;
+}
+
+static uint32_t benchProfileLoad(uint32_t i) {
+    static Profile profile;
+    builtinSource.load(i % PROFILE_COUNT, profile);
+    return profile.gridRows * profile.gridCols;
+}
+
+// Built-ins are resident: no copy
+static uint32_t benchProfileStore(uint32_t i) {
+    const Profile& p = store.get(i % PROFILE_COUNT);
+    return p.gridRows | p.gridCols << 8;
+}
+
+// Walks more profiles than PROFILE_CACHE_SLOTS holds, so every get() misses
+static uint32_t benchProfileStoreMiss(uint32_t i) {
+    const Profile& p = copiedStore.get(i % PROFILE_COUNT);
+    return p.gridRows | p.gridCols << 8;
+}
+
+static uint32_t benchRenderFull(uint32_t) {
+    ui->drawScreen();
+    return 0;
+}
+
+static uint32_t benchProfileSwitch(uint32_t) {
+    ui->nextProfile();
+    return (uint32_t)ui->getCurrentProfileIndex();
+}
+
+static uint32_t benchMacroKey(uint32_t) { return runMacro(MACRO_KEY); }
+static uint32_t benchMacroCombo(uint32_t) { return runMacro(MACRO_COMBO); }
+static uint32_t benchMacroSequence(uint32_t) { return runMacro(MACRO_SEQUENCE); }
+static uint32_t benchMacroMedia(uint32_t) { return runMacro(MACRO_MEDIA); }
+static uint32_t benchMacroText(uint32_t) { return runMacro(MACRO_TEXT); }
+
+struct Bench {
+    const char* name;
+    uint32_t (*op)(uint32_t i);
+    bool canvas;                // Checksum the canvas rather than the results
+};
+
+static const Bench BENCHES[] = {
+    {"ascii_to_hid",       benchAsciiToHid,        false},
+    {"hit_test",           benchHitTest,           false},
+    {"button_layout",      benchButtonLayout,      false},
+    {"profile_table",      benchProfileTable,      false},
+    {"profile_load",       benchProfileLoad,       false},
+    {"profile_store_get",  benchProfileStore,      false},
+    {"profile_store_miss", benchProfileStoreMiss,  false},
+    {"render_full",        benchRenderFull,        true},
+    {"profile_switch",     benchProfileSwitch,     true},
+    {"macro_key",          benchMacroKey,          false},
+    {"macro_combo",        benchMacroCombo,        false},
+    {"macro_sequence",     benchMacroSequence,     false},
+    {"macro_media",        benchMacroMedia,        false},
+    {"macro_text",         benchMacroText,         false},
+};
+
+// ==============================================================================
+// Runner
+// ==============================================================================
+
+static volatile uint32_t sink;
+
+static double timeOps(const Bench& bench, uint64_t n) {
+    auto start = std::chrono::steady_clock::now();
+    uint32_t h = 0;
+    for (uint64_t i = 0; i < n; i++) h += bench.op((uint32_t)i);
+    auto end = std::chrono::steady_clock::now();
+    sink = h;
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+static void runBench(const Bench& bench) {
+    // Same starting state for every benchmark
+    ui->setProfile(0);
+    ui->drawScreen();
+
+    uint32_t check = 2166136261u;
+    for (uint32_t i = 0; i < BENCH_CHECK_OPS; i++) {
+        check = fold(check, bench.op(i));
+        if (bench.canvas) check = fold(check, tft.checksum());
+    }
+
+    uint64_t n = 1;
+    while (timeOps(bench, n) < BENCH_TARGET_MS * 1e6 && n < (1ull << 40)) n *= 2;
+
+    std::vector<double> perOp;
+    for (int t = 0; t < BENCH_TRIALS; t++) perOp.push_back(timeOps(bench, n) / (double)n);
+    std::sort(perOp.begin(), perOp.end());
+
+    printf("name=%s ns_per_op=%.2f min_ns_per_op=%.2f iterations=%llu check=%08x\n", bench.name,
+           perOp[BENCH_TRIALS / 2], perOp[0], (unsigned long long)n, check);
+    fflush(stdout);
+}
+
+// ==============================================================================
+// Compare
+// ==============================================================================
+
+struct Result {
+    std::string name;
+    double minNsPerOp;
+    unsigned check;
+};
+
+static bool loadResults(const char* path, std::vector<Result>& out) {
+    FILE* f = fopen(path, "r");
+    if (f == nullptr) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char name[64];
+        double ns, minNs;
+        unsigned long long iterations;
+        unsigned check;
+        if (sscanf(line, "name=%63s ns_per_op=%lf min_ns_per_op=%lf iterations=%llu check=%x",
+                   name, &ns, &minNs, &iterations, &check) == 5) {
+            out.push_back({name, minNs, check});
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static int compare(const char* basePath, const char* newPath, double thresholdPct) {
+    std::vector<Result> base, current;
+    if (!loadResults(basePath, base) || !loadResults(newPath, current)) return 2;
+
+    int regressions = 0;
+    printf("%-20s %12s %12s %8s\n", "benchmark", "base ns", "new ns", "change");
+    for (const Result& r : current) {
+        const Result* b = nullptr;
+        for (const Result& candidate : base) {
+            if (candidate.name == r.name) b = &candidate;
+        }
+        if (b == nullptr) {
+            printf("%-20s %12s %12.2f %8s\n", r.name.c_str(), "-", r.minNsPerOp, "new");
+            continue;
+        }
+        double was = b->minNsPerOp, now = r.minNsPerOp;
+        double change = was > 0 ? (now - was) * 100.0 / was : 0;
+        bool slower = change > thresholdPct;
+        if (slower) regressions++;
+        printf("%-20s %12.2f %12.2f %+7.1f%%%s%s\n", r.name.c_str(), was, now, change,
+               slower ? "  SLOWER" : "", b->check != r.check ? "  (output changed)" : "");
+    }
+    printf("%d regression(s) over %.1f%%\n", regressions, thresholdPct);
+    return regressions > 0 ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "compare") == 0) {
+        if (argc < 4) {
+            fprintf(stderr, "Usage: native_bench compare base new [pct]\n");
+            return 2;
+        }
+        return compare(argv[2], argv[3], argc >= 5 ? atof(argv[4]) : 10.0);
+    }
+
+    const char* filter = argc >= 2 ? argv[1] : "";
+    setupFixtures();
+    for (const Bench& bench : BENCHES) {
+        if (strstr(bench.name, filter) != nullptr) runBench(bench);
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+// ==============================================================================
+// profile_json_bench - Streaming profile JSON benchmark (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -o profile_json_bench host/profile_json_bench.cpp
+//
+// Usage:
+//   profile_json_bench [profiles] [chunk]     defaults: 100 profiles, 512-byte chunks
+//
+// Exports `profiles` profiles (the built-ins, repeated) with ProfileJsonWriter,
+// parses the document back in chunks with ProfileJsonReader, and reports
+// throughput and peak memory. Heap use is measured by counting operator new;
+// the reader itself must not allocate, so its footprint is its object size.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+#include "Macros.hpp"
+#include "ProfileJson.hpp"
+
+static size_t heapInUse = 0;
+static size_t heapPeak = 0;
+static size_t heapAllocations = 0;
+
+// Sizes come from malloc_usable_size() (glibc) rather than a header in front
+// of the block, so new and delete hand back exactly what malloc returned
+void* operator new(size_t size) {
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) throw std::bad_alloc();
+    heapInUse += malloc_usable_size(p);
+    heapAllocations++;
+    if (heapInUse > heapPeak) heapPeak = heapInUse;
+    return p;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr == nullptr) return;
+    heapInUse -= malloc_usable_size(ptr);
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+static const Profile* builtinAt(int index, void*) {
+    return &BUILTIN_PROFILES[index % PROFILE_COUNT];
+}
+
+struct SinkStats {
+    uint32_t profiles;
+    uint32_t buttons;
+};
+
+static bool countProfile(const Profile& profile, void* context) {
+    SinkStats* stats = (SinkStats*)context;
+    stats->profiles++;
+    for (int i = 0; i < profile.gridRows * profile.gridCols; i++) {
+        if (profile.buttons[i].type != MACRO_TYPE_NONE) stats->buttons++;
+    }
+    return true;
+}
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 100;
+    size_t chunk = argc > 2 ? (size_t)atoi(argv[2]) : 512;
+    if (count <= 0 || chunk == 0 || chunk > 65536) {
+        fprintf(stderr, "usage: profile_json_bench [profiles] [chunk]\n");
+        return 2;
+    }
+
+    // Export (document kept in memory only to feed the parser)
+    std::string json;
+    json.reserve((size_t)count * 4096);
+    std::vector<char> buffer(chunk);
+
+    auto start = std::chrono::steady_clock::now();
+    ProfileJsonWriter writer(builtinAt, nullptr, count);
+    size_t n;
+    while ((n = writer.read(buffer.data(), chunk)) > 0) {
+        json.append(buffer.data(), n);
+    }
+    double writeMs = msSince(start);
+
+    // Import, measuring only what the reader allocates
+    SinkStats stats = {0, 0};
+    ProfileJsonReader* reader = new ProfileJsonReader(countProfile, &stats);
+    size_t heapBefore = heapInUse;
+    size_t allocationsBefore = heapAllocations;
+    heapPeak = heapInUse;
+
+    start = std::chrono::steady_clock::now();
+    for (size_t pos = 0; pos < json.size(); pos += chunk) {
+        size_t len = json.size() - pos < chunk ? json.size() - pos : chunk;
+        if (reader->feed(json.data() + pos, len) != JSON_OK) break;
+    }
+    JsonError err = reader->finish();
+    double readMs = msSince(start);
+
+    if (err != JSON_OK || stats.profiles != (uint32_t)count) {
+        fprintf(stderr, "parse failed at byte %zu: %s (%u profiles read)\n",
+            reader->offset(), reader->errorMessage(), stats.profiles);
+        return 1;
+    }
+
+    printf("profiles:        %d (%u buttons)\n", count, stats.buttons);
+    printf("document:        %zu bytes\n", json.size());
+    printf("chunk:           %zu bytes\n", chunk);
+    printf("export:          %.2f ms (%.1f MB/s)\n", writeMs, json.size() / writeMs / 1000.0);
+    printf("import:          %.2f ms (%.1f MB/s)\n", readMs, json.size() / readMs / 1000.0);
+    printf("reader state:    %zu bytes (arena %u, token %u, one Profile %zu)\n",
+        sizeof(ProfileJsonReader), (unsigned)PROFILE_JSON_ARENA_SIZE,
+        (unsigned)JSON_MAX_TOKEN, sizeof(Profile));
+    printf("arena peak:      %zu bytes\n", reader->arenaPeak());
+    printf("writer state:    %zu bytes\n", sizeof(ProfileJsonWriter));
+    printf("import heap:     %zu bytes peak, %zu allocations\n",
+        heapPeak - heapBefore, heapAllocations - allocationsBefore);
+    printf("peak memory:     %zu bytes (reader + chunk buffer + heap)\n",
+        sizeof(ProfileJsonReader) + chunk + (heapPeak - heapBefore));
+
+    delete reader;
+    return 0;
+}
@@ -0,0 +1,208 @@
+// ==============================================================================
+// profilec - Profile bundle compiler/validator (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -o profilec host/profilec.cpp
+//
+// Usage:
+//   profilec build <out.bin>      Compile the built-in profiles into a bundle
+//   profilec validate <in.bin>    Map and validate a bundle (exit code 0 = valid)
+//   profilec dump <in.bin>        Validate and print every profile
+//   profilec import <in.json> <out.bin>   Compile a JSON profile set into a bundle
+//   profilec export <in.bin> <out.json>   Write a bundle's profiles as JSON
+//
+// Flash a bundle to the "profiles" partition (offset from partitions.csv):
+//   esptool.py write_flash 0x310000 profiles.bin
+
+#include <stdio.h>
+#include <string.h>
+#include "Macros.hpp"
+#include "ProfileBundle.hpp"
+#include "ProfileJson.hpp"
+
+static int writeBundle(const ProfileBundleBuilder& builder, const char* outPath) {
+    std::vector<uint8_t> bundle = builder.build();
+
+    // Round-trip through the firmware reader before writing anything
+    ProfileBundleView view;
+    BundleError err = view.open(bundle.data(), bundle.size());
+    if (err != BUNDLE_OK) {
+        fprintf(stderr, "profilec: built bundle does not validate: %s\n", bundleErrorName(err));
+        return 1;
+    }
+
+    FILE* f = fopen(outPath, "wb");
+    if (f == nullptr || fwrite(bundle.data(), 1, bundle.size(), f) != bundle.size()) {
+        fprintf(stderr, "profilec: cannot write %s\n", outPath);
+        if (f) fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    printf("%s: %u profiles, %u macros, %zu bytes (vs %zu bytes as Profile structs)\n",
+        outPath, view.profileCount(), view.macroCount(), bundle.size(),
+        (size_t)view.profileCount() * sizeof(Profile));
+    return 0;
+}
+
+static int buildBuiltin(const char* outPath) {
+    ProfileBundleBuilder builder;
+    for (int i = 0; i < PROFILE_COUNT; i++) {
+        builder.addProfile(BUILTIN_PROFILES[i]);
+    }
+    return writeBundle(builder, outPath);
+}
+
+static bool addToBuilder(const Profile& profile, void* context) {
+    static_cast<ProfileBundleBuilder*>(context)->addProfile(profile);
+    return true;
+}
+
+// Streams the file through the same fixed-memory reader the firmware uses
+static int importJson(const char* inPath, const char* outPath) {
+    FILE* f = fopen(inPath, "rb");
+    if (f == nullptr) {
+        fprintf(stderr, "profilec: cannot open %s\n", inPath);
+        return 1;
+    }
+
+    ProfileBundleBuilder builder;
+    ProfileJsonReader reader(addToBuilder, &builder);
+    char chunk[512];
+    size_t n;
+    JsonError err = JSON_OK;
+    while (err == JSON_OK && (n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        err = reader.feed(chunk, n);
+    }
+    fclose(f);
+    if (err == JSON_OK) err = reader.finish();
+
+    if (err != JSON_OK) {
+        fprintf(stderr, "%s: byte %zu: %s\n", inPath, reader.offset(), reader.errorMessage());
+        return 1;
+    }
+    if (builder.profileCount() == 0) {
+        fprintf(stderr, "%s: no profiles\n", inPath);
+        return 1;
+    }
+    return writeBundle(builder, outPath);
+}
+
+struct ExportSource {
+    const ProfileBundleView* view;
+    Profile profile;
+};
+
+static const Profile* decodeForExport(int index, void* context) {
+    ExportSource* src = (ExportSource*)context;
+    src->view->decodeProfile((uint32_t)index, src->profile);
+    return &src->profile;
+}
+
+static int exportJson(const char* inPath, const char* outPath) {
+    MappedProfileBundle mapped;
+    BundleError err = mapped.map(inPath);
+    if (err != BUNDLE_OK) {
+        fprintf(stderr, "%s: invalid: %s\n", inPath, bundleErrorName(err));
+        return 1;
+    }
+
+    FILE* f = fopen(outPath, "wb");
+    if (f == nullptr) {
+        fprintf(stderr, "profilec: cannot write %s\n", outPath);
+        return 1;
+    }
+
+    ExportSource src;
+    src.view = &mapped.view();
+    ProfileJsonWriter writer(decodeForExport, &src, (int)mapped.view().profileCount());
+    char chunk[512];
+    size_t n;
+    while ((n = writer.read(chunk, sizeof(chunk))) > 0) {
+        if (fwrite(chunk, 1, n, f) != n) {
+            fprintf(stderr, "profilec: cannot write %s\n", outPath);
+            fclose(f);
+            return 1;
+        }
+    }
+    fclose(f);
+
+    printf("%s: %d profiles, %zu bytes\n", outPath, writer.profilesWritten(), writer.written());
+    return 0;
+}
+
+static const char* macroTypeName(MacroType type) {
+    switch (type) {
+        case MACRO_TYPE_NONE:     return "none";
+        case MACRO_TYPE_KEY:      return "key";
+        case MACRO_TYPE_COMBO:    return "combo";
+        case MACRO_TYPE_SEQUENCE: return "sequence";
+        case MACRO_TYPE_TEXT:     return "text";
+        case MACRO_TYPE_MEDIA:    return "media";
+        case MACRO_TYPE_HOST:     return "host";
+    }
+    return "?";
+}
+
+static int validateBundle(const char* path, bool dump) {
+    MappedProfileBundle mapped;
+    BundleError err = mapped.map(path);
+    if (err != BUNDLE_OK) {
+        fprintf(stderr, "%s: invalid: %s\n", path, bundleErrorName(err));
+        return 1;
+    }
+
+    const ProfileBundleView& view = mapped.view();
+    printf("%s: valid, version %d, %u profiles, %u macros, %zu bytes, crc %08X\n",
+        path, PROFILE_BUNDLE_VERSION, view.profileCount(), view.macroCount(),
+        view.size(), view.crc());
+
+    if (!dump) return 0;
+
+    Profile p;
+    for (uint32_t i = 0; i < view.profileCount(); i++) {
+        view.decodeProfile(i, p);
+        printf("\n[%u] %s (%dx%d, accent 0x%04X, keyboard %s, unicode %s", i, p.name,
+            p.gridRows, p.gridCols, p.accentColor, keyboardLayoutName(p.keyboardLayout),
+            unicodeInputName(p.unicodeInput));
+        if (p.trackpadRows) printf(", trackpad %d rows", p.trackpadRows);
+        printf(")\n");
+        for (int b = 0; b < p.gridRows * p.gridCols; b++) {
+            const Macro& m = p.buttons[b];
+            if (m.type == MACRO_TYPE_NONE) continue;
+            printf("  %2d %-8s %-16s %-14s mods=0x%02X keys=", b, macroTypeName(m.type),
+                m.label, m.sublabel, m.modifiers);
+            for (int k = 0; k < m.keyCount; k++) printf("%02X ", m.keys[k]);
+            if (m.text) printf("text=\"%s\"", m.text);
+            printf("%s\n", m.fireMode == FIRE_ON_TAP ? " (on tap)"
+                            : m.fireMode == FIRE_HOLD ? " (held)" : "");
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 3 && strcmp(argv[1], "build") == 0) {
+        return buildBuiltin(argv[2]);
+    }
+    if (argc == 3 && strcmp(argv[1], "validate") == 0) {
+        return validateBundle(argv[2], false);
+    }
+    if (argc == 3 && strcmp(argv[1], "dump") == 0) {
+        return validateBundle(argv[2], true);
+    }
+    if (argc == 4 && strcmp(argv[1], "import") == 0) {
+        return importJson(argv[2], argv[3]);
+    }
+    if (argc == 4 && strcmp(argv[1], "export") == 0) {
+        return exportJson(argv[2], argv[3]);
+    }
+
+    fprintf(stderr,
+        "usage: profilec build <out.bin>\n"
+        "       profilec validate <in.bin>\n"
+        "       profilec dump <in.bin>\n"
+        "       profilec import <in.json> <out.bin>\n"
+        "       profilec export <in.bin> <out.json>\n");
+    return 2;
+}
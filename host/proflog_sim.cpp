@@ -0,0 +1,191 @@
+// ==============================================================================
+// proflog_sim - Profile edit log simulator (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -o proflog_sim host/proflog_sim.cpp
+//
+// Usage:
+//   proflog_sim powercut [trials]    Cut power at random points, remount, verify
+//   proflog_sim wa [edits]           Write amplification vs. rewriting the bundle
+//
+// Runs ProfileLog on a RamFlashRegion sized like the "proflog" partition.
+// powercut exits 1 if any remount loses a durable edit or yields an edit
+// that was never made.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "Macros.hpp"
+#include "ProfileBundle.hpp"
+#include "ProfileLog.hpp"
+
+#define SIM_REGION_SIZE 0x10000     // proflog partition in partitions.csv
+#define SIM_PROFILES    PROFILE_COUNT
+#define SIM_BUTTONS     16
+
+typedef std::pair<int, int> ButtonKey;
+
+static Macro editMacro(const char* label) {
+    return Macro::combo(label, "Sim", MODIFIER_CTRL, KEY_A);
+}
+
+// Label of a button after the log's edits ("" = base profile)
+static std::string currentLabel(const ProfileLog& log, int profile, int button) {
+    Profile p;
+    log.apply(profile, p);
+    return p.buttons[button].label ? p.buttons[button].label : "";
+}
+
+// Random edits with one service() per edit, like loop() between touches
+static void randomEdit(ProfileLog& log, std::mt19937& rng, int serial,
+                       std::map<ButtonKey, std::vector<std::string>>* history) {
+    ButtonKey key((int)(rng() % SIM_PROFILES), (int)(rng() % SIM_BUTTONS));
+    std::string label;
+    if (rng() % 8 == 0) {
+        log.clearButton(key.first, key.second);
+    } else {
+        char buf[24];
+        snprintf(buf, sizeof(buf), "e%d", serial);
+        label = buf;
+        log.setButton(key.first, key.second, editMacro(buf));
+    }
+    if (history) {
+        // A button's first edit starts from the base profile
+        if (history->find(key) == history->end()) (*history)[key].push_back("");
+        (*history)[key].push_back(label);
+    }
+    log.service();
+}
+
+static int powerCut(int trials) {
+    std::mt19937 rng(12345);
+    int failures = 0;
+    uint32_t torn = 0, compactionsInterrupted = 0;
+
+    for (int t = 0; t < trials; t++) {
+        RamFlashRegion flash(SIM_REGION_SIZE);
+        ProfileLog* log = new ProfileLog(&flash);
+        log->mount(0x1234);
+
+        // Committed history: per button, values since the last durable point.
+        // The first entry is the durable value; later ones are in flight.
+        std::map<ButtonKey, std::vector<std::string>> history;
+        int serial = 0;
+
+        int warmup = (int)(rng() % 400);
+        for (int i = 0; i < warmup; i++) {
+            randomEdit(*log, rng, serial++, &history);
+        }
+        log->sync();
+        for (auto& h : history) h.second.erase(h.second.begin(), h.second.end() - 1);
+
+        // Keep editing until the power fails somewhere in a write or erase
+        flash.setPowerCutAfter((long)(rng() % 20000));
+        bool wasCompacting = false;
+        while (!flash.isDead()) {
+            randomEdit(*log, rng, serial++, &history);
+            wasCompacting = log->isCompacting();
+            for (int s = 0; s < 4 && !flash.isDead(); s++) log->service();
+            if (log->isDurable()) {
+                for (auto& h : history) h.second.erase(h.second.begin(), h.second.end() - 1);
+            }
+        }
+        if (wasCompacting) compactionsInterrupted++;
+        delete log;
+
+        // Reboot
+        flash.powerRestored();
+        log = new ProfileLog(&flash);
+        if (!log->mount(0x1234)) {
+            printf("trial %d: mount failed\n", t);
+            failures++;
+            delete log;
+            continue;
+        }
+        torn += log->stats().tornRecords;
+
+        for (int p = 0; p < SIM_PROFILES; p++) {
+            for (int b = 0; b < SIM_BUTTONS; b++) {
+                std::string got = currentLabel(*log, p, b);
+                auto it = history.find(ButtonKey(p, b));
+                bool ok;
+                if (it == history.end()) {
+                    ok = got.empty();
+                } else {
+                    ok = false;
+                    for (const std::string& v : it->second) ok = ok || v == got;
+                }
+                if (!ok) {
+                    printf("trial %d: profile %d button %d recovered \"%s\", not a committed value\n",
+                        t, p, b, got.c_str());
+                    failures++;
+                }
+            }
+        }
+
+        // The recovered log must keep working
+        log->setButton(0, 0, editMacro("after"));
+        log->sync();
+        if (currentLabel(*log, 0, 0) != "after" || !log->isDurable()) {
+            printf("trial %d: log unusable after recovery\n", t);
+            failures++;
+        }
+        delete log;
+    }
+
+    printf("powercut: %d trials, %d failures, %u torn tails recovered, "
+           "%u cuts during compaction\n", trials, failures, torn, compactionsInterrupted);
+    return failures ? 1 : 0;
+}
+
+static int writeAmplification(int edits) {
+    std::mt19937 rng(42);
+    RamFlashRegion flash(SIM_REGION_SIZE);
+    ProfileLog* log = new ProfileLog(&flash);
+    log->mount(0x1234);
+    log->sync();
+    flash.resetStats();
+
+    for (int i = 0; i < edits; i++) {
+        randomEdit(*log, rng, i, nullptr);
+        for (int s = 0; s < 8; s++) log->service();
+    }
+    log->sync();
+
+    // Baseline: every edit rewrites the whole bundle (erase + write)
+    ProfileBundleBuilder builder;
+    for (int i = 0; i < PROFILE_COUNT; i++) builder.addProfile(BUILTIN_PROFILES[i]);
+    size_t bundleSize = builder.build().size();
+    size_t bundleErase = (bundleSize + FLASH_SECTOR_SIZE - 1) & ~(size_t)(FLASH_SECTOR_SIZE - 1);
+
+    const ProfileLogStats& ls = log->stats();
+    const FlashRegionStats& fs = flash.stats();
+    printf("edits:              %d (%u logical bytes, %d buttons edited)\n",
+        edits, ls.logicalBytes, log->editCount());
+    printf("log writes:         %u bytes (%u appends, %u compactions, %u compaction bytes)\n",
+        fs.bytesWritten, ls.appends, ls.compactions, ls.compactionBytes);
+    printf("log erases:         %u bytes (%u sectors)\n", fs.bytesErased, fs.erases);
+    printf("write amplification: %.2fx written, %.2f sector erases per 100 edits\n",
+        (double)fs.bytesWritten / ls.logicalBytes, fs.erases * 100.0 / edits);
+    printf("full rewrite:       %zu bytes written + %zu erased per edit (%.1fx written)\n",
+        bundleSize, bundleErase, (double)bundleSize * edits / ls.logicalBytes);
+    delete log;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "powercut") == 0) {
+        return powerCut(argc > 2 ? atoi(argv[2]) : 500);
+    }
+    if (argc >= 2 && strcmp(argv[1], "wa") == 0) {
+        return writeAmplification(argc > 2 ? atoi(argv[2]) : 10000);
+    }
+    fprintf(stderr,
+        "usage: proflog_sim powercut [trials]\n"
+        "       proflog_sim wa [edits]\n");
+    return 2;
+}
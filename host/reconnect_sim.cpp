@@ -0,0 +1,238 @@
+// ==============================================================================
+// reconnect_sim - BLE reconnect engine checks (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -o reconnect_sim host/reconnect_sim.cpp
+//
+// Drives ReconnectEngine and PendingKeystrokes through boot and link-loss
+// scenarios against a scripted host that connects after a given delay in a
+// given advertising phase. Prints one line per scenario and exits 1 if any
+// expectation fails.
+
+#include <stdio.h>
+#include <vector>
+#include "ReconnectEngine.hpp"
+
+struct AdvStart {
+    uint32_t at;
+    AdvPhase phase;
+    bool directed;
+    bool restricted;            // Undirected, white-listed to one host
+};
+
+class MockAdvGap : public AdvertisingGap {
+public:
+    uint32_t now;
+    std::vector<AdvStart> starts;
+
+    MockAdvGap() : now(0) {}
+
+    bool startAdvertising(AdvPhase phase, const BlePeer* peer) override {
+        bool targeted = peer != nullptr && peer->valid;
+        AdvStart s = {now, phase, phase == ADV_PHASE_DIRECTED && targeted,
+                      phase != ADV_PHASE_DIRECTED && targeted};
+        starts.push_back(s);
+        return true;
+    }
+};
+
+// Scripted host: connects once the engine has been in `phase` for `after` ms,
+// then needs `readyAfter` ms of pairing/subscription before reports flow
+struct ScriptedHost {
+    AdvPhase phase;
+    uint32_t after;
+    uint32_t readyAfter;
+    bool failAuth;              // Drops the first link before it gets ready
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* scenario, const char* what) {
+    if (!ok) {
+        printf("  FAIL %s: %s\n", scenario, what);
+        failures++;
+    }
+}
+
+static BlePeer bondedPeer() {
+    BlePeer p;
+    const uint8_t addr[6] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+    memcpy(p.addr, addr, sizeof(addr));
+    p.valid = true;
+    return p;
+}
+
+// Runs 5 ms loop() passes until READY or `limit`; returns the time READY was seen
+static uint32_t runUntilReady(MockAdvGap& gap, ReconnectEngine& engine, ScriptedHost host,
+                              uint32_t limit) {
+    BleLinkStateId state = BLE_LINK_ADVERTISING;
+    uint32_t connectedAt = 0;
+    for (uint32_t end = gap.now + limit; gap.now < end; gap.now += 5) {
+        if (state == BLE_LINK_ADVERTISING && engine.phase() == host.phase &&
+            gap.now - gap.starts.back().at >= host.after) {
+            state = BLE_LINK_CONNECTING;
+            connectedAt = gap.now;
+        } else if (state == BLE_LINK_CONNECTING && gap.now - connectedAt >= host.readyAfter) {
+            if (host.failAuth) {
+                host.failAuth = false;
+                state = BLE_LINK_ADVERTISING;
+            } else {
+                state = BLE_LINK_READY;
+            }
+        }
+        engine.service(state, gap.now);
+        if (state == BLE_LINK_READY) return gap.now;
+    }
+    return 0;
+}
+
+static void loseLink(MockAdvGap& gap, ReconnectEngine& engine) {
+    gap.now += 5;
+    engine.service(BLE_LINK_ADVERTISING, gap.now);
+}
+
+static void report(const char* name, const ReconnectEngine& engine) {
+    const ReconnectStats& s = engine.stats();
+    printf("%-22s boot->ready %lu ms, %lu reconnects (last %lu ms, max %lu ms), "
+           "by phase d/f/s %lu/%lu/%lu, %lu adv starts\n",
+        name, (unsigned long)s.bootToReadyMs, (unsigned long)s.reconnects,
+        (unsigned long)s.lastReconnectMs, (unsigned long)s.maxReconnectMs,
+        (unsigned long)s.byPhase[ADV_PHASE_DIRECTED], (unsigned long)s.byPhase[ADV_PHASE_FAST],
+        (unsigned long)s.byPhase[ADV_PHASE_SLOW], (unsigned long)s.advStarts);
+}
+
+static void bootDirected() {
+    const char* name = "boot-directed";
+    MockAdvGap gap;
+    ReconnectEngine engine(&gap);
+    gap.now = 900;              // Setup time before BLE comes up
+    engine.begin(bondedPeer(), 0, gap.now);
+    expect(gap.starts.size() == 1 && gap.starts[0].directed, name, "did not start directed");
+
+    uint32_t ready = runUntilReady(gap, engine, {ADV_PHASE_DIRECTED, 15, 120, false}, 5000);
+    expect(ready != 0, name, "never ready");
+    expect(engine.stats().bootToReadyMs == ready, name, "boot metric not measured from power-on");
+    expect(engine.stats().byPhase[ADV_PHASE_DIRECTED] == 1, name, "not credited to directed");
+    expect(!engine.isSearching() && engine.phase() == ADV_PHASE_NONE, name, "still advertising");
+    report(name, engine);
+}
+
+static void bootWithoutPeer() {
+    const char* name = "boot-unbonded";
+    MockAdvGap gap;
+    ReconnectEngine engine(&gap);
+    engine.begin(BlePeer(), 0, gap.now);
+    expect(gap.starts.size() == 1 && gap.starts[0].phase == ADV_PHASE_FAST, name,
+        "did not start with fast advertising");
+    uint32_t ready = runUntilReady(gap, engine, {ADV_PHASE_FAST, 3000, 800, false}, 10000);
+    expect(ready != 0 && engine.stats().byPhase[ADV_PHASE_FAST] == 1, name,
+        "not connected on fast advertising");
+    report(name, engine);
+}
+
+static void fallbackToSlow() {
+    const char* name = "fallback-to-slow";
+    MockAdvGap gap;
+    ReconnectEngine engine(&gap);
+    engine.begin(bondedPeer(), 0, gap.now);
+    // Host away: only picks up the slow interval, 10 s into it
+    uint32_t ready = runUntilReady(gap, engine, {ADV_PHASE_SLOW, 10000, 100, false}, 60000);
+    expect(ready != 0, name, "never ready");
+    expect(gap.starts.size() == 3, name, "wrong number of advertising restarts");
+    if (gap.starts.size() == 3) {
+        expect(gap.starts[1].phase == ADV_PHASE_FAST &&
+               gap.starts[1].at - gap.starts[0].at >= RECONNECT_DIRECTED_MS, name,
+            "directed burst too short");
+        expect(gap.starts[2].phase == ADV_PHASE_SLOW &&
+               gap.starts[2].at - gap.starts[1].at >= RECONNECT_FAST_MS, name,
+            "fast phase too short");
+    }
+    expect(engine.stats().byPhase[ADV_PHASE_SLOW] == 1, name, "not credited to slow");
+    report(name, engine);
+}
+
+static void linkLoss() {
+    const char* name = "link-loss";
+    MockAdvGap gap;
+    ReconnectEngine engine(&gap);
+    engine.begin(bondedPeer(), 0, gap.now);
+    runUntilReady(gap, engine, {ADV_PHASE_DIRECTED, 10, 100, false}, 5000);
+
+    for (int i = 0; i < 5; i++) {
+        gap.now += 60000;
+        engine.service(BLE_LINK_READY, gap.now);
+        size_t before = gap.starts.size();
+        uint32_t lostAt = gap.now + 5;
+        loseLink(gap, engine);
+        expect(gap.starts.size() == before + 1 && gap.starts.back().directed, name,
+            "no directed burst after link loss");
+        uint32_t ready = runUntilReady(gap, engine,
+            {ADV_PHASE_DIRECTED, 20, 150 + 20u * i, false}, 5000);
+        expect(engine.stats().lastReconnectMs == ready - lostAt, name,
+            "reconnect metric not measured from link loss");
+    }
+    expect(engine.stats().reconnects == 5, name, "reconnects not counted");
+    expect(engine.stats().maxReconnectMs >= engine.stats().lastReconnectMs, name, "max < last");
+    report(name, engine);
+}
+
+static void failedAttempt() {
+    const char* name = "auth-fails-once";
+    MockAdvGap gap;
+    ReconnectEngine engine(&gap);
+    engine.begin(bondedPeer(), 0, gap.now);
+    runUntilReady(gap, engine, {ADV_PHASE_DIRECTED, 10, 100, false}, 5000);
+    gap.now += 1000;
+    engine.service(BLE_LINK_READY, gap.now);
+    uint32_t lostAt = gap.now + 5;
+    loseLink(gap, engine);
+    uint32_t ready = runUntilReady(gap, engine, {ADV_PHASE_DIRECTED, 10, 200, true}, 5000);
+    expect(ready != 0, name, "never ready");
+    expect(engine.stats().lastReconnectMs == ready - lostAt, name,
+        "failed attempt restarted the clock");
+    report(name, engine);
+}
+
+static void keystrokes() {
+    const char* name = "keystrokes";
+    PendingKeystrokes keys;
+    uint32_t now = 1000;
+    keys.push(0, 3, now);
+    keys.push(0, 4, now + 100);
+    PendingKeystroke k;
+    // Link back 1.5 s later: both still fresh
+    expect(keys.pop(now + 1500, k) && k.button == 3, name, "oldest not replayed first");
+    expect(keys.pop(now + 1500, k) && k.button == 4, name, "second not replayed");
+    expect(!keys.pop(now + 1500, k), name, "phantom keystroke");
+
+    // Stale presses are dropped, fresh ones kept
+    keys.push(1, 0, now);
+    keys.push(1, 1, now + RECONNECT_KEY_MAX_AGE_MS);
+    expect(keys.pop(now + RECONNECT_KEY_MAX_AGE_MS + 500, k) && k.button == 1, name,
+        "stale keystroke replayed");
+    expect(keys.stats().expired == 1, name, "expiry not counted");
+
+    // Overflow keeps the newest
+    for (int i = 0; i < RECONNECT_KEY_BUFFER + 3; i++) keys.push(2, (uint8_t)i, now);
+    expect(keys.count() == RECONNECT_KEY_BUFFER && keys.stats().dropped == 3, name,
+        "overflow not bounded");
+    expect(keys.pop(now, k) && k.button == 3, name, "overflow dropped the wrong end");
+    keys.clear();
+    expect(keys.count() == 0, name, "clear left entries");
+
+    const PendingKeystrokeStats& s = keys.stats();
+    printf("%-22s %lu buffered, %lu replayed, %lu expired, %lu dropped\n", name,
+        (unsigned long)s.buffered, (unsigned long)s.replayed, (unsigned long)s.expired,
+        (unsigned long)s.dropped);
+}
+
+int main() {
+    bootDirected();
+    bootWithoutPeer();
+    fallbackToSlow();
+    linkLoss();
+    failedAttempt();
+    keystrokes();
+    printf("reconnect_sim: %s (%d failures)\n", failures ? "FAILED" : "ok", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// ==============================================================================
+// Arduino Core Shim (native builds)
+// ==============================================================================
+// The few Arduino calls the shared headers make, for host builds such as
+// host/touch_bench.cpp. ARDUINO itself stays undefined, so ProfileStore,
+// FlashRegion and friends take their host paths. millis() and micros() read
+// Clock.hpp, so they follow a simulator's virtual clock too.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "Clock.hpp"
+
+inline uint32_t micros() {
+    return clockMicros();
+}
+
+inline uint32_t millis() {
+    return clockMillis();
+}
+
+using std::min;
+using std::max;
+
+inline void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
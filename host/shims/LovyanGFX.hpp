@@ -0,0 +1,248 @@
+#pragma once
+
+// ==============================================================================
+// LovyanGFX Shim (native builds)
+// ==============================================================================
+// The drawing calls MacroPadUI makes, rendered into a 16-bit memory canvas
+// the size of the panel. Shapes are filled pixel by pixel as the library
+// does in its own canvases; text is stamped as one pattern cell per
+// character at the font's advance and height, so a frame costs about the
+// same pixel work as on the device and its checksum changes whenever the
+// UI draws something different. It is not a font renderer.
+//
+// There is no touch: getTouch() reports whatever setTouch() last set. A
+// simulator can count the pixels each call fills (setDrawHook()) and charge
+// the time the panel would take.
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace fonts {
+    struct ShimFont {
+        uint8_t advance;
+        uint8_t height;
+    };
+    static const ShimFont FreeSans9pt7b = {9, 17};
+    static const ShimFont FreeSansBold9pt7b = {10, 17};
+}
+
+// Same values as lgfx::textdatum_t
+enum textdatum_t : uint8_t {
+    top_left = 0,
+    top_center = 1,
+    top_right = 2,
+    middle_left = 4,
+    middle_center = 5,
+    middle_right = 6,
+    bottom_left = 8,
+    bottom_center = 9,
+    bottom_right = 10
+};
+
+namespace lgfx {
+
+typedef void (*DrawHook)(uint32_t pixels);
+
+class LGFX_Device {
+private:
+    int32_t _width;
+    int32_t _height;
+    std::vector<uint16_t> _fb;
+    const fonts::ShimFont* _font;
+    uint16_t _textColor;
+    uint8_t _datum;
+    uint8_t _textSize;
+    bool _touching;
+    int32_t _touchX;
+    int32_t _touchY;
+    uint64_t _pixels;
+    DrawHook _drawHook;
+
+    // End of a drawing call that started at `before` pixels
+    void drawn(uint64_t before) {
+        if (_drawHook && _pixels != before) _drawHook((uint32_t)(_pixels - before));
+    }
+
+    void span(int32_t x, int32_t y, int32_t w, uint16_t color) {
+        if (y < 0 || y >= _height) return;
+        if (x < 0) {
+            w += x;
+            x = 0;
+        }
+        if (x + w > _width) w = _width - x;
+        if (w <= 0) return;
+        uint16_t* p = &_fb[(size_t)y * _width + x];
+        for (int32_t i = 0; i < w; i++) p[i] = color;
+        _pixels += w;
+    }
+
+    void pixel(int32_t x, int32_t y, uint16_t color) {
+        if (x < 0 || y < 0 || x >= _width || y >= _height) return;
+        _fb[(size_t)y * _width + x] = color;
+        _pixels++;
+    }
+
+    // Horizontal inset of row `dy` (0 = outermost) of a corner of radius r
+    static int32_t cornerInset(int32_t r, int32_t dy) {
+        int32_t ry = r - dy;
+        int32_t dx = 0;
+        while ((dx + 1) * (dx + 1) + ry * ry <= r * r) dx++;
+        return r - dx;
+    }
+
+public:
+    LGFX_Device(int32_t width = 480, int32_t height = 480)
+        : _width(width), _height(height), _fb((size_t)width * height, 0),
+          _font(&fonts::FreeSans9pt7b), _textColor(0xFFFF), _datum(top_left), _textSize(1),
+          _touching(false), _touchX(0), _touchY(0), _pixels(0), _drawHook(nullptr) {}
+
+    bool init() { return true; }
+    void setBrightness(uint8_t) {}
+    int32_t width() const { return _width; }
+    int32_t height() const { return _height; }
+
+    void setTextSize(uint8_t size) { _textSize = size ? size : 1; }
+    void setFont(const fonts::ShimFont* font) { _font = font; }
+    void setTextColor(uint16_t color) { _textColor = color; }
+    void setTextDatum(uint8_t datum) { _datum = datum; }
+
+    int32_t fontHeight() const { return _font->height * _textSize; }
+    int32_t textWidth(const char* text) const {
+        return (int32_t)strlen(text) * _font->advance * _textSize;
+    }
+
+    void fillScreen(uint16_t color) { fillRect(0, 0, _width, _height, color); }
+
+    void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color) {
+        uint64_t before = _pixels;
+        for (int32_t row = 0; row < h; row++) span(x, y + row, w, color);
+        drawn(before);
+    }
+
+    void drawFastHLine(int32_t x, int32_t y, int32_t w, uint16_t color) {
+        uint64_t before = _pixels;
+        span(x, y, w, color);
+        drawn(before);
+    }
+
+    void drawFastVLine(int32_t x, int32_t y, int32_t h, uint16_t color) {
+        uint64_t before = _pixels;
+        for (int32_t row = 0; row < h; row++) pixel(x, y + row, color);
+        drawn(before);
+    }
+
+    void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color) {
+        uint64_t before = _pixels;
+        span(x, y, w, color);
+        span(x, y + h - 1, w, color);
+        for (int32_t row = 1; row < h - 1; row++) {
+            pixel(x, y + row, color);
+            pixel(x + w - 1, y + row, color);
+        }
+        drawn(before);
+    }
+
+    void fillRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint16_t color) {
+        uint64_t before = _pixels;
+        for (int32_t row = 0; row < h; row++) {
+            int32_t edge = row < r ? row : (row >= h - r ? h - 1 - row : r);
+            int32_t inset = edge < r ? cornerInset(r, edge) : 0;
+            span(x + inset, y + row, w - 2 * inset, color);
+        }
+        drawn(before);
+    }
+
+    void drawRoundRect(int32_t x, int32_t y, int32_t w, int32_t h, int32_t r, uint16_t color) {
+        uint64_t before = _pixels;
+        for (int32_t row = 0; row < h; row++) {
+            int32_t edge = row < r ? row : (row >= h - r ? h - 1 - row : r);
+            int32_t inset = edge < r ? cornerInset(r, edge) : 0;
+            if (row == 0 || row == h - 1) {
+                span(x + inset, y + row, w - 2 * inset, color);
+            } else {
+                pixel(x + inset, y + row, color);
+                pixel(x + w - 1 - inset, y + row, color);
+            }
+        }
+        drawn(before);
+    }
+
+    void fillCircle(int32_t cx, int32_t cy, int32_t r, uint16_t color) {
+        uint64_t before = _pixels;
+        for (int32_t dy = -r; dy <= r; dy++) {
+            int32_t inset = cornerInset(r, r - (dy < 0 ? -dy : dy));
+            span(cx - r + inset, cy + dy, 2 * (r - inset) + 1, color);
+        }
+        drawn(before);
+    }
+
+    void drawCircle(int32_t cx, int32_t cy, int32_t r, uint16_t color) {
+        uint64_t before = _pixels;
+        for (int32_t dy = -r; dy <= r; dy++) {
+            int32_t half = r - cornerInset(r, r - (dy < 0 ? -dy : dy));
+            pixel(cx - half, cy + dy, color);
+            pixel(cx + half, cy + dy, color);
+        }
+        drawn(before);
+    }
+
+    // Returns the width drawn, like the library
+    int32_t drawString(const char* text, int32_t x, int32_t y) {
+        int32_t w = textWidth(text);
+        int32_t h = fontHeight();
+        if (_datum & 2) x -= w;
+        else if (_datum & 1) x -= w / 2;
+        if (_datum & 8) y -= h;
+        else if (_datum & 4) y -= h / 2;
+
+        uint64_t before = _pixels;
+        int32_t advance = _font->advance * _textSize;
+        for (const char* c = text; *c; c++, x += advance) {
+            if (*c == ' ') continue;
+            uint32_t bits = (uint8_t)*c * 2654435761u;
+            for (int32_t row = 0; row < h; row++) {
+                for (int32_t col = 0; col < advance - 1; col++) {
+                    if ((bits >> ((row * 7 + col) % 31)) & 1) pixel(x + col, y + row, _textColor);
+                }
+            }
+        }
+        drawn(before);
+        return w;
+    }
+
+    bool getTouch(int32_t* x, int32_t* y) {
+        if (!_touching) return false;
+        *x = _touchX;
+        *y = _touchY;
+        return true;
+    }
+
+    // Shim only: what the next getTouch() returns
+    void setTouch(bool touching, int32_t x = 0, int32_t y = 0) {
+        _touching = touching;
+        _touchX = x;
+        _touchY = y;
+    }
+
+    // Shim only: called after each drawing call with the pixels it filled
+    void setDrawHook(DrawHook hook) { _drawHook = hook; }
+    uint64_t pixelsDrawn() const { return _pixels; }
+
+    // Shim only: the canvas
+    const uint16_t* framebuffer() const { return _fb.data(); }
+
+    // Shim only: FNV-1a over the canvas
+    uint32_t checksum() const {
+        uint32_t h = 2166136261u;
+        for (uint16_t px : _fb) {
+            h = (h ^ (px & 0xFF)) * 16777619u;
+            h = (h ^ (px >> 8)) * 16777619u;
+        }
+        return h;
+    }
+};
+
+}   // namespace lgfx
+
+using lgfx::LGFX_Device;
@@ -0,0 +1,383 @@
+// ==============================================================================
+// touch_bench - Touch filtering and tap resolution on jitter traces (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -Ihost/shims -o touch_bench host/touch_bench.cpp
+//
+// Replays touch traces through the firmware's MacroPadUI (TouchFilter,
+// TapResolver and the hysteresis in update()) on a virtual clock, one
+// GT911 sample per poll, and compares it with hit-testing the raw
+// coordinates as the UI did before filtering. For each trace it reports
+// highlight redraws and touch-down to commit time for both, and checks that
+// every contact fired the button it was aimed at.
+//
+// The built-in traces are jittery contacts near the gaps between buttons,
+// with single-sample spikes, a contact rolling into a button, a clean tap,
+// and a hold of several hundred samples that slides off its button at the
+// end (which the filter must still follow after 255 samples). Prediction
+// has to commit the roll-in before raw hit-testing does. Prints one line
+// per trace and exits 1 if any expectation fails.
+//
+//   touch_bench             built-in traces
+//   touch_bench <trace>     replays a recorded trace: one sample per line,
+//                           "<ms> <x> <y>", "<ms> up" when the finger lifts,
+//                           '#' comments
+//
+// Recording: build the firmware with -DLOG_MIN_LEVEL=LOG_SEV_DEBUG and
+// capture with logdecode. MacroPadUI logs every GT911 sample and lift as a
+// "Touch trace:" record, and the decoded capture replays as it is.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <Arduino.h>
+#include <LovyanGFX.hpp>
+
+// What LGFX_Setup.hpp declares on the device
+class LGFX : public lgfx::LGFX_Device {
+public:
+    LGFX() : lgfx::LGFX_Device(480, 480) {}
+};
+
+#include "Macros.hpp"
+#include "ProfileStore.hpp"
+#include "MacroPadUI.hpp"
+
+#define SIM_POLL_MS     GESTURE_SAMPLE_PERIOD_MS
+#define SIM_LIFT_MS     100     // Polls without contact after each release
+
+struct TraceSample {
+    uint32_t ms;
+    int32_t x;
+    int32_t y;
+    bool up;                // Finger lifted
+};
+
+typedef std::vector<TraceSample> Trace;
+
+struct Result {
+    uint32_t contacts;
+    uint32_t rawRedraws;        // Hit-testing raw samples, redrawing on every change
+    uint32_t rawCommitMs;       // Touch-down to the first raw sample on a button
+    uint32_t rawCommits;
+    uint32_t redraws;           // MacroPadUI's highlight redraws
+    uint32_t commitMs;
+    uint32_t commits;
+    uint32_t maxCommitMs;
+    uint32_t slidOff;           // Hysteresis releases
+    uint32_t wrongFires;        // Macros fired by a button other than the target
+
+    Result() : contacts(0), rawRedraws(0), rawCommitMs(0), rawCommits(0), redraws(0),
+               commitMs(0), commits(0), maxCommitMs(0), slidOff(0), wrongFires(0) {}
+};
+
+static uint64_t simMicros = 0;
+static uint64_t simClock() { return simMicros; }
+
+static LGFX tft;
+static BuiltinProfileSource builtinSource;
+static ProfileStore store;
+static MacroPadUI* ui = nullptr;   // Layout for building traces
+
+static int targetButton = -1;       // Button the replayed contacts aim at, -1 = any
+static uint32_t wrongFires = 0;
+
+static void onMacro(const Macro&, int buttonIndex) {
+    if (targetButton >= 0 && buttonIndex != targetButton) wrongFires++;
+}
+
+static void poll(MacroPadUI& pad, uint32_t ms, bool touching, int32_t x, int32_t y) {
+    simMicros = (uint64_t)ms * 1000;
+    tft.setTouch(touching, x, y);
+    pad.update();
+}
+
+// Each trace gets a fresh UI, so its touch statistics are the trace's own
+static Result replay(const Trace& trace, int target = -1) {
+    Result r;
+    MacroPadUI pad(&tft, &store);
+    pad.setMacroCallback(onMacro);
+    pad.init();
+    targetButton = target;
+    wrongFires = 0;
+
+    // Raw baseline: the button under each sample is highlighted
+    int rawHighlighted = -1;
+    bool rawCommitted = false;
+    uint32_t downMs = 0;
+    bool touching = false;
+
+    uint32_t now = trace.empty() ? 0 : trace[0].ms;
+    for (size_t i = 0; i < trace.size(); i++) {
+        const TraceSample& s = trace[i];
+        // Lost polls between samples report no contact, as the GT911 does
+        for (; now + SIM_POLL_MS <= s.ms; now += SIM_POLL_MS) poll(pad, now, false, 0, 0);
+        now = s.ms;
+        if (s.up) {
+            for (uint32_t t = 0; t < SIM_LIFT_MS; t += SIM_POLL_MS) poll(pad, now + t, false, 0, 0);
+            now += SIM_LIFT_MS;
+            if (rawHighlighted >= 0) r.rawRedraws++;
+            rawHighlighted = -1;
+            touching = false;
+            continue;
+        }
+        if (!touching) {
+            touching = true;
+            rawCommitted = false;
+            downMs = s.ms;
+            r.contacts++;
+        }
+        poll(pad, now, true, s.x, s.y);
+        now += SIM_POLL_MS;
+
+        int hit = pad.getButtonAt(s.x, s.y);
+        if (hit != rawHighlighted) {
+            if (rawHighlighted >= 0) r.rawRedraws++;
+            if (hit >= 0) r.rawRedraws++;
+            rawHighlighted = hit;
+        }
+        if (hit >= 0 && !rawCommitted) {
+            rawCommitted = true;
+            r.rawCommits++;
+            r.rawCommitMs += s.ms - downMs;
+        }
+    }
+
+    const TouchStats& stats = pad.touchStats();
+    r.redraws = stats.highlightRedraws;
+    r.commits = stats.commits;
+    r.commitMs = stats.totalCommitMs;
+    r.maxCommitMs = stats.maxCommitMs;
+    r.slidOff = stats.hysteresisReleases;
+    r.wrongFires = wrongFires;
+    return r;
+}
+
+// ==============================================================================
+// Traces
+// ==============================================================================
+static uint32_t seed = 12345;
+
+// Roughly normal jitter (sum of uniforms), about +/- `amplitude` px
+static int32_t jitter(int32_t amplitude) {
+    int32_t sum = 0;
+    for (int i = 0; i < 3; i++) {
+        seed = seed * 1103515245u + 12345u;
+        sum += (int32_t)((seed >> 16) % (2 * amplitude + 1)) - amplitude;
+    }
+    return sum / 2;
+}
+
+// Held around (x, y) for `ms` with jitter, a `spike` px outlier every
+// `spikeEvery` samples (0 = none), then lifted
+static void addContact(Trace& t, uint32_t& at, int32_t x, int32_t y, uint32_t ms,
+                       int32_t amplitude, int32_t spike = 0, int spikeEvery = 0) {
+    int n = 0;
+    for (uint32_t end = at + ms; at <= end; at += SIM_POLL_MS, n++) {
+        TraceSample s = {at, x + jitter(amplitude), y + jitter(amplitude), false};
+        if (spikeEvery > 0 && n % spikeEvery == spikeEvery - 1) s.x += spike;
+        t.push_back(s);
+    }
+    TraceSample up = {at, 0, 0, true};
+    t.push_back(up);
+    at += SIM_LIFT_MS + SIM_POLL_MS;
+}
+
+// Right edge of button `index` at height `y`, found by hit-testing
+static int32_t rightEdge(int index, int32_t y) {
+    int32_t x = 0;
+    while (x < SCREEN_WIDTH && ui->getButtonAt(x, y) != index) x++;
+    while (x < SCREEN_WIDTH && ui->getButtonAt(x, y) == index) x++;
+    return x - 1;
+}
+
+// Middle of grid row `row` (General is 4 columns wide)
+static int32_t rowCenter(int row) {
+    int32_t y = HEADER_HEIGHT;
+    while (y < SCREEN_HEIGHT && ui->getButtonAt(SCREEN_WIDTH / 2 - 60, y) < row * 4) y++;
+    int32_t top = y;
+    while (y < SCREEN_HEIGHT && ui->getButtonAt(SCREEN_WIDTH / 2 - 60, y) >= 0) y++;
+    return (top + y) / 2;
+}
+
+static int failures = 0;
+static bool filteredFaster = false;     // Some trace committed sooner than raw
+
+static void expect(bool ok, const char* trace, const char* what) {
+    if (!ok) {
+        printf("  FAIL %s: %s\n", trace, what);
+        failures++;
+    }
+}
+
+static void report(const char* name, const Result& r) {
+    uint32_t rawAvg = r.rawCommits ? r.rawCommitMs / r.rawCommits : 0;
+    uint32_t avg = r.commits ? r.commitMs / r.commits : 0;
+    if (r.commits && r.rawCommits && avg < rawAvg) filteredFaster = true;
+    printf("%-12s %2lu contacts  redraws raw %3lu filtered %3lu  commit raw %3lu ms filtered "
+           "%3lu ms avg (max %lu)\n", name, (unsigned long)r.contacts,
+        (unsigned long)r.rawRedraws, (unsigned long)r.redraws,
+        (unsigned long)rawAvg, (unsigned long)avg, (unsigned long)r.maxCommitMs);
+}
+
+static void gapJitter() {
+    const char* name = "gap-jitter";
+    int32_t y = rowCenter(0);
+    int32_t edge = rightEdge(0, y);
+    Trace t;
+    uint32_t at = 10;
+    // Ten contacts on button 0's right edge, jittering across the gap
+    for (int i = 0; i < 10; i++) addContact(t, at, edge - 2, y, 250, 6);
+    Result r = replay(t, 0);
+    expect(r.commits == r.contacts, name, "contact not resolved to a button");
+    expect(r.wrongFires == 0, name, "jitter pulled a contact into the next button");
+    expect(r.redraws <= 2 * r.contacts, name, "more than a press and a release per contact");
+    expect(r.redraws * 3 < r.rawRedraws, name, "filtering did not cut redraws");
+    report(name, r);
+}
+
+static void spikes() {
+    const char* name = "spikes";
+    int32_t y = rowCenter(1);
+    int32_t edge = rightEdge(4, y);
+    Trace t;
+    uint32_t at = 10;
+    // Inside button 4 with single-sample 30 px spikes into the next button
+    for (int i = 0; i < 10; i++) addContact(t, at, edge - 12, y, 300, 3, 30, 5);
+    Result r = replay(t, 4);
+    expect(r.commits == r.contacts && r.slidOff == 0 && r.wrongFires == 0, name,
+        "a spike moved the press");
+    expect(r.redraws == 2 * r.contacts, name, "spikes repainted the highlight");
+    report(name, r);
+}
+
+static void rollIn() {
+    const char* name = "roll-in";
+    int32_t y = rowCenter(2);
+    int32_t edge = rightEdge(8, y);
+    Trace t;
+    uint32_t at = 10;
+    // Lands in the gap after button 8 and rolls right into button 9
+    for (int i = 0; i < 10; i++) {
+        for (int n = 0; n < 20; n++, at += SIM_POLL_MS) {
+            int32_t x = edge + 2 + (n < 6 ? n * 4 : 24);
+            TraceSample s = {at, x + jitter(1), y + jitter(1), false};
+            t.push_back(s);
+        }
+        TraceSample up = {at, 0, 0, true};
+        t.push_back(up);
+        at += SIM_LIFT_MS + SIM_POLL_MS;
+    }
+    Result r = replay(t, 9);
+    expect(r.commits == r.contacts && r.wrongFires == 0, name, "contact not resolved to button 9");
+    expect(r.maxCommitMs < (TOUCH_COMMIT_MAX_SAMPLES - 1) * SIM_POLL_MS, name,
+        "prediction did not commit before the sample limit");
+    expect(r.commitMs / r.commits < r.rawCommitMs / r.rawCommits, name,
+        "prediction committed no sooner than raw hit-testing");
+    report(name, r);
+}
+
+static void centerTap() {
+    const char* name = "center-tap";
+    int32_t y = rowCenter(1);
+    int32_t edge = rightEdge(5, y);
+    Trace t;
+    uint32_t at = 10;
+    for (int i = 0; i < 10; i++) addContact(t, at, edge - 40, y, 80, 2);
+    Result r = replay(t, 5);
+    expect(r.commits == r.contacts && r.commitMs == 0, name, "clear hit not committed at once");
+    expect(r.redraws == 2 * r.contacts, name, "extra redraws");
+    report(name, r);
+}
+
+static void longHold() {
+    const char* name = "long-hold";
+    int32_t y = rowCenter(3);
+    int32_t edge = rightEdge(12, y);
+    Trace t;
+    uint32_t at = 10;
+    // 400 samples jittering on button 12, then sliding 60 px into the next one
+    int samples = 0;
+    for (; samples < 400; samples++, at += SIM_POLL_MS) {
+        TraceSample s = {at, edge - 10 + jitter(4), y + jitter(4), false};
+        t.push_back(s);
+    }
+    for (int n = 0; n <= 30; n++, samples++, at += SIM_POLL_MS) {
+        TraceSample s = {at, edge - 10 + n * 2, y, false};
+        t.push_back(s);
+    }
+    TraceSample up = {at, 0, 0, true};
+    t.push_back(up);
+    Result r = replay(t, 12);
+    expect(r.commits == 1 && r.slidOff == 1, name, "slide off after 255 samples not seen");
+    expect(r.redraws == 2, name, "jitter repainted the highlight during the hold");
+
+    // The filter itself keeps following the finger
+    TouchFilter filter;
+    for (int n = 0; n < 600; n++) filter.push(100 + n / 4, 200, n * SIM_POLL_MS);
+    expect(abs(filter.x() - (100 + 599 / 4)) <= 2, name, "filtered position froze");
+    report(name, r);
+    printf("%-12s %d samples, filter within %ld px after 600\n", "", samples,
+        (long)abs(filter.x() - (100 + 599 / 4)));
+}
+
+static bool loadTrace(const char* path, Trace& out) {
+    FILE* f = fopen(path, "r");
+    if (f == nullptr) return false;
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        // logdecode output: only the touch records, past their prefix
+        const char* text = line;
+        if (line[0] == '[') {
+            text = strstr(line, "Touch trace: ");
+            if (text == nullptr) continue;
+            text += strlen("Touch trace: ");
+        }
+        TraceSample s = {0, 0, 0, false};
+        char word[8];
+        unsigned long ms;
+        long x, y;
+        if (sscanf(text, "%lu %ld %ld", &ms, &x, &y) == 3) {
+            s.ms = (uint32_t)ms;
+            s.x = (int32_t)x;
+            s.y = (int32_t)y;
+        } else if (sscanf(text, "%lu %7s", &ms, word) == 2 && strcmp(word, "up") == 0) {
+            s.ms = (uint32_t)ms;
+            s.up = true;
+        } else {
+            continue;
+        }
+        out.push_back(s);
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    setClockSource(simClock);
+    store.begin(&builtinSource);
+    static MacroPadUI instance(&tft, &store);
+    ui = &instance;
+    ui->init();
+
+    if (argc >= 2) {
+        Trace t;
+        if (!loadTrace(argv[1], t) || t.empty()) {
+            fprintf(stderr, "%s: no samples\n", argv[1]);
+            return 1;
+        }
+        report(argv[1], replay(t));
+        return 0;
+    }
+
+    gapJitter();
+    spikes();
+    rollIn();
+    centerTap();
+    longHold();
+    expect(filteredFaster, "all", "filtering committed no trace sooner than raw hit-testing");
+    printf("touch_bench: %s (%d failures)\n", failures ? "FAILED" : "ok", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,324 @@
+// ==============================================================================
+// trackpad_sim - Trackpad motion coalescing against drag traces (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -o trackpad_sim host/trackpad_sim.cpp
+//
+// Replays drag traces through TouchFilter and MotionCoalescer the way
+// MacroPadUI and main.cpp's serviceTrackpad() do: samples arrive with the
+// touch controller's timing, loop() runs every millisecond, and a report is
+// only taken once the link has sent the previous one at a connection event.
+// Checks that motion is neither lost nor invented (sub-pixel and clamped
+// remainders included), that no two reports share a connection event, the
+// acceleration curve, scrolling, clicks and the input-to-report delay.
+// Prints one line per scenario and exits 1 if any expectation fails.
+//
+//   trackpad_sim                      built-in traces
+//   trackpad_sim <trace> [interval]   replays a recorded trace: one sample
+//                                     per line, "<ms> <x> <y>", "<ms> up"
+//                                     when the finger lifts, '#' comments;
+//                                     interval in us (default 7500)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "MotionCoalescer.hpp"
+
+#define SIM_LOOP_US         1000    // loop() period
+#define SIM_BLE_INTERVAL_US 7500    // 6 x 1.25 ms, the active interval
+#define SIM_PAD_RIGHT       470     // Trackpad's right edge (x), for the scroll strip
+
+struct TraceSample {
+    uint32_t ms;
+    int32_t x;
+    int32_t y;
+    bool up;                // Finger lifted
+};
+
+typedef std::vector<TraceSample> Trace;
+
+struct SentMouse {
+    uint32_t atUs;          // Taken from the coalescer
+    HidReport report;
+};
+
+struct Replay {
+    std::vector<SentMouse> sent;
+    MotionStats stats;
+    int32_t sumX;
+    int32_t sumY;
+    int32_t sumWheel;
+    uint32_t minGapUs;      // Closest two reports came
+    int32_t travelX;        // Filtered finger travel of the last contact, px
+    int32_t travelY;
+
+    Replay() : sumX(0), sumY(0), sumWheel(0), minGapUs(UINT32_MAX), travelX(0), travelY(0) {}
+};
+
+// Runs `trace` at `intervalUs`. The link sends a taken report at the next
+// connection event; until then the queue is busy and nothing is taken.
+static Replay replay(const Trace& trace, uint32_t intervalUs) {
+    Replay r;
+    MotionCoalescer pad;
+    TouchFilter filter;
+    pad.setInterval(intervalUs);
+
+    size_t next = 0;
+    bool touching = false;
+    uint32_t linkBusyUntil = 0;
+    int32_t firstX = 0;
+    int32_t firstY = 0;
+    uint32_t endUs = trace.empty() ? 0 : (trace.back().ms + 500) * 1000;
+
+    for (uint32_t now = 0; now <= endUs; now += SIM_LOOP_US) {
+        // MacroPadUI::update(): the samples that arrived since the last pass
+        while (next < trace.size() && trace[next].ms * 1000 <= now) {
+            const TraceSample& s = trace[next++];
+            if (s.up) {
+                if (touching) pad.end(now);
+                touching = false;
+                filter.reset();
+                continue;
+            }
+            filter.push(s.x, s.y, s.ms);
+            if (!touching) {
+                touching = true;
+                firstX = filter.fixedX();
+                firstY = filter.fixedY();
+                pad.begin(filter.fixedX(), filter.fixedY(), now,
+                          s.x >= SIM_PAD_RIGHT - TRACKPAD_SCROLL_WIDTH);
+            } else {
+                pad.move(filter.fixedX(), filter.fixedY(), now);
+            }
+            r.travelX = (filter.fixedX() - firstX) / (1 << TOUCH_FIXED_SHIFT);
+            r.travelY = (filter.fixedY() - firstY) / (1 << TOUCH_FIXED_SHIFT);
+        }
+
+        // serviceTrackpad()
+        if (now < linkBusyUntil) continue;
+        HidReport report;
+        if (!pad.take(now, report)) continue;
+        if (!r.sent.empty() && now - r.sent.back().atUs < r.minGapUs) {
+            r.minGapUs = now - r.sent.back().atUs;
+        }
+        SentMouse m = {now, report};
+        r.sent.push_back(m);
+        r.sumX += report.dx;
+        r.sumY += report.dy;
+        r.sumWheel += report.wheel;
+        linkBusyUntil = (now / intervalUs + 1) * intervalUs;
+    }
+    r.stats = pad.stats();
+    return r;
+}
+
+// Straight drag from (x0, y0) by (dx, dy) px over `ms`, sampled every
+// `periodMs`, then held still for 100 ms and lifted
+static Trace drag(int32_t x0, int32_t y0, int32_t dx, int32_t dy, uint32_t ms,
+                  uint32_t periodMs = 10) {
+    Trace t;
+    uint32_t start = 10;
+    for (uint32_t at = 0; at <= ms; at += periodMs) {
+        TraceSample s = {start + at, x0 + (int32_t)((int64_t)dx * at / ms),
+                         y0 + (int32_t)((int64_t)dy * at / ms), false};
+        t.push_back(s);
+    }
+    for (uint32_t at = ms + periodMs; at <= ms + 100; at += periodMs) {
+        TraceSample s = {start + at, x0 + dx, y0 + dy, false};
+        t.push_back(s);
+    }
+    TraceSample up = {start + ms + 100 + periodMs, 0, 0, true};
+    t.push_back(up);
+    return t;
+}
+
+// Finger down at (x, y) for `ms` without moving
+static Trace press(int32_t x, int32_t y, uint32_t ms) {
+    return drag(x, y, 0, 0, ms);
+}
+
+static int failures = 0;
+
+static void expect(bool ok, const char* scenario, const char* what) {
+    if (!ok) {
+        printf("  FAIL %s: %s\n", scenario, what);
+        failures++;
+    }
+}
+
+static int buttonReports(const Replay& r, uint8_t buttons) {
+    int n = 0;
+    for (const SentMouse& m : r.sent) {
+        if (m.report.buttons == buttons) n++;
+    }
+    return n;
+}
+
+static void slowDrag() {
+    const char* name = "slow-drag";
+    // 100 px in 2 s: below TRACKPAD_ACCEL_LOW, so one count per pixel
+    Replay r = replay(drag(100, 200, 100, 0, 2000), SIM_BLE_INTERVAL_US);
+    expect(abs(r.sumX - r.travelX) <= 1 && r.sumY == 0, name, "motion lost or invented");
+    expect(r.minGapUs >= SIM_BLE_INTERVAL_US, name, "two reports in one connection event");
+    expect(buttonReports(r, 0) == (int)r.sent.size(), name, "a drag clicked");
+    printf("%-14s %d counts for %d px in %zu reports, min gap %lu us\n", name, r.sumX,
+        r.travelX, r.sent.size(), (unsigned long)r.minGapUs);
+}
+
+static void subPixel() {
+    const char* name = "sub-pixel";
+    // 30 px in 3 s sampled every 10 ms: 0.1 px per sample, nothing whole
+    Replay r = replay(drag(100, 200, 0, 30, 3000), SIM_BLE_INTERVAL_US);
+    expect(abs(r.sumY - r.travelY) <= 1 && r.travelY >= 29 && r.sumX == 0, name,
+        "fractions not accumulated");
+    printf("%-14s %d counts for %d px at 0.1 px per sample\n", name, r.sumY, r.travelY);
+}
+
+static void acceleration() {
+    const char* name = "accel";
+    // 300 px in 100 ms (3000 px/s): full gain, several reports clamped
+    Replay fast = replay(drag(60, 200, 300, 0, 100), SIM_BLE_INTERVAL_US);
+    Replay slow = replay(drag(60, 200, 300, 0, 6000), SIM_BLE_INTERVAL_US);
+    expect(fast.sumX > 3 * slow.sumX, name, "fast flick not accelerated");
+    expect(abs(slow.sumX - 300) <= 2, name, "slow drag accelerated");
+    int maxed = 0;
+    for (const SentMouse& m : fast.sent) {
+        if (m.report.dx == 127) maxed++;
+    }
+    expect(maxed > 0 && fast.stats.carried > 0, name, "big motion not carried over");
+    expect(fast.minGapUs >= SIM_BLE_INTERVAL_US, name, "flick flooded the link");
+    printf("%-14s 300 px: %d counts slow, %d fast (%lu reports carried)\n", name, slow.sumX,
+        fast.sumX, (unsigned long)fast.stats.carried);
+}
+
+static void coalescing() {
+    const char* name = "coalesce";
+    // Samples every 2 ms against a 30 ms interval (a slow central)
+    Trace t = drag(60, 200, 200, 100, 1000, 2);
+    Replay r = replay(t, 30000);
+    Replay fine = replay(t, SIM_BLE_INTERVAL_US);
+    expect(r.sumX == fine.sumX && r.sumY == fine.sumY, name, "interval changed the motion");
+    expect(r.minGapUs >= 30000 && r.sent.size() * 30000 <= 1300000, name,
+        "more than one report per interval");
+    expect(r.stats.maxSamplesPerReport >= 10, name, "samples not coalesced");
+    expect(r.stats.maxDelayUs <= 30000 + SIM_LOOP_US, name, "delay beyond one interval");
+    printf("%-14s %lu samples -> %zu reports at 30 ms (%zu at 7.5 ms), delay max %lu us\n",
+        name, (unsigned long)r.stats.samples, r.sent.size(), fine.sent.size(),
+        (unsigned long)r.stats.maxDelayUs);
+}
+
+static void scroll() {
+    const char* name = "scroll";
+    // Up the scroll strip by 5 detents
+    Replay r = replay(drag(SIM_PAD_RIGHT - 10, 300, 0, -5 * TRACKPAD_SCROLL_PX, 1000),
+                      SIM_BLE_INTERVAL_US);
+    expect(abs(r.sumWheel - 5) <= 1 && r.sumX == 0 && r.sumY == 0, name,
+        "strip did not scroll, or moved the pointer");
+    printf("%-14s %d detents for %d px\n", name, r.sumWheel, 5 * TRACKPAD_SCROLL_PX);
+}
+
+static void clicks() {
+    const char* name = "clicks";
+    Replay tap = replay(press(200, 200, 80), SIM_BLE_INTERVAL_US);
+    expect(tap.sent.size() == 2 && tap.sent[0].report.buttons == MOUSE_BUTTON_LEFT &&
+           tap.sent[1].report.buttons == 0, name, "tap is not one left click");
+    expect(tap.sent.size() == 2 && tap.sent[1].atUs - tap.sent[0].atUs >= SIM_BLE_INTERVAL_US,
+        name, "press and release in one connection event");
+
+    Replay hold = replay(press(200, 200, 800), SIM_BLE_INTERVAL_US);
+    expect(hold.sent.size() == 2 && hold.sent[0].report.buttons == MOUSE_BUTTON_RIGHT, name,
+        "still hold is not a right click");
+
+    Replay between = replay(press(200, 200, 400), SIM_BLE_INTERVAL_US);
+    expect(between.sent.empty(), name, "hold shorter than a right click clicked");
+
+    // Cancelled between press and release: the release still goes out
+    MotionCoalescer pad;
+    HidReport r1, r2;
+    pad.begin(0, 0, 0, false);
+    pad.end(50000);
+    bool pressed = pad.take(50000, r1);
+    pad.cancel();
+    bool released = pad.take(60000, r2);
+    expect(pressed && released && r1.buttons == MOUSE_BUTTON_LEFT && r2.buttons == 0 &&
+           !pad.take(80000, r2), name, "cancel left the button down");
+    printf("%-14s tap: %zu reports, hold: right click, cancel mid-click released\n", name,
+        tap.sent.size());
+}
+
+static void delay() {
+    const char* name = "delay";
+    // Samples every 2 ms, four or so per connection event
+    Replay r = replay(drag(60, 200, 150, 80, 1500, 2), SIM_BLE_INTERVAL_US);
+    uint32_t avg = r.stats.reports ? (uint32_t)(r.stats.totalDelayUs / r.stats.reports) : 0;
+    expect(r.stats.maxDelayUs <= SIM_BLE_INTERVAL_US + SIM_LOOP_US, name,
+        "input waited more than a connection event");
+    uint32_t rate = (uint32_t)(r.stats.reports * 1000000ull / r.stats.touchingUs);
+    expect(rate <= 1000000 / SIM_BLE_INTERVAL_US + 1, name, "rate above one per interval");
+    printf("%-14s %lu reports/s while touching, delay avg %lu us, max %lu us\n", name,
+        (unsigned long)rate, (unsigned long)avg, (unsigned long)r.stats.maxDelayUs);
+}
+
+static bool loadTrace(const char* path, Trace& out) {
+    FILE* f = fopen(path, "r");
+    if (f == nullptr) return false;
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        TraceSample s = {0, 0, 0, false};
+        char word[8];
+        unsigned long ms;
+        long x, y;
+        if (sscanf(line, "%lu %ld %ld", &ms, &x, &y) == 3) {
+            s.ms = (uint32_t)ms;
+            s.x = (int32_t)x;
+            s.y = (int32_t)y;
+        } else if (sscanf(line, "%lu %7s", &ms, word) == 2 && strcmp(word, "up") == 0) {
+            s.ms = (uint32_t)ms;
+            s.up = true;
+        } else {
+            continue;
+        }
+        out.push_back(s);
+    }
+    fclose(f);
+    return true;
+}
+
+static int replayFile(const char* path, uint32_t intervalUs) {
+    Trace t;
+    if (!loadTrace(path, t) || t.empty()) {
+        fprintf(stderr, "%s: no samples\n", path);
+        return 1;
+    }
+    Replay r = replay(t, intervalUs);
+    const MotionStats& s = r.stats;
+    printf("%s: %zu samples, %lu contacts -> %lu reports at %lu us (%lu/s while touching, "
+           "up to %lu samples each)\n", path, t.size(), (unsigned long)s.contacts,
+        (unsigned long)s.reports, (unsigned long)intervalUs,
+        (unsigned long)(s.touchingUs ? s.reports * 1000000ull / s.touchingUs : 0),
+        (unsigned long)s.maxSamplesPerReport);
+    printf("motion %d,%d counts, wheel %d, %lu clicks, %lu right clicks, %lu carried\n",
+        r.sumX, r.sumY, r.sumWheel, (unsigned long)s.clicks, (unsigned long)s.rightClicks,
+        (unsigned long)s.carried);
+    printf("delay avg %lu us, max %lu us\n",
+        (unsigned long)(s.reports ? s.totalDelayUs / s.reports : 0),
+        (unsigned long)s.maxDelayUs);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 2) {
+        return replayFile(argv[1], argc > 2 ? (uint32_t)atol(argv[2]) : SIM_BLE_INTERVAL_US);
+    }
+    slowDrag();
+    subPixel();
+    acceleration();
+    coalescing();
+    scroll();
+    clicks();
+    delay();
+    printf("trackpad_sim: %s (%d failures)\n", failures ? "FAILED" : "ok", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,337 @@
+// ==============================================================================
+// usbhid_sim - USB HID report encoding and wired output selection (Linux host tool)
+// ==============================================================================
+// Build:
+//   g++ -std=c++17 -O2 -Isrc -o usbhid_sim host/usbhid_sim.cpp
+//
+// Checks the USB report encoding (UsbHidReports.hpp) for every key and
+// media report a macro can produce and for the trackpad's mouse report,
+// then runs MacroExecutor and HidReportQueue over a mock USB endpoint
+// polled every 1 ms (send blocks until the host collects the report, like
+// USBHID::SendReport()) and a mock BLE link, switching between them the way
+// main.cpp's serviceHidOutput() does. Prints one line per scenario and exits 1 if any expectation fails.
+
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "HidTransport.hpp"
+#include "MacroExecutor.hpp"
+#include "UsbHidReports.hpp"
+
+#define SIM_STEP_US         250
+#define SIM_USB_FRAME_US    1000    // Host polls the interrupt IN endpoint
+#define SIM_BLE_COMPLETE_US 7500    // One connection interval
+
+struct SentReport {
+    uint64_t atUs;              // Host has the report
+    HidReport report;
+};
+
+static uint64_t simNowUs = 0;
+
+class MockTransport : public HidTransport {
+public:
+    const char* label;
+    bool up;
+    std::vector<SentReport> sent;
+
+    explicit MockTransport(const char* l) : label(l), up(false) {}
+
+    const char* name() const override { return label; }
+    bool begin() override { return true; }
+    int sendable() override { return -1; }
+
+protected:
+    virtual bool deliver(const HidReport& report) = 0;
+
+    bool sendKeyboardReport(uint8_t modifiers, const uint8_t keys[6]) override {
+        HidReport r = HidReport::press(modifiers, KEY_NONE);
+        memcpy(r.keys, keys, 6);
+        return up && deliver(r);
+    }
+
+    bool sendConsumerReport(uint8_t low, uint8_t high) override {
+        return up && deliver(HidReport::mediaState(low, high));
+    }
+
+    uint32_t clockUs() override { return (uint32_t)simNowUs; }
+};
+
+// Send blocks until the next poll has collected the report
+class MockUsb : public MockTransport {
+public:
+    MockUsb() : MockTransport("usb") {}
+
+    bool sendReport(const HidReport& report) override {
+        if (!HidTransport::sendReport(report)) return false;
+        onCompleted();
+        return true;
+    }
+
+    bool completesOnSend() const override { return true; }
+
+protected:
+    bool deliver(const HidReport& report) override {
+        simNowUs = (simNowUs / SIM_USB_FRAME_US + 1) * SIM_USB_FRAME_US;
+        SentReport s = {simNowUs, report};
+        sent.push_back(s);
+        return true;
+    }
+};
+
+// Notifications reach the host and complete one connection interval later
+class MockBle : public MockTransport {
+public:
+    HidReportQueue* queue;
+    std::deque<SentReport> inFlight;
+
+    MockBle() : MockTransport("ble"), queue(nullptr) {}
+
+    void step() {
+        while (!inFlight.empty() && inFlight.front().atUs <= simNowUs) {
+            sent.push_back(inFlight.front());
+            inFlight.pop_front();
+            onCompleted();
+            queue->onSent(true);
+        }
+    }
+
+protected:
+    bool deliver(const HidReport& report) override {
+        SentReport s = {simNowUs + SIM_BLE_COMPLETE_US, report};
+        inFlight.push_back(s);
+        return true;
+    }
+};
+
+// Both transports, queue and executor, wired like main.cpp
+struct Pad {
+    MockUsb usb;
+    MockBle ble;
+    HidReportQueue queue;
+    MacroExecutor executor;
+    HidTransport* output;
+    int switches;
+
+    Pad() : queue(&ble), executor(&queue), output(nullptr), switches(0) {
+        simNowUs = 0;
+        ble.queue = &queue;
+    }
+
+    uint32_t nowMs() const { return (uint32_t)(simNowUs / 1000); }
+
+    // serviceHidOutput()
+    void selectOutput() {
+        HidTransport* want = usb.up ? (HidTransport*)&usb : ble.up ? (HidTransport*)&ble : nullptr;
+        if (want == output) return;
+        if (output != nullptr) {
+            bool oldStillUp = output == &usb ? usb.up : ble.up;
+            if (oldStillUp && executor.isBusy()) {
+                output->sendReport(HidReport::release());
+                output->sendReport(HidReport::mediaState(0, 0));
+            }
+            executor.cancel(false);
+            queue.close(nowMs());
+            output->onLinkLost();
+        }
+        output = want;
+        if (want != nullptr) {
+            queue.setSink(want);
+            queue.open();
+        }
+        switches++;
+    }
+
+    // sendMacro(): output brought up to date first, so a new macro is not
+    // cancelled as leftover of the old one
+    void press(const Macro& macro) {
+        selectOutput();
+        executor.enqueue(macro, true);
+    }
+
+    // One loop() pass
+    void pass() {
+        selectOutput();
+        executor.service(nowMs());
+        queue.service(nowMs());
+        simNowUs += SIM_STEP_US;
+        ble.step();
+    }
+
+    void run(uint32_t ms) {
+        uint64_t end = simNowUs + (uint64_t)ms * 1000;
+        while (simNowUs < end) pass();
+    }
+
+    bool runUntilIdle(uint32_t limitMs) {
+        uint64_t end = simNowUs + (uint64_t)limitMs * 1000;
+        while (simNowUs < end) {
+            pass();
+            if (!executor.isBusy() && queue.isEmpty() && ble.inFlight.empty()) return true;
+        }
+        return false;
+    }
+};
+
+static int failures = 0;
+
+static void expect(bool ok, const char* scenario, const char* what) {
+    if (!ok) {
+        printf("  FAIL %s: %s\n", scenario, what);
+        failures++;
+    }
+}
+
+static int pressCount(const std::vector<SentReport>& sent) {
+    int n = 0;
+    for (const SentReport& s : sent) {
+        if (s.report.kind == HID_REPORT_KEYBOARD && s.report.keys[0] != KEY_NONE) n++;
+    }
+    return n;
+}
+
+static bool endsReleased(const std::vector<SentReport>& sent) {
+    size_t n = sent.size();
+    return n >= 2 && sent[n - 2].report.kind == HID_REPORT_KEYBOARD &&
+           sent[n - 2].report.keys[0] == KEY_NONE && sent[n - 2].report.modifiers == 0 &&
+           sent[n - 1].report.kind == HID_REPORT_MEDIA && sent[n - 1].report.media[0] == 0;
+}
+
+static void encoding() {
+    const char* name = "encoding";
+    uint8_t keys[6] = {KEY_C, KEY_NONE, KEY_NONE, KEY_NONE, KEY_NONE, KEY_NONE};
+    uint8_t raw[USB_KEYBOARD_REPORT_BYTES];
+    usbKeyboardReport(MODIFIER_CTRL | MODIFIER_SHIFT, keys, raw);
+    const uint8_t want[8] = {MODIFIER_CTRL | MODIFIER_SHIFT, 0, KEY_C, 0, 0, 0, 0, 0};
+    expect(memcmp(raw, want, 8) == 0, name, "keyboard report layout");
+
+    struct { uint8_t key; uint16_t usage; } media[] = {
+        {KEY_MEDIA_NEXT, 0xB5}, {KEY_MEDIA_PREV, 0xB6}, {KEY_MEDIA_STOP, 0xB7},
+        {KEY_MEDIA_PLAY_PAUSE, 0xCD}, {KEY_MEDIA_MUTE, 0xE2}, {KEY_MEDIA_VOLUME_UP, 0xE9},
+        {KEY_MEDIA_VOLUME_DOWN, 0xEA},
+    };
+    int mapped = 0;
+    for (const auto& m : media) {
+        uint8_t low, high, out[USB_CONSUMER_REPORT_BYTES];
+        if (!mediaKeyBits(m.key, low, high)) continue;
+        usbConsumerReport(low, high, out);
+        if (out[0] == (m.usage & 0xFF) && out[1] == (m.usage >> 8)) mapped++;
+    }
+    expect(mapped == 7, name, "media key with the wrong consumer usage");
+    uint8_t out[USB_CONSUMER_REPORT_BYTES];
+    usbConsumerReport(0, 0, out);
+    expect(out[0] == 0 && out[1] == 0, name, "consumer release not zero");
+    expect(usbConsumerUsage(16 | 32, 0) == USB_CONSUMER_MUTE, name, "lowest bit does not win");
+
+    int typed = 0;
+    for (int c = 0x20; c <= 0x7E; c++) {
+        uint8_t key, mods;
+        if (!asciiToHid((char)c, key, mods)) continue;
+        uint8_t k[6] = {key, 0, 0, 0, 0, 0};
+        usbKeyboardReport(mods, k, raw);
+        if (raw[0] == mods && raw[2] == key) typed++;
+    }
+    expect(typed == 95, name, "printable character encoded wrong");
+
+    uint8_t mouse[USB_MOUSE_REPORT_BYTES];
+    usbMouseReport(MOUSE_BUTTON_LEFT, -127, 5, -1, mouse);
+    const uint8_t wantMouse[5] = {MOUSE_BUTTON_LEFT, 0x81, 5, 0xFF, 0};
+    expect(memcmp(mouse, wantMouse, 5) == 0, name, "mouse report layout");
+    printf("%-14s 95 characters, %d media keys, report IDs %d/%d/%d\n", name, mapped,
+        USB_REPORT_ID_KEYBOARD, USB_REPORT_ID_MOUSE, USB_REPORT_ID_CONSUMER);
+}
+
+static void usbTyping() {
+    const char* name = "usb-typing";
+    Pad pad;
+    pad.usb.up = true;
+    std::string text(200, 'k');
+    pad.press(Macro::textMacro("Long", text.c_str()));
+    uint64_t start = simNowUs;
+    expect(pad.runUntilIdle(2000), name, "did not finish");
+    const std::vector<SentReport>& s = pad.usb.sent;
+    expect(pressCount(s) == (int)text.size(), name, "characters lost");
+    double secs = (s.back().atUs - start) / 1e6;
+    double rate = text.size() / secs;
+    HidTransportStats ts = pad.usb.stats();
+    expect(ts.maxLatencyUs <= SIM_USB_FRAME_US, name, "report waited more than one frame");
+    expect(rate >= 0.9 * 1e6 / SIM_USB_FRAME_US / 2, name, "under 90% of one report per frame");
+    expect(pad.queue.credits() == HID_REPORT_CREDITS, name, "USB sends took credits");
+    printf("%-14s %d chars at %.0f chars/s, latency avg %lu us, max %lu us\n", name,
+        pressCount(s), rate, (unsigned long)(ts.totalLatencyUs / ts.completions),
+        (unsigned long)ts.maxLatencyUs);
+}
+
+static void usbCombo() {
+    const char* name = "usb-combo";
+    Pad pad;
+    pad.usb.up = true;
+    pad.press(Macro::combo("Copy", "Ctrl+C", MODIFIER_CTRL, KEY_C));
+    expect(pad.runUntilIdle(200), name, "did not finish");
+    const std::vector<SentReport>& s = pad.usb.sent;
+    uint64_t heldUs = s.size() == 2 ? s[1].atUs - s[0].atUs : 0;
+    expect(s.size() == 2 && heldUs >= MACRO_COMBO_HOLD_MS * 1000, name, "hold not kept");
+    printf("%-14s held %llu us\n", name, (unsigned long long)heldUs);
+}
+
+// Touch to the host having the press, per transport
+static void keyLatency() {
+    const char* name = "key-latency";
+    uint64_t at[2];
+    for (int usb = 0; usb < 2; usb++) {
+        Pad pad;
+        (usb ? pad.usb.up : pad.ble.up) = true;
+        pad.run(5);
+        uint64_t pressed = simNowUs;
+        pad.press(Macro::singleKey("Esc", "Esc", KEY_ESC));
+        pad.runUntilIdle(100);
+        const std::vector<SentReport>& s = usb ? pad.usb.sent : pad.ble.sent;
+        at[usb] = s.empty() ? 0 : s[0].atUs - pressed;
+    }
+    expect(at[1] > 0 && at[1] <= SIM_USB_FRAME_US + SIM_STEP_US, name, "USB press later than a frame");
+    expect(at[1] < at[0], name, "USB not faster than BLE");
+    printf("%-14s ble %llu us, usb %llu us\n", name, (unsigned long long)at[0],
+        (unsigned long long)at[1]);
+}
+
+static void attachDetach() {
+    const char* name = "attach-detach";
+    Pad pad;
+    pad.ble.up = true;
+    std::string text(200, 'w');
+    pad.press(Macro::textMacro("Long", text.c_str()));
+    pad.run(100);
+
+    // Cable in mid-macro: the BLE host is left with nothing held
+    pad.usb.up = true;
+    pad.run(20);
+    expect(pad.output == &pad.usb, name, "USB not chosen when attached");
+    expect(!pad.executor.isBusy() && pressCount(pad.ble.sent) < (int)text.size(), name,
+        "macro carried over to USB");
+    expect(endsReleased(pad.ble.sent), name, "BLE host left with keys held");
+    expect(pad.usb.sent.empty(), name, "old macro's reports went to USB");
+
+    pad.press(Macro::singleKey("A", "A", KEY_A));
+    expect(pad.runUntilIdle(100) && pressCount(pad.usb.sent) == 1, name, "USB not used");
+
+    // Cable out: back to BLE
+    pad.usb.up = false;
+    size_t bleBefore = pad.ble.sent.size();
+    pad.press(Macro::singleKey("B", "B", KEY_B));
+    expect(pad.runUntilIdle(100) && pad.output == &pad.ble &&
+           pad.ble.sent.size() == bleBefore + 2, name, "no fallback to BLE");
+    printf("%-14s %d output switches, %d chars on BLE before attach\n", name, pad.switches,
+        pressCount(pad.ble.sent) - 1);
+}
+
+int main() {
+    encoding();
+    usbTyping();
+    usbCombo();
+    keyLatency();
+    attachDetach();
+    printf("usbhid_sim: %s (%d failures)\n", failures ? "FAILED" : "ok", failures);
+    return failures ? 1 : 0;
+}
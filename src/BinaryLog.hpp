@@ -0,0 +1,386 @@
+#pragma once
+
+// ==============================================================================
+// Binary Log
+// ==============================================================================
+// printf on the device formats on the caller's task and then waits for the
+// UART, which at 921600 baud is ~11 us per character. LOG() instead stores
+// the message ID (LogCatalog.hpp), a timestamp and the raw arguments in a
+// lock-free ring and returns; a low-priority task drains the ring into
+// FRAME_LOG frames on the serial port (SerialProtocol.hpp), and the host
+// applies the formats (host/logdecode.cpp, macropadctl).
+//
+// Record (little-endian), in the ring and in FRAME_LOG payloads:
+//
+//   id u16 | level u8 | arg bytes u8 | time us u32 | args...
+//
+// Integers take 4 bytes (8 for 64-bit types), floats 4, strings a length
+// byte and up to LOG_MAX_STRING bytes. A FRAME_LOG payload is the total
+// dropped count (u32) followed by whole records.
+//
+// Any task may log. Writers reserve space with a compare-and-swap on the
+// head and publish the record by setting the commit bit in its span word;
+// the single reader stops at the first span not yet committed. When the
+// ring is full the record is counted as dropped and the caller carries on.
+// Not for use from ISRs.
+//
+// Messages below LOG_MIN_LEVEL compile to nothing. With LOG_TEXT set the
+// drain task prints the formatted text instead of FRAME_LOG frames.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+#include "LogCatalog.hpp"
+#include "Clock.hpp"
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_SEV_INFO
+#endif
+
+// Ring size, a power of two; ~120 typical records
+#ifndef LOG_RING_BYTES
+#define LOG_RING_BYTES          4096
+#endif
+
+// Debug builds: the drain task formats records on the device and prints
+// them as text, for a plain serial monitor instead of logdecode
+#ifndef LOG_TEXT
+#define LOG_TEXT                0
+#endif
+
+#ifndef LOG_CLOCK_US
+#define LOG_CLOCK_US()          clockMicros()
+#endif
+
+#define LOG_RECORD_HEADER       8
+#define LOG_MAX_ARG_BYTES       64
+#define LOG_MAX_RECORD          (LOG_RECORD_HEADER + LOG_MAX_ARG_BYTES)
+#define LOG_MAX_STRING          32
+
+static_assert((LOG_RING_BYTES & (LOG_RING_BYTES - 1)) == 0, "LOG_RING_BYTES must be a power of two");
+static_assert(LOG_RING_BYTES <= 0x10000, "span words hold 16-bit lengths");
+
+#define LOG_SPAN_COMMIT         0x80000000u
+#define LOG_SPAN_PAD            0x40000000u     // Filler up to the end of the ring
+#define LOG_SPAN_BYTES          0x0000FFFFu
+
+struct BinaryLogStats {
+    uint32_t records;
+    uint32_t dropped;           // Ring full
+    uint32_t truncated;         // Arguments over LOG_MAX_ARG_BYTES
+    uint32_t maxUsed;           // Ring high-water mark, bytes
+
+    BinaryLogStats() : records(0), dropped(0), truncated(0), maxUsed(0) {}
+};
+
+// Serializes LOG() arguments by type
+class LogArgWriter {
+private:
+    uint8_t* _out;
+    size_t _len;
+    size_t _cap;
+    bool _truncated;
+
+    void raw(const void* data, size_t len) {
+        if (_len + len > _cap) {
+            _truncated = true;
+            return;
+        }
+        memcpy(_out + _len, data, len);
+        _len += len;
+    }
+
+    void string(const char* s) {
+        size_t n = s ? strnlen(s, LOG_MAX_STRING) : 0;
+        if (_len + 1 + n > _cap) {
+            _truncated = true;
+            return;
+        }
+        _out[_len++] = (uint8_t)n;
+        raw(s, n);
+    }
+
+public:
+    LogArgWriter(uint8_t* out, size_t cap) : _out(out), _len(0), _cap(cap), _truncated(false) {}
+
+    template <typename T>
+    void put(const T& v) {
+        typedef typename std::decay<T>::type U;
+        if constexpr (std::is_array<T>::value || std::is_same<U, const char*>::value ||
+                      std::is_same<U, char*>::value) {
+            string(v);
+        } else if constexpr (std::is_floating_point<U>::value) {
+            float f = (float)v;
+            raw(&f, 4);
+        } else if constexpr (std::is_integral<U>::value || std::is_enum<U>::value) {
+            if constexpr (sizeof(U) > 4) {
+                uint64_t x = (uint64_t)v;
+                raw(&x, 8);
+            } else {
+                uint32_t x = (uint32_t)v;
+                raw(&x, 4);
+            }
+        } else if constexpr (std::is_pointer<U>::value) {
+            uint32_t x = (uint32_t)(uintptr_t)v;
+            raw(&x, 4);
+        } else {
+            static_assert(sizeof(U) == 0, "unsupported LOG() argument type");
+        }
+    }
+
+    size_t length() const { return _len; }
+    bool truncated() const { return _truncated; }
+};
+
+class BinaryLog {
+private:
+    uint32_t _ring[LOG_RING_BYTES / 4];
+    std::atomic<uint32_t> _head;        // Reserved up to (writers)
+    std::atomic<uint32_t> _tail;        // Consumed up to (reader)
+    std::atomic<uint32_t> _records;
+    std::atomic<uint32_t> _dropped;
+    std::atomic<uint32_t> _truncated;
+    std::atomic<uint32_t> _maxUsed;
+
+    // Span words are written by one task and read by another
+    uint32_t loadSpan(uint32_t at) const {
+        return __atomic_load_n(&_ring[(at & (LOG_RING_BYTES - 1)) / 4], __ATOMIC_ACQUIRE);
+    }
+    void storeSpan(uint32_t at, uint32_t word) {
+        __atomic_store_n(&_ring[(at & (LOG_RING_BYTES - 1)) / 4], word, __ATOMIC_RELEASE);
+    }
+    uint8_t* bytesAt(uint32_t at) { return (uint8_t*)_ring + (at & (LOG_RING_BYTES - 1)); }
+
+    void noteUsed(uint32_t used) {
+        uint32_t seen = _maxUsed.load(std::memory_order_relaxed);
+        while (used > seen &&
+               !_maxUsed.compare_exchange_weak(seen, used, std::memory_order_relaxed)) {
+        }
+    }
+
+public:
+    BinaryLog() : _head(0), _tail(0), _records(0), _dropped(0), _truncated(0), _maxUsed(0) {
+        memset(_ring, 0, sizeof(_ring));
+    }
+
+    // Copies a whole record into the ring; false (and counted) if it is full
+    bool push(const uint8_t* record, size_t len) {
+        uint32_t span = 4 + (uint32_t)((len + 3) & ~(size_t)3);
+        if (len == 0 || span > LOG_RING_BYTES / 2) return false;
+
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t pad;
+        for (;;) {
+            uint32_t room = LOG_RING_BYTES - (head & (LOG_RING_BYTES - 1));
+            pad = room < span ? room : 0;   // Records never wrap
+            uint32_t tail = _tail.load(std::memory_order_acquire);
+            if (head + pad + span - tail > LOG_RING_BYTES) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (_head.compare_exchange_weak(head, head + pad + span, std::memory_order_acq_rel,
+                                            std::memory_order_relaxed)) {
+                noteUsed(head + pad + span - tail);
+                break;
+            }
+        }
+
+        if (pad) storeSpan(head, pad | LOG_SPAN_PAD | LOG_SPAN_COMMIT);
+        memcpy(bytesAt(head + pad + 4), record, len);
+        storeSpan(head + pad, span | LOG_SPAN_COMMIT);
+        _records.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    template <typename... Args>
+    bool write(LogMessageId id, uint32_t nowUs, const Args&... args) {
+        uint8_t record[LOG_MAX_RECORD];
+        LogArgWriter w(record + LOG_RECORD_HEADER, LOG_MAX_ARG_BYTES);
+        (w.put(args), ...);
+        if (w.truncated()) _truncated.fetch_add(1, std::memory_order_relaxed);
+
+        record[0] = (uint8_t)(id & 0xFF);
+        record[1] = (uint8_t)(id >> 8);
+        record[2] = (uint8_t)logLevelOf(id);
+        record[3] = (uint8_t)w.length();
+        memcpy(record + 4, &nowUs, 4);
+        return push(record, LOG_RECORD_HEADER + w.length());
+    }
+
+    // Reader only: moves whole records into a FRAME_LOG payload of up to
+    // `cap` bytes; 0 if there were none
+    size_t takeBatch(uint8_t* out, size_t cap) {
+        if (cap < 4 + LOG_MAX_RECORD) return 0;
+        size_t len = 4;
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        while (tail != _head.load(std::memory_order_acquire)) {
+            uint32_t word = loadSpan(tail);
+            if (!(word & LOG_SPAN_COMMIT)) break;   // Writer still copying
+            uint32_t span = word & LOG_SPAN_BYTES;
+            if (!(word & LOG_SPAN_PAD)) {
+                const uint8_t* record = bytesAt(tail + 4);
+                size_t n = LOG_RECORD_HEADER + record[3];
+                if (len + n > cap) break;
+                memcpy(out + len, record, n);
+                len += n;
+            }
+            // Cleared before release, so stale bytes never read as a commit
+            memset(bytesAt(tail), 0, span);
+            tail += span;
+            _tail.store(tail, std::memory_order_release);
+        }
+        if (len == 4) return 0;
+        uint32_t dropped = _dropped.load(std::memory_order_relaxed);
+        memcpy(out, &dropped, 4);
+        return len;
+    }
+
+    size_t used() const {
+        return _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_relaxed);
+    }
+
+    BinaryLogStats stats() const {
+        BinaryLogStats s;
+        s.records = _records.load(std::memory_order_relaxed);
+        s.dropped = _dropped.load(std::memory_order_relaxed);
+        s.truncated = _truncated.load(std::memory_order_relaxed);
+        s.maxUsed = _maxUsed.load(std::memory_order_relaxed);
+        return s;
+    }
+};
+
+inline BinaryLog binaryLog;
+
+#define LOG(id, ...) do { \
+        if constexpr (logLevelOf(id) >= LOG_MIN_LEVEL) { \
+            binaryLog.write(id, (uint32_t)LOG_CLOCK_US(), ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+// ==============================================================================
+// Decoding (host side)
+// ==============================================================================
+// Formats one record's message into `out`; returns the record's length, or
+// 0 if `avail` does not hold a whole record. Arguments that are missing or
+// do not match the format print as "?".
+inline size_t logFormatRecord(const uint8_t* rec, size_t avail, char* out, size_t outLen) {
+    if (avail < LOG_RECORD_HEADER || outLen == 0) return 0;
+    uint16_t id = (uint16_t)(rec[0] | (rec[1] << 8));
+    size_t n = LOG_RECORD_HEADER + rec[3];
+    if (n > avail) return 0;
+    const uint8_t* a = rec + LOG_RECORD_HEADER;
+    const uint8_t* end = rec + n;
+
+    const char* fmt = logFormatOf(id);
+    if (!fmt) {
+        snprintf(out, outLen, "log message %u (%u argument bytes)", id, rec[3]);
+        return n;
+    }
+
+    size_t o = 0;
+    auto append = [&](const char* s) {
+        while (*s && o + 1 < outLen) out[o++] = *s++;
+    };
+    while (*fmt) {
+        if (*fmt != '%') {
+            if (o + 1 < outLen) out[o++] = *fmt;
+            fmt++;
+            continue;
+        }
+        fmt++;
+        if (*fmt == '%') {
+            append("%");
+            fmt++;
+            continue;
+        }
+
+        // Flags, width and precision are kept; length modifiers are replaced
+        char spec[24];
+        size_t s = 0;
+        spec[s++] = '%';
+        while (*fmt && strchr("-+ #0123456789.", *fmt)) {
+            if (s < 16) spec[s++] = *fmt;
+            fmt++;
+        }
+        int longs = 0;
+        while (*fmt && strchr("hlLqjzt", *fmt)) {
+            if (*fmt == 'l') longs++;
+            fmt++;
+        }
+        char conv = *fmt ? *fmt++ : 0;
+
+        char piece[64] = "?";
+        bool wide = longs >= 2;
+        switch (conv) {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c': {
+                bool sign = conv == 'd' || conv == 'i';
+                if (wide && end - a >= 8) {
+                    uint64_t v;
+                    memcpy(&v, a, 8);
+                    a += 8;
+                    spec[s++] = 'l';
+                    spec[s++] = 'l';
+                    spec[s++] = conv;
+                    spec[s] = 0;
+                    if (sign) snprintf(piece, sizeof(piece), spec, (long long)v);
+                    else snprintf(piece, sizeof(piece), spec, (unsigned long long)v);
+                } else if (!wide && end - a >= 4) {
+                    uint32_t v;
+                    memcpy(&v, a, 4);
+                    a += 4;
+                    spec[s++] = conv;
+                    spec[s] = 0;
+                    if (sign) snprintf(piece, sizeof(piece), spec, (int)(int32_t)v);
+                    else snprintf(piece, sizeof(piece), spec, (unsigned)v);
+                } else {
+                    a = end;
+                }
+                break;
+            }
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                if (end - a >= 4) {
+                    float v;
+                    memcpy(&v, a, 4);
+                    a += 4;
+                    spec[s++] = conv;
+                    spec[s] = 0;
+                    snprintf(piece, sizeof(piece), spec, (double)v);
+                } else {
+                    a = end;
+                }
+                break;
+            case 's':
+                if (end - a >= 1 && (size_t)(end - a - 1) >= a[0]) {
+                    char str[LOG_MAX_STRING + 1];
+                    size_t len = a[0] < LOG_MAX_STRING ? a[0] : LOG_MAX_STRING;
+                    memcpy(str, a + 1, len);
+                    str[len] = 0;
+                    a += 1 + a[0];
+                    spec[s++] = 's';
+                    spec[s] = 0;
+                    snprintf(piece, sizeof(piece), spec, str);
+                } else {
+                    a = end;
+                }
+                break;
+            case 'p':
+                if (end - a >= 4) {
+                    uint32_t v;
+                    memcpy(&v, a, 4);
+                    a += 4;
+                    snprintf(piece, sizeof(piece), "0x%08x", (unsigned)v);
+                } else {
+                    a = end;
+                }
+                break;
+            default:
+                break;
+        }
+        append(piece);
+    }
+    out[o] = 0;
+    return n;
+}
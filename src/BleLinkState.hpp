@@ -0,0 +1,238 @@
+#pragma once
+
+// ==============================================================================
+// BLE Link State Machine
+// ==============================================================================
+// One connection state, driven by Bluedroid callbacks:
+//
+//   OFF -> ADVERTISING -> CONNECTING -> ENCRYPTED -> READY
+//                 ^            |            |          |
+//                 +------ DISCONNECTING <---+----------+
+//
+// READY means the link is encrypted and the host has enabled notifications
+// (the HID input report CCCD), i.e. keystrokes will actually be delivered.
+//
+// Writers: post() is only called from the BT task (GAP and GATTS callbacks
+// both run there), so transitions need no lock. Readers on any task (loop(),
+// UI, HID) see the state and its timestamps through atomics: the transition
+// time is stored before the state word is published with release ordering.
+// generation() changes on every transition, so a reader can tell that it
+// missed one.
+
+#include <stdint.h>
+#include <atomic>
+
+enum BleLinkStateId : uint8_t {
+    BLE_LINK_OFF = 0,
+    BLE_LINK_ADVERTISING,
+    BLE_LINK_CONNECTING,        // Link up, not yet encrypted
+    BLE_LINK_ENCRYPTED,         // Paired/re-encrypted, host not subscribed yet
+    BLE_LINK_READY,             // Reports are delivered
+    BLE_LINK_DISCONNECTING,     // We or the security layer are tearing it down
+    BLE_LINK_STATE_COUNT
+};
+
+enum BleLinkInput : uint8_t {
+    BLE_INPUT_ADV_STARTED = 0,  // ESP_GAP_BLE_ADV_START_COMPLETE_EVT
+    BLE_INPUT_ADV_STOPPED,      // ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT
+    BLE_INPUT_CONNECTED,        // ESP_GATTS_CONNECT_EVT
+    BLE_INPUT_AUTH_OK,          // ESP_GAP_BLE_AUTH_CMPL_EVT, success
+    BLE_INPUT_AUTH_FAILED,      // ESP_GAP_BLE_AUTH_CMPL_EVT, failure
+    BLE_INPUT_SUBSCRIBED,       // CCCD write enabling notifications
+    BLE_INPUT_DISCONNECT_REQUESTED,
+    BLE_INPUT_DISCONNECTED,     // ESP_GATTS_DISCONNECT_EVT
+    BLE_INPUT_COUNT
+};
+
+inline const char* bleLinkStateName(BleLinkStateId state) {
+    switch (state) {
+        case BLE_LINK_OFF:           return "off";
+        case BLE_LINK_ADVERTISING:   return "advertising";
+        case BLE_LINK_CONNECTING:    return "connecting";
+        case BLE_LINK_ENCRYPTED:     return "encrypted";
+        case BLE_LINK_READY:         return "ready";
+        case BLE_LINK_DISCONNECTING: return "disconnecting";
+        default:                     return "?";
+    }
+}
+
+inline const char* bleLinkInputName(BleLinkInput input) {
+    switch (input) {
+        case BLE_INPUT_ADV_STARTED:          return "adv-started";
+        case BLE_INPUT_ADV_STOPPED:          return "adv-stopped";
+        case BLE_INPUT_CONNECTED:            return "connected";
+        case BLE_INPUT_AUTH_OK:              return "auth-ok";
+        case BLE_INPUT_AUTH_FAILED:          return "auth-failed";
+        case BLE_INPUT_SUBSCRIBED:           return "subscribed";
+        case BLE_INPUT_DISCONNECT_REQUESTED: return "disconnect-requested";
+        case BLE_INPUT_DISCONNECTED:         return "disconnected";
+        default:                             return "?";
+    }
+}
+
+// Consistent copy of the published state
+struct BleLinkSnapshot {
+    BleLinkStateId state;
+    uint32_t generation;        // Transitions since boot
+    uint32_t enteredAt;         // clockMillis() of the transition into `state`
+    uint32_t connectedAt;       // Last CONNECTING entry
+    uint32_t readyAt;           // Last READY entry
+};
+
+class BleLinkState {
+private:
+    // state | generation << 8
+    std::atomic<uint32_t> _word;
+    std::atomic<uint32_t> _enteredAt[BLE_LINK_STATE_COUNT];
+    std::atomic<uint32_t> _connects;
+    std::atomic<uint32_t> _readies;
+    std::atomic<uint32_t> _ignored;
+    std::atomic<uint32_t> _lastReadyLatency;    // CONNECTING -> READY, ms
+    std::atomic<uint32_t> _maxReadyLatency;
+
+    // Writer-private (BT task): notifications enabled on this link
+    bool _subscribed;
+
+    static BleLinkStateId stateOf(uint32_t word) { return (BleLinkStateId)(word & 0xFF); }
+
+    void enter(BleLinkStateId to, uint32_t now) {
+        uint32_t word = _word.load(std::memory_order_relaxed);
+        _enteredAt[to].store(now, std::memory_order_relaxed);
+        if (to == BLE_LINK_CONNECTING) {
+            _connects.fetch_add(1, std::memory_order_relaxed);
+        } else if (to == BLE_LINK_READY) {
+            uint32_t latency = now - _enteredAt[BLE_LINK_CONNECTING].load(std::memory_order_relaxed);
+            _lastReadyLatency.store(latency, std::memory_order_relaxed);
+            if (latency > _maxReadyLatency.load(std::memory_order_relaxed)) {
+                _maxReadyLatency.store(latency, std::memory_order_relaxed);
+            }
+            _readies.fetch_add(1, std::memory_order_relaxed);
+        }
+        _word.store((((word >> 8) + 1) << 8) | to, std::memory_order_release);
+    }
+
+    // Transition table; BLE_LINK_STATE_COUNT = input not valid in `from`
+    BleLinkStateId next(BleLinkStateId from, BleLinkInput input) {
+        switch (input) {
+            case BLE_INPUT_ADV_STARTED:
+                return (from == BLE_LINK_OFF || from == BLE_LINK_ADVERTISING ||
+                        from == BLE_LINK_DISCONNECTING) ? BLE_LINK_ADVERTISING
+                                                        : BLE_LINK_STATE_COUNT;
+            case BLE_INPUT_ADV_STOPPED:
+                return from == BLE_LINK_ADVERTISING ? BLE_LINK_OFF : BLE_LINK_STATE_COUNT;
+            case BLE_INPUT_CONNECTED:
+                // Advertising stops implicitly when a central connects
+                return (from == BLE_LINK_ADVERTISING || from == BLE_LINK_OFF)
+                    ? BLE_LINK_CONNECTING : BLE_LINK_STATE_COUNT;
+            case BLE_INPUT_AUTH_OK:
+                if (from != BLE_LINK_CONNECTING && from != BLE_LINK_ENCRYPTED) break;
+                return _subscribed ? BLE_LINK_READY : BLE_LINK_ENCRYPTED;
+            case BLE_INPUT_AUTH_FAILED:
+                return (from == BLE_LINK_CONNECTING || from == BLE_LINK_ENCRYPTED ||
+                        from == BLE_LINK_READY) ? BLE_LINK_DISCONNECTING : BLE_LINK_STATE_COUNT;
+            case BLE_INPUT_SUBSCRIBED:
+                if (from == BLE_LINK_ENCRYPTED) return BLE_LINK_READY;
+                // Before encryption: remembered for AUTH_OK
+                return from == BLE_LINK_CONNECTING || from == BLE_LINK_READY
+                    ? from : BLE_LINK_STATE_COUNT;
+            case BLE_INPUT_DISCONNECT_REQUESTED:
+                return (from == BLE_LINK_CONNECTING || from == BLE_LINK_ENCRYPTED ||
+                        from == BLE_LINK_READY) ? BLE_LINK_DISCONNECTING : BLE_LINK_STATE_COUNT;
+            case BLE_INPUT_DISCONNECTED:
+                // BleKeyboard restarts advertising from its disconnect callback
+                return (from == BLE_LINK_CONNECTING || from == BLE_LINK_ENCRYPTED ||
+                        from == BLE_LINK_READY || from == BLE_LINK_DISCONNECTING)
+                    ? BLE_LINK_ADVERTISING : BLE_LINK_STATE_COUNT;
+            default:
+                break;
+        }
+        return BLE_LINK_STATE_COUNT;
+    }
+
+public:
+    BleLinkState() : _word(BLE_LINK_OFF), _connects(0), _readies(0), _ignored(0),
+                     _lastReadyLatency(0), _maxReadyLatency(0),
+                     _subscribed(false) {
+        for (int i = 0; i < BLE_LINK_STATE_COUNT; i++) _enteredAt[i].store(0);
+    }
+
+    // Feeds one stack event (BT task only). Returns false if the event does
+    // not apply in the current state; it is counted and otherwise ignored.
+    bool post(BleLinkInput input, uint32_t now) {
+        BleLinkStateId from = stateOf(_word.load(std::memory_order_relaxed));
+        BleLinkStateId to = next(from, input);
+        if (to == BLE_LINK_STATE_COUNT) {
+            _ignored.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        if (to != from && (to == BLE_LINK_ADVERTISING || to == BLE_LINK_CONNECTING)) {
+            _subscribed = false;
+        }
+        if (input == BLE_INPUT_SUBSCRIBED) _subscribed = true;
+
+        if (to != from) enter(to, now);
+        return true;
+    }
+
+    // ==== Readers (any task) ====
+    BleLinkStateId state() const {
+        return stateOf(_word.load(std::memory_order_acquire));
+    }
+
+    uint32_t generation() const {
+        return _word.load(std::memory_order_acquire) >> 8;
+    }
+
+    bool isReady() const { return state() == BLE_LINK_READY; }
+
+    // Link layer up (encrypted or not)
+    bool isConnected() const {
+        BleLinkStateId s = state();
+        return s == BLE_LINK_CONNECTING || s == BLE_LINK_ENCRYPTED || s == BLE_LINK_READY;
+    }
+
+    uint32_t enteredAt(BleLinkStateId state) const {
+        return _enteredAt[state].load(std::memory_order_relaxed);
+    }
+
+    BleLinkSnapshot snapshot() const {
+        BleLinkSnapshot s;
+        uint32_t word;
+        do {
+            word = _word.load(std::memory_order_acquire);
+            s.state = stateOf(word);
+            s.generation = word >> 8;
+            s.enteredAt = _enteredAt[s.state].load(std::memory_order_relaxed);
+            s.connectedAt = _enteredAt[BLE_LINK_CONNECTING].load(std::memory_order_relaxed);
+            s.readyAt = _enteredAt[BLE_LINK_READY].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while (_word.load(std::memory_order_relaxed) != word);
+        return s;
+    }
+
+    uint32_t connects() const { return _connects.load(std::memory_order_relaxed); }
+    uint32_t readies() const { return _readies.load(std::memory_order_relaxed); }
+    uint32_t ignoredEvents() const { return _ignored.load(std::memory_order_relaxed); }
+    uint32_t lastReadyLatency() const { return _lastReadyLatency.load(std::memory_order_relaxed); }
+    uint32_t maxReadyLatency() const { return _maxReadyLatency.load(std::memory_order_relaxed); }
+};
+
+// Details of link events, forwarded from the stack's task to loop() (the
+// state above says what the link is; these say with whom and how)
+enum BleLinkEventType : uint8_t {
+    BLE_LINK_CONNECTED = 0,
+    BLE_LINK_DISCONNECTED,
+    BLE_LINK_PARAMS_UPDATED,
+    BLE_LINK_BONDED             // Pairing or re-encryption succeeded
+};
+
+struct BleLinkEvent {
+    BleLinkEventType type;
+    uint8_t status;             // PARAMS_UPDATED: 0 = applied
+    uint16_t interval;          // 1.25 ms units
+    uint16_t latency;
+    uint16_t timeout;           // 10 ms units
+    uint8_t peer[6];
+    uint8_t addrType;           // BONDED: esp_ble_addr_type_t of `peer`
+};
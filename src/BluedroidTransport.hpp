@@ -0,0 +1,426 @@
+#pragma once
+
+// ==============================================================================
+// Bluedroid HID Transport
+// ==============================================================================
+// BleKeyboard on the Arduino Bluedroid stack (the default build). Stack
+// events arrive through the custom GAP/GATTS handlers the Arduino BLE library
+// forwards to; the glue classes give the policy engines (connection
+// parameters, reconnect advertising, host switching) their view of the stack.
+// Included by BLEConfig.hpp; see HidTransport.hpp for the NimBLE option.
+
+#include <esp_bt.h>
+#include <esp_gap_ble_api.h>
+#include <esp_gatts_api.h>
+#include <esp_bt_main.h>
+#include <esp_bt_device.h>
+#include <BLEDevice.h>
+
+// Current link's GATT connection and whether the stack reported it congested
+// (ESP_GATTS_CONGEST_EVT); read by the HID transport
+static std::atomic<uint16_t> bleConnId(0);
+static std::atomic<bool> bleCongested(false);
+
+// ==============================================================================
+// Stack Event Handlers (BT task)
+// ==============================================================================
+
+// GAP event handler for connection events
+static void ble_gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+    switch (event) {
+        case ESP_GAP_BLE_ADV_START_COMPLETE_EVT:
+            if (param->adv_start_cmpl.status == ESP_BT_STATUS_SUCCESS) {
+                bleLink.post(BLE_INPUT_ADV_STARTED, clockMillis());
+            }
+            break;
+
+        case ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT:
+            bleLink.post(BLE_INPUT_ADV_STOPPED, clockMillis());
+            break;
+
+        case ESP_GAP_BLE_AUTH_CMPL_EVT: {
+            if (param->ble_security.auth_cmpl.success) {
+                // loop() checks the host against the slots; queued before the
+                // transition so it is seen no later than READY
+                BleLinkEvent ev;
+                memset(&ev, 0, sizeof(ev));
+                ev.type = BLE_LINK_BONDED;
+                memcpy(ev.peer, param->ble_security.auth_cmpl.bd_addr, sizeof(esp_bd_addr_t));
+                ev.addrType = param->ble_security.auth_cmpl.addr_type;
+                postBLELinkEvent(ev);
+            }
+            bleLink.post(param->ble_security.auth_cmpl.success ? BLE_INPUT_AUTH_OK
+                                                               : BLE_INPUT_AUTH_FAILED, clockMillis());
+            Serial.println("BLE: Authentication complete");
+            if (param->ble_security.auth_cmpl.success) {
+                Serial.println("  Status: success, device bonded");
+            } else {
+                Serial.printf("  Status: fail, reason: 0x%x\n",
+                    param->ble_security.auth_cmpl.fail_reason);
+            }
+            break;
+        }
+
+        case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT: {
+            // Runs on the BT task: hand the outcome to loop()
+            BleLinkEvent ev;
+            ev.type = BLE_LINK_PARAMS_UPDATED;
+            ev.status = param->update_conn_params.status;
+            ev.interval = param->update_conn_params.conn_int;
+            ev.latency = param->update_conn_params.latency;
+            ev.timeout = param->update_conn_params.timeout;
+            memcpy(ev.peer, param->update_conn_params.bda, sizeof(esp_bd_addr_t));
+            postBLELinkEvent(ev);
+            break;
+        }
+
+        case ESP_GAP_BLE_PASSKEY_NOTIF_EVT: {
+            Serial.printf("BLE: Passkey notification: %06d\n",
+                param->ble_security.key_notif.passkey);
+            break;
+        }
+
+        case ESP_GAP_BLE_PASSKEY_REQ_EVT: {
+            Serial.println("BLE: Passkey request");
+            // For IO_CAP_NONE, this shouldn't happen
+            break;
+        }
+
+        case ESP_GAP_BLE_OOB_REQ_EVT: {
+            Serial.println("BLE: OOB data request");
+            break;
+        }
+
+        case ESP_GAP_BLE_NC_REQ_EVT: {
+            Serial.printf("BLE: Numeric comparison request: %06d\n",
+                param->ble_security.key_notif.passkey);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+// GATT server event handler for connection/disconnection
+static void ble_gatts_event_handler(esp_gatts_cb_event_t event,
+                                    esp_gatt_if_t gatts_if,
+                                    esp_ble_gatts_cb_param_t* param) {
+    switch (event) {
+        case ESP_GATTS_CONNECT_EVT: {
+            Serial.println("BLE GATTS: Client connected");
+            Serial.printf("  Connection handle: %d\n", param->connect.conn_id);
+            Serial.printf("  Remote address: %02X:%02X:%02X:%02X:%02X:%02X\n",
+                param->connect.remote_bda[0], param->connect.remote_bda[1],
+                param->connect.remote_bda[2], param->connect.remote_bda[3],
+                param->connect.remote_bda[4], param->connect.remote_bda[5]);
+
+            bleConnId.store(param->connect.conn_id);
+            bleCongested.store(false);
+            bleLink.post(BLE_INPUT_CONNECTED, clockMillis());
+
+            // Parameters are negotiated from loop() once the link settles
+            BleLinkEvent ev;
+            ev.type = BLE_LINK_CONNECTED;
+            ev.status = 0;
+            ev.interval = param->connect.conn_params.interval;
+            ev.latency = param->connect.conn_params.latency;
+            ev.timeout = param->connect.conn_params.timeout;
+            memcpy(ev.peer, param->connect.remote_bda, sizeof(esp_bd_addr_t));
+            postBLELinkEvent(ev);
+            break;
+        }
+
+        case ESP_GATTS_DISCONNECT_EVT: {
+            Serial.println("BLE GATTS: Client disconnected");
+            Serial.printf("  Reason: 0x%04x\n", param->disconnect.reason);
+            Serial.printf("  Connection duration: %lu ms\n",
+                clockMillis() - bleLink.enteredAt(BLE_LINK_CONNECTING));
+            bleLink.post(BLE_INPUT_DISCONNECTED, clockMillis());
+
+            BleLinkEvent ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.type = BLE_LINK_DISCONNECTED;
+            memcpy(ev.peer, param->disconnect.remote_bda, sizeof(esp_bd_addr_t));
+            postBLELinkEvent(ev);
+            break;
+        }
+
+        case ESP_GATTS_CONF_EVT:
+            // Sent for notifications too, once the stack has taken them
+            onHidReportSent(param->conf.status == ESP_GATT_OK);
+            break;
+
+        case ESP_GATTS_CONGEST_EVT:
+            bleCongested.store(param->congest.congested);
+            break;
+
+        case ESP_GATTS_WRITE_EVT:
+            // A 2-byte write with the notify bit set is a CCCD (the HID report
+            // characteristics themselves take 1-byte LED output reports)
+            if (!param->write.is_prep && param->write.len == 2 && (param->write.value[0] & 0x01)) {
+                bleLink.post(BLE_INPUT_SUBSCRIBED, clockMillis());
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+// ==============================================================================
+// Connection Parameters Update
+// ==============================================================================
+
+bool updateConnectionParams(const esp_bd_addr_t peer, const ConnParams& params) {
+    esp_ble_conn_update_params_t update;
+    memcpy(update.bda, peer, sizeof(esp_bd_addr_t));
+    update.min_int = params.minInterval;
+    update.max_int = params.maxInterval;
+    update.latency = params.latency;
+    update.timeout = params.timeout;
+
+    esp_err_t ret = esp_ble_gap_update_conn_params(&update);
+    if (ret != ESP_OK) {
+        Serial.printf("BLE: Connection param request failed: %d\n", ret);
+        return false;
+    }
+    Serial.printf("BLE: Requested interval %.2f-%.2f ms, latency %d, timeout %d ms\n",
+        params.minInterval * 1.25, params.maxInterval * 1.25, params.latency,
+        params.timeout * 10);
+    return true;
+}
+
+// ConnParamPolicy's view of the stack: the peer of the current link
+class EspConnParamGap : public ConnParamGap {
+private:
+    esp_bd_addr_t _peer;
+
+public:
+    EspConnParamGap() { memset(_peer, 0, sizeof(_peer)); }
+
+    void setPeer(const esp_bd_addr_t peer) { memcpy(_peer, peer, sizeof(_peer)); }
+
+    bool requestConnParams(const ConnParams& params) override {
+        return updateConnectionParams(_peer, params);
+    }
+};
+
+// ==============================================================================
+// Reconnect Advertising
+// ==============================================================================
+// ReconnectEngine's view of the stack. BleKeyboard starts undirected
+// advertising itself (at begin() and on every disconnect); each phase
+// stops whatever is running and starts its own parameters, reusing the
+// advertising data the library configured.
+class EspAdvertisingGap : public AdvertisingGap {
+public:
+    bool startAdvertising(AdvPhase phase, const BlePeer* peer) override {
+        esp_ble_adv_params_t params;
+        memset(&params, 0, sizeof(params));
+        params.own_addr_type = BLE_ADDR_TYPE_PUBLIC;
+        params.channel_map = ADV_CHNL_ALL;
+        params.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+
+        if (phase == ADV_PHASE_DIRECTED && peer != nullptr && peer->valid) {
+            // Interval is ignored: high duty cycle advertises every <= 3.75 ms
+            params.adv_type = ADV_TYPE_DIRECT_IND_HIGH;
+            params.adv_int_min = RECONNECT_FAST_ADV_MIN;
+            params.adv_int_max = RECONNECT_FAST_ADV_MAX;
+            memcpy(params.peer_addr, peer->addr, sizeof(esp_bd_addr_t));
+            params.peer_addr_type = (esp_ble_addr_type_t)peer->addrType;
+        } else if (phase == ADV_PHASE_SLOW) {
+            params.adv_type = ADV_TYPE_IND;
+            params.adv_int_min = RECONNECT_SLOW_ADV_MIN;
+            params.adv_int_max = RECONNECT_SLOW_ADV_MAX;
+        } else {
+            params.adv_type = ADV_TYPE_IND;
+            params.adv_int_min = RECONNECT_FAST_ADV_MIN;
+            params.adv_int_max = RECONNECT_FAST_ADV_MAX;
+        }
+
+        esp_ble_gap_stop_advertising();
+
+        // Exclusive undirected phase: only the white-listed host may connect
+        // (anyone may still scan, so the device stays visible)
+        if (phase != ADV_PHASE_DIRECTED && peer != nullptr && peer->valid) {
+            esp_bd_addr_t addr;
+            memcpy(addr, peer->addr, sizeof(addr));
+            esp_ble_gap_clear_whitelist();
+            esp_ble_gap_update_whitelist(true, addr,
+                peer->addrType == BLE_ADDR_TYPE_PUBLIC ? BLE_WL_ADDR_TYPE_PUBLIC
+                                                       : BLE_WL_ADDR_TYPE_RANDOM);
+            params.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_WLST;
+        }
+
+        esp_err_t ret = esp_ble_gap_start_advertising(&params);
+        if (ret != ESP_OK) {
+            Serial.printf("BLE: %s advertising failed: %d\n", advPhaseName(phase), ret);
+            return false;
+        }
+        Serial.printf("BLE: %s advertising\n", advPhaseName(phase));
+        return true;
+    }
+};
+
+// Maps the address a host paired from to its identity address. Hosts using
+// resolvable private addresses distribute an identity key; directed
+// advertising must target the identity address so the controller can
+// match it through the resolving list.
+bool resolveBondedPeer(const esp_bd_addr_t addr, uint8_t addrType, BlePeer& out) {
+    out = BlePeer();
+    int count = esp_ble_get_bond_device_num();
+    if (count <= 0) return false;
+    esp_ble_bond_dev_t* list = (esp_ble_bond_dev_t*)malloc(sizeof(esp_ble_bond_dev_t) * count);
+    if (list == nullptr) return false;
+    esp_ble_get_bond_device_list(&count, list);
+
+    for (int i = 0; i < count && !out.valid; i++) {
+        const esp_ble_bond_key_info_t& key = list[i].bond_key;
+        bool hasIdentity = (key.key_mask & ESP_BLE_ID_KEY_MASK) != 0;
+        if (memcmp(list[i].bd_addr, addr, sizeof(esp_bd_addr_t)) != 0 &&
+            !(hasIdentity && memcmp(key.pid_key.static_addr, addr, sizeof(esp_bd_addr_t)) == 0)) {
+            continue;
+        }
+        if (hasIdentity) {
+            memcpy(out.addr, key.pid_key.static_addr, sizeof(out.addr));
+            out.addrType = key.pid_key.addr_type;
+        } else {
+            memcpy(out.addr, addr, sizeof(out.addr));
+            out.addrType = addrType;
+        }
+        out.valid = true;
+    }
+    free(list);
+    return out.valid;
+}
+
+// Removes the stack's bond for a host given by identity address
+void removeBondedPeer(const BlePeer& peer) {
+    int count = esp_ble_get_bond_device_num();
+    if (count <= 0 || !peer.valid) return;
+    esp_ble_bond_dev_t* list = (esp_ble_bond_dev_t*)malloc(sizeof(esp_ble_bond_dev_t) * count);
+    if (list == nullptr) return;
+    esp_ble_get_bond_device_list(&count, list);
+    for (int i = 0; i < count; i++) {
+        const esp_ble_bond_key_info_t& key = list[i].bond_key;
+        bool match = memcmp(list[i].bd_addr, peer.addr, sizeof(esp_bd_addr_t)) == 0 ||
+            ((key.key_mask & ESP_BLE_ID_KEY_MASK) &&
+             memcmp(key.pid_key.static_addr, peer.addr, sizeof(esp_bd_addr_t)) == 0);
+        if (match) esp_ble_remove_bond_device(list[i].bd_addr);
+    }
+    free(list);
+}
+
+// HostSwitcher's view of the stack: the peer of the current link
+class EspHostLinkControl : public HostLinkControl {
+private:
+    esp_bd_addr_t _peer;
+
+public:
+    EspHostLinkControl() { memset(_peer, 0, sizeof(_peer)); }
+
+    void setPeer(const esp_bd_addr_t peer) { memcpy(_peer, peer, sizeof(_peer)); }
+
+    bool disconnect() override {
+        esp_err_t ret = esp_ble_gap_disconnect(_peer);
+        if (ret != ESP_OK) {
+            Serial.printf("BLE: Disconnect failed: %d\n", ret);
+            return false;
+        }
+        return true;
+    }
+};
+
+// ==============================================================================
+// HID Transport
+// ==============================================================================
+// BleKeyboard's input report characteristics, and Bluedroid's free buffer
+// count for the link. begin() hooks the handlers above into the Arduino BLE
+// library BleKeyboard runs on, then starts the keyboard (which brings up
+// Bluedroid and starts advertising).
+class BluedroidHidTransport : public HidTransport {
+private:
+    BleKeyboard* _keyboard;
+
+protected:
+    bool sendKeyboardReport(uint8_t modifiers, const uint8_t keys[6]) override {
+        if (!_keyboard->isConnected()) return false;
+        KeyReport report;
+        report.modifiers = modifiers;
+        report.reserved = 0;
+        memcpy(report.keys, keys, sizeof(report.keys));
+        _keyboard->sendReport(&report);
+        return true;
+    }
+
+    bool sendConsumerReport(uint8_t low, uint8_t high) override {
+        if (!_keyboard->isConnected()) return false;
+        MediaKeyReport report = {low, high};
+        _keyboard->sendReport(&report);
+        return true;
+    }
+
+    uint32_t clockUs() override { return clockMicros(); }
+
+public:
+    explicit BluedroidHidTransport(BleKeyboard* keyboard) : _keyboard(keyboard) {}
+
+    const char* name() const override { return "bluedroid"; }
+
+    bool begin() override {
+        initBLELinkEvents();
+        BLEDevice::setCustomGapHandler(ble_gap_event_handler);
+        BLEDevice::setCustomGattsHandler(ble_gatts_event_handler);
+        _keyboard->begin();
+        return true;
+    }
+
+    int sendable() override {
+        if (bleCongested.load()) return 0;
+        return esp_ble_get_cur_sendable_packets_num(bleConnId.load());
+    }
+};
+
+typedef BluedroidHidTransport PlatformHidTransport;
+
+// ==============================================================================
+// Bonding Management
+// ==============================================================================
+
+void clearBLEBondingData() {
+    Serial.println("BLE: Clearing all bonding data...");
+
+    // Remove all bonded devices
+    int dev_num = esp_ble_get_bond_device_num();
+    Serial.printf("BLE: Found %d bonded devices\n", dev_num);
+
+    if (dev_num > 0) {
+        esp_ble_bond_dev_t* dev_list = (esp_ble_bond_dev_t*)malloc(
+            sizeof(esp_ble_bond_dev_t) * dev_num);
+        if (dev_list) {
+            esp_ble_get_bond_device_list(&dev_num, dev_list);
+            for (int i = 0; i < dev_num; i++) {
+                Serial.printf("BLE: Removing bond for %02X:%02X:%02X:%02X:%02X:%02X\n",
+                    dev_list[i].bd_addr[0], dev_list[i].bd_addr[1],
+                    dev_list[i].bd_addr[2], dev_list[i].bd_addr[3],
+                    dev_list[i].bd_addr[4], dev_list[i].bd_addr[5]);
+                esp_ble_remove_bond_device(dev_list[i].bd_addr);
+            }
+            free(dev_list);
+        }
+    }
+
+    // Also clear NVS
+    esp_err_t ret = nvs_flash_erase();
+    if (ret == ESP_OK) {
+        Serial.println("BLE: NVS erased");
+    }
+
+    ret = nvs_flash_init();
+    if (ret == ESP_OK) {
+        Serial.println("BLE: NVS reinitialized");
+    }
+
+    Serial.println("BLE: Bonding data cleared - please re-pair your device");
+}
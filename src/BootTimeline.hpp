@@ -0,0 +1,78 @@
+#pragma once
+
+// ==============================================================================
+// Boot Timeline
+// ==============================================================================
+// Timestamps of the boot phases, in microseconds since reset. setup() and
+// the BLE start task each mark their own phases (they run in parallel, on
+// different cores); the advertising phase comes from BleLinkState. loop()
+// prints the timeline once the first frame is up and advertising has
+// started, so every boot reports boot-to-first-frame and
+// boot-to-advertising.
+
+#include <stdint.h>
+#include <atomic>
+
+enum BootPhase : uint8_t {
+    BOOT_SETUP = 0,             // setup() entered
+    BOOT_PANEL_START,
+    BOOT_PANEL_DONE,            // ST7701 configured
+    BOOT_TFT_DONE,              // RGB bus running
+    BOOT_PROFILES_DONE,
+    BOOT_FIRST_FRAME,           // UI drawn, backlight on
+    BOOT_BLE_START,             // BLE start task running
+    BOOT_BLE_DONE,              // Stack up, HID service registered
+    BOOT_ADVERTISING,
+    BOOT_SETUP_DONE,
+    BOOT_PHASE_COUNT
+};
+
+inline const char* bootPhaseName(BootPhase phase) {
+    switch (phase) {
+        case BOOT_SETUP:         return "setup";
+        case BOOT_PANEL_START:   return "panel init";
+        case BOOT_PANEL_DONE:    return "panel ready";
+        case BOOT_TFT_DONE:      return "rgb bus";
+        case BOOT_PROFILES_DONE: return "profiles";
+        case BOOT_FIRST_FRAME:   return "first frame";
+        case BOOT_BLE_START:     return "ble start";
+        case BOOT_BLE_DONE:      return "ble ready";
+        case BOOT_ADVERTISING:   return "advertising";
+        case BOOT_SETUP_DONE:    return "setup done";
+        default:                 return "?";
+    }
+}
+
+class BootTimeline {
+private:
+    std::atomic<uint32_t> _at[BOOT_PHASE_COUNT];    // 0 = not reached
+    bool _reported;
+
+public:
+    BootTimeline() : _reported(false) {
+        for (int i = 0; i < BOOT_PHASE_COUNT; i++) _at[i].store(0);
+    }
+
+    // First time only; `nowUs` since reset (never 0 in practice)
+    void mark(BootPhase phase, uint32_t nowUs) {
+        uint32_t none = 0;
+        _at[phase].compare_exchange_strong(none, nowUs ? nowUs : 1, std::memory_order_relaxed);
+    }
+
+    bool reached(BootPhase phase) const { return _at[phase].load(std::memory_order_relaxed) != 0; }
+    uint32_t atUs(BootPhase phase) const { return _at[phase].load(std::memory_order_relaxed); }
+    uint32_t atMs(BootPhase phase) const { return atUs(phase) / 1000; }
+
+    // Time between two phases; 0 if either is missing
+    uint32_t spanUs(BootPhase from, BootPhase to) const {
+        if (!reached(from) || !reached(to) || atUs(to) < atUs(from)) return 0;
+        return atUs(to) - atUs(from);
+    }
+
+    // True once, when the phases worth reporting are in
+    bool takeReport() {
+        if (_reported || !reached(BOOT_FIRST_FRAME) || !reached(BOOT_ADVERTISING)) return false;
+        _reported = true;
+        return true;
+    }
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+// ==============================================================================
+// Clock
+// ==============================================================================
+// Where firmware code reads the time. On the device clockMillis() and
+// clockMicros() return what millis() and micros() would (both come from
+// esp_timer). A host simulation (host/device_sim.cpp) installs a virtual
+// clock with setClockSource() and advances it itself, so the UI, the link
+// glue and loop()'s timers all run on simulated time.
+//
+// Components that are handed `now` (gestures, executor, queues, policies)
+// don't read a clock at all; this is for the places that do.
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_timer.h>
+#else
+#include <chrono>
+#endif
+
+// Microseconds since boot, 64-bit so millis derived from it don't wrap with micros
+typedef uint64_t (*ClockSource)();
+
+inline uint64_t systemClockMicros() {
+#ifdef ARDUINO
+    return (uint64_t)esp_timer_get_time();
+#else
+    static const auto start = std::chrono::steady_clock::now();
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+#endif
+}
+
+inline ClockSource clockSource = systemClockMicros;
+
+// nullptr restores the system clock
+inline void setClockSource(ClockSource source) {
+    clockSource = source ? source : systemClockMicros;
+}
+
+inline uint64_t clockMicros64() { return clockSource(); }
+inline uint32_t clockMicros() { return (uint32_t)clockSource(); }
+inline uint32_t clockMillis() { return (uint32_t)(clockSource() / 1000); }
@@ -0,0 +1,307 @@
+#pragma once
+
+// ==============================================================================
+// BLE Connection Parameter Policy
+// ==============================================================================
+// Asks the central for the shortest connection interval with no slave
+// latency while the pad is in use, then for a longer interval with slave
+// latency once it has been idle for BLE_IDLE_AFTER_MS. Each request is
+// tracked until ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT reports the outcome;
+// rejected or unanswered requests are retried with backoff, up to
+// BLE_CONN_UPDATE_RETRIES times per mode change.
+//
+// The policy talks to the stack only through ConnParamGap, so it runs on the
+// host against a scripted GAP (host/connparam_sim.cpp). All calls come from
+// loop(); stack callbacks are forwarded there by the device glue.
+
+#include <stdint.h>
+#include <string.h>
+
+// Active: 7.5 ms, answer every connection event
+#ifndef BLE_ACTIVE_INTERVAL
+#define BLE_ACTIVE_INTERVAL         6       // 1.25 ms units
+#endif
+#define BLE_ACTIVE_LATENCY          0
+
+// Idle: 30-50 ms, skip up to 4 events (worst-case wake-up ~250 ms)
+#ifndef BLE_IDLE_MIN_INTERVAL
+#define BLE_IDLE_MIN_INTERVAL       24
+#endif
+#ifndef BLE_IDLE_MAX_INTERVAL
+#define BLE_IDLE_MAX_INTERVAL       40
+#endif
+#ifndef BLE_IDLE_LATENCY
+#define BLE_IDLE_LATENCY            4
+#endif
+
+// Supervision timeout for both modes (10 ms units)
+#ifndef BLE_SUPERVISION_TIMEOUT
+#define BLE_SUPERVISION_TIMEOUT     400     // 4 s
+#endif
+
+// Inactivity before backing off to the idle parameters
+#ifndef BLE_IDLE_AFTER_MS
+#define BLE_IDLE_AFTER_MS           5000
+#endif
+
+// Give up waiting for an answer after this long
+#define BLE_CONN_UPDATE_TIMEOUT_MS  2000
+
+// Retries per mode change; the delay doubles from BLE_CONN_RETRY_BASE_MS
+#define BLE_CONN_UPDATE_RETRIES     3
+#define BLE_CONN_RETRY_BASE_MS      1000
+
+// Centrals only negotiate parameters once the link is settled
+#define BLE_CONN_SETTLE_MS          1000
+
+// The supervision timeout must outlast the longest gap between answered events
+static_assert(BLE_SUPERVISION_TIMEOUT * 10 >
+              (1 + BLE_IDLE_LATENCY) * BLE_IDLE_MAX_INTERVAL * 125 / 100 * 2,
+              "Idle slave latency does not fit in the supervision timeout");
+
+struct ConnParams {
+    uint16_t minInterval;       // 1.25 ms units
+    uint16_t maxInterval;
+    uint16_t latency;           // Connection events the peripheral may skip
+    uint16_t timeout;           // 10 ms units
+};
+
+enum ConnParamMode : uint8_t {
+    CONN_MODE_NONE = 0,         // Not connected
+    CONN_MODE_ACTIVE,
+    CONN_MODE_IDLE
+};
+
+inline const char* connParamModeName(ConnParamMode mode) {
+    switch (mode) {
+        case CONN_MODE_ACTIVE: return "active";
+        case CONN_MODE_IDLE:   return "idle";
+        default:               return "none";
+    }
+}
+
+inline ConnParams connParamsFor(ConnParamMode mode) {
+    ConnParams p;
+    if (mode == CONN_MODE_ACTIVE) {
+        p.minInterval = BLE_ACTIVE_INTERVAL;
+        p.maxInterval = BLE_ACTIVE_INTERVAL;
+        p.latency = BLE_ACTIVE_LATENCY;
+    } else {
+        p.minInterval = BLE_IDLE_MIN_INTERVAL;
+        p.maxInterval = BLE_IDLE_MAX_INTERVAL;
+        p.latency = BLE_IDLE_LATENCY;
+    }
+    p.timeout = BLE_SUPERVISION_TIMEOUT;
+    return p;
+}
+
+// Stack access: the device sends esp_ble_gap_update_conn_params()
+class ConnParamGap {
+public:
+    virtual ~ConnParamGap() {}
+    // Returns false if the request could not be issued at all
+    virtual bool requestConnParams(const ConnParams& params) = 0;
+};
+
+struct ConnParamStats {
+    uint32_t requests;
+    uint32_t accepted;          // Central applied parameters inside the requested range
+    uint32_t compromised;       // Central answered with other parameters
+    uint32_t rejected;          // Non-zero status
+    uint32_t timeouts;
+    uint32_t unsolicited;       // Central changed parameters on its own
+    uint32_t activeMs;          // Time on the active / idle parameters
+    uint32_t idleMs;
+
+    ConnParamStats() : requests(0), accepted(0), compromised(0), rejected(0), timeouts(0),
+                       unsolicited(0), activeMs(0), idleMs(0) {}
+};
+
+class ConnParamPolicy {
+private:
+    ConnParamGap* _gap;
+    bool _connected;
+    uint32_t _connectedAt;
+    uint32_t _lastActivity;
+
+    ConnParamMode _wanted;      // What the policy wants now
+    ConnParamMode _requested;   // Outstanding request (NONE = none in flight)
+    ConnParamMode _applied;     // What the link is running, as far as we know
+    uint32_t _requestedAt;
+    uint32_t _retryAt;          // Earliest time for the next attempt
+    uint8_t _attempts;          // Attempts for the current _wanted
+    bool _gaveUp;
+
+    // Negotiated values from the last update event
+    uint16_t _interval;
+    uint16_t _latency;
+    uint16_t _timeout;
+
+    uint32_t _lastAccounting;
+    ConnParamStats _stats;
+
+    void account(uint32_t now) {
+        uint32_t elapsed = now - _lastAccounting;
+        _lastAccounting = now;
+        if (!_connected) return;
+        if (_applied == CONN_MODE_ACTIVE) _stats.activeMs += elapsed;
+        else if (_applied == CONN_MODE_IDLE) _stats.idleMs += elapsed;
+    }
+
+    void want(ConnParamMode mode) {
+        if (mode == _wanted) return;
+        _wanted = mode;
+        _attempts = 0;
+        _gaveUp = false;
+    }
+
+    void send(uint32_t now) {
+        _attempts++;
+        _stats.requests++;
+        if (_gap->requestConnParams(connParamsFor(_wanted))) {
+            _requested = _wanted;
+            _requestedAt = now;
+        } else {
+            scheduleRetry(now);
+        }
+    }
+
+    void scheduleRetry(uint32_t now) {
+        _requested = CONN_MODE_NONE;
+        if (_attempts == 0) {
+            // The answer was for a mode we no longer want: ask for the new one now
+            _retryAt = now;
+            return;
+        }
+        if (_attempts > BLE_CONN_UPDATE_RETRIES) {
+            _gaveUp = true;
+            return;
+        }
+        _retryAt = now + (BLE_CONN_RETRY_BASE_MS << (_attempts - 1));
+    }
+
+public:
+    explicit ConnParamPolicy(ConnParamGap* gap)
+        : _gap(gap), _connected(false), _connectedAt(0), _lastActivity(0),
+          _wanted(CONN_MODE_NONE), _requested(CONN_MODE_NONE), _applied(CONN_MODE_NONE),
+          _requestedAt(0), _retryAt(0), _attempts(0), _gaveUp(false),
+          _interval(0), _latency(0), _timeout(0), _lastAccounting(0) {}
+
+    // Pass the parameters the link was opened with, if known
+    void onConnected(uint32_t now, uint16_t interval = 0, uint16_t latency = 0,
+                     uint16_t timeout = 0) {
+        account(now);
+        _connected = true;
+        _connectedAt = now;
+        _lastActivity = now;        // A new connection is usually about to be used
+        _wanted = CONN_MODE_NONE;
+        _requested = CONN_MODE_NONE;
+        _retryAt = now + BLE_CONN_SETTLE_MS;
+        _interval = interval;
+        _latency = latency;
+        _timeout = timeout;
+        _applied = interval ? classify(interval, latency) : CONN_MODE_NONE;
+        want(CONN_MODE_ACTIVE);
+    }
+
+    void onDisconnected(uint32_t now) {
+        account(now);
+        _connected = false;
+        _wanted = _requested = _applied = CONN_MODE_NONE;
+    }
+
+    // Touch, macro or report traffic: switch to (or stay on) the fast interval
+    void onActivity(uint32_t now) {
+        _lastActivity = now;
+        if (!_connected) return;
+        if (_wanted != CONN_MODE_ACTIVE) {
+            want(CONN_MODE_ACTIVE);
+            // Waking up is latency-critical: don't wait out an idle backoff
+            if (_requested == CONN_MODE_NONE && (int32_t)(_retryAt - now) > 0 &&
+                (int32_t)(_connectedAt + BLE_CONN_SETTLE_MS - now) <= 0) {
+                _retryAt = now;
+            }
+        }
+        service(now);
+    }
+
+    // ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT
+    void onParamsUpdated(uint8_t status, uint16_t interval, uint16_t latency, uint16_t timeout,
+                         uint32_t now) {
+        account(now);
+        if (!_connected) return;
+
+        if (_requested == CONN_MODE_NONE) {
+            // The central renegotiated by itself
+            if (status == 0) {
+                _stats.unsolicited++;
+                _interval = interval;
+                _latency = latency;
+                _timeout = timeout;
+                _applied = classify(interval, latency);
+                if (_applied != _wanted) {
+                    _attempts = 0;
+                    _gaveUp = false;
+                }
+            }
+            return;
+        }
+
+        ConnParamMode requested = _requested;
+        if (status != 0) {
+            _stats.rejected++;
+            scheduleRetry(now);
+            return;
+        }
+
+        _requested = CONN_MODE_NONE;
+        _interval = interval;
+        _latency = latency;
+        _timeout = timeout;
+        ConnParams p = connParamsFor(requested);
+        if (interval >= p.minInterval && interval <= p.maxInterval && latency == p.latency) {
+            _stats.accepted++;
+            _applied = requested;
+        } else {
+            // The central picked its own values; asking again won't change them
+            _stats.compromised++;
+            _applied = classify(interval, latency);
+            _gaveUp = _applied != _wanted;
+        }
+    }
+
+    // Sends due requests and detects idleness / lost answers; call from loop()
+    void service(uint32_t now) {
+        account(now);
+        if (!_connected) return;
+
+        if (_wanted == CONN_MODE_ACTIVE && now - _lastActivity >= BLE_IDLE_AFTER_MS) {
+            want(CONN_MODE_IDLE);
+        }
+
+        if (_requested != CONN_MODE_NONE) {
+            if (now - _requestedAt < BLE_CONN_UPDATE_TIMEOUT_MS) return;
+            _stats.timeouts++;
+            scheduleRetry(now);
+        }
+
+        if (_gaveUp || _wanted == _applied || (int32_t)(now - _retryAt) < 0) return;
+        send(now);
+    }
+
+    // Which mode a set of negotiated values behaves like
+    static ConnParamMode classify(uint16_t interval, uint16_t latency) {
+        return (interval <= BLE_ACTIVE_INTERVAL * 2 && latency == 0) ? CONN_MODE_ACTIVE
+                                                                     : CONN_MODE_IDLE;
+    }
+
+    bool isConnected() const { return _connected; }
+    ConnParamMode wantedMode() const { return _wanted; }
+    ConnParamMode appliedMode() const { return _applied; }
+    bool isPending() const { return _requested != CONN_MODE_NONE; }
+    bool gaveUp() const { return _gaveUp; }
+    uint16_t interval() const { return _interval; }
+    uint16_t latency() const { return _latency; }
+    uint16_t timeout() const { return _timeout; }
+    const ConnParamStats& stats() const { return _stats; }
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+// ==============================================================================
+// Flash Region
+// ==============================================================================
+// Minimal NOR-flash interface used by the profile log: erase sets bytes to
+// 0xFF, write can only clear bits. The device implementation wraps an ESP32
+// data partition; the RAM implementation has the same semantics (plus
+// power-cut injection) so the log can be exercised on the host.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <esp_partition.h>
+#else
+#include <vector>
+#endif
+
+#define FLASH_SECTOR_SIZE 4096
+
+// Physical traffic, for write-amplification accounting
+struct FlashRegionStats {
+    uint32_t bytesWritten;
+    uint32_t bytesErased;
+    uint32_t writes;
+    uint32_t erases;
+
+    FlashRegionStats() : bytesWritten(0), bytesErased(0), writes(0), erases(0) {}
+};
+
+class FlashRegion {
+protected:
+    FlashRegionStats _stats;
+
+public:
+    virtual ~FlashRegion() {}
+    virtual size_t size() const = 0;
+    virtual bool read(size_t offset, void* out, size_t len) const = 0;
+    virtual bool write(size_t offset, const void* data, size_t len) = 0;
+
+    // `offset` and `len` must be sector-aligned
+    virtual bool erase(size_t offset, size_t len) = 0;
+
+    const FlashRegionStats& stats() const { return _stats; }
+    void resetStats() { _stats = FlashRegionStats(); }
+};
+
+#ifdef ARDUINO
+// ==============================================================================
+// ESP32 Data Partition
+// ==============================================================================
+class PartitionFlashRegion : public FlashRegion {
+private:
+    const esp_partition_t* _partition;
+
+public:
+    PartitionFlashRegion() : _partition(nullptr) {}
+
+    bool begin(const char* label, uint8_t subtype) {
+        _partition = esp_partition_find_first(
+            ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)subtype, label);
+        return _partition != nullptr;
+    }
+
+    size_t size() const override { return _partition ? _partition->size : 0; }
+
+    bool read(size_t offset, void* out, size_t len) const override {
+        return esp_partition_read(_partition, offset, out, len) == ESP_OK;
+    }
+
+    bool write(size_t offset, const void* data, size_t len) override {
+        _stats.writes++;
+        _stats.bytesWritten += len;
+        return esp_partition_write(_partition, offset, data, len) == ESP_OK;
+    }
+
+    bool erase(size_t offset, size_t len) override {
+        _stats.erases++;
+        _stats.bytesErased += len;
+        return esp_partition_erase_range(_partition, offset, len) == ESP_OK;
+    }
+};
+#else
+// ==============================================================================
+// RAM Region (host)
+// ==============================================================================
+// After setPowerCutAfter(n), the operation that crosses n more written or
+// erased bytes is torn (a prefix of a write lands, half a sector erases) and
+// every later operation fails until powerRestored().
+class RamFlashRegion : public FlashRegion {
+private:
+    std::vector<uint8_t> _data;
+    long _budget;           // Bytes until the power cut; < 0 = never
+    bool _dead;
+
+    // Bytes of the next operation that still make it before the cut
+    size_t allow(size_t len) {
+        if (_dead) return 0;
+        if (_budget < 0) return len;
+        if ((long)len <= _budget) {
+            _budget -= (long)len;
+            return len;
+        }
+        size_t n = (size_t)_budget;
+        _budget = 0;
+        _dead = true;
+        return n;
+    }
+
+public:
+    explicit RamFlashRegion(size_t size) : _data(size, 0xFF), _budget(-1), _dead(false) {}
+
+    void setPowerCutAfter(long bytes) { _budget = bytes; _dead = false; }
+    void powerRestored() { _budget = -1; _dead = false; }
+    bool isDead() const { return _dead; }
+
+    size_t size() const override { return _data.size(); }
+
+    bool read(size_t offset, void* out, size_t len) const override {
+        if (offset + len > _data.size()) return false;
+        memcpy(out, &_data[offset], len);
+        return true;
+    }
+
+    bool write(size_t offset, const void* data, size_t len) override {
+        if (offset + len > _data.size()) return false;
+        size_t n = allow(len);
+        _stats.writes++;
+        _stats.bytesWritten += n;
+        const uint8_t* src = (const uint8_t*)data;
+        for (size_t i = 0; i < n; i++) {
+            _data[offset + i] &= src[i];
+        }
+        return n == len;
+    }
+
+    bool erase(size_t offset, size_t len) override {
+        if (offset % FLASH_SECTOR_SIZE || len % FLASH_SECTOR_SIZE ||
+            offset + len > _data.size()) {
+            return false;
+        }
+        size_t n = allow(len);
+        if (n < len) n = n / 2;     // A torn erase leaves part of the range intact
+        _stats.erases++;
+        _stats.bytesErased += n;
+        memset(&_data[offset], 0xFF, n);
+        return !_dead;
+    }
+};
+#endif
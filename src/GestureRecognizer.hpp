@@ -0,0 +1,326 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// ==============================================================================
+// Gesture Timing & Thresholds
+// ==============================================================================
+
+// A contact must be absent this long before it counts as released
+// (GT911 occasionally drops a sample mid-touch)
+#ifndef TOUCH_DEBOUNCE_MS
+#define TOUCH_DEBOUNCE_MS   20
+#endif
+
+// Minimum time between two fires of the same button (accidental double-press guard)
+#ifndef BUTTON_PRESS_DELAY
+#define BUTTON_PRESS_DELAY  100
+#endif
+
+// Movement (px) after which a contact stops being a tap candidate
+#ifndef SWIPE_THRESHOLD
+#define SWIPE_THRESHOLD     50
+#endif
+
+// Displacement (px) that is always a swipe, regardless of speed
+#ifndef SWIPE_MIN_DISTANCE
+#define SWIPE_MIN_DISTANCE  80
+#endif
+
+// Release speed (px/s) that turns a shorter drag (> SWIPE_THRESHOLD) into a flick
+#ifndef SWIPE_MIN_VELOCITY
+#define SWIPE_MIN_VELOCITY  400
+#endif
+
+// Stationary hold time for a long-press
+#ifndef LONG_PRESS_MS
+#define LONG_PRESS_MS       500
+#endif
+
+// Max gap between the first release and the second touch of a double-tap
+#ifndef DOUBLE_TAP_MS
+#define DOUBLE_TAP_MS       300
+#endif
+
+// Worst-case time from the physical edge (finger down/up) to a decision.
+// Down decisions are made on the first sample; up decisions wait for the
+// release debounce plus one touch poll.
+#ifndef GESTURE_DECISION_BUDGET_MS
+#define GESTURE_DECISION_BUDGET_MS 40
+#endif
+
+#define GESTURE_SAMPLE_PERIOD_MS 10  // GT911 report period
+
+static_assert(SWIPE_THRESHOLD < SWIPE_MIN_DISTANCE,
+              "Tap slop must be smaller than the swipe distance");
+static_assert(TOUCH_DEBOUNCE_MS + GESTURE_SAMPLE_PERIOD_MS <= GESTURE_DECISION_BUDGET_MS,
+              "Release debounce does not fit the decision-latency budget");
+
+// ==============================================================================
+// Gesture Events
+// ==============================================================================
+enum GestureType : uint8_t {
+    GESTURE_NONE = 0,
+    GESTURE_DOWN,           // Contact started (fire-on-down point)
+    GESTURE_CANCEL,         // Contact moved past the tap slop; pending tap abandoned
+    GESTURE_TAP,            // Short, stationary contact released (fire-on-up point)
+    GESTURE_DOUBLE_TAP,     // Second tap close to the previous one (reported after TAP)
+    GESTURE_LONG_PRESS,     // Stationary contact held for LONG_PRESS_MS
+    GESTURE_SWIPE,          // Released drag, by distance or velocity
+    GESTURE_UP              // Contact ended (always the last event of a contact)
+};
+
+enum SwipeDirection : uint8_t {
+    SWIPE_NONE = 0,
+    SWIPE_LEFT,
+    SWIPE_RIGHT,
+    SWIPE_UP,
+    SWIPE_DOWN
+};
+
+struct GestureEvent {
+    GestureType type;
+    SwipeDirection direction;   // GESTURE_SWIPE only
+    int16_t x;                  // Contact start position
+    int16_t y;
+    int16_t dx;                 // Displacement from start
+    int16_t dy;
+    int32_t velocity;           // px/s along the dominant axis (GESTURE_SWIPE only)
+    uint32_t time;              // Decision time
+    uint32_t latency;           // Decision time minus the physical edge time
+};
+
+// ==============================================================================
+// Gesture Recognizer
+// ==============================================================================
+// Pure state machine: feed it one sample per poll with a timestamp and drain
+// the resulting events. It knows nothing about buttons or the display, so the
+// same recognizer runs on the device and against synthetic touch streams.
+class GestureRecognizer {
+private:
+    enum State : uint8_t {
+        STATE_IDLE,
+        STATE_PRESSED,      // Within tap slop
+        STATE_DRAGGING,     // Moved past tap slop
+        STATE_RELEASING     // Sample lost, waiting out the release debounce
+    };
+
+    static const int EVENT_QUEUE_SIZE = 8;
+
+    State _state;
+    bool _dragging;         // Contact has left the tap slop (survives RELEASING)
+
+    int32_t _startX;
+    int32_t _startY;
+    int32_t _lastX;
+    int32_t _lastY;
+    uint32_t _downTime;
+    uint32_t _lastSampleTime;
+    bool _longPressSent;
+
+    // Velocity estimate from the last two samples
+    int32_t _prevX;
+    int32_t _prevY;
+    uint32_t _prevTime;
+
+    // Double-tap tracking
+    uint32_t _lastTapUpTime;
+    int32_t _lastTapX;
+    int32_t _lastTapY;
+    bool _lastTapValid;
+
+    GestureEvent _events[EVENT_QUEUE_SIZE];
+    uint8_t _eventHead;
+    uint8_t _eventCount;
+
+    // Decision-latency statistics
+    uint32_t _maxLatency;
+    uint32_t _budgetOverruns;
+
+public:
+    GestureRecognizer() { reset(); }
+
+    void reset() {
+        _state = STATE_IDLE;
+        _dragging = false;
+        _startX = _startY = _lastX = _lastY = 0;
+        _prevX = _prevY = 0;
+        _downTime = _lastSampleTime = _prevTime = 0;
+        _longPressSent = false;
+        _lastTapUpTime = 0;
+        _lastTapX = _lastTapY = 0;
+        _lastTapValid = false;
+        _eventHead = 0;
+        _eventCount = 0;
+        _maxLatency = 0;
+        _budgetOverruns = 0;
+    }
+
+    bool isTouching() const {
+        return _state != STATE_IDLE;
+    }
+
+    bool isDragging() const {
+        return _state != STATE_IDLE && _dragging;
+    }
+
+    int32_t lastX() const { return _lastX; }
+    int32_t lastY() const { return _lastY; }
+
+    uint32_t maxDecisionLatency() const { return _maxLatency; }
+    uint32_t budgetOverruns() const { return _budgetOverruns; }
+
+    // Feed one touch sample. `touching` is false when the panel reports no contact.
+    void update(bool touching, int32_t x, int32_t y, uint32_t now) {
+        if (touching) {
+            if (_state == STATE_IDLE) {
+                beginContact(x, y, now);
+                return;
+            }
+
+            if (_state == STATE_RELEASING) {
+                // Dropout shorter than the debounce: same contact continues
+                _state = _dragging ? STATE_DRAGGING : STATE_PRESSED;
+            }
+
+            _prevX = _lastX;
+            _prevY = _lastY;
+            _prevTime = _lastSampleTime;
+            _lastX = x;
+            _lastY = y;
+            _lastSampleTime = now;
+
+            if (_state == STATE_PRESSED && movedPastSlop(x, y)) {
+                _state = STATE_DRAGGING;
+                _dragging = true;
+                emit(GESTURE_CANCEL, now, now);
+            }
+
+            if (_state == STATE_PRESSED && !_longPressSent &&
+                now - _downTime >= LONG_PRESS_MS) {
+                _longPressSent = true;
+                emit(GESTURE_LONG_PRESS, now, _downTime + LONG_PRESS_MS);
+            }
+            return;
+        }
+
+        switch (_state) {
+            case STATE_IDLE:
+                break;
+
+            case STATE_PRESSED:
+            case STATE_DRAGGING:
+                _state = STATE_RELEASING;
+                // fall through
+            case STATE_RELEASING:
+                if (now - _lastSampleTime >= TOUCH_DEBOUNCE_MS) {
+                    endContact(now);
+                }
+                break;
+        }
+    }
+
+    bool poll(GestureEvent& event) {
+        if (_eventCount == 0) return false;
+        event = _events[_eventHead];
+        _eventHead = (_eventHead + 1) % EVENT_QUEUE_SIZE;
+        _eventCount--;
+        return true;
+    }
+
+private:
+    bool movedPastSlop(int32_t x, int32_t y) const {
+        int32_t dx = x - _startX;
+        int32_t dy = y - _startY;
+        return (dx * dx + dy * dy) > (SWIPE_THRESHOLD * SWIPE_THRESHOLD);
+    }
+
+    void beginContact(int32_t x, int32_t y, uint32_t now) {
+        _state = STATE_PRESSED;
+        _startX = _lastX = _prevX = x;
+        _startY = _lastY = _prevY = y;
+        _downTime = _lastSampleTime = _prevTime = now;
+        _longPressSent = false;
+        _dragging = false;
+        emit(GESTURE_DOWN, now, now);
+    }
+
+    void endContact(uint32_t now) {
+        // The finger physically left after the last reported sample
+        uint32_t edge = _lastSampleTime;
+        int32_t dx = _lastX - _startX;
+        int32_t dy = _lastY - _startY;
+
+        if (_dragging) {
+            int32_t adx = abs(dx);
+            int32_t ady = abs(dy);
+            bool horizontal = adx >= ady;
+            int32_t distance = horizontal ? adx : ady;
+
+            uint32_t dt = _lastSampleTime - _prevTime;
+            int32_t step = horizontal ? abs((int)(_lastX - _prevX)) : abs((int)(_lastY - _prevY));
+            int32_t velocity = dt > 0 ? (int32_t)((step * 1000) / (int32_t)dt) : 0;
+
+            if (distance >= SWIPE_MIN_DISTANCE ||
+                (distance > SWIPE_THRESHOLD && velocity >= SWIPE_MIN_VELOCITY)) {
+                GestureEvent& e = emit(GESTURE_SWIPE, now, edge);
+                e.velocity = velocity;
+                if (horizontal) {
+                    e.direction = dx > 0 ? SWIPE_RIGHT : SWIPE_LEFT;
+                } else {
+                    e.direction = dy > 0 ? SWIPE_DOWN : SWIPE_UP;
+                }
+            }
+            _lastTapValid = false;
+        } else if (!_longPressSent) {
+            emit(GESTURE_TAP, now, edge);
+
+            bool isDouble = _lastTapValid &&
+                            (_downTime - _lastTapUpTime) <= DOUBLE_TAP_MS &&
+                            abs((int)(_startX - _lastTapX)) <= SWIPE_THRESHOLD &&
+                            abs((int)(_startY - _lastTapY)) <= SWIPE_THRESHOLD;
+            if (isDouble) {
+                emit(GESTURE_DOUBLE_TAP, now, edge);
+                _lastTapValid = false;
+            } else {
+                _lastTapValid = true;
+                _lastTapUpTime = edge;
+                _lastTapX = _startX;
+                _lastTapY = _startY;
+            }
+        } else {
+            _lastTapValid = false;
+        }
+
+        emit(GESTURE_UP, now, edge);
+        _state = STATE_IDLE;
+    }
+
+    GestureEvent& emit(GestureType type, uint32_t now, uint32_t edge) {
+        uint8_t slot;
+        if (_eventCount < EVENT_QUEUE_SIZE) {
+            slot = (_eventHead + _eventCount) % EVENT_QUEUE_SIZE;
+            _eventCount++;
+        } else {
+            // Consumer fell behind: overwrite the oldest event
+            slot = _eventHead;
+            _eventHead = (_eventHead + 1) % EVENT_QUEUE_SIZE;
+        }
+
+        GestureEvent& e = _events[slot];
+        e.type = type;
+        e.direction = SWIPE_NONE;
+        e.x = (int16_t)_startX;
+        e.y = (int16_t)_startY;
+        e.dx = (int16_t)(_lastX - _startX);
+        e.dy = (int16_t)(_lastY - _startY);
+        e.velocity = 0;
+        e.time = now;
+        e.latency = now - edge;
+
+        if (e.latency > _maxLatency) _maxLatency = e.latency;
+        if (e.latency > GESTURE_DECISION_BUDGET_MS) _budgetOverruns++;
+        return e;
+    }
+};
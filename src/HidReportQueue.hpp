@@ -0,0 +1,267 @@
+#pragma once
+
+// ==============================================================================
+// Flow-Controlled HID Report Queue
+// ==============================================================================
+// Macros are turned into HID reports (absolute key state: press, release)
+// and queued here instead of being pushed straight into Bluedroid. The
+// queue only hands a report to the stack when it has a credit for it:
+//
+//   credits   notifications in flight, at most HID_REPORT_CREDITS. One is
+//             taken per report sent and returned when the stack reports the
+//             notification done (ESP_GATTS_CONF_EVT, BT task).
+//   sendable  free controller buffers for the link; the stack frees them
+//             as the host acknowledges packets at each connection event.
+//
+// A long text macro therefore fills the queue and drains at the rate the
+// link actually takes, rather than overflowing the stack (silently lost
+// characters) or blocking in notify(). Producers check space() first and
+// wait (service()) while it is full; push() on a full queue drops the
+// report and counts it.
+//
+// Time spent with reports waiting and no credit is counted as stall time.
+// The queue talks to the stack only through HidReportSink, so it runs on
+// the host (host/hidqueue_sim.cpp).
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include "Macros.hpp"
+#include "KeyboardLayout.hpp"
+
+// Reports held while waiting for credits (two per typed character)
+#ifndef HID_REPORT_QUEUE_DEPTH
+#define HID_REPORT_QUEUE_DEPTH      64
+#endif
+
+// Notifications handed to the stack and not yet confirmed
+#ifndef HID_REPORT_CREDITS
+#define HID_REPORT_CREDITS          4
+#endif
+
+enum HidReportKind : uint8_t {
+    HID_REPORT_KEYBOARD = 0,    // Modifiers + 6 keys (input report 1)
+    HID_REPORT_MEDIA,           // 16-bit consumer control bitmap (input report 2)
+    HID_REPORT_MOUSE            // Buttons + relative motion (USB only, see hasPointer())
+};
+
+// Mouse buttons (HID button page bits)
+#define MOUSE_BUTTON_LEFT       0x01
+#define MOUSE_BUTTON_RIGHT      0x02
+
+struct HidReport {
+    HidReportKind kind;
+    uint8_t modifiers;          // MODIFIER_* bits (HID left-hand modifiers)
+    uint8_t keys[6];            // HID usages, KEY_NONE = unused
+    uint8_t media[2];           // BleKeyboard MediaKeyReport layout
+    uint8_t buttons;            // Mouse: MOUSE_BUTTON_* bits
+    int8_t dx;                  // Mouse: motion in counts, right/down positive
+    int8_t dy;
+    int8_t wheel;               // Mouse: detents, up positive
+
+    HidReport() : kind(HID_REPORT_KEYBOARD), modifiers(0), buttons(0), dx(0), dy(0), wheel(0) {
+        memset(keys, 0, sizeof(keys));
+        memset(media, 0, sizeof(media));
+    }
+
+    static HidReport press(uint8_t modifiers, uint8_t key) {
+        HidReport r;
+        r.modifiers = modifiers;
+        r.keys[0] = key;
+        return r;
+    }
+
+    static HidReport release() { return HidReport(); }
+
+    static HidReport mediaState(uint8_t low, uint8_t high) {
+        HidReport r;
+        r.kind = HID_REPORT_MEDIA;
+        r.media[0] = low;
+        r.media[1] = high;
+        return r;
+    }
+
+    static HidReport mouse(uint8_t buttons, int8_t dx, int8_t dy, int8_t wheel) {
+        HidReport r;
+        r.kind = HID_REPORT_MOUSE;
+        r.buttons = buttons;
+        r.dx = dx;
+        r.dy = dy;
+        r.wheel = wheel;
+        return r;
+    }
+};
+
+// Consumer control bits for a KEY_MEDIA_* code (BleKeyboard's bitmap).
+// Returns false for codes without one.
+inline bool mediaKeyBits(uint8_t mediaKey, uint8_t& low, uint8_t& high) {
+    high = 0;
+    switch (mediaKey) {
+        case KEY_MEDIA_NEXT:        low = 1;  return true;
+        case KEY_MEDIA_PREV:        low = 2;  return true;
+        case KEY_MEDIA_STOP:        low = 4;  return true;
+        case KEY_MEDIA_PLAY_PAUSE:  low = 8;  return true;
+        case KEY_MEDIA_MUTE:        low = 16; return true;
+        case KEY_MEDIA_VOLUME_UP:   low = 32; return true;
+        case KEY_MEDIA_VOLUME_DOWN: low = 64; return true;
+        default:                    low = 0;  return false;
+    }
+}
+
+// US layout: printable ASCII (and \n, \t, \b) to HID usage + shift.
+// Returns false for characters the layout cannot type. Text macros go
+// through keystrokesFor() (KeyboardLayout.hpp), which knows other layouts.
+inline bool asciiToHid(char c, uint8_t& key, uint8_t& modifiers) {
+    const KeymapEntry* e = keymapFor(KEYBOARD_LAYOUT_US).find((uint8_t)c);
+    if (e == nullptr) return false;
+    key = e->key;
+    modifiers = e->modifiers;
+    return true;
+}
+
+// Stack access: the device sends through a HidTransport (HidTransport.hpp),
+// BLE or USB
+class HidReportSink {
+public:
+    virtual ~HidReportSink() {}
+    // Controller buffers free for this link (packets); < 0 if unknown
+    virtual int sendable() = 0;
+    // Queues one notification with the stack; false if it refused it
+    virtual bool sendReport(const HidReport& report) = 0;
+    // True if sendReport() returns only once the report is delivered (USB):
+    // no credit is held for it
+    virtual bool completesOnSend() const { return false; }
+};
+
+struct HidReportQueueStats {
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t dropped;           // push() on a full queue
+    uint32_t flushed;           // Still queued when the link went down
+    uint32_t stackErrors;       // Refused by the stack or confirmed with an error
+    uint32_t maxDepth;
+    uint32_t stalls;            // Times reports had to wait for a credit
+    uint32_t lastStallMs;
+    uint32_t maxStallMs;
+    uint64_t totalStallMs;
+
+    HidReportQueueStats() : queued(0), sent(0), dropped(0), flushed(0), stackErrors(0),
+                            maxDepth(0), stalls(0), lastStallMs(0), maxStallMs(0),
+                            totalStallMs(0) {}
+};
+
+class HidReportQueue {
+private:
+    HidReportSink* _sink;
+    HidReport _ring[HID_REPORT_QUEUE_DEPTH];
+    uint16_t _head;
+    uint16_t _count;
+
+    // Returned by the BT task (onSent), taken by loop() (service)
+    std::atomic<int32_t> _credits;
+    std::atomic<uint32_t> _confirmErrors;
+    bool _open;                 // Link ready: reports may be sent
+
+    bool _stalled;
+    uint32_t _stalledAt;
+    HidReportQueueStats _stats;
+
+    void endStall(uint32_t now) {
+        if (!_stalled) return;
+        _stalled = false;
+        uint32_t elapsed = now - _stalledAt;
+        _stats.lastStallMs = elapsed;
+        _stats.totalStallMs += elapsed;
+        if (elapsed > _stats.maxStallMs) _stats.maxStallMs = elapsed;
+    }
+
+public:
+    explicit HidReportQueue(HidReportSink* sink)
+        : _sink(sink), _head(0), _count(0), _credits(0), _confirmErrors(0), _open(false),
+          _stalled(false), _stalledAt(0) {}
+
+    // Link ready (loop()): start sending with a full set of credits
+    void open() {
+        _credits.store(HID_REPORT_CREDITS, std::memory_order_relaxed);
+        _open = true;
+    }
+
+    // Link gone (loop()): what is still queued was meant for that link
+    void close(uint32_t now) {
+        _open = false;
+        _stats.flushed += _count;
+        _head = _count = 0;
+        endStall(now);
+    }
+
+    // Drops what has not been sent yet (a cancelled macro); counted as flushed
+    void discard() {
+        _stats.flushed += _count;
+        _head = _count = 0;
+    }
+
+    bool isOpen() const { return _open; }
+
+    // Switches output (USB <-> BLE); only while closed
+    void setSink(HidReportSink* sink) {
+        if (!_open) _sink = sink;
+    }
+
+    bool push(const HidReport& report) {
+        if (_count == HID_REPORT_QUEUE_DEPTH) {
+            _stats.dropped++;
+            return false;
+        }
+        _ring[(_head + _count) % HID_REPORT_QUEUE_DEPTH] = report;
+        _count++;
+        _stats.queued++;
+        if (_count > _stats.maxDepth) _stats.maxDepth = _count;
+        return true;
+    }
+
+    // A notification completed (BT task, ESP_GATTS_CONF_EVT). Other
+    // characteristics confirm through the same event, so the credits are
+    // capped rather than trusted to balance.
+    void onSent(bool ok) {
+        if (!ok) _confirmErrors.fetch_add(1, std::memory_order_relaxed);
+        int32_t credits = _credits.load(std::memory_order_relaxed);
+        while (credits < HID_REPORT_CREDITS &&
+               !_credits.compare_exchange_weak(credits, credits + 1, std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+        }
+    }
+
+    // Sends what the credits allow; call from loop() and while waiting for space
+    void service(uint32_t now) {
+        _stats.stackErrors += _confirmErrors.exchange(0, std::memory_order_relaxed);
+        if (!_open) return;
+
+        while (_count > 0) {
+            if (_credits.load(std::memory_order_acquire) <= 0 || _sink->sendable() == 0) {
+                if (!_stalled) {
+                    _stalled = true;
+                    _stalledAt = now;
+                    _stats.stalls++;
+                }
+                return;
+            }
+            if (!_sink->sendReport(_ring[_head])) {
+                // Congested after all: keep the report and try again later
+                _stats.stackErrors++;
+                return;
+            }
+            if (!_sink->completesOnSend()) _credits.fetch_sub(1, std::memory_order_relaxed);
+            _head = (_head + 1) % HID_REPORT_QUEUE_DEPTH;
+            _count--;
+            _stats.sent++;
+            endStall(now);
+        }
+    }
+
+    int depth() const { return _count; }
+    int space() const { return HID_REPORT_QUEUE_DEPTH - _count; }
+    bool isEmpty() const { return _count == 0; }
+    int credits() const { return _credits.load(std::memory_order_relaxed); }
+    bool isStalled() const { return _stalled; }
+    const HidReportQueueStats& stats() const { return _stats; }
+};
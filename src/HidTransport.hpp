@@ -0,0 +1,148 @@
+#pragma once
+
+// ==============================================================================
+// HID Transport
+// ==============================================================================
+// The output side of the HID link behind one interface, so the BLE host
+// stack is a build-time choice:
+//
+//   BluedroidTransport.hpp   BleKeyboard on the Arduino Bluedroid stack (default)
+//   NimBLETransport.hpp      BleKeyboard built with USE_NIMBLE on NimBLE-Arduino
+//                            ([env:esp32-s3-nimble] in platformio.ini)
+//
+// A transport sends keyboard and consumer reports (and mouse reports, if its
+// report map has a pointer: hasPointer()) and reports connection
+// events: it drives BleLinkState (BleLinkState.hpp) from the stack's task
+// and forwards the details loop() needs (peer, parameters, bonding) as
+// BleLinkEvents. Everything above it - HidReportQueue, MacroExecutor, the
+// reconnect engine - is stack independent; host/macroexec_sim.cpp runs
+// macros against a mock transport.
+//
+// The base class also times each report from the send call to the stack's
+// completion event (notification handed to the link layer).
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include "HidReportQueue.hpp"
+
+// Send times remembered for completion latency (>= HID_REPORT_CREDITS)
+#define HID_TRANSPORT_TRACKED       8
+
+static_assert(HID_TRANSPORT_TRACKED >= HID_REPORT_CREDITS, "Track every report in flight");
+
+struct HidTransportStats {
+    uint32_t reports;
+    uint32_t failures;          // Send call refused
+    uint32_t completions;
+    uint32_t lastLatencyUs;     // Send call -> completion event
+    uint32_t maxLatencyUs;
+    uint64_t totalLatencyUs;
+
+    HidTransportStats() : reports(0), failures(0), completions(0), lastLatencyUs(0),
+                          maxLatencyUs(0), totalLatencyUs(0) {}
+};
+
+class HidTransport : public HidReportSink {
+private:
+    // Ring of send times: loop() appends, the stack's task consumes
+    uint32_t _sentAt[HID_TRANSPORT_TRACKED];
+    std::atomic<uint32_t> _sentHead;
+    std::atomic<uint32_t> _sentTail;
+
+    uint32_t _reports;
+    uint32_t _failures;
+    std::atomic<uint32_t> _completions;
+    std::atomic<uint32_t> _lastLatencyUs;
+    std::atomic<uint32_t> _maxLatencyUs;
+    std::atomic<uint64_t> _totalLatencyUs;
+
+protected:
+    // Stack specifics
+    virtual bool sendKeyboardReport(uint8_t modifiers, const uint8_t keys[6]) = 0;
+    virtual bool sendConsumerReport(uint8_t low, uint8_t high) = 0;
+    virtual bool sendMouseReport(uint8_t buttons, int8_t dx, int8_t dy, int8_t wheel) {
+        (void)buttons;
+        (void)dx;
+        (void)dy;
+        (void)wheel;
+        return false;
+    }
+    virtual uint32_t clockUs() = 0;
+
+public:
+    HidTransport() : _sentHead(0), _sentTail(0), _reports(0), _failures(0), _completions(0),
+                     _lastLatencyUs(0), _maxLatencyUs(0), _totalLatencyUs(0) {
+        memset(_sentAt, 0, sizeof(_sentAt));
+    }
+
+    virtual const char* name() const = 0;
+
+    // Brings the stack up, registers the HID service and starts advertising
+    virtual bool begin() = 0;
+
+    // Mouse reports can be sent (the report map has a mouse collection).
+    // BleKeyboard's has none, so only USB does; the trackpad stays idle on BLE.
+    virtual bool hasPointer() const { return false; }
+
+    // HidReportSink: what HidReportQueue sends through
+    bool sendReport(const HidReport& report) override {
+        uint32_t sentAt = clockUs();
+        bool ok;
+        switch (report.kind) {
+            case HID_REPORT_MEDIA:
+                ok = sendConsumerReport(report.media[0], report.media[1]);
+                break;
+            case HID_REPORT_MOUSE:
+                ok = sendMouseReport(report.buttons, report.dx, report.dy, report.wheel);
+                break;
+            default:
+                ok = sendKeyboardReport(report.modifiers, report.keys);
+                break;
+        }
+        if (!ok) {
+            _failures++;
+            return false;
+        }
+        _reports++;
+        uint32_t head = _sentHead.load(std::memory_order_relaxed);
+        if (head - _sentTail.load(std::memory_order_acquire) < HID_TRANSPORT_TRACKED) {
+            _sentAt[head % HID_TRANSPORT_TRACKED] = sentAt;
+            _sentHead.store(head + 1, std::memory_order_release);
+        }
+        return true;
+    }
+
+    // A notification completed (stack's task)
+    void onCompleted() {
+        uint32_t now = clockUs();
+        uint32_t tail = _sentTail.load(std::memory_order_relaxed);
+        if (tail == _sentHead.load(std::memory_order_acquire)) return;    // Not ours
+        uint32_t latency = now - _sentAt[tail % HID_TRANSPORT_TRACKED];
+        _sentTail.store(tail + 1, std::memory_order_release);
+
+        _completions.fetch_add(1, std::memory_order_relaxed);
+        _lastLatencyUs.store(latency, std::memory_order_relaxed);
+        _totalLatencyUs.fetch_add(latency, std::memory_order_relaxed);
+        if (latency > _maxLatencyUs.load(std::memory_order_relaxed)) {
+            _maxLatencyUs.store(latency, std::memory_order_relaxed);
+        }
+    }
+
+    // Reports sent on a link that went away never complete. Call once the
+    // link is down: no completion can race the reset then.
+    void onLinkLost() {
+        _sentTail.store(_sentHead.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    HidTransportStats stats() const {
+        HidTransportStats s;
+        s.reports = _reports;
+        s.failures = _failures;
+        s.completions = _completions.load(std::memory_order_relaxed);
+        s.lastLatencyUs = _lastLatencyUs.load(std::memory_order_relaxed);
+        s.maxLatencyUs = _maxLatencyUs.load(std::memory_order_relaxed);
+        s.totalLatencyUs = _totalLatencyUs.load(std::memory_order_relaxed);
+        return s;
+    }
+};
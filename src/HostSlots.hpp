@@ -0,0 +1,222 @@
+#pragma once
+
+// ==============================================================================
+// BLE Host Slots
+// ==============================================================================
+// Up to HOST_SLOT_COUNT bonded hosts (e.g. desktop and laptop), one active at
+// a time. Bonds stay in the stack's NVS store; a slot only names the host's
+// identity address, which is all a switch needs: the pad drops the current
+// link and sends directed advertising to the target, which re-encrypts with
+// the keys it already has. No pairing, no bond clearing.
+//
+//   switchTo(slot)  -> disconnect (if linked) -> directed burst to the target
+//                   -> target re-encrypts and subscribes -> READY: switch done
+//
+// Until the switch completes, the undirected fallback phases are white-listed
+// to the target and any other known host that still manages to connect is
+// refused, so the host being left cannot grab the link back. Switching to an
+// empty slot advertises openly; the next host to bond is stored there.
+//
+// The selection logic talks to the stack only through HostLinkControl and the
+// reconnect engine's AdvertisingGap, so it runs on the host
+// (host/hostslot_sim.cpp).
+
+#include <stdint.h>
+#include <string.h>
+#include "Macros.hpp"
+#include "ReconnectEngine.hpp"
+
+// Give up on a switch (and stop refusing other hosts) after this long
+#ifndef HOST_SWITCH_TIMEOUT_MS
+#define HOST_SWITCH_TIMEOUT_MS      10000
+#endif
+
+// Serialized table: per slot addr[6], addrType, valid; then the active slot
+#define HOST_SLOT_RECORD_BYTES      8
+#define HOST_SLOTS_BLOB_BYTES       (HOST_SLOT_COUNT * HOST_SLOT_RECORD_BYTES + 1)
+
+class HostSlotTable {
+private:
+    BlePeer _slots[HOST_SLOT_COUNT];
+    uint8_t _active;
+
+public:
+    HostSlotTable() : _active(0) {}
+
+    int active() const { return _active; }
+    const BlePeer& peer(int slot) const { return _slots[slot]; }
+    const BlePeer& activePeer() const { return _slots[_active]; }
+    bool isEmpty(int slot) const { return !_slots[slot].valid; }
+
+    bool select(int slot) {
+        if (slot < 0 || slot >= HOST_SLOT_COUNT) return false;
+        _active = (uint8_t)slot;
+        return true;
+    }
+
+    // Slot holding `peer`, or -1
+    int find(const BlePeer& peer) const {
+        if (!peer.valid) return -1;
+        for (int i = 0; i < HOST_SLOT_COUNT; i++) {
+            if (_slots[i].sameAs(peer)) return i;
+        }
+        return -1;
+    }
+
+    // Stores `peer` in `slot`; `replaced` receives the host it displaced
+    void assign(int slot, const BlePeer& peer, BlePeer& replaced) {
+        replaced = _slots[slot].sameAs(peer) ? BlePeer() : _slots[slot];
+        _slots[slot] = peer;
+    }
+
+    void clear(int slot) { _slots[slot] = BlePeer(); }
+
+    void serialize(uint8_t* out) const {
+        for (int i = 0; i < HOST_SLOT_COUNT; i++) {
+            uint8_t* r = out + i * HOST_SLOT_RECORD_BYTES;
+            memcpy(r, _slots[i].addr, 6);
+            r[6] = _slots[i].addrType;
+            r[7] = _slots[i].valid ? 1 : 0;
+        }
+        out[HOST_SLOT_COUNT * HOST_SLOT_RECORD_BYTES] = _active;
+    }
+
+    bool deserialize(const uint8_t* in) {
+        uint8_t active = in[HOST_SLOT_COUNT * HOST_SLOT_RECORD_BYTES];
+        if (active >= HOST_SLOT_COUNT) return false;
+        for (int i = 0; i < HOST_SLOT_COUNT; i++) {
+            const uint8_t* r = in + i * HOST_SLOT_RECORD_BYTES;
+            if (r[7] > 1) return false;
+            memcpy(_slots[i].addr, r, 6);
+            _slots[i].addrType = r[6];
+            _slots[i].valid = r[7] == 1;
+        }
+        _active = active;
+        return true;
+    }
+};
+
+// Stack access: the device calls esp_ble_gap_disconnect() on the current link
+class HostLinkControl {
+public:
+    virtual ~HostLinkControl() {}
+    virtual bool disconnect() = 0;
+};
+
+// What to do with a host that just bonded or re-encrypted
+enum HostBondAction : uint8_t {
+    HOST_BOND_KNOWN = 0,        // Active slot's host, nothing changed
+    HOST_BOND_STORED,           // Table changed: persist it
+    HOST_BOND_REFUSED           // Another slot's host during a switch: disconnected
+};
+
+struct HostSwitchStats {
+    uint32_t switches;
+    uint32_t completed;
+    uint32_t timedOut;
+    uint32_t refused;           // Wrong host connected mid-switch
+    uint32_t followed;          // A known host reconnected by itself and became active
+    uint32_t lastMs;            // switchTo() -> READY
+    uint32_t maxMs;
+    uint64_t totalMs;
+
+    HostSwitchStats() : switches(0), completed(0), timedOut(0), refused(0), followed(0),
+                        lastMs(0), maxMs(0), totalMs(0) {}
+};
+
+class HostSwitcher {
+private:
+    HostSlotTable* _table;
+    ReconnectEngine* _engine;
+    HostLinkControl* _link;
+
+    bool _switching;
+    uint32_t _startedAt;
+    bool _linkUp;
+    bool _ready;
+    bool _refusing;             // Current link is a refused host on its way out
+    HostSwitchStats _stats;
+
+    void finish(uint32_t now, bool completed) {
+        _switching = false;
+        _engine->setExclusive(false, now);
+        if (!completed) {
+            _stats.timedOut++;
+            return;
+        }
+        uint32_t elapsed = now - _startedAt;
+        _stats.completed++;
+        _stats.lastMs = elapsed;
+        _stats.totalMs += elapsed;
+        if (elapsed > _stats.maxMs) _stats.maxMs = elapsed;
+    }
+
+public:
+    HostSwitcher(HostSlotTable* table, ReconnectEngine* engine, HostLinkControl* link)
+        : _table(table), _engine(engine), _link(link), _switching(false), _startedAt(0),
+          _linkUp(false), _ready(false), _refusing(false) {}
+
+    // Makes `slot` the active host. Returns false if it already is and is
+    // connected, or the slot does not exist.
+    bool switchTo(int slot, uint32_t now) {
+        if (slot < 0 || slot >= HOST_SLOT_COUNT) return false;
+        if (slot == _table->active() && _linkUp && !_switching) return false;
+
+        _table->select(slot);
+        _switching = true;
+        _startedAt = now;
+        _stats.switches++;
+        _engine->retarget(_table->activePeer(), true, now);
+        if (_linkUp) _link->disconnect();
+        return true;
+    }
+
+    // Pairing or re-encryption completed with `peer` (identity address)
+    HostBondAction onBonded(const BlePeer& peer, BlePeer& replaced) {
+        replaced = BlePeer();
+        int slot = _table->find(peer);
+        int active = _table->active();
+
+        if (slot == active) return HOST_BOND_KNOWN;
+
+        if (slot >= 0) {
+            if (_switching) {
+                // The host we are leaving got in before the radio changed
+                _stats.refused++;
+                _refusing = true;
+                _link->disconnect();
+                return HOST_BOND_REFUSED;
+            }
+            // A known host came back by itself (e.g. through open
+            // advertising after a failed switch): follow it
+            _table->select(slot);
+            _engine->setPeer(peer);
+            _stats.followed++;
+            return HOST_BOND_STORED;
+        }
+
+        // A new host: it takes the active slot
+        _table->assign(active, peer, replaced);
+        _engine->setPeer(peer);
+        return HOST_BOND_STORED;
+    }
+
+    // Follows the link; call from loop() after the reconnect engine
+    void service(BleLinkStateId state, uint32_t now) {
+        _linkUp = state == BLE_LINK_CONNECTING || state == BLE_LINK_ENCRYPTED ||
+                  state == BLE_LINK_READY;
+        bool ready = state == BLE_LINK_READY;
+        if (!_linkUp) _refusing = false;
+        if (_switching) {
+            if (ready && !_ready && !_refusing) {
+                finish(now, true);
+            } else if (now - _startedAt >= HOST_SWITCH_TIMEOUT_MS) {
+                finish(now, false);
+            }
+        }
+        _ready = ready;
+    }
+
+    bool isSwitching() const { return _switching; }
+    const HostSwitchStats& stats() const { return _stats; }
+};
@@ -0,0 +1,396 @@
+#pragma once
+
+// ==============================================================================
+// Keyboard Layouts
+// ==============================================================================
+// A keyboard sends key positions; the host turns them into characters with
+// its own layout. Text macros are therefore typed through a keymap for the
+// layout the host uses: per character, the key and modifiers, preceded by a
+// dead key for accented letters the layout composes (German "é" is ´ then e).
+//
+// Keymaps are built at compile time from each layout's key rows and cover
+// U+0000-U+00FF plus the euro sign; a lookup is one array index. They
+// follow the Windows and Linux variants of each layout (macOS moves
+// AltGr characters such as the German @ and { to other keys).
+//
+// Characters a layout has no key for go through the host's Unicode input,
+// if the profile names one:
+//
+//   windows  Alt held, 0 and the Windows-1252 code on the keypad (NumLock on;
+//            Latin-1, the euro sign and the other Windows-1252 characters)
+//   macos    Option held, each UTF-16 code unit in hex; needs the "Unicode
+//            Hex Input" source, which is a US layout: pair it with "us"
+//   linux    Ctrl+Shift+U, the code point in hex, Space (IBus and GTK)
+//
+// Anything else is skipped and counted (MacroExecStats::unmapped).
+//
+// The layout and Unicode input come from the profile (Profile::keyboardLayout,
+// "keyboard" and "unicode" in JSON). Profiles that leave them at DEFAULT use
+// the build's KEYBOARD_LAYOUT and UNICODE_INPUT.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "Macros.hpp"
+
+#ifndef KEYBOARD_LAYOUT
+#define KEYBOARD_LAYOUT             KEYBOARD_LAYOUT_US
+#endif
+
+#ifndef UNICODE_INPUT
+#define UNICODE_INPUT               UNICODE_INPUT_NONE
+#endif
+
+// Longest keystroke sequence for one character (Unicode input of U+10000 and up)
+#define KEYSTROKES_MAX              8
+
+#define KEYMAP_CHARS                256     // U+0000-U+00FF, then the euro sign
+#define KEYMAP_EURO                 0x20AC
+
+// One key press: `held` modifiers stay down when the key is released
+// (Option or Alt across the digits of a Unicode entry)
+struct KeyStroke {
+    uint8_t key;
+    uint8_t modifiers;
+    uint8_t held;
+};
+
+// How a layout types one character; key KEY_NONE = it cannot
+struct KeymapEntry {
+    uint8_t deadKey;            // KEY_NONE, or the dead key pressed first
+    uint8_t deadModifiers;
+    uint8_t key;
+    uint8_t modifiers;
+};
+
+struct Keymap {
+    KeymapEntry chars[KEYMAP_CHARS];
+    KeymapEntry euro;
+
+    constexpr KeymapEntry* slot(uint32_t cp) {
+        if (cp < KEYMAP_CHARS) return &chars[cp];
+        return cp == KEYMAP_EURO ? &euro : nullptr;
+    }
+
+    // Entry for `cp`, or nullptr if the layout cannot type it
+    constexpr const KeymapEntry* find(uint32_t cp) const {
+        const KeymapEntry* e = cp < KEYMAP_CHARS ? &chars[cp] : cp == KEYMAP_EURO ? &euro : nullptr;
+        return e != nullptr && e->key != KEY_NONE ? e : nullptr;
+    }
+};
+
+// ==============================================================================
+// Layout Definitions
+// ==============================================================================
+
+// Keys of the main block whose characters differ between layouts, in the
+// order of KeymapSpec::plain and ::shifted
+#define KEYMAP_ROW_LENGTH           23
+
+inline constexpr uint8_t KEYMAP_ROW_KEYS[KEYMAP_ROW_LENGTH] = {
+    KEY_TILDE, KEY_1, KEY_2, KEY_3, KEY_4, KEY_5, KEY_6, KEY_7, KEY_8, KEY_9, KEY_0,
+    KEY_MINUS, KEY_EQUAL, KEY_LEFT_BRACE, KEY_RIGHT_BRACE, KEY_BACKSLASH,
+    KEY_SEMICOLON, KEY_QUOTE, KEY_NON_US_HASH, KEY_NON_US_BACKSLASH,
+    KEY_COMMA, KEY_PERIOD, KEY_SLASH
+};
+
+struct KeymapKey {
+    char16_t ch;
+    uint8_t key;
+    uint8_t modifiers;
+};
+
+struct KeymapSpec {
+    const char16_t* letters;    // What KEY_A..KEY_Z type; Shift gives the capital
+    const char16_t* plain;      // KEYMAP_ROW_KEYS unshifted; ' ' = dead key or nothing
+    const char16_t* shifted;
+    const KeymapKey* altGr;     // Characters on AltGr
+    size_t altGrCount;
+    const KeymapKey* dead;      // Dead keys, by the accent they type before a space
+    size_t deadCount;
+};
+
+inline constexpr char16_t KEYMAP_LETTERS[] = u"abcdefghijklmnopqrstuvwxyz";
+
+inline constexpr char16_t KEYMAP_US_PLAIN[] = u"`1234567890-=[]\\;'  ,./";
+inline constexpr char16_t KEYMAP_US_SHIFTED[] = u"~!@#$%^&*()_+{}|:\"  <>?";
+
+inline constexpr char16_t KEYMAP_UK_PLAIN[] = u"`1234567890-=[] ;'#\\,./";
+inline constexpr char16_t KEYMAP_UK_SHIFTED[] = u"¬!\"£$%^&*()_+{} :@~|<>?";
+inline constexpr KeymapKey KEYMAP_UK_ALTGR[] = {
+    {u'¦', KEY_TILDE, MODIFIER_ALTGR},
+    {u'€', KEY_4, MODIFIER_ALTGR}
+};
+
+inline constexpr char16_t KEYMAP_DE_LETTERS[] = u"abcdefghijklmnopqrstuvwxzy";
+inline constexpr char16_t KEYMAP_DE_PLAIN[] = u" 1234567890ß ü+ öä#<,.-";
+inline constexpr char16_t KEYMAP_DE_SHIFTED[] = u"°!\"§$%&/()=? Ü* ÖÄ'>;:_";
+inline constexpr KeymapKey KEYMAP_DE_ALTGR[] = {
+    {u'²', KEY_2, MODIFIER_ALTGR},
+    {u'³', KEY_3, MODIFIER_ALTGR},
+    {u'{', KEY_7, MODIFIER_ALTGR},
+    {u'[', KEY_8, MODIFIER_ALTGR},
+    {u']', KEY_9, MODIFIER_ALTGR},
+    {u'}', KEY_0, MODIFIER_ALTGR},
+    {u'\\', KEY_MINUS, MODIFIER_ALTGR},
+    {u'~', KEY_RIGHT_BRACE, MODIFIER_ALTGR},
+    {u'|', KEY_NON_US_BACKSLASH, MODIFIER_ALTGR},
+    {u'@', KEY_Q, MODIFIER_ALTGR},
+    {u'€', KEY_E, MODIFIER_ALTGR},
+    {u'µ', KEY_M, MODIFIER_ALTGR}
+};
+inline constexpr KeymapKey KEYMAP_DE_DEAD[] = {
+    {u'^', KEY_TILDE, MODIFIER_NONE},
+    {u'´', KEY_EQUAL, MODIFIER_NONE},
+    {u'`', KEY_EQUAL, MODIFIER_SHIFT}
+};
+
+static_assert(sizeof(KEYMAP_LETTERS) / sizeof(char16_t) == 27 &&
+              sizeof(KEYMAP_DE_LETTERS) / sizeof(char16_t) == 27, "Keymap: 26 letters");
+static_assert(sizeof(KEYMAP_US_PLAIN) / sizeof(char16_t) == KEYMAP_ROW_LENGTH + 1 &&
+              sizeof(KEYMAP_US_SHIFTED) / sizeof(char16_t) == KEYMAP_ROW_LENGTH + 1 &&
+              sizeof(KEYMAP_UK_PLAIN) / sizeof(char16_t) == KEYMAP_ROW_LENGTH + 1 &&
+              sizeof(KEYMAP_UK_SHIFTED) / sizeof(char16_t) == KEYMAP_ROW_LENGTH + 1 &&
+              sizeof(KEYMAP_DE_PLAIN) / sizeof(char16_t) == KEYMAP_ROW_LENGTH + 1 &&
+              sizeof(KEYMAP_DE_SHIFTED) / sizeof(char16_t) == KEYMAP_ROW_LENGTH + 1,
+              "Keymap: one character per row key");
+
+#define KEYMAP_COUNT_OF(a)          (sizeof(a) / sizeof((a)[0]))
+
+inline constexpr KeymapSpec KEYMAP_SPECS[KEYBOARD_LAYOUT_COUNT - 1] = {
+    {KEYMAP_LETTERS, KEYMAP_US_PLAIN, KEYMAP_US_SHIFTED, nullptr, 0, nullptr, 0},
+    {KEYMAP_LETTERS, KEYMAP_UK_PLAIN, KEYMAP_UK_SHIFTED,
+     KEYMAP_UK_ALTGR, KEYMAP_COUNT_OF(KEYMAP_UK_ALTGR), nullptr, 0},
+    {KEYMAP_DE_LETTERS, KEYMAP_DE_PLAIN, KEYMAP_DE_SHIFTED,
+     KEYMAP_DE_ALTGR, KEYMAP_COUNT_OF(KEYMAP_DE_ALTGR),
+     KEYMAP_DE_DEAD, KEYMAP_COUNT_OF(KEYMAP_DE_DEAD)}
+};
+
+// Latin-1 capitals a dead key composes from a base letter; the small letter
+// is 0x20 above each (plus y with diaeresis, whose capital is not Latin-1)
+struct KeymapComposed {
+    char16_t ch;
+    char16_t accent;            // Spacing form, as in KeymapSpec::dead
+    char base;
+};
+
+inline constexpr KeymapComposed KEYMAP_COMPOSED[] = {
+    {u'À', u'`', 'A'}, {u'È', u'`', 'E'}, {u'Ì', u'`', 'I'},
+    {u'Ò', u'`', 'O'}, {u'Ù', u'`', 'U'},
+    {u'Á', u'´', 'A'}, {u'É', u'´', 'E'}, {u'Í', u'´', 'I'},
+    {u'Ó', u'´', 'O'}, {u'Ú', u'´', 'U'}, {u'Ý', u'´', 'Y'},
+    {u'Â', u'^', 'A'}, {u'Ê', u'^', 'E'}, {u'Î', u'^', 'I'},
+    {u'Ô', u'^', 'O'}, {u'Û', u'^', 'U'},
+    {u'Ã', u'~', 'A'}, {u'Ñ', u'~', 'N'}, {u'Õ', u'~', 'O'},
+    {u'Ä', u'¨', 'A'}, {u'Ë', u'¨', 'E'}, {u'Ï', u'¨', 'I'},
+    {u'Ö', u'¨', 'O'}, {u'Ü', u'¨', 'U'}
+};
+
+// First definition of a character wins: plain keys before AltGr before dead keys
+constexpr void keymapPut(Keymap& m, uint32_t cp, uint8_t key, uint8_t modifiers,
+                         uint8_t deadKey = KEY_NONE, uint8_t deadModifiers = MODIFIER_NONE) {
+    KeymapEntry* e = m.slot(cp);
+    if (e == nullptr || e->key != KEY_NONE || key == KEY_NONE) return;
+    e->deadKey = deadKey;
+    e->deadModifiers = deadModifiers;
+    e->key = key;
+    e->modifiers = modifiers;
+}
+
+constexpr void keymapCompose(Keymap& m, const KeymapKey& dead, uint32_t cp, uint32_t base) {
+    const KeymapEntry* b = m.find(base);
+    if (b == nullptr || b->deadKey != KEY_NONE) return;
+    keymapPut(m, cp, b->key, b->modifiers, dead.key, dead.modifiers);
+}
+
+constexpr Keymap buildKeymap(const KeymapSpec& s) {
+    Keymap m{};
+    keymapPut(m, '\n', KEY_ENTER, MODIFIER_NONE);
+    keymapPut(m, '\t', KEY_TAB, MODIFIER_NONE);
+    keymapPut(m, '\b', KEY_BACKSPACE, MODIFIER_NONE);
+    keymapPut(m, ' ', KEY_SPACE, MODIFIER_NONE);
+
+    for (int i = 0; i < 26; i++) {
+        keymapPut(m, s.letters[i], KEY_A + i, MODIFIER_NONE);
+        keymapPut(m, s.letters[i] - 'a' + 'A', KEY_A + i, MODIFIER_SHIFT);
+    }
+    for (int i = 0; i < KEYMAP_ROW_LENGTH; i++) {
+        if (s.plain[i] != u' ') keymapPut(m, s.plain[i], KEYMAP_ROW_KEYS[i], MODIFIER_NONE);
+        if (s.shifted[i] != u' ') keymapPut(m, s.shifted[i], KEYMAP_ROW_KEYS[i], MODIFIER_SHIFT);
+    }
+    for (size_t i = 0; i < s.altGrCount; i++) {
+        keymapPut(m, s.altGr[i].ch, s.altGr[i].key, s.altGr[i].modifiers);
+    }
+
+    for (size_t d = 0; d < s.deadCount; d++) {
+        const KeymapKey& dead = s.dead[d];
+        for (const KeymapComposed& c : KEYMAP_COMPOSED) {
+            if (c.accent != dead.ch) continue;
+            keymapCompose(m, dead, c.ch, (uint32_t)c.base);
+            keymapCompose(m, dead, c.ch + 0x20, (uint32_t)c.base + 0x20);
+        }
+        if (dead.ch == u'¨') keymapCompose(m, dead, 0xFF, 'y');
+        keymapPut(m, dead.ch, KEY_SPACE, MODIFIER_NONE, dead.key, dead.modifiers);
+    }
+    return m;
+}
+
+// Indexed by KeyboardLayout - 1
+inline constexpr Keymap KEYMAPS[KEYBOARD_LAYOUT_COUNT - 1] = {
+    buildKeymap(KEYMAP_SPECS[0]),
+    buildKeymap(KEYMAP_SPECS[1]),
+    buildKeymap(KEYMAP_SPECS[2])
+};
+
+static_assert(KEYMAPS[KEYBOARD_LAYOUT_DE - 1].chars[u'é'].deadKey == KEY_EQUAL &&
+              KEYMAPS[KEYBOARD_LAYOUT_DE - 1].chars[u'é'].key == KEY_E,
+              "German keymap: é is ´ then e");
+static_assert(KEYMAPS[KEYBOARD_LAYOUT_UK - 1].chars['@'].key == KEY_QUOTE,
+              "UK keymap: @ is Shift+'");
+
+// ==============================================================================
+// Typing
+// ==============================================================================
+
+// Layout and Unicode input of a text macro, DEFAULT resolved
+struct TextInput {
+    KeyboardLayout layout;
+    UnicodeInput unicode;
+
+    explicit TextInput(uint8_t keyboardLayout = KEYBOARD_LAYOUT_DEFAULT,
+                       uint8_t unicodeInput = UNICODE_INPUT_DEFAULT)
+        : layout(keyboardLayout == KEYBOARD_LAYOUT_DEFAULT || keyboardLayout >= KEYBOARD_LAYOUT_COUNT
+                     ? (KeyboardLayout)KEYBOARD_LAYOUT : (KeyboardLayout)keyboardLayout),
+          unicode(unicodeInput == UNICODE_INPUT_DEFAULT || unicodeInput >= UNICODE_INPUT_COUNT
+                      ? (UnicodeInput)UNICODE_INPUT : (UnicodeInput)unicodeInput) {}
+};
+
+inline const Keymap& keymapFor(KeyboardLayout layout) {
+    return KEYMAPS[(layout > KEYBOARD_LAYOUT_DEFAULT && layout < KEYBOARD_LAYOUT_COUNT
+                        ? layout : KEYBOARD_LAYOUT_US) - 1];
+}
+
+inline const char* keyboardLayoutName(uint8_t layout) {
+    switch (layout) {
+        case KEYBOARD_LAYOUT_DEFAULT: return "default";
+        case KEYBOARD_LAYOUT_US:      return "us";
+        case KEYBOARD_LAYOUT_UK:      return "uk";
+        case KEYBOARD_LAYOUT_DE:      return "de";
+        default:                      return "?";
+    }
+}
+
+inline const char* unicodeInputName(uint8_t input) {
+    switch (input) {
+        case UNICODE_INPUT_DEFAULT: return "default";
+        case UNICODE_INPUT_NONE:    return "none";
+        case UNICODE_INPUT_WINDOWS: return "windows";
+        case UNICODE_INPUT_MACOS:   return "macos";
+        case UNICODE_INPUT_LINUX:   return "linux";
+        default:                    return "?";
+    }
+}
+
+// Next code point of UTF-8 text, advancing `s`; U+FFFD for malformed bytes
+inline uint32_t utf8Next(const char*& s) {
+    uint8_t c = (uint8_t)*s++;
+    if (c < 0x80) return c;
+    int extra = c >= 0xC2 && c < 0xE0 ? 1 : c >= 0xE0 && c < 0xF0 ? 2 : c >= 0xF0 && c < 0xF5 ? 3 : 0;
+    if (extra == 0) return 0xFFFD;
+    uint32_t cp = c & (0x3F >> extra);
+    for (int i = 0; i < extra; i++) {
+        uint8_t next = (uint8_t)*s;
+        if ((next & 0xC0) != 0x80) return 0xFFFD;
+        cp = (cp << 6) | (next & 0x3F);
+        s++;
+    }
+    return cp;
+}
+
+// Windows-1252 code of `cp` (what Alt+0nnn types), 0 if it has none
+inline uint8_t windows1252Code(uint32_t cp) {
+    static const uint16_t HIGH[32] = {
+        0x20AC, 0, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+        0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0, 0x017D, 0,
+        0, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+        0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0, 0x017E, 0x0178
+    };
+    if ((cp >= 0x20 && cp < 0x7F) || (cp >= 0xA0 && cp <= 0xFF)) return (uint8_t)cp;
+    for (int i = 0; i < 32; i++) {
+        if (HIGH[i] != 0 && HIGH[i] == cp) return (uint8_t)(0x80 + i);
+    }
+    return 0;
+}
+
+// Key for a hex digit in `map` (digits and a-f are plain keys on every layout)
+inline bool keymapHexDigit(const Keymap& map, uint32_t value, KeyStroke& out) {
+    const KeymapEntry* e = map.find(value < 10 ? '0' + value : 'a' + value - 10);
+    if (e == nullptr || e->deadKey != KEY_NONE) return false;
+    out.key = e->key;
+    out.modifiers = e->modifiers;
+    out.held = MODIFIER_NONE;
+    return true;
+}
+
+// Keystrokes that type `cp` on a host with `input`; 0 if it cannot be typed
+inline int keystrokesFor(uint32_t cp, const TextInput& input, KeyStroke out[KEYSTROKES_MAX]) {
+    const Keymap& map = keymapFor(input.layout);
+    const KeymapEntry* e = map.find(cp);
+    if (e != nullptr) {
+        int n = 0;
+        if (e->deadKey != KEY_NONE) out[n++] = {e->deadKey, e->deadModifiers, MODIFIER_NONE};
+        out[n++] = {e->key, e->modifiers, MODIFIER_NONE};
+        return n;
+    }
+    if (cp < 0x20 || cp > 0x10FFFF || (cp >= 0xD800 && cp < 0xE000)) return 0;
+
+    int n = 0;
+    switch (input.unicode) {
+        case UNICODE_INPUT_LINUX: {
+            int digits = 1;
+            while (digits < 6 && (cp >> (digits * 4)) != 0) digits++;
+            out[n++] = {KEY_U, MODIFIER_CTRL | MODIFIER_SHIFT, MODIFIER_NONE};
+            for (int d = digits - 1; d >= 0; d--) {
+                if (!keymapHexDigit(map, (cp >> (d * 4)) & 0xF, out[n++])) return 0;
+            }
+            out[n++] = {KEY_SPACE, MODIFIER_NONE, MODIFIER_NONE};
+            return n;
+        }
+
+        case UNICODE_INPUT_MACOS: {
+            // Unicode Hex Input is itself a US layout
+            const Keymap& us = keymapFor(KEYBOARD_LAYOUT_US);
+            uint16_t units[2] = {(uint16_t)cp, 0};
+            int count = 1;
+            if (cp >= 0x10000) {
+                units[0] = (uint16_t)(0xD800 + ((cp - 0x10000) >> 10));
+                units[1] = (uint16_t)(0xDC00 + ((cp - 0x10000) & 0x3FF));
+                count = 2;
+            }
+            for (int u = 0; u < count; u++) {
+                for (int d = 3; d >= 0; d--) {
+                    KeyStroke& s = out[n++];
+                    if (!keymapHexDigit(us, (units[u] >> (d * 4)) & 0xF, s)) return 0;
+                    s.modifiers |= MODIFIER_ALT;
+                    s.held = MODIFIER_ALT;
+                }
+            }
+            out[n - 1].held = MODIFIER_NONE;    // Releasing Option enters the character
+            return n;
+        }
+
+        case UNICODE_INPUT_WINDOWS: {
+            uint8_t code = windows1252Code(cp);
+            if (code == 0) return 0;
+            uint8_t digits[4] = {0, (uint8_t)(code / 100), (uint8_t)(code / 10 % 10), (uint8_t)(code % 10)};
+            for (int d = 0; d < 4; d++) {
+                uint8_t key = digits[d] == 0 ? KEY_KP_0 : KEY_KP_1 + digits[d] - 1;
+                out[n++] = {key, MODIFIER_ALT, MODIFIER_ALT};
+            }
+            out[n - 1].held = MODIFIER_NONE;    // Releasing Alt enters the character
+            return n;
+        }
+
+        default:
+            return 0;
+    }
+}
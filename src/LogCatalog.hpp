@@ -0,0 +1,100 @@
+#pragma once
+
+// ==============================================================================
+// Log Message Catalog
+// ==============================================================================
+// Every message BinaryLog.hpp can record: an ID, a level and a printf
+// format. The device stores only the ID and the raw arguments; the format
+// is applied on the host (host/logdecode.cpp, macropadctl), which includes
+// this same table. Append new messages at the end so IDs in old captures
+// keep their meaning.
+//
+// Formats take one conversion per argument: %d %u %x %c for 32-bit
+// integers (%lld/%llu for 64-bit), %f/%e/%g for floats (recorded as float),
+// %s for strings (recorded up to LOG_MAX_STRING bytes), %p for pointers.
+
+#include <stdint.h>
+
+enum LogLevel : uint8_t {
+    LOG_SEV_DEBUG = 0,
+    LOG_SEV_INFO,
+    LOG_SEV_WARN,
+    LOG_SEV_ERROR
+};
+
+// X(id, level, format)
+#define LOG_CATALOG(X) \
+    X(LOG_MACRO_EXEC,       LOG_SEV_INFO,  "Executing macro: %s (type=%d)") \
+    X(LOG_MACRO_DROPPED,    LOG_SEV_WARN,  "Macro %s dropped: %d macros already waiting") \
+    X(LOG_MACRO_HELD,       LOG_SEV_INFO,  "BLE %s, macro %s held for reconnect") \
+    X(LOG_HID_OUTPUT,       LOG_SEV_INFO,  "HID output: %s") \
+    X(LOG_BLE_STATE,        LOG_SEV_INFO,  "*** BLE %s (%u ms ago) ***") \
+    X(LOG_BLE_PARAMS,       LOG_SEV_INFO,  "BLE: Connection params %s: interval %.2f ms, latency %d, timeout %d ms") \
+    X(LOG_GESTURE_LONG,     LOG_SEV_DEBUG, "Gesture: long-press at %d,%d") \
+    X(LOG_GESTURE_DOUBLE,   LOG_SEV_DEBUG, "Gesture: double-tap at %d,%d") \
+    X(LOG_GESTURE_SWIPE,    LOG_SEV_DEBUG, "Gesture: swipe dir=%d v=%d px/s (decided in %u ms)") \
+    X(LOG_HEAP,             LOG_SEV_INFO,  "Heap: %u free, PSRAM: %u free") \
+    X(LOG_LOG_STATS,        LOG_SEV_INFO,  "Log: %u records, %u dropped, ring max %u/%u bytes") \
+    X(LOG_PROFILE_SWITCHED, LOG_SEV_INFO,  "Switched to profile: %s") \
+    X(LOG_BLE_CONNECTS,     LOG_SEV_INFO,  "BLE: %u connects (%u reached ready), connect-to-ready last %u ms, max %u ms") \
+    X(LOG_HOST_REFUSED,     LOG_SEV_WARN,  "BLE: Host %d connected mid-switch, refused") \
+    X(LOG_HOST_BONDED,      LOG_SEV_INFO,  "BLE: Host %d is %02X:%02X:%02X:%02X:%02X:%02X") \
+    X(LOG_HOST_SWITCHING,   LOG_SEV_INFO,  "BLE: Switching to host %d (%s)") \
+    X(LOG_HOST_SWITCHED,    LOG_SEV_INFO,  "BLE: Switched to host %d in %u ms") \
+    X(LOG_HOST_SWITCH_TIMEOUT, LOG_SEV_WARN, "BLE: Switch to host %d timed out, advertising openly") \
+    X(LOG_MACRO_HOLD,       LOG_SEV_INFO,  "Holding macro: %s (%d held)") \
+    X(LOG_MACRO_HOLD_DROPPED, LOG_SEV_WARN, "Hold %s dropped: %s") \
+    X(LOG_MACRO_CANCELLED,  LOG_SEV_INFO,  "Cancelled %d running macro(s), keys released") \
+    X(LOG_PROFILE_EXPORT,   LOG_SEV_INFO,  "Export: %d profiles to %s") \
+    X(LOG_PROFILE_UPLOAD,   LOG_SEV_INFO,  "Upload: receiving %u byte bundle") \
+    X(LOG_PROFILE_UPLOAD_FAILED, LOG_SEV_WARN, "Upload: %s") \
+    X(LOG_STATUS_BLE_READY, LOG_SEV_INFO,  "BLE: Stable connection, uptime: %u ms") \
+    X(LOG_STATUS_BLE_WAITING, LOG_SEV_INFO, "BLE: Waiting for connection (%s)...") \
+    X(LOG_STATUS_RECONNECT, LOG_SEV_INFO,  "BLE reconnect: boot->ready %u ms, %u reconnects (last %u ms, avg %u ms, max %u ms), via directed/fast/slow %u/%u/%u; keys held %u, replayed %u, expired %u") \
+    X(LOG_STATUS_HOSTS,     LOG_SEV_INFO,  "BLE hosts: slot %d active, %u switches (%u done, %u timed out, %u refused), last %u ms, avg %u ms, max %u ms") \
+    X(LOG_STATUS_HID_QUEUE, LOG_SEV_INFO,  "HID reports: %u sent, depth %d (max %u), %u dropped, %u flushed, %u stack errors, %u stalls (last %u ms, max %u ms, total %u ms)") \
+    X(LOG_STATUS_MACROS,    LOG_SEV_INFO,  "Macros: %u run, %u cancelled, %u rejected, %u texts truncated, %u characters untypeable, %d waiting") \
+    X(LOG_STATUS_MACRO_TIMING, LOG_SEV_INFO, "Macro timing: %u pre-empted, wait last %u ms (max %u, avg %u), run last %u ms (max %u, avg %u)") \
+    X(LOG_STATUS_HOLDS,     LOG_SEV_INFO,  "Holds: %u pressed, %u reports, %u released by the stuck-key guard, %d held now") \
+    X(LOG_STATUS_BLE_HID,   LOG_SEV_INFO,  "HID transport: %s, heap after init %u (BLE used %u), boot->advertising %u ms, %u reports (%u refused), completion last %u us, avg %u us, max %u us") \
+    X(LOG_STATUS_USB_HID,   LOG_SEV_INFO,  "USB HID: %s, output %s, %u reports (%u refused), latency last %u us, avg %u us, max %u us") \
+    X(LOG_STATUS_BLE_PARAMS, LOG_SEV_INFO, "BLE params: %s at %.2f ms / latency %d, %u requests (%u accepted, %u compromised, %u rejected, %u timed out), active %u s, idle %u s") \
+    X(LOG_STATUS_GESTURES,  LOG_SEV_INFO,  "Gestures: worst decision %u ms, %u over %d ms budget") \
+    X(LOG_STATUS_TOUCH_TO_REPORT, LOG_SEV_INFO, "Touch-to-report (%s): last %u us, avg %u us, max %u us over %u macros") \
+    X(LOG_STATUS_TOUCH,     LOG_SEV_INFO,  "Touch: %u commits (%u immediate), avg commit %u ms, max %u ms, %u slid off, %u highlight redraws") \
+    X(LOG_STATUS_TRACKPAD,  LOG_SEV_INFO,  "Trackpad: %u contacts, %u samples -> %u reports (%u/s while touching, up to %u samples each), delay last %u us, avg %u us, max %u us, %u clicks, %u right clicks, %u carried") \
+    X(LOG_STATUS_PROFILE_CACHE, LOG_SEV_INFO, "Profile cache: %u%% hits (%u/%u), %u prefetched, %u evicted, load avg %u us, max %u us") \
+    X(LOG_STATUS_PROFILE_LOG, LOG_SEV_INFO, "Profile log: %u edits (%u B logical), %u B written, %u B erased, %u compactions, %u torn, %u errors") \
+    X(LOG_STATUS_SERIAL,    LOG_SEV_INFO,  "Serial protocol: %u requests (%u rejected), %u bad frames, %u overflows") \
+    X(LOG_TOUCH_SAMPLE,     LOG_SEV_DEBUG, "Touch trace: %u %d %d") \
+    X(LOG_TOUCH_LIFT,       LOG_SEV_DEBUG, "Touch trace: %u up")
+
+#define LOG_CATALOG_ID(id, level, format) id,
+enum LogMessageId : uint16_t {
+    LOG_CATALOG(LOG_CATALOG_ID)
+    LOG_MESSAGE_COUNT
+};
+#undef LOG_CATALOG_ID
+
+constexpr LogLevel logLevelOf(LogMessageId id) {
+#define LOG_CATALOG_LEVEL(id_, level, format) id == id_ ? level :
+    return LOG_CATALOG(LOG_CATALOG_LEVEL) LOG_SEV_ERROR;
+#undef LOG_CATALOG_LEVEL
+}
+
+inline const char* logFormatOf(uint16_t id) {
+#define LOG_CATALOG_FORMAT(id, level, format) format,
+    static const char* const FORMATS[LOG_MESSAGE_COUNT] = { LOG_CATALOG(LOG_CATALOG_FORMAT) };
+#undef LOG_CATALOG_FORMAT
+    return id < LOG_MESSAGE_COUNT ? FORMATS[id] : nullptr;
+}
+
+inline const char* logLevelName(uint8_t level) {
+    switch (level) {
+        case LOG_SEV_DEBUG: return "D";
+        case LOG_SEV_INFO:  return "I";
+        case LOG_SEV_WARN:  return "W";
+        case LOG_SEV_ERROR: return "E";
+        default:            return "?";
+    }
+}
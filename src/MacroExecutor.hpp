@@ -0,0 +1,653 @@
+#pragma once
+
+// ==============================================================================
+// Macro Executor
+// ==============================================================================
+// Turns macros into HID reports for HidReportQueue without blocking loop().
+// Each macro becomes a job, expanded one step at a time:
+//
+//   KEY       press, release
+//   COMBO     press (modifiers + key), drain, hold MACRO_COMBO_HOLD_MS, release
+//   SEQUENCE  per key: press, release, drain, gap MACRO_SEQUENCE_GAP_MS
+//   TEXT      per character: press, release for each keystroke the host's
+//             layout needs (dead key, AltGr, Unicode entry; KeyboardLayout.hpp)
+//   MEDIA     consumer bits, consumer release
+//
+// service() runs steps until one has to wait: the report queue is full, a
+// drain is not done yet, or a hold/gap has not elapsed. "Drain" waits until
+// the queue has handed everything to the transport, so the hold or gap that
+// follows is seen by the host rather than absorbed by the queue.
+//
+// Jobs are scheduled by priority, first come first served within one:
+// keys, combos and media keys are interactive, text and sequences bulk. A
+// bulk job gives way to a waiting interactive one between characters (or
+// sequence keys), with nothing held down, and carries on where it stopped
+// afterwards. Bulk jobs only keep MACRO_BULK_AHEAD reports queued, so a
+// combo pressed during a long text goes out within a few characters, and
+// they leave one job slot free for interactive ones. The time each job
+// waited and ran is kept in the stats and handed out through takeFinished().
+//
+// Jobs copy the macro, text included: the profile it came from may be
+// evicted from the cache or edited while it is still typing. Text is UTF-8
+// and is typed for the layout given to enqueue().
+//
+// Held buttons (FIRE_HOLD) are not jobs. hold() keeps a macro's keys down
+// until release(); what is held is merged into every report, so a macro
+// run meanwhile does not let go of it. A hold or release is sent as one
+// report, and only if it changes the merged state last queued.
+
+#include <stdint.h>
+#include <string.h>
+#include "Macros.hpp"
+#include "HidReportQueue.hpp"
+
+// Macros waiting, running or paused; text and sequences may use all but one
+#ifndef MACRO_EXEC_QUEUE
+#define MACRO_EXEC_QUEUE            4
+#endif
+
+// Longest text typed (JSON strings are limited to 256 bytes as well)
+#ifndef MACRO_EXEC_TEXT_BYTES
+#define MACRO_EXEC_TEXT_BYTES       256
+#endif
+
+// Reports a text or sequence keeps queued ahead of the transport: the
+// most a combo pressed meanwhile waits behind
+#ifndef MACRO_BULK_AHEAD
+#define MACRO_BULK_AHEAD            16
+#endif
+
+// Buttons held down at once (FIRE_HOLD)
+#ifndef MACRO_HOLD_MAX
+#define MACRO_HOLD_MAX              6
+#endif
+
+#define MACRO_COMBO_HOLD_MS         50
+#define MACRO_SEQUENCE_GAP_MS       30
+
+struct MacroExecStats {
+    uint32_t queued;
+    uint32_t completed;
+    uint32_t rejected;          // Job queue full
+    uint32_t cancelled;
+    uint32_t truncated;         // Text longer than MACRO_EXEC_TEXT_BYTES
+    uint32_t unmapped;          // Characters the host's layout could not type
+    uint32_t holds;             // Buttons held down
+    uint32_t holdReports;       // Reports sent for holds and releases
+    uint32_t forcedReleases;    // Holds ended by releaseHolds()/cancel(), not release()
+    uint32_t preempted;         // Bulk jobs paused for an interactive one
+    uint32_t lastWaitMs;        // Completed jobs: queued until the first step ran
+    uint32_t maxWaitMs;
+    uint64_t totalWaitMs;
+    uint32_t lastRunMs;         // First step to completion, pauses included
+    uint32_t maxRunMs;
+    uint64_t totalRunMs;
+
+    MacroExecStats() : queued(0), completed(0), rejected(0), cancelled(0), truncated(0),
+                       unmapped(0), holds(0), holdReports(0), forcedReleases(0), preempted(0),
+                       lastWaitMs(0), maxWaitMs(0), totalWaitMs(0), lastRunMs(0), maxRunMs(0),
+                       totalRunMs(0) {}
+};
+
+enum MacroJobPriority : uint8_t {
+    MACRO_PRIORITY_INTERACTIVE = 0, // Key, combo, media: short, pre-empt bulk jobs
+    MACRO_PRIORITY_BULK             // Text, sequence: give way between characters
+};
+
+inline MacroJobPriority macroPriorityOf(MacroType type) {
+    return type == MACRO_TYPE_TEXT || type == MACRO_TYPE_SEQUENCE ? MACRO_PRIORITY_BULK
+                                                                  : MACRO_PRIORITY_INTERACTIVE;
+}
+
+// A completed job, from takeFinished()
+struct MacroJobTiming {
+    MacroType type;
+    uint32_t waitMs;
+    uint32_t runMs;
+};
+
+class MacroExecutor {
+private:
+    struct Job {
+        Macro macro;
+        char text[MACRO_EXEC_TEXT_BYTES + 1];
+        TextInput input;
+        bool fromTouch;         // Counts towards touch-to-report latency
+        bool reported;          // First report queued
+        bool used;              // Slot holds a job
+        bool stamped;           // queuedAt set (by the first service() after enqueue())
+        bool started;
+        MacroJobPriority priority;
+        uint32_t seq;           // Arrival order
+        uint32_t queuedAt;
+        uint32_t startedAt;
+
+        // Where a pre-empted job stopped (see saveProgress())
+        uint16_t step;
+        uint16_t textAt;
+        uint16_t charStep;
+    };
+
+    enum StepKind : uint8_t {
+        STEP_REPORT,
+        STEP_DRAIN,
+        STEP_DELAY,
+        STEP_SKIP,              // Nothing to send for this step (unmapped key)
+        STEP_END
+    };
+
+    struct Hold {
+        int owner;              // Caller's id for it (button index)
+        uint8_t modifiers;
+        uint8_t key;
+        uint8_t mediaLow;
+        uint8_t mediaHigh;
+    };
+
+    struct Step {
+        StepKind kind;
+        HidReport report;
+        uint16_t ms;
+
+        Step(StepKind k) : kind(k), ms(0) {}
+        Step(const HidReport& r) : kind(STEP_REPORT), report(r), ms(0) {}
+        static Step delay(uint16_t ms) {
+            Step s(STEP_DELAY);
+            s.ms = ms;
+            return s;
+        }
+    };
+
+    HidReportQueue* _reports;
+    Job _jobs[MACRO_EXEC_QUEUE];
+    uint8_t _count;
+    int8_t _running;            // Slot being expanded, -1 if none was picked yet
+    uint32_t _nextSeq;
+    MacroJobTiming _finished[MACRO_EXEC_QUEUE];
+    uint8_t _finishedHead;
+    uint8_t _finishedCount;
+
+    uint16_t _step;             // Step of the running job
+    bool _waiting;
+    uint32_t _waitStartedAt;
+    uint16_t _waitMs;
+    uint8_t _touchReports;      // Touch jobs that queued their first report
+    MacroExecStats _stats;
+
+    // Running text job: keystrokes of the character being typed, which are
+    // steps [_charStep, _charStep + 2 * _strokeCount)
+    uint16_t _textAt;           // Offset of the next character
+    uint16_t _charStep;
+    uint8_t _strokeCount;
+    KeyStroke _strokes[KEYSTROKES_MAX];
+
+    Hold _holds[MACRO_HOLD_MAX];
+    uint8_t _holdCount;
+    bool _holdPending;          // A hold change is waiting for queue space
+    HidReport _jobKeys;         // Running job's keyboard state, without holds
+    HidReport _jobMedia;        // ...and consumer state
+    HidReport _sentKeys;        // Merged states last queued
+    HidReport _sentMedia;
+
+    static void addKey(HidReport& r, uint8_t key) {
+        if (key == KEY_NONE) return;
+        for (int i = 0; i < 6; i++) {
+            if (r.keys[i] == key) return;
+            if (r.keys[i] == KEY_NONE) {
+                r.keys[i] = key;
+                return;
+            }
+        }
+        // More than 6 keys down: this one is not reported (rollover)
+    }
+
+    static bool sameState(const HidReport& a, const HidReport& b) {
+        return a.modifiers == b.modifiers && memcmp(a.keys, b.keys, sizeof(a.keys)) == 0 &&
+               memcmp(a.media, b.media, sizeof(a.media)) == 0;
+    }
+
+    // `r` with every held key, modifier and consumer bit added
+    HidReport withHolds(const HidReport& r) const {
+        HidReport merged = r;
+        for (int i = 0; i < _holdCount; i++) {
+            const Hold& h = _holds[i];
+            if (merged.kind == HID_REPORT_KEYBOARD) {
+                merged.modifiers |= h.modifiers;
+                addKey(merged, h.key);
+            } else {
+                merged.media[0] |= h.mediaLow;
+                merged.media[1] |= h.mediaHigh;
+            }
+        }
+        return merged;
+    }
+
+    // Queues a job's report with the holds merged in; needs queue space
+    void pushReport(const HidReport& r) {
+        HidReport merged = withHolds(r);
+        _reports->push(merged);
+        if (r.kind == HID_REPORT_KEYBOARD) {
+            _jobKeys = r;
+            _sentKeys = merged;
+        } else {
+            _jobMedia = r;
+            _sentMedia = merged;
+        }
+    }
+
+    // Queues the states the holds changed. False if the queue was full
+    // (retried from service()).
+    bool syncHolds() {
+        _holdPending = false;
+        const HidReport* jobs[2] = {&_jobKeys, &_jobMedia};
+        HidReport* sent[2] = {&_sentKeys, &_sentMedia};
+        for (int i = 0; i < 2; i++) {
+            HidReport merged = withHolds(*jobs[i]);
+            if (sameState(merged, *sent[i])) continue;
+            if (_reports->space() == 0) {
+                _holdPending = true;
+                return false;
+            }
+            _reports->push(merged);
+            *sent[i] = merged;
+            _stats.holdReports++;
+        }
+        return true;
+    }
+
+    // The job's keys are up (it ended or was dropped)
+    void clearJobState() {
+        _jobKeys = HidReport::release();
+        _jobMedia = HidReport::mediaState(0, 0);
+    }
+
+    static Step keyStep(uint8_t modifiers, uint8_t key, bool press) {
+        if (key == KEY_NONE) return Step(STEP_SKIP);
+        return press ? Step(HidReport::press(modifiers, key)) : Step(HidReport::release());
+    }
+
+    Step textStep(const Job& job, uint16_t i) {
+        while (i >= _charStep + 2 * _strokeCount) {
+            if (job.text[_textAt] == '\0') return Step(STEP_END);
+            _charStep += 2 * _strokeCount;
+            const char* next = job.text + _textAt;
+            _strokeCount = (uint8_t)keystrokesFor(utf8Next(next), job.input, _strokes);
+            _textAt = (uint16_t)(next - job.text);
+            if (_strokeCount == 0) _stats.unmapped++;
+        }
+        const KeyStroke& s = _strokes[(i - _charStep) / 2];
+        if ((i - _charStep) % 2 == 0) return Step(HidReport::press(s.modifiers, s.key));
+        return Step(s.held ? HidReport::press(s.held, KEY_NONE) : HidReport::release());
+    }
+
+    // Step `i` of `job`
+    Step stepAt(const Job& job, uint16_t i) {
+        const Macro& m = job.macro;
+        switch (m.type) {
+            case MACRO_TYPE_KEY:
+                if (m.keyCount == 0 || i >= 2) return Step(STEP_END);
+                return keyStep(MODIFIER_NONE, m.keys[0], i == 0);
+
+            case MACRO_TYPE_COMBO:
+                if (m.keys[0] == KEY_NONE) return Step(STEP_END);
+                switch (i) {
+                    case 0:  return Step(HidReport::press(m.modifiers, m.keys[0]));
+                    case 1:  return Step(STEP_DRAIN);
+                    case 2:  return Step::delay(MACRO_COMBO_HOLD_MS);
+                    case 3:  return Step(HidReport::release());
+                    default: return Step(STEP_END);
+                }
+
+            case MACRO_TYPE_SEQUENCE: {
+                int key = i / 4;
+                if (key >= m.keyCount || key >= 6) return Step(STEP_END);
+                if (m.keys[key] == KEY_NONE) return Step(STEP_SKIP);
+                switch (i % 4) {
+                    case 0:  return Step(HidReport::press(MODIFIER_NONE, m.keys[key]));
+                    case 1:  return Step(HidReport::release());
+                    case 2:  return Step(STEP_DRAIN);
+                    default: return Step::delay(MACRO_SEQUENCE_GAP_MS);
+                }
+            }
+
+            case MACRO_TYPE_TEXT:
+                return textStep(job, i);
+
+            case MACRO_TYPE_MEDIA: {
+                uint8_t low, high;
+                if (m.keyCount == 0 || i >= 2 || !mediaKeyBits(m.keys[0], low, high)) {
+                    return Step(STEP_END);
+                }
+                return i == 0 ? Step(HidReport::mediaState(low, high))
+                              : Step(HidReport::mediaState(0, 0));
+            }
+
+            default:
+                return Step(STEP_END);
+        }
+    }
+
+    void resetStep() {
+        _step = 0;
+        _waiting = false;
+        _textAt = 0;
+        _charStep = 0;
+        _strokeCount = 0;
+    }
+
+    // Next job to run: highest priority, then the oldest
+    int pickJob() const {
+        int best = -1;
+        for (int i = 0; i < MACRO_EXEC_QUEUE; i++) {
+            const Job& j = _jobs[i];
+            if (!j.used) continue;
+            if (best < 0 || j.priority < _jobs[best].priority ||
+                (j.priority == _jobs[best].priority && (int32_t)(j.seq - _jobs[best].seq) < 0)) {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    // The running job is between characters (or sequence keys) with its
+    // keys up: it can be paused here and picked up again later
+    bool atYieldPoint() const {
+        const Job& job = _jobs[_running];
+        if (_waiting || job.priority != MACRO_PRIORITY_BULK) return false;
+        if (job.macro.type == MACRO_TYPE_TEXT) return _step == _charStep + 2 * _strokeCount;
+        return _step % 4 == 0;
+    }
+
+    // Strokes are not kept: a job is only paused once its character is done,
+    // so it carries on from the next one
+    void saveProgress(Job& job) const {
+        job.step = _step;
+        job.textAt = _textAt;
+        job.charStep = (uint16_t)(_charStep + 2 * _strokeCount);
+    }
+
+    void restoreProgress(const Job& job) {
+        resetStep();
+        _step = job.step;
+        _textAt = job.textAt;
+        _charStep = job.charStep;
+    }
+
+    // Runs the job pickJob() chooses next, pausing the current one
+    void switchJob(uint32_t now) {
+        int next = pickJob();
+        if (next == _running) return;
+        if (_running >= 0) {
+            saveProgress(_jobs[_running]);
+            _stats.preempted++;
+        }
+        _running = (int8_t)next;
+        Job& job = _jobs[next];
+        restoreProgress(job);
+        if (!job.started) {
+            job.started = true;
+            job.startedAt = now;
+        }
+    }
+
+    void finishJob(uint32_t now) {
+        Job& job = _jobs[_running];
+        uint32_t waitMs = job.startedAt - job.queuedAt;
+        uint32_t runMs = now - job.startedAt;
+        _stats.completed++;
+        _stats.lastWaitMs = waitMs;
+        if (waitMs > _stats.maxWaitMs) _stats.maxWaitMs = waitMs;
+        _stats.totalWaitMs += waitMs;
+        _stats.lastRunMs = runMs;
+        if (runMs > _stats.maxRunMs) _stats.maxRunMs = runMs;
+        _stats.totalRunMs += runMs;
+
+        if (_finishedCount == MACRO_EXEC_QUEUE) {
+            _finishedHead = (_finishedHead + 1) % MACRO_EXEC_QUEUE;     // Oldest goes
+            _finishedCount--;
+        }
+        MacroJobTiming& t = _finished[(_finishedHead + _finishedCount) % MACRO_EXEC_QUEUE];
+        t.type = job.macro.type;
+        t.waitMs = waitMs;
+        t.runMs = runMs;
+        _finishedCount++;
+
+        job.used = false;
+        _count--;
+        _running = -1;
+        resetStep();
+        clearJobState();
+    }
+
+    // Drops every job, or only those that have started (running or paused)
+    int dropJobs(bool startedOnly) {
+        int dropped = 0;
+        for (int i = 0; i < MACRO_EXEC_QUEUE; i++) {
+            Job& j = _jobs[i];
+            if (!j.used || (startedOnly && !j.started)) continue;
+            j.used = false;
+            dropped++;
+        }
+        _count -= dropped;
+        _stats.cancelled += dropped;
+        return dropped;
+    }
+
+    // No job is running and nothing is held any more
+    void resetKeys() {
+        _running = -1;
+        resetStep();
+        clearJobState();
+        _stats.forcedReleases += _holdCount;
+        _holdCount = 0;
+        _holdPending = false;
+        _sentKeys = _jobKeys;
+        _sentMedia = _jobMedia;
+    }
+
+public:
+    explicit MacroExecutor(HidReportQueue* reports)
+        : _reports(reports), _count(0), _running(-1), _nextSeq(0), _finishedHead(0),
+          _finishedCount(0), _step(0), _waiting(false), _waitStartedAt(0),
+          _waitMs(0), _touchReports(0), _textAt(0), _charStep(0), _strokeCount(0),
+          _holdCount(0), _holdPending(false) {
+        for (int i = 0; i < MACRO_EXEC_QUEUE; i++) _jobs[i].used = false;
+        clearJobState();
+        _sentKeys = _jobKeys;
+        _sentMedia = _jobMedia;
+    }
+
+    // Queues `macro`, its text typed for `input` (the profile's layout);
+    // false if MACRO_EXEC_QUEUE jobs are already waiting, or a text or
+    // sequence would take the last free slot
+    bool enqueue(const Macro& macro, bool fromTouch, const TextInput& input = TextInput()) {
+        MacroJobPriority priority = macroPriorityOf(macro.type);
+        int bulk = 0;
+        int slot = -1;
+        for (int i = 0; i < MACRO_EXEC_QUEUE; i++) {
+            if (!_jobs[i].used) {
+                if (slot < 0) slot = i;
+            } else if (_jobs[i].priority == MACRO_PRIORITY_BULK) {
+                bulk++;
+            }
+        }
+        if (slot < 0 || (priority == MACRO_PRIORITY_BULK && bulk >= MACRO_EXEC_QUEUE - 1)) {
+            _stats.rejected++;
+            return false;
+        }
+        Job& job = _jobs[slot];
+        job.macro = macro;
+        job.text[0] = '\0';
+        if (macro.type == MACRO_TYPE_TEXT && macro.text != nullptr) {
+            size_t len = strlen(macro.text);
+            if (len > MACRO_EXEC_TEXT_BYTES) {
+                // Cut at a character boundary, not inside a UTF-8 sequence
+                len = MACRO_EXEC_TEXT_BYTES;
+                while (len > 0 && ((uint8_t)macro.text[len] & 0xC0) == 0x80) len--;
+                _stats.truncated++;
+            }
+            memcpy(job.text, macro.text, len);
+            job.text[len] = '\0';
+        }
+        job.macro.text = nullptr;
+        job.input = input;
+        job.fromTouch = fromTouch;
+        job.reported = false;
+        job.used = true;
+        job.stamped = false;
+        job.started = false;
+        job.priority = priority;
+        job.seq = _nextSeq++;
+        job.step = job.textAt = job.charStep = 0;
+        _count++;
+        _stats.queued++;
+        return true;
+    }
+
+    // Runs steps until one has to wait; call from loop()
+    void service(uint32_t now) {
+        if (_holdPending) syncHolds();
+        for (int i = 0; i < MACRO_EXEC_QUEUE; i++) {
+            Job& j = _jobs[i];
+            if (j.used && !j.stamped) {
+                j.stamped = true;
+                j.queuedAt = now;
+            }
+        }
+        while (_count > 0) {
+            if (_running < 0 || atYieldPoint()) switchJob(now);
+            Job& job = _jobs[_running];
+            if (_waiting) {
+                if (now - _waitStartedAt < _waitMs) return;
+                _waiting = false;
+                _step++;
+                continue;
+            }
+
+            Step step = stepAt(job, _step);
+            switch (step.kind) {
+                case STEP_END:
+                    finishJob(now);
+                    break;
+                case STEP_SKIP:
+                    _step++;
+                    break;
+                case STEP_REPORT:
+                    if (_reports->space() == 0) return;
+                    if (job.priority == MACRO_PRIORITY_BULK &&
+                        _reports->depth() >= MACRO_BULK_AHEAD) {
+                        return;
+                    }
+                    pushReport(step.report);
+                    if (job.fromTouch && !job.reported) _touchReports++;
+                    job.reported = true;
+                    _step++;
+                    break;
+                case STEP_DRAIN:
+                    if (!_reports->isEmpty()) return;
+                    _step++;
+                    break;
+                case STEP_DELAY:
+                    _waiting = true;
+                    _waitStartedAt = now;
+                    _waitMs = step.ms;
+                    break;
+            }
+        }
+    }
+
+    // Drops every job and hold. With `release` (link still up) the reports
+    // not yet sent go too, replaced by key and consumer releases so nothing
+    // stays held on the host. Without, the link is gone and the host has
+    // released everything itself.
+    void cancel(bool release) {
+        if (_count == 0 && _holdCount == 0) return;
+        dropJobs(false);
+        resetKeys();
+        if (release) {
+            _reports->discard();
+            _reports->push(HidReport::release());
+            _reports->push(HidReport::mediaState(0, 0));
+        }
+    }
+
+    // Cancel gesture: aborts the running job (and any it paused) and lets go
+    // of every key, holds included. Jobs that have not started yet still run.
+    // Returns the jobs dropped.
+    int cancelRunning() {
+        int dropped = dropJobs(true);
+        if (dropped == 0 && _holdCount == 0) return 0;
+        resetKeys();
+        _reports->discard();
+        _reports->push(HidReport::release());
+        _reports->push(HidReport::mediaState(0, 0));
+        return dropped;
+    }
+
+    // Presses `macro` (a key, combo or media key) until release(owner).
+    // False if it cannot be held or MACRO_HOLD_MAX buttons already are.
+    bool hold(int owner, const Macro& macro) {
+        if (!isHoldable(macro.type) || macro.keyCount == 0 || _holdCount == MACRO_HOLD_MAX) {
+            return false;
+        }
+        Hold& h = _holds[_holdCount];
+        h.owner = owner;
+        h.modifiers = macro.type == MACRO_TYPE_COMBO ? macro.modifiers : MODIFIER_NONE;
+        h.key = KEY_NONE;
+        h.mediaLow = h.mediaHigh = 0;
+        if (macro.type == MACRO_TYPE_MEDIA) {
+            mediaKeyBits(macro.keys[0], h.mediaLow, h.mediaHigh);
+        } else {
+            h.key = macro.keys[0];
+        }
+        _holdCount++;
+        _stats.holds++;
+        uint32_t sent = _stats.holdReports;
+        syncHolds();
+        if (_stats.holdReports != sent) _touchReports++;
+        return true;
+    }
+
+    // Lets go of what `owner` holds; nothing if it holds nothing
+    void release(int owner) {
+        for (int i = 0; i < _holdCount; i++) {
+            if (_holds[i].owner != owner) continue;
+            // Keep the rest in the order they were pressed
+            memmove(&_holds[i], &_holds[i + 1], (_holdCount - i - 1) * sizeof(Hold));
+            _holdCount--;
+            syncHolds();
+            return;
+        }
+    }
+
+    // Stuck-key guard: lets go of every hold (profile switch, lost touch)
+    void releaseHolds() {
+        if (_holdCount == 0) return;
+        _stats.forcedReleases += _holdCount;
+        _holdCount = 0;
+        syncHolds();
+    }
+
+    // True once for each touch job, when its first report was queued
+    bool takeTouchReport() {
+        if (_touchReports == 0) return false;
+        _touchReports--;
+        return true;
+    }
+
+    // Oldest completed job not taken yet; false if none. Only the last
+    // MACRO_EXEC_QUEUE are kept.
+    bool takeFinished(MacroJobTiming& out) {
+        if (_finishedCount == 0) return false;
+        out = _finished[_finishedHead];
+        _finishedHead = (_finishedHead + 1) % MACRO_EXEC_QUEUE;
+        _finishedCount--;
+        return true;
+    }
+
+    bool isBusy() const { return _count > 0; }
+    bool isHolding() const { return _holdCount > 0; }
+    int held() const { return _holdCount; }
+    int queued() const { return _count; }
+    const MacroExecStats& stats() const { return _stats; }
+};
@@ -3,6 +3,13 @@
 #include <Arduino.h>
 #include <LovyanGFX.hpp>
 #include "Macros.hpp"
+#include "GestureRecognizer.hpp"
+#include "TouchFilter.hpp"
+#include "MotionCoalescer.hpp"
+#include "ProfileStore.hpp"
+#include "Metrics.hpp"
+#include "BinaryLog.hpp"
+#include "Clock.hpp"
 
 // ==============================================================================
 // UI Constants
@@ -38,14 +45,20 @@
 #define COLOR_BT_CONNECTED  0x07E0  // Green
 #define COLOR_BT_DISCONNECTED 0xF800 // Red
 #define COLOR_DIVIDER       0x4208
+#define COLOR_TRACKPAD      0x2104
 
-// Touch debounce
-#define TOUCH_DEBOUNCE_MS   150
-#define BUTTON_PRESS_DELAY  100
+// Footer navigation buttons
+#define FOOTER_PREV_X       20
+#define FOOTER_NEXT_X       360
+#define FOOTER_BUTTON_WIDTH 100
 
-// Swipe detection
-#define SWIPE_THRESHOLD     50
-#define SWIPE_MIN_DISTANCE  80
+// Touch/gesture thresholds live in GestureRecognizer.hpp
+
+// Press path ordering: 1 = resolve, queue HID report, then draw feedback in the
+// render phase; 0 = legacy order (draw the highlight before dispatching)
+#ifndef HID_FIRST_ORDERING
+#define HID_FIRST_ORDERING 1
+#endif
 
 // ==============================================================================
 // Button State
@@ -54,9 +67,27 @@ struct ButtonState {
     bool pressed;
     bool wasPressed;
     uint32_t pressStartTime;
+    uint32_t lastFireTime;  // For the BUTTON_PRESS_DELAY re-fire guard
     int16_t touchId;  // Track which touch point is pressing this button
+    bool holding;     // FIRE_HOLD macro is down until this touch ends
+
+    ButtonState() : pressed(false), wasPressed(false), pressStartTime(0),
+                    lastFireTime(0), touchId(-1), holding(false) {}
+};
 
-    ButtonState() : pressed(false), wasPressed(false), pressStartTime(0), touchId(-1) {}
+// ==============================================================================
+// Touch Statistics
+// ==============================================================================
+struct TouchStats {
+    uint32_t commits;           // Contacts resolved to a button
+    uint32_t immediateCommits;  // ...on the first sample
+    uint32_t totalCommitMs;     // Sum of touch-down to commit times
+    uint32_t maxCommitMs;
+    uint32_t hysteresisReleases; // Contacts that slid off their committed button
+    uint32_t highlightRedraws;  // drawButton() calls from press/release feedback
+
+    TouchStats() : commits(0), immediateCommits(0), totalCommitMs(0), maxCommitMs(0),
+                   hysteresisReleases(0), highlightRedraws(0) {}
 };
 
 // ==============================================================================
@@ -67,32 +98,44 @@ class MacroPadUI;
 // Callback function type for macro execution
 typedef void (*MacroCallback)(const Macro& macro, int buttonIndex);
 
+// Callback for FIRE_HOLD macros: `down` on touch-down, then once more when
+// the touch ends, slides off the button or the profile changes
+typedef void (*HoldCallback)(const Macro& macro, int buttonIndex, bool down);
+
 // Callback for profile change
 typedef void (*ProfileChangeCallback)(int newProfileIndex);
 
+// Callback for every recognized gesture (after the UI has handled it)
+typedef void (*GestureCallback)(const GestureEvent& event);
+
 // ==============================================================================
 // MacroPad UI Class
 // ==============================================================================
 class MacroPadUI {
 private:
     LGFX* _tft;
-    Profile* _profiles;
-    int _profileCount;
+    ProfileStore* _store;
+    const Profile* _profile;        // Current profile, pinned in the store's cache
     int _currentProfileIndex;
 
     ButtonState _buttonStates[BUTTON_COUNT];
 
     // Touch handling
-    int32_t _lastTouchX;
-    int32_t _lastTouchY;
-    uint32_t _lastTouchTime;
-    bool _touchActive;
-    int32_t _touchStartX;
-    int32_t _touchStartY;
+    TouchFilter _filter;
+    GestureRecognizer _gestures;
+    TapResolver _resolver;
+    GridGeometry _grid;
+    TouchStats _touchStats;
+    int _pressedButton;     // Button under the current contact, -1 if none
+    MotionCoalescer* _trackpad;
+    bool _trackpadContact;  // Current contact started on the trackpad
+    bool _pointerAvailable; // The HID output carries mouse reports
 
     // Callbacks
     MacroCallback _macroCallback;
+    HoldCallback _holdCallback;
     ProfileChangeCallback _profileChangeCallback;
+    GestureCallback _gestureCallback;
 
     // Cached button coordinates
     int16_t _buttonX[BUTTON_COUNT];
@@ -101,16 +144,25 @@ private:
     // Needs full redraw flag
     bool _needsFullRedraw;
 
+    // Buttons whose pressed state changed since the last render phase
+    uint64_t _dirtyButtons;
+
+    // clockMicros() when the current touch sample was read
+    uint32_t _sampleMicros;
+
     // Bluetooth status cache
     bool _btConnected;
+    int _hostSlot;          // Active BLE host slot (0-based)
 
 public:
-    MacroPadUI(LGFX* tft, Profile* profiles, int profileCount)
-        : _tft(tft), _profiles(profiles), _profileCount(profileCount),
-          _currentProfileIndex(0), _lastTouchX(0), _lastTouchY(0),
-          _lastTouchTime(0), _touchActive(false), _touchStartX(0), _touchStartY(0),
-            _macroCallback(nullptr), _profileChangeCallback(nullptr), _needsFullRedraw(true),
-            _btConnected(false)
+    MacroPadUI(LGFX* tft, ProfileStore* store)
+        : _tft(tft), _store(store), _profile(&store->get(0)),
+          _currentProfileIndex(0), _pressedButton(-1), _trackpad(nullptr),
+          _trackpadContact(false), _pointerAvailable(false),
+            _macroCallback(nullptr), _holdCallback(nullptr), _profileChangeCallback(nullptr),
+            _gestureCallback(nullptr), _needsFullRedraw(true),
+            _dirtyButtons(0), _sampleMicros(0), _btConnected(false),
+            _hostSlot(0)
     {
         updateButtonLayout();
     }
@@ -120,33 +172,131 @@ public:
         _tft->setFont(&fonts::FreeSans9pt7b);
         updateButtonLayout();
         drawScreen();
+        _store->prefetchAround(_currentProfileIndex);
     }
 
     void setMacroCallback(MacroCallback callback) {
         _macroCallback = callback;
     }
 
+    void setHoldCallback(HoldCallback callback) {
+        _holdCallback = callback;
+    }
+
     void setProfileChangeCallback(ProfileChangeCallback callback) {
         _profileChangeCallback = callback;
     }
 
+    void setGestureCallback(GestureCallback callback) {
+        _gestureCallback = callback;
+    }
+
+    // Receives the samples of contacts on a profile's trackpad rows
+    void setTrackpad(MotionCoalescer* trackpad) {
+        _trackpad = trackpad;
+    }
+
+    // Whether the HID output can send mouse reports (HidTransport::hasPointer());
+    // without one the trackpad rows are drawn disabled and ignore touches
+    void setPointerAvailable(bool available) {
+        if (available == _pointerAvailable) return;
+        _pointerAvailable = available;
+        if (!available) cancelTrackpad();
+        drawTrackpad();
+    }
+
+    const GestureRecognizer& gestures() const {
+        return _gestures;
+    }
+
+    const TouchStats& touchStats() const {
+        return _touchStats;
+    }
+
+    // Timestamp of the touch sample that is being acted on; lets the macro
+    // callback measure touch-to-report latency
+    uint32_t touchSampleMicros() const {
+        return _sampleMicros;
+    }
+
     void setBluetoothConnected(bool connected) {
         _btConnected = connected;
         drawBluetoothStatus(connected);
     }
 
+    void setHostSlot(int slot) {
+        _hostSlot = slot;
+        drawBluetoothStatus(_btConnected);
+    }
+
+    // Tapping the Bluetooth status switches host
+    static bool isBluetoothStatusHit(int16_t x, int16_t y) {
+        return y < HEADER_HEIGHT && x >= BT_STATUS_X - 80;
+    }
+
+    // Button under a point (-1 if none), from the layout updateButtonLayout()
+    // computed for the current profile
+    int getButtonAt(int32_t x, int32_t y) const {
+        return _grid.hitTest(x, y);
+    }
+
+    // Recomputes button positions and the hit-test grid; done on every
+    // profile change
+    void updateButtonLayout() {
+        int rows = gridRows();
+        int cols = gridCols();
+        int bw = buttonWidth();
+        int bh = buttonHeight();
+        int startX = gridStartX();
+        int startY = gridStartY();
+
+        for (int row = 0; row < rows; row++) {
+            for (int col = 0; col < cols; col++) {
+                int idx = row * cols + col;
+                _buttonX[idx] = startX + col * (bw + BUTTON_SPACING_X);
+                _buttonY[idx] = startY + row * (bh + BUTTON_SPACING_Y);
+            }
+        }
+
+        const Profile& p = *_profile;
+        _grid.startX = startX;
+        _grid.startY = startY;
+        _grid.buttonW = bw;
+        _grid.buttonH = bh;
+        _grid.pitchX = bw + BUTTON_SPACING_X;
+        _grid.pitchY = bh + BUTTON_SPACING_Y;
+        _grid.rows = rows;
+        _grid.cols = cols;
+        _grid.enabledMask = 0;
+        for (int i = 0; i < activeButtonCount(); i++) {
+            const Macro& m = p.buttons[i];
+            if (m.type != MACRO_TYPE_NONE || (m.label && strlen(m.label) > 0)) {
+                _grid.enabledMask |= (uint64_t)1 << i;
+            }
+        }
+    }
+
     int getCurrentProfileIndex() const {
         return _currentProfileIndex;
     }
 
+    const Profile& getCurrentProfile() const {
+        return *_profile;
+    }
+
     const char* getCurrentProfileName() const {
-        return _profiles[_currentProfileIndex].name;
+        return _profile->name;
     }
 
     void setProfile(int index) {
-        if (index >= 0 && index < _profileCount && index != _currentProfileIndex) {
+        if (index >= 0 && index < _store->count() && index != _currentProfileIndex) {
+            releasePressedButton(false);
+            cancelTrackpad();
             _currentProfileIndex = index;
+            _profile = &_store->get(index);
+            _store->prefetchAround(index);
             _needsFullRedraw = true;
+            _dirtyButtons = 0;
             updateButtonLayout();
             drawScreen();
 
@@ -156,30 +306,104 @@ public:
         }
     }
 
+    // The store's source changed (e.g. after an import); keeps the current
+    // index when it still exists
+    void reloadProfiles() {
+        releasePressedButton(false);
+        cancelTrackpad();
+        if (_currentProfileIndex >= _store->count()) {
+            _currentProfileIndex = 0;
+        }
+        _profile = &_store->get(_currentProfileIndex);
+        _store->prefetchAround(_currentProfileIndex);
+        _needsFullRedraw = true;
+        _dirtyButtons = 0;
+        updateButtonLayout();
+        drawScreen();
+    }
+
     void nextProfile() {
-        int next = (_currentProfileIndex + 1) % _profileCount;
+        int next = (_currentProfileIndex + 1) % _store->count();
         setProfile(next);
     }
 
     void prevProfile() {
-        int prev = (_currentProfileIndex - 1 + _profileCount) % _profileCount;
+        int count = _store->count();
+        int prev = (_currentProfileIndex - 1 + count) % count;
         setProfile(prev);
     }
 
     void update() {
-        // Handle touch input
-        int32_t x, y;
-        if (_tft->getTouch(&x, &y)) {
-            handleTouch(x, y);
-        } else {
-            handleTouchRelease();
+        uint32_t now = clockMillis();
+
+        // Smooth the raw sample, feed the recognizer, then act on its decisions
+        int32_t x = 0, y = 0;
+        bool touching = _tft->getTouch(&x, &y);
+        _sampleMicros = clockMicros();
+        if (touching) {
+            // Raw samples for host/touch_bench (debug log level only)
+            LOG(LOG_TOUCH_SAMPLE, now, x, y);
+            _filter.push(x, y, now);
+            x = _filter.x();
+            y = _filter.y();
+        }
+        _gestures.update(touching, x, y, now);
+
+        GestureEvent event;
+        while (_gestures.poll(event)) {
+            handleGesture(event);
+        }
+
+        if (_trackpadContact) {
+            if (touching) {
+                _trackpad->move(_filter.fixedX(), _filter.fixedY(), _sampleMicros);
+            } else if (!_gestures.isTouching()) {
+                // Lifted (after the recognizer's release debounce)
+                _trackpadContact = false;
+                _trackpad->end(_sampleMicros);
+            }
+        } else if (touching) {
+            if (_resolver.isPending()) {
+                int target = _resolver.update(_filter, now);
+                if (target != TAP_PENDING) {
+                    commitTarget(target, now);
+                }
+            } else if (_pressedButton >= 0 && !_resolver.stillOnTarget(x, y)) {
+                _touchStats.hysteresisReleases++;
+                releasePressedButton(true);
+            }
+        }
+
+        if (!_gestures.isTouching()) {
+            if (_filter.hasSample()) LOG(LOG_TOUCH_LIFT, now);
+            _filter.reset();
+        }
+
+        // Render phase: visual feedback after all input (and HID) work is done
+        renderPending();
+    }
+
+    void renderPending() {
+        if (_dirtyButtons == 0) return;
+
+        uint32_t start = clockMicros();
+        const Profile& p = *_profile;
+        for (int i = 0; i < activeButtonCount(); i++) {
+            if (_dirtyButtons & ((uint64_t)1 << i)) {
+                _touchStats.highlightRedraws++;
+                drawButton(i, p.buttons[i], _buttonStates[i].pressed);
+            }
         }
+        _dirtyButtons = 0;
+        metrics.observe(METRIC_RENDER_US, clockMicros() - start);
     }
 
     void drawScreen() {
+        uint32_t start = clockMicros();
         drawHeader();
         drawGrid();
         drawFooter();
+        metrics.observe(METRIC_RENDER_US, clockMicros() - start);
     }
 
     void drawHeader() {
@@ -190,7 +414,7 @@ public:
         _tft->setTextColor(COLOR_TEXT_HEADER);
         _tft->setTextDatum(middle_left);
         _tft->setFont(&fonts::FreeSansBold9pt7b);
-        _tft->drawString(_profiles[_currentProfileIndex].name, 10, HEADER_HEIGHT / 2);
+        _tft->drawString(_profile->name, 10, HEADER_HEIGHT / 2);
 
         // Divider line
         _tft->drawFastHLine(0, HEADER_HEIGHT - 1, SCREEN_WIDTH, COLOR_DIVIDER);
@@ -206,14 +430,16 @@ public:
         // Clear the BT status area
         _tft->fillRect(BT_STATUS_X - 80, 0, 130, HEADER_HEIGHT - 1, COLOR_BG_HEADER);
 
-        // Draw BT icon and text
+        // Draw BT icon and text (with the host slot number)
+        char label[16];
+        snprintf(label, sizeof(label), "BT%d: ", _hostSlot + 1);
         if (connected) {
             _tft->setTextColor(COLOR_BT_CONNECTED);
-            _tft->drawString("BT: ", BT_STATUS_X + 60, HEADER_HEIGHT / 2);
+            _tft->drawString(label, BT_STATUS_X + 60, HEADER_HEIGHT / 2);
             _tft->fillCircle(BT_STATUS_X + 75, HEADER_HEIGHT / 2, 5, COLOR_BT_CONNECTED);
         } else {
             _tft->setTextColor(COLOR_BT_DISCONNECTED);
-            _tft->drawString("BT: ", BT_STATUS_X + 60, HEADER_HEIGHT / 2);
+            _tft->drawString(label, BT_STATUS_X + 60, HEADER_HEIGHT / 2);
             _tft->drawCircle(BT_STATUS_X + 75, HEADER_HEIGHT / 2, 5, COLOR_BT_DISCONNECTED);
         }
     }
@@ -223,10 +449,34 @@ public:
         _tft->fillRect(0, HEADER_HEIGHT, SCREEN_WIDTH, GRID_AREA_HEIGHT, COLOR_BG_GRID);
 
         // Draw all buttons
-        Profile& p = _profiles[_currentProfileIndex];
+        const Profile& p = *_profile;
         for (int i = 0; i < activeButtonCount(); i++) {
             drawButton(i, p.buttons[i], false);
         }
+        drawTrackpad();
+    }
+
+    void drawTrackpad() {
+        int16_t x, y, w, h;
+        if (!trackpadRect(x, y, w, h)) return;
+        _tft->fillRoundRect(x, y, w, h, 8, _pointerAvailable ? COLOR_TRACKPAD : COLOR_BG_GRID);
+        _tft->drawRoundRect(x, y, w, h, 8, COLOR_DARK_GRAY);
+
+        _tft->setFont(&fonts::FreeSans9pt7b);
+        _tft->setTextDatum(middle_center);
+        if (!_pointerAvailable) {
+            // No mouse on this output (BLE, or no host yet)
+            _tft->setTextColor(COLOR_DARK_GRAY);
+            _tft->drawString("Trackpad (USB only)", x + w / 2, y + h / 2);
+            return;
+        }
+
+        // Scroll strip
+        int16_t stripX = x + w - TRACKPAD_SCROLL_WIDTH;
+        _tft->drawFastVLine(stripX, y + 8, h - 16, COLOR_DARK_GRAY);
+
+        _tft->setTextColor(BTN_COLOR_SUBTEXT);
+        _tft->drawString("Trackpad", x + (w - TRACKPAD_SCROLL_WIDTH) / 2, y + h / 2);
     }
 
     void drawButton(int index, const Macro& macro, bool pressed) {
@@ -281,40 +531,63 @@ public:
         _tft->setTextDatum(middle_center);
 
         // Left arrow (previous profile)
-        _tft->fillRoundRect(20, footerY + 5, 100, 30, 5, 0x3186);
-        _tft->drawString("< Prev", 70, footerY + 20);
+        _tft->fillRoundRect(FOOTER_PREV_X, footerY + 5, FOOTER_BUTTON_WIDTH, 30, 5, 0x3186);
+        _tft->drawString("< Prev", FOOTER_PREV_X + FOOTER_BUTTON_WIDTH / 2, footerY + 20);
 
         // Home indicator (shows current profile number)
-        char profileNum[8];
-        snprintf(profileNum, sizeof(profileNum), "%d/%d", _currentProfileIndex + 1, _profileCount);
+        char profileNum[16];
+        snprintf(profileNum, sizeof(profileNum), "%d/%d", _currentProfileIndex + 1, _store->count());
         _tft->fillRoundRect(190, footerY + 5, 100, 30, 5, 0x4208);
         _tft->drawString(profileNum, 240, footerY + 20);
 
         // Right arrow (next profile)
-        _tft->fillRoundRect(360, footerY + 5, 100, 30, 5, 0x3186);
-        _tft->drawString("Next >", 410, footerY + 20);
+        _tft->fillRoundRect(FOOTER_NEXT_X, footerY + 5, FOOTER_BUTTON_WIDTH, 30, 5, 0x3186);
+        _tft->drawString("Next >", FOOTER_NEXT_X + FOOTER_BUTTON_WIDTH / 2, footerY + 20);
     }
 
     void highlightButton(int index, bool pressed) {
         if (index >= 0 && index < activeButtonCount()) {
-            Profile& p = _profiles[_currentProfileIndex];
+            _touchStats.highlightRedraws++;
+            const Profile& p = *_profile;
             drawButton(index, p.buttons[index], pressed);
         }
     }
 
 private:
     int gridRows() const {
-        int rows = _profiles[_currentProfileIndex].gridRows;
+        int rows = _profile->gridRows;
         return rows > 0 ? rows : 1;
     }
 
     int gridCols() const {
-        int cols = _profiles[_currentProfileIndex].gridCols;
+        int cols = _profile->gridCols;
         return cols > 0 ? cols : 1;
     }
 
+    int trackpadRows() const {
+        int rows = _profile->trackpadRows;
+        return rows < gridRows() ? rows : gridRows();
+    }
+
+    // Cells above the trackpad rows
     int activeButtonCount() const {
-        return gridRows() * gridCols();
+        return (gridRows() - trackpadRows()) * gridCols();
+    }
+
+    // Area of the trackpad rows; false if the profile has none
+    bool trackpadRect(int16_t& x, int16_t& y, int16_t& w, int16_t& h) const {
+        int rows = trackpadRows();
+        if (rows == 0) return false;
+        x = gridStartX();
+        y = gridStartY() + (gridRows() - rows) * (buttonHeight() + BUTTON_SPACING_Y);
+        w = gridTotalWidth();
+        h = rows * buttonHeight() + (rows - 1) * BUTTON_SPACING_Y;
+        return true;
+    }
+
+    void cancelTrackpad() {
+        if (_trackpad != nullptr) _trackpad->cancel();
+        _trackpadContact = false;
     }
 
     int buttonWidth() const {
@@ -345,163 +618,159 @@ private:
         return HEADER_HEIGHT + ((GRID_AREA_HEIGHT - gridTotalHeight()) / 2);
     }
 
-    void updateButtonLayout() {
-        int rows = gridRows();
-        int cols = gridCols();
-        int bw = buttonWidth();
-        int bh = buttonHeight();
-        int startX = gridStartX();
-        int startY = gridStartY();
+    void handleGesture(const GestureEvent& event) {
+        switch (event.type) {
+            case GESTURE_DOWN:
+                handleTouchDown(event);
+                break;
+
+            case GESTURE_TAP:
+                handleTap(event);
+                break;
+
+            case GESTURE_SWIPE:
+                // Horizontal swipes anywhere but the trackpad switch profiles
+                if (_trackpadContact) break;
+                if (event.direction == SWIPE_RIGHT) {
+                    prevProfile();
+                } else if (event.direction == SWIPE_LEFT) {
+                    nextProfile();
+                }
+                break;
 
-        for (int row = 0; row < rows; row++) {
-            for (int col = 0; col < cols; col++) {
-                int idx = row * cols + col;
-                _buttonX[idx] = startX + col * (bw + BUTTON_SPACING_X);
-                _buttonY[idx] = startY + row * (bh + BUTTON_SPACING_Y);
-            }
-        }
-    }
+            case GESTURE_CANCEL:
+                // A held key stays down while the finger wanders; it is let
+                // go when it slides off the button (see update())
+                if (_pressedButton >= 0 && _buttonStates[_pressedButton].holding) break;
+                releasePressedButton(true);
+                break;
 
-    void handleTouch(int32_t x, int32_t y) {
-        uint32_t now = millis();
+            case GESTURE_UP:
+                releasePressedButton(true);
+                break;
 
-        if (!_touchActive) {
-            // New touch started
-            _touchStartX = x;
-            _touchStartY = y;
-            _touchActive = true;
+            default:
+                break;
         }
 
-        _lastTouchX = x;
-        _lastTouchY = y;
-        _lastTouchTime = now;
+        if (_gestureCallback) {
+            _gestureCallback(event);
+        }
+    }
 
-        // Check if touching header (profile swipe area)
-        if (y < HEADER_HEIGHT) {
-            // Header touch - could use for profile switching gestures
+    void handleTouchDown(const GestureEvent& event) {
+        // Header and footer act on confirmed taps/swipes only
+        if (event.y < HEADER_HEIGHT || event.y >= SCREEN_HEIGHT - FOOTER_HEIGHT) {
             return;
         }
 
-        // Check if touching footer (navigation)
-        if (y >= SCREEN_HEIGHT - FOOTER_HEIGHT) {
-            return;  // Handle footer in touch release
+        int16_t tx, ty, tw, th;
+        if (_trackpad != nullptr && trackpadRect(tx, ty, tw, th) && event.x >= tx &&
+            event.x < tx + tw && event.y >= ty && event.y < ty + th) {
+            if (!_pointerAvailable) return;
+            _trackpadContact = true;
+            _trackpad->begin(_filter.fixedX(), _filter.fixedY(), _sampleMicros,
+                             event.x >= tx + tw - TRACKPAD_SCROLL_WIDTH);
+            return;
         }
 
-        // Check which button is being touched
-        int buttonIndex = getButtonAt(x, y);
+        // The button is chosen from the first filtered samples (see update())
+        _resolver.begin(&_grid, event.time);
+    }
 
-        if (buttonIndex >= 0) {
-            ButtonState& state = _buttonStates[buttonIndex];
+    void commitTarget(int buttonIndex, uint32_t now) {
+        if (buttonIndex < 0) {
+            return;
+        }
 
-            if (!state.pressed) {
-                // Button just pressed
-                state.pressed = true;
-                state.pressStartTime = now;
-                highlightButton(buttonIndex, true);
+        uint32_t commitMs = _resolver.timeToCommit();
+        _touchStats.commits++;
+        _touchStats.totalCommitMs += commitMs;
+        if (commitMs > _touchStats.maxCommitMs) _touchStats.maxCommitMs = commitMs;
+        if (_resolver.samplesToCommit() <= 1) _touchStats.immediateCommits++;
 
-                // Execute macro
-                Profile& p = _profiles[_currentProfileIndex];
-                if (p.buttons[buttonIndex].type != MACRO_TYPE_NONE) {
-                    if (_macroCallback) {
-                        _macroCallback(p.buttons[buttonIndex], buttonIndex);
-                    }
-                }
-            }
+        ButtonState& state = _buttonStates[buttonIndex];
+        state.pressed = true;
+        state.pressStartTime = now;
+        _pressedButton = buttonIndex;
+
+#if !HID_FIRST_ORDERING
+        highlightButton(buttonIndex, true);
+#endif
+
+        // Queue the HID report before any drawing...
+        if (_profile->buttons[buttonIndex].fireMode != FIRE_ON_TAP) {
+            fireButton(buttonIndex, now);
         }
 
-            // Release buttons that are no longer being touched
-            for (int i = 0; i < activeButtonCount(); i++) {
-                if (_buttonStates[i].pressed && i != buttonIndex) {
-                    _buttonStates[i].pressed = false;
-                    highlightButton(i, false);
-                }
-            }
+#if HID_FIRST_ORDERING
+        // ...and leave the highlight to the render phase
+        markButtonDirty(buttonIndex);
+#endif
     }
 
-    void handleTouchRelease() {
-        if (!_touchActive) return;
+    void markButtonDirty(int index) {
+        _dirtyButtons |= (uint64_t)1 << index;
+    }
 
-        // Check for swipe gesture
-        int16_t dx = _lastTouchX - _touchStartX;
-        int16_t dy = _lastTouchY - _touchStartY;
+    void handleTap(const GestureEvent& event) {
+        if (_resolver.isPending()) {
+            // Released before the target was certain: resolve from the last position
+            commitTarget(_resolver.finish(_filter, event.time), event.time);
+        }
 
-        // Profile swipe detection (in header area)
-        if (_touchStartY < HEADER_HEIGHT && abs(dx) > SWIPE_MIN_DISTANCE) {
-            if (dx > 0) {
-                prevProfile();
-            } else {
-                nextProfile();
+        if (_pressedButton >= 0) {
+            if (_profile->buttons[_pressedButton].fireMode == FIRE_ON_TAP) {
+                fireButton(_pressedButton, event.time);
             }
+            return;
         }
 
-        // Footer button detection
-        if (_lastTouchY >= SCREEN_HEIGHT - FOOTER_HEIGHT) {
-            int16_t footerY = SCREEN_HEIGHT - FOOTER_HEIGHT;
-            // Prev button
-            if (_lastTouchX >= 20 && _lastTouchX <= 120 &&
-                _lastTouchY >= footerY + 5 && _lastTouchY <= footerY + 35) {
+        // Footer navigation buttons
+        int16_t footerY = SCREEN_HEIGHT - FOOTER_HEIGHT;
+        if (event.y >= footerY + 5 && event.y <= footerY + 35) {
+            if (event.x >= FOOTER_PREV_X && event.x <= FOOTER_PREV_X + FOOTER_BUTTON_WIDTH) {
                 prevProfile();
-            }
-            // Next button
-            else if (_lastTouchX >= 360 && _lastTouchX <= 460 &&
-                     _lastTouchY >= footerY + 5 && _lastTouchY <= footerY + 35) {
+            } else if (event.x >= FOOTER_NEXT_X && event.x <= FOOTER_NEXT_X + FOOTER_BUTTON_WIDTH) {
                 nextProfile();
             }
         }
-
-            // Release all buttons
-            for (int i = 0; i < activeButtonCount(); i++) {
-                if (_buttonStates[i].pressed) {
-                    _buttonStates[i].pressed = false;
-                    highlightButton(i, false);
-                }
-            }
-
-        _touchActive = false;
     }
 
-    int getButtonAt(int32_t x, int32_t y) {
-        // Check if within grid area
-        int16_t startX = gridStartX();
-        int16_t startY = gridStartY();
-        int16_t totalW = gridTotalWidth();
-        int16_t totalH = gridTotalHeight();
-        int16_t bw = buttonWidth();
-        int16_t bh = buttonHeight();
-
-        if (y < startY || y >= startY + totalH) {
-            return -1;
+    void fireButton(int buttonIndex, uint32_t now) {
+        ButtonState& state = _buttonStates[buttonIndex];
+        if (state.wasPressed && now - state.lastFireTime < BUTTON_PRESS_DELAY) {
+            return;  // Accidental double-press
         }
-
-        if (x < startX || x >= startX + totalW) {
-            return -1;
-        }
-
-        // Calculate row and column
-        int cols = gridCols();
-        int rows = gridRows();
-        int col = (x - startX) / (bw + BUTTON_SPACING_X);
-        int row = (y - startY) / (bh + BUTTON_SPACING_Y);
-
-        // Check if actually within a button (not in spacing)
-        int localX = (x - startX) % (bw + BUTTON_SPACING_X);
-        int localY = (y - startY) % (bh + BUTTON_SPACING_Y);
-
-        if (localX >= bw || localY >= bh) {
-            return -1;  // In spacing area
+        state.wasPressed = true;
+        state.lastFireTime = now;
+
+        const Macro& macro = _profile->buttons[buttonIndex];
+        if (macro.type == MACRO_TYPE_NONE) return;
+        if (macro.fireMode == FIRE_HOLD) {
+            state.holding = true;
+            if (_holdCallback) _holdCallback(macro, buttonIndex, true);
+        } else if (_macroCallback) {
+            _macroCallback(macro, buttonIndex);
         }
+    }
 
-        // Validate bounds
-        if (row >= 0 && row < rows && col >= 0 && col < cols) {
-            int idx = row * cols + col;
-            Profile& p = _profiles[_currentProfileIndex];
-            if (p.buttons[idx].type == MACRO_TYPE_NONE &&
-                (!p.buttons[idx].label || strlen(p.buttons[idx].label) == 0)) {
-                return -1;
+    void releasePressedButton(bool redraw) {
+        _resolver.cancel();
+        if (_pressedButton < 0) return;
+
+        ButtonState& state = _buttonStates[_pressedButton];
+        state.pressed = false;
+        if (state.holding) {
+            // Before the profile changes: the macro is still this profile's
+            state.holding = false;
+            if (_holdCallback) {
+                _holdCallback(_profile->buttons[_pressedButton], _pressedButton, false);
             }
-            return idx;
         }
-
-        return -1;
+        if (redraw) {
+            markButtonDirty(_pressedButton);
+        }
+        _pressedButton = -1;
     }
 };
@@ -1,6 +1,7 @@
 #pragma once
 
-#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
 
 // ==============================================================================
 // HID Key Codes (USB HID Usage Tables)
@@ -12,6 +13,7 @@
 #define MODIFIER_SHIFT  0x02
 #define MODIFIER_ALT    0x04
 #define MODIFIER_GUI    0x08  // Windows key / Command key
+#define MODIFIER_ALTGR  0x40  // Right Alt: AltGr on ISO layouts (text typing only)
 
 // Special keys
 #define KEY_NONE        0x00
@@ -61,6 +63,7 @@
 #define KEY_LEFT_BRACE  0x2F
 #define KEY_RIGHT_BRACE 0x30
 #define KEY_BACKSLASH   0x31
+#define KEY_NON_US_HASH 0x32  // ISO key left of Enter (# on UK and German layouts)
 #define KEY_SEMICOLON   0x33
 #define KEY_QUOTE       0x34
 #define KEY_TILDE       0x35
@@ -68,6 +71,7 @@
 #define KEY_PERIOD      0x37
 #define KEY_SLASH       0x38
 #define KEY_CAPS_LOCK   0x39
+#define KEY_NON_US_BACKSLASH 0x64  // ISO key right of left Shift (\ on UK, < on German)
 
 // Function keys
 #define KEY_F1          0x3A
@@ -107,6 +111,10 @@
 #define KEY_DOWN        0x51
 #define KEY_UP          0x52
 
+// Keypad digits (Alt+keypad character entry on Windows)
+#define KEY_KP_1        0x59
+#define KEY_KP_0        0x62
+
 // Media keys (Consumer Page)
 #define KEY_MEDIA_PLAY_PAUSE    0xE8
 #define KEY_MEDIA_STOP          0xE9
@@ -130,7 +138,40 @@ enum MacroType {
     MACRO_TYPE_COMBO = 2,       // Modifier + key
     MACRO_TYPE_SEQUENCE = 3,    // Multiple keys in sequence
     MACRO_TYPE_TEXT = 4,        // Type text string
-    MACRO_TYPE_MEDIA = 5        // Media key
+    MACRO_TYPE_MEDIA = 5,       // Media key
+    MACRO_TYPE_HOST = 6         // Switch BLE host slot (keys[0] = slot)
+};
+
+// Bonded hosts the pad can switch between (HostSlots.hpp)
+#ifndef HOST_SLOT_COUNT
+#define HOST_SLOT_COUNT 3
+#endif
+
+// When a button's macro fires relative to the touch gesture
+enum FireMode : uint8_t {
+    FIRE_ON_DOWN = 0,           // First touch sample (lowest latency)
+    FIRE_ON_TAP = 1,            // Confirmed tap on release (never fires during a swipe)
+    FIRE_HOLD = 2               // Pressed on touch-down, released when the touch ends
+                                // (single keys, combos and media keys only)
+};
+
+// Keyboard layout the host uses, for text macros (KeyboardLayout.hpp)
+enum KeyboardLayout : uint8_t {
+    KEYBOARD_LAYOUT_DEFAULT = 0,    // KEYBOARD_LAYOUT (build flag), US unless set
+    KEYBOARD_LAYOUT_US,
+    KEYBOARD_LAYOUT_UK,
+    KEYBOARD_LAYOUT_DE,
+    KEYBOARD_LAYOUT_COUNT
+};
+
+// How the host accepts characters its layout has no key for
+enum UnicodeInput : uint8_t {
+    UNICODE_INPUT_DEFAULT = 0,      // UNICODE_INPUT (build flag), none unless set
+    UNICODE_INPUT_NONE,             // Such characters are skipped
+    UNICODE_INPUT_WINDOWS,          // Alt + keypad code (Windows-1252 characters)
+    UNICODE_INPUT_MACOS,            // Option + hex ("Unicode Hex Input" source)
+    UNICODE_INPUT_LINUX,            // Ctrl+Shift+U, hex, Space (IBus/GTK)
+    UNICODE_INPUT_COUNT
 };
 
 // ==============================================================================
@@ -168,6 +209,7 @@ enum MacroType {
 // ==============================================================================
 // Macro Structure
 // ==============================================================================
+// Literal type: built-in macros are constant-initialized into flash (.rodata)
 struct Macro {
     const char* label;          // Button label (e.g., "Copy", "Paste")
     const char* sublabel;       // Secondary label showing shortcut
@@ -178,89 +220,72 @@ struct Macro {
     const char* text;           // Text string for text macros
     uint16_t color;             // Button color
     uint16_t pressColor;        // Color when pressed
+    FireMode fireMode;          // Fire on touch-down, on confirmed tap, or hold
 
     // Default constructor
-    Macro() : label(""), sublabel(""), type(MACRO_TYPE_NONE), modifiers(0),
-              keyCount(0), text(nullptr), color(BTN_COLOR_DEFAULT),
-              pressColor(BTN_COLOR_PRESSED) {
-        for (int i = 0; i < 6; i++) keys[i] = 0;
+    constexpr Macro() : label(""), sublabel(""), type(MACRO_TYPE_NONE), modifiers(0),
+                        keyCount(0), keys{0, 0, 0, 0, 0, 0}, text(nullptr),
+                        color(BTN_COLOR_DEFAULT), pressColor(BTN_COLOR_PRESSED),
+                        fireMode(FIRE_ON_DOWN) {}
+
+    // Single-key constructor shared by the helpers below
+    constexpr Macro(const char* label, const char* sublabel, MacroType type,
+                    uint8_t modifiers, uint8_t key, const char* text, uint16_t color,
+                    FireMode fireMode = FIRE_ON_DOWN)
+        : label(label), sublabel(sublabel), type(type), modifiers(modifiers),
+          keyCount(key == KEY_NONE && type == MACRO_TYPE_TEXT ? 0 : 1),
+          keys{key, 0, 0, 0, 0, 0}, text(text), color(color),
+          pressColor(BTN_COLOR_PRESSED), fireMode(fireMode) {}
+
+    // Copy with a different fire mode, e.g. Macro::combo(...).firedOn(FIRE_ON_TAP)
+    constexpr Macro firedOn(FireMode mode) const {
+        Macro m = *this;
+        m.fireMode = mode;
+        return m;
     }
 
     // Single key constructor
-    static Macro singleKey(const char* label, const char* sublabel, uint8_t key,
-                           uint16_t color = BTN_COLOR_DEFAULT) {
-        Macro m;
-        m.label = label;
-        m.sublabel = sublabel;
-        m.type = MACRO_TYPE_KEY;
-        m.modifiers = MODIFIER_NONE;
-        m.keyCount = 1;
-        m.keys[0] = key;
-        m.color = color;
-        m.pressColor = BTN_COLOR_PRESSED;
-        return m;
+    static constexpr Macro singleKey(const char* label, const char* sublabel, uint8_t key,
+                                     uint16_t color = BTN_COLOR_DEFAULT) {
+        return Macro(label, sublabel, MACRO_TYPE_KEY, MODIFIER_NONE, key, nullptr, color);
     }
 
     // Combo constructor
-    static Macro combo(const char* label, const char* sublabel, uint8_t modifiers,
-                       uint8_t key, uint16_t color = BTN_COLOR_DEFAULT) {
-        Macro m;
-        m.label = label;
-        m.sublabel = sublabel;
-        m.type = MACRO_TYPE_COMBO;
-        m.modifiers = modifiers;
-        m.keyCount = 1;
-        m.keys[0] = key;
-        m.color = color;
-        m.pressColor = BTN_COLOR_PRESSED;
-        return m;
+    static constexpr Macro combo(const char* label, const char* sublabel, uint8_t modifiers,
+                                 uint8_t key, uint16_t color = BTN_COLOR_DEFAULT) {
+        return Macro(label, sublabel, MACRO_TYPE_COMBO, modifiers, key, nullptr, color);
     }
 
     // Media key constructor
-    static Macro media(const char* label, uint8_t mediaKey,
-                       uint16_t color = BTN_COLOR_DEFAULT) {
-        Macro m;
-        m.label = label;
-        m.sublabel = "";
-        m.type = MACRO_TYPE_MEDIA;
-        m.modifiers = MODIFIER_NONE;
-        m.keyCount = 1;
-        m.keys[0] = mediaKey;
-        m.color = color;
-        m.pressColor = BTN_COLOR_PRESSED;
-        return m;
+    static constexpr Macro media(const char* label, uint8_t mediaKey,
+                                 uint16_t color = BTN_COLOR_DEFAULT) {
+        return Macro(label, "", MACRO_TYPE_MEDIA, MODIFIER_NONE, mediaKey, nullptr, color);
     }
 
     // Text macro constructor
-    static Macro textMacro(const char* label, const char* text,
-                           uint16_t color = BTN_COLOR_DEFAULT) {
-        Macro m;
-        m.label = label;
-        m.sublabel = "Text";
-        m.type = MACRO_TYPE_TEXT;
-        m.modifiers = MODIFIER_NONE;
-        m.keyCount = 0;
-        m.text = text;
-        m.color = color;
-        m.pressColor = BTN_COLOR_PRESSED;
-        return m;
+    static constexpr Macro textMacro(const char* label, const char* text,
+                                     uint16_t color = BTN_COLOR_DEFAULT) {
+        // Typing a whole string by accident is costly: fire on confirmed tap
+        return Macro(label, "Text", MACRO_TYPE_TEXT, MODIFIER_NONE, KEY_NONE, text, color,
+                     FIRE_ON_TAP);
+    }
+
+    // Host switch constructor: makes `slot` the active BLE host
+    static constexpr Macro host(const char* label, uint8_t slot,
+                                uint16_t color = BTN_COLOR_DEFAULT) {
+        return Macro(label, "Host", MACRO_TYPE_HOST, MODIFIER_NONE, slot, nullptr, color,
+                     FIRE_ON_TAP);
     }
 
     // Sequence constructor
-    static Macro sequence(const char* label, const char* sublabel, uint8_t modifiers,
-                          const uint8_t* keySeq, uint8_t count,
-                          uint16_t color = BTN_COLOR_DEFAULT) {
-        Macro m;
-        m.label = label;
-        m.sublabel = sublabel;
-        m.type = MACRO_TYPE_SEQUENCE;
-        m.modifiers = modifiers;
-        m.keyCount = min(count, (uint8_t)6);
+    static constexpr Macro sequence(const char* label, const char* sublabel, uint8_t modifiers,
+                                    const uint8_t* keySeq, uint8_t count,
+                                    uint16_t color = BTN_COLOR_DEFAULT) {
+        Macro m(label, sublabel, MACRO_TYPE_SEQUENCE, modifiers, KEY_NONE, nullptr, color);
+        m.keyCount = count < 6 ? count : 6;
         for (int i = 0; i < m.keyCount; i++) {
             m.keys[i] = keySeq[i];
         }
-        m.color = color;
-        m.pressColor = BTN_COLOR_PRESSED;
         return m;
     }
 };
@@ -283,6 +308,7 @@ struct Macro {
 #define ACTIVE_GRID_COLS GRID_SIZE_5
 #endif
 
+#define MIN_GRID_SIZE GRID_SIZE_2
 #define MAX_GRID_ROWS GRID_SIZE_6
 #define MAX_GRID_COLS GRID_SIZE_6
 #define GRID_ROWS ACTIVE_GRID_ROWS
@@ -297,236 +323,327 @@ struct Profile {
     uint16_t accentColor;       // Profile color theme
     uint8_t gridRows;           // Active grid rows for this profile
     uint8_t gridCols;           // Active grid cols for this profile
+    uint8_t keyboardLayout;     // KeyboardLayout text macros are typed for
+    uint8_t unicodeInput;       // UnicodeInput for characters the layout lacks
+    uint8_t trackpadRows;       // Bottom grid rows that form a trackpad, 0 = none
     Macro buttons[BUTTON_COUNT]; // Button grid
 
     // Default constructor
-    Profile() : name("Default"), accentColor(PROFILE_COLOR_GENERAL),
-                gridRows(ACTIVE_GRID_ROWS), gridCols(ACTIVE_GRID_COLS) {}
+    constexpr Profile() : name("Default"), accentColor(PROFILE_COLOR_GENERAL),
+                          gridRows(ACTIVE_GRID_ROWS), gridCols(ACTIVE_GRID_COLS),
+                          keyboardLayout(KEYBOARD_LAYOUT_DEFAULT),
+                          unicodeInput(UNICODE_INPUT_DEFAULT), trackpadRows(0), buttons{} {}
+
+    // Constructor with name and grid size
+    constexpr Profile(const char* profileName, uint16_t color,
+                      uint8_t rows = ACTIVE_GRID_ROWS, uint8_t cols = ACTIVE_GRID_COLS)
+        : name(profileName), accentColor(color), gridRows(rows), gridCols(cols),
+          keyboardLayout(KEYBOARD_LAYOUT_DEFAULT), unicodeInput(UNICODE_INPUT_DEFAULT),
+          trackpadRows(0), buttons{} {}
+
+    // Copy typing text for another host, e.g. makeProfile(...).typedFor(KEYBOARD_LAYOUT_DE)
+    constexpr Profile typedFor(KeyboardLayout layout,
+                               UnicodeInput unicode = UNICODE_INPUT_DEFAULT) const {
+        Profile p = *this;
+        p.keyboardLayout = layout;
+        p.unicodeInput = unicode;
+        return p;
+    }
 
-    // Constructor with name
-    Profile(const char* profileName, uint16_t color)
-        : name(profileName), accentColor(color),
-          gridRows(ACTIVE_GRID_ROWS), gridCols(ACTIVE_GRID_COLS) {}
+    // Copy whose bottom `rows` grid rows are a trackpad (MotionCoalescer.hpp);
+    // buttons in them are not shown
+    constexpr Profile withTrackpad(uint8_t rows) const {
+        Profile p = *this;
+        p.trackpadRows = rows;
+        return p;
+    }
 };
 
-// Helpers for mapping 4-column profiles into the active grid size
-inline int gridIndexFixed(int row, int col, int cols) {
-    return row * cols + col;
+// Builds a profile from its buttons in row-major order; unlisted cells stay empty
+template <typename... Macros>
+constexpr Profile makeProfile(const char* name, uint16_t color, uint8_t rows, uint8_t cols,
+                              const Macros&... macros) {
+    static_assert(sizeof...(Macros) <= BUTTON_COUNT, "Too many buttons for one profile");
+    Profile p(name, color, rows, cols);
+    const Macro list[] = { macros... };
+    for (size_t i = 0; i < sizeof...(Macros); i++) {
+        p.buttons[i] = list[i];
+    }
+    return p;
 }
 
-inline int gridIndexFrom4(int idx) {
-    return gridIndexFixed(idx / 4, idx % 4, 4);
+// ==============================================================================
+// Compile-time Validation
+// ==============================================================================
+constexpr bool isKeyboardUsage(uint8_t key) {
+    return key >= KEY_A && key <= KEY_F24;
 }
 
-#define BTN4(profile, index, macro) profile.buttons[gridIndexFrom4(index)] = macro
+constexpr bool isMediaUsage(uint8_t key) {
+    return key >= KEY_MEDIA_PLAY_PAUSE && key <= KEY_MEDIA_MUTE;
+}
+
+// Macros that can be held down for as long as the touch lasts
+constexpr bool isHoldable(MacroType type) {
+    return type == MACRO_TYPE_KEY || type == MACRO_TYPE_COMBO || type == MACRO_TYPE_MEDIA;
+}
+
+constexpr bool isValidMacro(const Macro& m) {
+    if (m.keyCount > 6 || (m.modifiers & ~0x0F) != 0) return false;
+    if (m.fireMode > FIRE_HOLD || (m.fireMode == FIRE_HOLD && !isHoldable(m.type))) return false;
+
+    switch (m.type) {
+        case MACRO_TYPE_NONE:
+            return m.keyCount == 0;
+        case MACRO_TYPE_KEY:
+        case MACRO_TYPE_COMBO:
+            return m.keyCount == 1 && isKeyboardUsage(m.keys[0]);
+        case MACRO_TYPE_SEQUENCE:
+            for (int i = 0; i < m.keyCount; i++) {
+                if (!isKeyboardUsage(m.keys[i])) return false;
+            }
+            return m.keyCount > 0;
+        case MACRO_TYPE_TEXT:
+            return m.text != nullptr;
+        case MACRO_TYPE_MEDIA:
+            return m.keyCount == 1 && isMediaUsage(m.keys[0]);
+        case MACRO_TYPE_HOST:
+            return m.keyCount == 1 && m.keys[0] < HOST_SLOT_COUNT;
+    }
+    return false;
+}
+
+constexpr bool isValidProfile(const Profile& p) {
+    if (p.gridRows < MIN_GRID_SIZE || p.gridRows > MAX_GRID_ROWS ||
+        p.gridCols < MIN_GRID_SIZE || p.gridCols > MAX_GRID_COLS ||
+        p.keyboardLayout >= KEYBOARD_LAYOUT_COUNT || p.unicodeInput >= UNICODE_INPUT_COUNT ||
+        p.trackpadRows > p.gridRows) {
+        return false;
+    }
+    int active = p.gridRows * p.gridCols;
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+        if (!isValidMacro(p.buttons[i])) return false;
+        // Cells outside the active grid would never be reachable
+        if (i >= active && p.buttons[i].type != MACRO_TYPE_NONE) return false;
+    }
+    return true;
+}
 
 // ==============================================================================
 // Default Profiles
 // ==============================================================================
 
 // General Productivity Profile
-inline Profile createGeneralProfile() {
-    Profile p("General", PROFILE_COLOR_GENERAL);
-    p.gridRows = 4;
-    p.gridCols = 4;
-
+inline constexpr Profile PROFILE_GENERAL = makeProfile("General", PROFILE_COLOR_GENERAL, 4, 4,
     // Row 1
-    BTN4(p, 0, Macro::combo("Copy", "Ctrl+C", MODIFIER_CTRL, KEY_C));
-    BTN4(p, 1, Macro::combo("Paste", "Ctrl+V", MODIFIER_CTRL, KEY_V));
-    BTN4(p, 2, Macro::combo("Cut", "Ctrl+X", MODIFIER_CTRL, KEY_X));
-    BTN4(p, 3, Macro::combo("Undo", "Ctrl+Z", MODIFIER_CTRL, KEY_Z));
+    Macro::combo("Copy", "Ctrl+C", MODIFIER_CTRL, KEY_C),
+    Macro::combo("Paste", "Ctrl+V", MODIFIER_CTRL, KEY_V),
+    Macro::combo("Cut", "Ctrl+X", MODIFIER_CTRL, KEY_X),
+    Macro::combo("Undo", "Ctrl+Z", MODIFIER_CTRL, KEY_Z),
 
     // Row 2
-    BTN4(p, 4, Macro::combo("Save", "Ctrl+S", MODIFIER_CTRL, KEY_S));
-    BTN4(p, 5, Macro::combo("Find", "Ctrl+F", MODIFIER_CTRL, KEY_F));
-    BTN4(p, 6, Macro::combo("Select", "Ctrl+A", MODIFIER_CTRL, KEY_A));
-    BTN4(p, 7, Macro::combo("Redo", "Ctrl+Y", MODIFIER_CTRL, KEY_Y));
+    Macro::combo("Save", "Ctrl+S", MODIFIER_CTRL, KEY_S),
+    Macro::combo("Find", "Ctrl+F", MODIFIER_CTRL, KEY_F),
+    Macro::combo("Select", "Ctrl+A", MODIFIER_CTRL, KEY_A),
+    Macro::combo("Redo", "Ctrl+Y", MODIFIER_CTRL, KEY_Y),
 
     // Row 3 - Media
-    BTN4(p, 8, Macro::media("Play/Pause", KEY_MEDIA_PLAY_PAUSE, COLOR_DARK_GREEN));
-    BTN4(p, 9, Macro::media("Prev", KEY_MEDIA_PREV, COLOR_DARK_GREEN));
-    BTN4(p, 10, Macro::media("Next", KEY_MEDIA_NEXT, COLOR_DARK_GREEN));
-    BTN4(p, 11, Macro::media("Mute", KEY_MEDIA_MUTE, COLOR_RED));
+    Macro::media("Play/Pause", KEY_MEDIA_PLAY_PAUSE, COLOR_DARK_GREEN),
+    Macro::media("Prev", KEY_MEDIA_PREV, COLOR_DARK_GREEN),
+    Macro::media("Next", KEY_MEDIA_NEXT, COLOR_DARK_GREEN),
+    Macro::media("Mute", KEY_MEDIA_MUTE, COLOR_RED),
 
     // Row 4 - System
-    BTN4(p, 12, Macro::singleKey("Vol -", "Volume", KEY_MEDIA_VOLUME_DOWN, COLOR_BLUE));
-    BTN4(p, 13, Macro::singleKey("Vol +", "Volume", KEY_MEDIA_VOLUME_UP, COLOR_BLUE));
-    BTN4(p, 14, Macro::combo("Screenshot", "Win+Shift+S", MODIFIER_GUI | MODIFIER_SHIFT, KEY_S, COLOR_PURPLE));
-    BTN4(p, 15, Macro::combo("Lock", "Win+L", MODIFIER_GUI, KEY_L, COLOR_GRAY));
-
-    return p;
-}
+    Macro::media("Vol -", KEY_MEDIA_VOLUME_DOWN, COLOR_BLUE),
+    Macro::media("Vol +", KEY_MEDIA_VOLUME_UP, COLOR_BLUE),
+    Macro::combo("Screenshot", "Win+Shift+S", MODIFIER_GUI | MODIFIER_SHIFT, KEY_S, COLOR_PURPLE),
+    Macro::combo("Lock", "Win+L", MODIFIER_GUI, KEY_L, COLOR_GRAY).firedOn(FIRE_ON_TAP)
+);
 
 // Developer Profile (VS Code shortcuts)
-inline Profile createDevProfile() {
-    Profile p("VS Code", PROFILE_COLOR_DEV);
-    p.gridRows = 4;
-    p.gridCols = 4;
-
+inline constexpr Profile PROFILE_DEV = makeProfile("VS Code", PROFILE_COLOR_DEV, 4, 4,
     // Row 1
-    BTN4(p, 0, Macro::singleKey("Run", "F5", KEY_F5, 0x0400));
-    BTN4(p, 1, Macro::singleKey("Debug", "F10", KEY_F10, 0x0500));
-    BTN4(p, 2, Macro::combo("Terminal", "Ctrl+`", MODIFIER_CTRL, KEY_TILDE, 0x0600));
-    BTN4(p, 3, Macro::combo("Find", "Ctrl+F", MODIFIER_CTRL, KEY_F));
+    Macro::singleKey("Run", "F5", KEY_F5, 0x0400),
+    Macro::singleKey("Debug", "F10", KEY_F10, 0x0500),
+    Macro::combo("Terminal", "Ctrl+`", MODIFIER_CTRL, KEY_TILDE, 0x0600),
+    Macro::combo("Find", "Ctrl+F", MODIFIER_CTRL, KEY_F),
 
     // Row 2
-    BTN4(p, 4, Macro::combo("Save", "Ctrl+S", MODIFIER_CTRL, KEY_S));
-    BTN4(p, 5, Macro::combo("Undo", "Ctrl+Z", MODIFIER_CTRL, KEY_Z));
-    BTN4(p, 6, Macro::combo("Redo", "Ctrl+Y", MODIFIER_CTRL, KEY_Y));
-    BTN4(p, 7, Macro::combo("Format", "Alt+Shift+F", MODIFIER_ALT | MODIFIER_SHIFT, KEY_F));
+    Macro::combo("Save", "Ctrl+S", MODIFIER_CTRL, KEY_S),
+    Macro::combo("Undo", "Ctrl+Z", MODIFIER_CTRL, KEY_Z),
+    Macro::combo("Redo", "Ctrl+Y", MODIFIER_CTRL, KEY_Y),
+    Macro::combo("Format", "Alt+Shift+F", MODIFIER_ALT | MODIFIER_SHIFT, KEY_F),
 
     // Row 3
-    BTN4(p, 8, Macro::combo("Copy", "Ctrl+C", MODIFIER_CTRL, KEY_C));
-    BTN4(p, 9, Macro::combo("Paste", "Ctrl+V", MODIFIER_CTRL, KEY_V));
-    BTN4(p, 10, Macro::combo("Cut", "Ctrl+X", MODIFIER_CTRL, KEY_X));
-    BTN4(p, 11, Macro::combo("Dup Line", "Ctrl+D", MODIFIER_CTRL, KEY_D));
+    Macro::combo("Copy", "Ctrl+C", MODIFIER_CTRL, KEY_C),
+    Macro::combo("Paste", "Ctrl+V", MODIFIER_CTRL, KEY_V),
+    Macro::combo("Cut", "Ctrl+X", MODIFIER_CTRL, KEY_X),
+    Macro::combo("Dup Line", "Ctrl+D", MODIFIER_CTRL, KEY_D),
 
     // Row 4
-    BTN4(p, 12, Macro::combo("Split", "Ctrl+\\", MODIFIER_CTRL, KEY_BACKSLASH));
-    BTN4(p, 13, Macro::combo("Close", "Ctrl+W", MODIFIER_CTRL, KEY_W));
-    BTN4(p, 14, Macro::combo("Prev Tab", "Ctrl+PgUp", MODIFIER_CTRL, KEY_PAGE_UP));
-    BTN4(p, 15, Macro::combo("Next Tab", "Ctrl+PgDn", MODIFIER_CTRL, KEY_PAGE_DOWN));
-
-    return p;
-}
+    Macro::combo("Split", "Ctrl+\\", MODIFIER_CTRL, KEY_BACKSLASH),
+    Macro::combo("Close", "Ctrl+W", MODIFIER_CTRL, KEY_W).firedOn(FIRE_ON_TAP),
+    Macro::combo("Prev Tab", "Ctrl+PgUp", MODIFIER_CTRL, KEY_PAGE_UP),
+    Macro::combo("Next Tab", "Ctrl+PgDn", MODIFIER_CTRL, KEY_PAGE_DOWN)
+);
 
 // MIR4 Profile (default PC-style shortcuts - adjust in-game if needed)
-inline Profile createMir4Profile() {
-    Profile p("MIR4", PROFILE_COLOR_MIR4);
-    p.gridRows = 5;
-    p.gridCols = 4;
-
+inline constexpr Profile PROFILE_MIR4 = makeProfile("MIR4", PROFILE_COLOR_MIR4, 5, 4,
     // Row 1 - Function keys (as shown in overlay)
-    BTN4(p, 0, Macro::singleKey("Character", "F1", KEY_F1, COLOR_BLUE));
-    BTN4(p, 1, Macro::singleKey("Mail", "F2", KEY_F2, COLOR_BLUE));
-    BTN4(p, 2, Macro::singleKey("Events", "F3", KEY_F3, COLOR_BLUE));
-    BTN4(p, 3, Macro::singleKey("Shop", "F4", KEY_F4, COLOR_BLUE));
+    Macro::singleKey("Character", "F1", KEY_F1, COLOR_BLUE),
+    Macro::singleKey("Mail", "F2", KEY_F2, COLOR_BLUE),
+    Macro::singleKey("Events", "F3", KEY_F3, COLOR_BLUE),
+    Macro::singleKey("Shop", "F4", KEY_F4, COLOR_BLUE),
 
     // Row 2 - Function keys
-    BTN4(p, 4, Macro::singleKey("Clan Info", "F5", KEY_F5, COLOR_PURPLE));
-    BTN4(p, 5, Macro::singleKey("F6", "F6", KEY_F6, COLOR_PURPLE));
-    BTN4(p, 6, Macro::singleKey("Equipment", "F7", KEY_F7, COLOR_PURPLE));
-    BTN4(p, 7, Macro::singleKey("Notify", "F8", KEY_F8, COLOR_PURPLE));
+    Macro::singleKey("Clan Info", "F5", KEY_F5, COLOR_PURPLE),
+    Macro::singleKey("F6", "F6", KEY_F6, COLOR_PURPLE),
+    Macro::singleKey("Equipment", "F7", KEY_F7, COLOR_PURPLE),
+    Macro::singleKey("Notify", "F8", KEY_F8, COLOR_PURPLE),
 
     // Row 3 - Function keys + UI/mission
-    BTN4(p, 8, Macro::singleKey("Game Menu", "F9", KEY_F9, COLOR_ORANGE));
-    BTN4(p, 9, Macro::singleKey("Map", "F10", KEY_F10, COLOR_ORANGE));
-    BTN4(p, 10, Macro::singleKey("Quest", "Q", KEY_Q, COLOR_DARK_GREEN));
-    BTN4(p, 11, Macro::singleKey("Guild", "G", KEY_G, COLOR_CYAN));
+    Macro::singleKey("Game Menu", "F9", KEY_F9, COLOR_ORANGE),
+    Macro::singleKey("Map", "F10", KEY_F10, COLOR_ORANGE),
+    Macro::singleKey("Quest", "Q", KEY_Q, COLOR_DARK_GREEN),
+    Macro::singleKey("Guild", "G", KEY_G, COLOR_CYAN),
 
     // Row 4 - Combat/utility
-    BTN4(p, 12, Macro::singleKey("V", "V", KEY_V, COLOR_DARK_GREEN));
-    BTN4(p, 13, Macro::singleKey("R", "R", KEY_R, COLOR_DARK_GREEN));
-    BTN4(p, 14, Macro::singleKey("Target", "Tab", KEY_TAB, COLOR_DARK_GRAY));
-    BTN4(p, 15, Macro::singleKey("Jump", "Space", KEY_SPACE, COLOR_GRAY));
+    Macro::singleKey("V", "V", KEY_V, COLOR_DARK_GREEN),
+    Macro::singleKey("R", "R", KEY_R, COLOR_DARK_GREEN),
+    Macro::singleKey("Target", "Tab", KEY_TAB, COLOR_DARK_GRAY),
+    Macro::singleKey("Jump", "Space", KEY_SPACE, COLOR_GRAY).firedOn(FIRE_HOLD),
 
     // Row 5 - Potions
-    BTN4(p, 16, Macro::singleKey("Potion 1", "8", KEY_8, COLOR_RED));
-    BTN4(p, 17, Macro::singleKey("Potion 2", "9", KEY_9, COLOR_RED));
-    BTN4(p, 18, Macro::singleKey("Potion 3", "0", KEY_0, COLOR_RED));
-    BTN4(p, 19, Macro::singleKey("Swap Pot", "-", KEY_MINUS, COLOR_ORANGE));
-
-    return p;
-}
+    Macro::singleKey("Potion 1", "8", KEY_8, COLOR_RED),
+    Macro::singleKey("Potion 2", "9", KEY_9, COLOR_RED),
+    Macro::singleKey("Potion 3", "0", KEY_0, COLOR_RED),
+    Macro::singleKey("Swap Pot", "-", KEY_MINUS, COLOR_ORANGE)
+);
 
 // Photoshop Profile
-inline Profile createPhotoshopProfile() {
-    Profile p("Photoshop", PROFILE_COLOR_PHOTOSHOP);
-    p.gridRows = 4;
-    p.gridCols = 4;
-
+inline constexpr Profile PROFILE_PHOTOSHOP = makeProfile("Photoshop", PROFILE_COLOR_PHOTOSHOP, 4, 4,
     // Row 1 - Tools
-    BTN4(p, 0, Macro::singleKey("Brush", "B", KEY_B, 0xF800));
-    BTN4(p, 1, Macro::singleKey("Eraser", "E", KEY_E, 0xF800));
-    BTN4(p, 2, Macro::singleKey("Clone", "S", KEY_S, 0xF800));
-    BTN4(p, 3, Macro::singleKey("Heal", "J", KEY_J, 0xF800));
+    Macro::singleKey("Brush", "B", KEY_B, 0xF800),
+    Macro::singleKey("Eraser", "E", KEY_E, 0xF800),
+    Macro::singleKey("Clone", "S", KEY_S, 0xF800),
+    Macro::singleKey("Heal", "J", KEY_J, 0xF800),
 
     // Row 2
-    BTN4(p, 4, Macro::singleKey("Zoom", "Z", KEY_Z, 0xF9E7));
-    BTN4(p, 5, Macro::singleKey("Crop", "C", KEY_C, 0xF9E7));
-    BTN4(p, 6, Macro::singleKey("Lasso", "L", KEY_L, 0xF9E7));
-    BTN4(p, 7, Macro::singleKey("Move", "V", KEY_V, 0xF9E7));
+    Macro::singleKey("Zoom", "Z", KEY_Z, 0xF9E7),
+    Macro::singleKey("Crop", "C", KEY_C, 0xF9E7),
+    Macro::singleKey("Lasso", "L", KEY_L, 0xF9E7),
+    Macro::singleKey("Move", "V", KEY_V, 0xF9E7),
 
     // Row 3
-    BTN4(p, 8, Macro::combo("Undo", "Ctrl+Z", MODIFIER_CTRL, KEY_Z));
-    BTN4(p, 9, Macro::combo("Redo", "Ctrl+Shift+Z", MODIFIER_CTRL | MODIFIER_SHIFT, KEY_Z));
-    BTN4(p, 10, Macro::combo("Free Trans", "Ctrl+T", MODIFIER_CTRL, KEY_T));
-    BTN4(p, 11, Macro::combo("Deselect", "Ctrl+D", MODIFIER_CTRL, KEY_D));
+    Macro::combo("Undo", "Ctrl+Z", MODIFIER_CTRL, KEY_Z),
+    Macro::combo("Redo", "Ctrl+Shift+Z", MODIFIER_CTRL | MODIFIER_SHIFT, KEY_Z),
+    Macro::combo("Free Trans", "Ctrl+T", MODIFIER_CTRL, KEY_T),
+    Macro::combo("Deselect", "Ctrl+D", MODIFIER_CTRL, KEY_D),
 
     // Row 4
-    BTN4(p, 12, Macro::combo("New Layer", "Ctrl+Shift+N", MODIFIER_CTRL | MODIFIER_SHIFT, KEY_N));
-    BTN4(p, 13, Macro::combo("Merge", "Ctrl+E", MODIFIER_CTRL, KEY_E));
-    BTN4(p, 14, Macro::singleKey("Fill", "G", KEY_G, 0xF800));
-    BTN4(p, 15, Macro::combo("Export", "Ctrl+Shift+S", MODIFIER_CTRL | MODIFIER_SHIFT, KEY_S));
-
-    return p;
-}
+    Macro::combo("New Layer", "Ctrl+Shift+N", MODIFIER_CTRL | MODIFIER_SHIFT, KEY_N),
+    Macro::combo("Merge", "Ctrl+E", MODIFIER_CTRL, KEY_E),
+    Macro::singleKey("Fill", "G", KEY_G, 0xF800),
+    Macro::combo("Export", "Ctrl+Shift+S", MODIFIER_CTRL | MODIFIER_SHIFT, KEY_S)
+);
 
 // Media Control Profile
-inline Profile createMediaProfile() {
-    Profile p("Media", PROFILE_COLOR_MEDIA);
-    p.gridRows = 2;
-    p.gridCols = 4;
-
+inline constexpr Profile PROFILE_MEDIA = makeProfile("Media", PROFILE_COLOR_MEDIA, 2, 4,
     // Row 1
-    BTN4(p, 0, Macro::media("Play", KEY_MEDIA_PLAY_PAUSE, COLOR_GREEN));
-    BTN4(p, 1, Macro::media("Stop", KEY_MEDIA_STOP, COLOR_RED));
-    BTN4(p, 2, Macro::media("Vol Up", KEY_MEDIA_VOLUME_UP, COLOR_GREEN));
-    BTN4(p, 3, Macro::media("Mute", KEY_MEDIA_MUTE, COLOR_RED));
+    Macro::media("Play", KEY_MEDIA_PLAY_PAUSE, COLOR_GREEN),
+    Macro::media("Stop", KEY_MEDIA_STOP, COLOR_RED),
+    Macro::media("Vol Up", KEY_MEDIA_VOLUME_UP, COLOR_GREEN),
+    Macro::media("Mute", KEY_MEDIA_MUTE, COLOR_RED),
 
     // Row 2
-    BTN4(p, 4, Macro::media("Prev", KEY_MEDIA_PREV, COLOR_BLUE));
-    BTN4(p, 5, Macro::media("Next", KEY_MEDIA_NEXT, COLOR_BLUE));
-    BTN4(p, 6, Macro::media("Vol Down", KEY_MEDIA_VOLUME_DOWN, COLOR_GREEN));
-    BTN4(p, 7, Macro::singleKey("", "", KEY_NONE));
-
-    return p;
-}
+    Macro::media("Prev", KEY_MEDIA_PREV, COLOR_BLUE),
+    Macro::media("Next", KEY_MEDIA_NEXT, COLOR_BLUE),
+    Macro::media("Vol Down", KEY_MEDIA_VOLUME_DOWN, COLOR_GREEN)
+);
 
 // Gaming/OBS Streaming Profile
-inline Profile createGamingProfile() {
-    Profile p("OBS/Gaming", PROFILE_COLOR_GAMING);
-    p.gridRows = 4;
-    p.gridCols = 4;
-
+inline constexpr Profile PROFILE_GAMING = makeProfile("OBS/Gaming", PROFILE_COLOR_GAMING, 4, 4,
     // Row 1 - OBS Controls
-    BTN4(p, 0, Macro::combo("Start Rec", "Ctrl+F9", MODIFIER_CTRL, KEY_F9, COLOR_RED));
-    BTN4(p, 1, Macro::combo("Stop Rec", "Ctrl+F10", MODIFIER_CTRL, KEY_F10, COLOR_RED));
-    BTN4(p, 2, Macro::combo("Pause Rec", "Ctrl+F11", MODIFIER_CTRL, KEY_F11, COLOR_ORANGE));
-    BTN4(p, 3, Macro::combo("Screenshot", "F12", KEY_NONE, KEY_F12, COLOR_BLUE));
+    Macro::combo("Start Rec", "Ctrl+F9", MODIFIER_CTRL, KEY_F9, COLOR_RED),
+    Macro::combo("Stop Rec", "Ctrl+F10", MODIFIER_CTRL, KEY_F10, COLOR_RED),
+    Macro::combo("Pause Rec", "Ctrl+F11", MODIFIER_CTRL, KEY_F11, COLOR_ORANGE),
+    Macro::combo("Screenshot", "F12", KEY_NONE, KEY_F12, COLOR_BLUE),
 
     // Row 2 - Scene/Sources
-    BTN4(p, 4, Macro::singleKey("Scene 1", "F1", KEY_F1, COLOR_PURPLE));
-    BTN4(p, 5, Macro::singleKey("Scene 2", "F2", KEY_F2, COLOR_PURPLE));
-    BTN4(p, 6, Macro::singleKey("Scene 3", "F3", KEY_F3, COLOR_PURPLE));
-    BTN4(p, 7, Macro::singleKey("Scene 4", "F4", KEY_F4, COLOR_PURPLE));
+    Macro::singleKey("Scene 1", "F1", KEY_F1, COLOR_PURPLE),
+    Macro::singleKey("Scene 2", "F2", KEY_F2, COLOR_PURPLE),
+    Macro::singleKey("Scene 3", "F3", KEY_F3, COLOR_PURPLE),
+    Macro::singleKey("Scene 4", "F4", KEY_F4, COLOR_PURPLE),
 
     // Row 3 - Audio
-    BTN4(p, 8, Macro::combo("Mute Mic", "Ctrl+M", MODIFIER_CTRL, KEY_M, COLOR_CYAN));
-    BTN4(p, 9, Macro::combo("Mute Desktop", "Ctrl+D", MODIFIER_CTRL, KEY_D, COLOR_CYAN));
-    BTN4(p, 10, Macro::media("Vol Down", KEY_MEDIA_VOLUME_DOWN, COLOR_GREEN));
-    BTN4(p, 11, Macro::media("Vol Up", KEY_MEDIA_VOLUME_UP, COLOR_GREEN));
+    Macro::combo("Mute Mic", "Ctrl+M", MODIFIER_CTRL, KEY_M, COLOR_CYAN),
+    Macro::combo("Mute Desktop", "Ctrl+D", MODIFIER_CTRL, KEY_D, COLOR_CYAN),
+    Macro::media("Vol Down", KEY_MEDIA_VOLUME_DOWN, COLOR_GREEN),
+    Macro::media("Vol Up", KEY_MEDIA_VOLUME_UP, COLOR_GREEN),
 
     // Row 4 - Gaming utilities
-    BTN4(p, 12, Macro::combo("Discord Mute", "Ctrl+Shift+M", MODIFIER_CTRL | MODIFIER_SHIFT, KEY_M, 0x7282));
-    BTN4(p, 13, Macro::combo("Discord Deafen", "Ctrl+Shift+D", MODIFIER_CTRL | MODIFIER_SHIFT, KEY_D, 0x7282));
-    BTN4(p, 14, Macro::combo("Push to Talk", "F13", KEY_NONE, KEY_F13, COLOR_RED));
-    BTN4(p, 15, Macro::combo("Push to Mute", "F14", KEY_NONE, KEY_F14, COLOR_RED));
-
-    return p;
-}
+    Macro::combo("Discord Mute", "Ctrl+Shift+M", MODIFIER_CTRL | MODIFIER_SHIFT, KEY_M, 0x7282),
+    Macro::combo("Discord Deafen", "Ctrl+Shift+D", MODIFIER_CTRL | MODIFIER_SHIFT, KEY_D, 0x7282),
+    Macro::combo("Push to Talk", "F13", KEY_NONE, KEY_F13, COLOR_RED).firedOn(FIRE_HOLD),
+    Macro::combo("Push to Mute", "F14", KEY_NONE, KEY_F14, COLOR_RED).firedOn(FIRE_HOLD)
+);
 
 // Number of profiles
 #define PROFILE_COUNT 6
 
-// Array of all profiles
-inline Profile* getAllProfiles() {
-    static Profile profiles[PROFILE_COUNT];
-    profiles[0] = createGeneralProfile();
-    profiles[1] = createDevProfile();
-    profiles[2] = createMir4Profile();
-    profiles[3] = createPhotoshopProfile();
-    profiles[4] = createMediaProfile();
-    profiles[5] = createGamingProfile();
-    return profiles;
+// All built-in profiles, constant-initialized in flash
+inline constexpr Profile BUILTIN_PROFILES[PROFILE_COUNT] = {
+    PROFILE_GENERAL,
+    PROFILE_DEV,
+    PROFILE_MIR4,
+    PROFILE_PHOTOSHOP,
+    PROFILE_MEDIA,
+    PROFILE_GAMING
+};
+
+static_assert(isValidProfile(PROFILE_GENERAL), "General profile: bad grid size or key code");
+static_assert(isValidProfile(PROFILE_DEV), "VS Code profile: bad grid size or key code");
+static_assert(isValidProfile(PROFILE_MIR4), "MIR4 profile: bad grid size or key code");
+static_assert(isValidProfile(PROFILE_PHOTOSHOP), "Photoshop profile: bad grid size or key code");
+static_assert(isValidProfile(PROFILE_MEDIA), "Media profile: bad grid size or key code");
+static_assert(isValidProfile(PROFILE_GAMING), "OBS/Gaming profile: bad grid size or key code");
+
+// Array of all profiles (no construction or copy at boot)
+inline const Profile* getAllProfiles() {
+    return BUILTIN_PROFILES;
+}
+
+// ==============================================================================
+// Profile Footprint
+// ==============================================================================
+// What a built-in profile takes, counted from its table: the whole Profile
+// (every BUTTON_COUNT cell is in .rodata, used or not) plus the strings its
+// cells point at, against the SRAM copy the old boot-time construction made
+// of every profile.
+struct ProfileFootprint {
+    uint16_t usedCells;         // Non-empty buttons (informational)
+    uint32_t stringBytes;       // Name, labels and text, with terminators
+    uint32_t flashBytes;        // sizeof(Profile) + stringBytes
+    uint32_t legacyRamBytes;    // Header + every cell, as constructed at boot before
+};
+
+constexpr uint32_t footprintStringBytes(const char* s) {
+    if (s == nullptr) return 0;
+    uint32_t n = 1;
+    while (*s++) n++;
+    return n;
+}
+
+constexpr ProfileFootprint profileFootprint(const Profile& p) {
+    ProfileFootprint f = {0, footprintStringBytes(p.name), 0, 0};
+    for (int i = 0; i < p.gridRows * p.gridCols; i++) {
+        const Macro& m = p.buttons[i];
+        if (m.type == MACRO_TYPE_NONE) continue;
+        f.usedCells++;
+        f.stringBytes += footprintStringBytes(m.label) + footprintStringBytes(m.sublabel) +
+                         footprintStringBytes(m.text);
+    }
+    f.flashBytes = (uint32_t)sizeof(Profile) + f.stringBytes;
+    f.legacyRamBytes = (uint32_t)offsetof(Profile, buttons) + BUTTON_COUNT * (uint32_t)sizeof(Macro);
+    return f;
 }
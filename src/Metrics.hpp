@@ -0,0 +1,262 @@
+#pragma once
+
+// ==============================================================================
+// Runtime Metrics
+// ==============================================================================
+// A fixed registry of counters, gauges and latency histograms, indexed by
+// the IDs in METRIC_CATALOG. Everything is allocated statically; recording
+// is an increment, a store and two compares, or (histograms) a count-leading-
+// zeros and four updates. Metrics are recorded and read on loop()'s task
+// only, so there is no locking.
+//
+// Histograms have power-of-two buckets: bucket 0 counts zeros, bucket b
+// counts values in [2^(b-1), 2^b), the last bucket everything above.
+// Gauges keep the last value and the lowest and highest seen.
+//
+// FRAME_METRICS (SerialProtocol.hpp) reads the registry a page at a time:
+// the request names the first metric, the reply carries as many as fit and
+// the next one to ask for. Asking for metric 0 freezes a copy, so the pages
+// of one snapshot are consistent. Page (little-endian):
+//
+//   metric count u8 | next u8 | uptime ms u32 | entries...
+//
+//   counter     id u8, value u32
+//   gauge       id u8, value u32, min u32, max u32
+//   histogram   id u8, count u32, sum u64, max u32, bucket mask u32,
+//               one u32 per bucket in the mask
+//
+// Append new metrics at the end so IDs in saved snapshots keep their meaning.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+enum MetricKind : uint8_t {
+    METRIC_COUNTER = 0,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+};
+
+// X(id, kind, name)
+#define METRIC_CATALOG(X) \
+    X(METRIC_LOOP_PERIOD_US,      METRIC_HISTOGRAM, "loop.period_us") \
+    X(METRIC_RENDER_US,           METRIC_HISTOGRAM, "ui.render_us") \
+    X(METRIC_TOUCH_TO_REPORT_US,  METRIC_HISTOGRAM, "hid.touch_to_report_us") \
+    X(METRIC_BLE_DISCONNECTS,     METRIC_COUNTER,   "ble.disconnects") \
+    X(METRIC_BLE_RECONNECT_MS,    METRIC_HISTOGRAM, "ble.reconnect_ms") \
+    X(METRIC_HID_QUEUE_DEPTH,     METRIC_GAUGE,     "hid.queue_depth") \
+    X(METRIC_MACRO_QUEUE_DEPTH,   METRIC_GAUGE,     "macro.queue_depth") \
+    X(METRIC_LOG_RING_BYTES,      METRIC_GAUGE,     "log.ring_bytes") \
+    X(METRIC_HEAP_FREE,           METRIC_GAUGE,     "heap.free") \
+    X(METRIC_HEAP_LOW_WATER,      METRIC_GAUGE,     "heap.low_water") \
+    X(METRIC_PSRAM_FREE,          METRIC_GAUGE,     "psram.free") \
+    X(METRIC_PSRAM_LOW_WATER,     METRIC_GAUGE,     "psram.low_water") \
+    X(METRIC_MACRO_WAIT_MS,       METRIC_HISTOGRAM, "macro.wait_ms") \
+    X(METRIC_MACRO_RUN_MS,        METRIC_HISTOGRAM, "macro.run_ms") \
+    X(METRIC_TRACKPAD_DELAY_US,   METRIC_HISTOGRAM, "trackpad.delay_us")
+
+#define METRIC_CATALOG_ID(id, kind, name) id,
+enum MetricId : uint8_t {
+    METRIC_CATALOG(METRIC_CATALOG_ID)
+    METRIC_COUNT
+};
+#undef METRIC_CATALOG_ID
+
+inline MetricKind metricKindOf(uint8_t id) {
+#define METRIC_CATALOG_KIND(id, kind, name) kind,
+    static const MetricKind KINDS[METRIC_COUNT] = { METRIC_CATALOG(METRIC_CATALOG_KIND) };
+#undef METRIC_CATALOG_KIND
+    return id < METRIC_COUNT ? KINDS[id] : METRIC_COUNTER;
+}
+
+inline const char* metricName(uint8_t id) {
+#define METRIC_CATALOG_NAME(id, kind, name) name,
+    static const char* const NAMES[METRIC_COUNT] = { METRIC_CATALOG(METRIC_CATALOG_NAME) };
+#undef METRIC_CATALOG_NAME
+    return id < METRIC_COUNT ? NAMES[id] : "?";
+}
+
+#define METRIC_BUCKETS          24      // Last bucket: 2^22 and up (~4 s in us)
+#define METRIC_PAGE_HEADER      6
+
+inline uint8_t metricBucket(uint32_t value) {
+    if (value == 0) return 0;
+    uint8_t b = (uint8_t)(32 - __builtin_clz(value));
+    return b < METRIC_BUCKETS ? b : METRIC_BUCKETS - 1;
+}
+
+// Exclusive upper bound of bucket `b` (0 for the open-ended last bucket)
+inline uint32_t metricBucketLimit(uint8_t b) {
+    return b + 1 < METRIC_BUCKETS ? (uint32_t)1 << b : 0;
+}
+
+struct MetricValue {
+    uint32_t value;             // Counter, gauge's last value, histogram's count
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t buckets[METRIC_BUCKETS];
+
+    MetricValue() { clear(); }
+
+    void clear() {
+        value = 0;
+        min = UINT32_MAX;
+        max = 0;
+        sum = 0;
+        memset(buckets, 0, sizeof(buckets));
+    }
+
+    // Upper edge of the bucket holding the `p` quantile, capped at the max
+    uint32_t percentile(double p) const {
+        uint64_t need = (uint64_t)(p * value + 0.5), seen = 0;
+        if (need == 0) need = 1;
+        for (uint8_t b = 0; b < METRIC_BUCKETS; b++) {
+            seen += buckets[b];
+            if (seen < need) continue;
+            uint32_t limit = metricBucketLimit(b);
+            return limit && limit - 1 < max ? limit - 1 : max;
+        }
+        return max;
+    }
+};
+
+class MetricsRegistry {
+private:
+    MetricValue _m[METRIC_COUNT];
+    MetricValue _frozen[METRIC_COUNT];
+    uint32_t _frozenAtMs;
+
+    static void put32(uint8_t* p, uint32_t v) { memcpy(p, &v, 4); }
+
+public:
+    MetricsRegistry() : _frozenAtMs(0) {}
+
+    void add(MetricId id, uint32_t n = 1) { _m[id].value += n; }
+
+    void set(MetricId id, uint32_t v) {
+        MetricValue& m = _m[id];
+        m.value = v;
+        if (v < m.min) m.min = v;
+        if (v > m.max) m.max = v;
+    }
+
+    void observe(MetricId id, uint32_t v) {
+        MetricValue& m = _m[id];
+        m.buckets[metricBucket(v)]++;
+        m.value++;
+        m.sum += v;
+        if (v > m.max) m.max = v;
+    }
+
+    const MetricValue& get(MetricId id) const { return _m[id]; }
+    const MetricValue& frozen(MetricId id) const { return _frozen[id]; }
+
+    // One reply page starting at metric `first`; 0 if `first` is out of range
+    size_t encodePage(uint8_t first, uint32_t nowMs, uint8_t* out, size_t cap) {
+        if (first >= METRIC_COUNT || cap < METRIC_PAGE_HEADER) return 0;
+        if (first == 0) {
+            memcpy(_frozen, _m, sizeof(_m));
+            _frozenAtMs = nowMs;
+        }
+
+        size_t len = METRIC_PAGE_HEADER;
+        uint8_t id = first;
+        for (; id < METRIC_COUNT; id++) {
+            const MetricValue& m = _frozen[id];
+            uint8_t entry[1 + 20 + METRIC_BUCKETS * 4];
+            size_t n = 0;
+            entry[n++] = id;
+            switch (metricKindOf(id)) {
+                case METRIC_COUNTER:
+                    put32(entry + n, m.value);
+                    n += 4;
+                    break;
+                case METRIC_GAUGE:
+                    put32(entry + n, m.value);
+                    put32(entry + n + 4, m.min);
+                    put32(entry + n + 8, m.max);
+                    n += 12;
+                    break;
+                case METRIC_HISTOGRAM: {
+                    put32(entry + n, m.value);
+                    memcpy(entry + n + 4, &m.sum, 8);
+                    put32(entry + n + 12, m.max);
+                    uint32_t mask = 0;
+                    for (int b = 0; b < METRIC_BUCKETS; b++) {
+                        if (m.buckets[b]) mask |= (uint32_t)1 << b;
+                    }
+                    put32(entry + n + 16, mask);
+                    n += 20;
+                    for (int b = 0; b < METRIC_BUCKETS; b++) {
+                        if (!m.buckets[b]) continue;
+                        put32(entry + n, m.buckets[b]);
+                        n += 4;
+                    }
+                    break;
+                }
+            }
+            if (len + n > cap) break;
+            memcpy(out + len, entry, n);
+            len += n;
+        }
+
+        out[0] = METRIC_COUNT;
+        out[1] = id;
+        put32(out + 2, _frozenAtMs);
+        return len;
+    }
+};
+
+inline MetricsRegistry metrics;
+
+// Host side: merges one page into `out` (METRIC_COUNT values); false if it
+// is malformed or from a build with a different catalog
+inline bool decodeMetricsPage(const uint8_t* p, size_t len, MetricValue* out, uint8_t& next,
+                              uint32_t& uptimeMs) {
+    if (len < METRIC_PAGE_HEADER || p[0] != METRIC_COUNT) return false;
+    next = p[1];
+    memcpy(&uptimeMs, p + 2, 4);
+    size_t at = METRIC_PAGE_HEADER;
+    auto get32 = [&](size_t off) {
+        uint32_t v;
+        memcpy(&v, p + off, 4);
+        return v;
+    };
+    while (at < len) {
+        uint8_t id = p[at++];
+        if (id >= METRIC_COUNT) return false;
+        MetricValue& m = out[id];
+        m.clear();
+        switch (metricKindOf(id)) {
+            case METRIC_COUNTER:
+                if (at + 4 > len) return false;
+                m.value = get32(at);
+                at += 4;
+                break;
+            case METRIC_GAUGE:
+                if (at + 12 > len) return false;
+                m.value = get32(at);
+                m.min = get32(at + 4);
+                m.max = get32(at + 8);
+                at += 12;
+                break;
+            case METRIC_HISTOGRAM: {
+                if (at + 20 > len) return false;
+                m.value = get32(at);
+                memcpy(&m.sum, p + at + 4, 8);
+                m.max = get32(at + 12);
+                uint32_t mask = get32(at + 16);
+                at += 20;
+                for (int b = 0; b < METRIC_BUCKETS; b++) {
+                    if (!(mask & ((uint32_t)1 << b))) continue;
+                    if (at + 4 > len) return false;
+                    m.buckets[b] = get32(at);
+                    at += 4;
+                }
+                break;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,291 @@
+#pragma once
+
+// ==============================================================================
+// Trackpad Motion Coalescer
+// ==============================================================================
+// Turns touch samples on a profile's trackpad rows (Profile::trackpadRows)
+// into relative mouse reports. Samples arrive every loop() pass, far more
+// often than the link takes reports, so their motion is summed and handed
+// out as at most one report per interval: a BLE connection event, or a USB
+// frame. A busy link therefore gets fewer, larger reports rather than a
+// backlog, and no motion is lost.
+//
+//   pointer   finger motion, scaled by a gain that grows with speed: slow
+//             moves stay precise, a quick flick crosses the screen
+//   scroll    contacts starting in the right-hand TRACKPAD_SCROLL_WIDTH
+//             strip move the wheel, one detent per TRACKPAD_SCROLL_PX
+//   click     a tap is a left click; holding still for
+//             TRACKPAD_RIGHT_CLICK_MS, then lifting, a right click
+//
+// Positions are TouchFilter fixed point (TOUCH_FIXED_SHIFT), and motion is
+// summed at that precision: what does not add up to a whole count stays for
+// the next report, so slow drags move the pointer too. Motion beyond a
+// report's int8 range is carried over as well.
+//
+// The time from the sample that made a report worth sending to take()
+// handing it out is its input-to-report delay. Nothing here reads a clock
+// or touches the link, so host/trackpad_sim.cpp replays drag traces through
+// it.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "HidReportQueue.hpp"
+#include "TouchFilter.hpp"
+
+// Gain (x256) below TRACKPAD_ACCEL_LOW px/s and above TRACKPAD_ACCEL_HIGH,
+// linear in between
+#ifndef TRACKPAD_GAIN_MIN
+#define TRACKPAD_GAIN_MIN           256
+#endif
+#ifndef TRACKPAD_GAIN_MAX
+#define TRACKPAD_GAIN_MAX           1536
+#endif
+#ifndef TRACKPAD_ACCEL_LOW
+#define TRACKPAD_ACCEL_LOW          100
+#endif
+#ifndef TRACKPAD_ACCEL_HIGH
+#define TRACKPAD_ACCEL_HIGH         1000
+#endif
+
+// Scroll strip on the trackpad's right edge, and finger travel per detent
+#ifndef TRACKPAD_SCROLL_WIDTH
+#define TRACKPAD_SCROLL_WIDTH       48
+#endif
+#ifndef TRACKPAD_SCROLL_PX
+#define TRACKPAD_SCROLL_PX          24
+#endif
+
+// Contacts shorter than this that stay within TRACKPAD_TAP_SLOP px click
+#ifndef TRACKPAD_TAP_MS
+#define TRACKPAD_TAP_MS             200
+#endif
+#ifndef TRACKPAD_TAP_SLOP
+#define TRACKPAD_TAP_SLOP           8
+#endif
+#ifndef TRACKPAD_RIGHT_CLICK_MS
+#define TRACKPAD_RIGHT_CLICK_MS     600
+#endif
+
+// Report interval until setInterval() is called (one USB frame)
+#define TRACKPAD_DEFAULT_INTERVAL_US 1000
+
+struct MotionStats {
+    uint32_t contacts;
+    uint32_t samples;           // Touch samples on the trackpad
+    uint32_t reports;
+    uint32_t maxSamplesPerReport;
+    uint32_t clicks;
+    uint32_t rightClicks;
+    uint32_t carried;           // Reports whose motion did not fit and went on to the next
+    uint32_t dropped;           // Motion thrown away by cancel()
+    uint64_t touchingUs;        // Time with a finger down, for the report rate
+    uint32_t lastDelayUs;       // Sample -> take()
+    uint32_t maxDelayUs;
+    uint64_t totalDelayUs;
+
+    MotionStats() : contacts(0), samples(0), reports(0), maxSamplesPerReport(0), clicks(0),
+                    rightClicks(0), carried(0), dropped(0), touchingUs(0), lastDelayUs(0),
+                    maxDelayUs(0), totalDelayUs(0) {}
+};
+
+class MotionCoalescer {
+private:
+    uint32_t _intervalUs;
+    uint32_t _lastReportUs;
+    bool _reported;             // _lastReportUs is valid
+
+    // Current contact
+    bool _touching;
+    bool _scrolling;
+    bool _moved;                // Left the tap slop
+    int32_t _startX;            // TOUCH_FIXED_SHIFT fixed point
+    int32_t _startY;
+    int32_t _lastX;
+    int32_t _lastY;
+    uint32_t _downUs;
+    uint32_t _lastUs;
+
+    // Motion not reported yet: counts << TOUCH_FIXED_SHIFT
+    int32_t _accX;
+    int32_t _accY;
+    int32_t _accWheel;
+    bool _pending;              // Worth a report since _pendingSince
+    uint32_t _pendingSince;
+    uint32_t _pendingSamples;
+
+    // Button states still to send, one per report (press, release)
+    uint8_t _buttonQueue[4];
+    uint8_t _buttonCount;
+
+    MotionStats _stats;
+
+    static const int32_t ONE = 1 << TOUCH_FIXED_SHIFT;
+
+    // Gain (x256) for a move of `dist` (fixed point) over `dtUs`
+    static int32_t gainFor(int32_t dist, uint32_t dtUs) {
+        if (dtUs == 0) dtUs = 1;
+        int64_t pxPerSec = (int64_t)dist * 1000000 / ((int64_t)dtUs * ONE);
+        if (pxPerSec <= TRACKPAD_ACCEL_LOW) return TRACKPAD_GAIN_MIN;
+        if (pxPerSec >= TRACKPAD_ACCEL_HIGH) return TRACKPAD_GAIN_MAX;
+        return TRACKPAD_GAIN_MIN + (int32_t)((pxPerSec - TRACKPAD_ACCEL_LOW) *
+            (TRACKPAD_GAIN_MAX - TRACKPAD_GAIN_MIN) / (TRACKPAD_ACCEL_HIGH - TRACKPAD_ACCEL_LOW));
+    }
+
+    // Whole units in `acc` (of `unit`), at most one report's worth; the rest stays
+    int8_t drain(int32_t& acc, int32_t unit, bool& clamped) {
+        int32_t n = acc / unit;     // Towards zero: the remainder keeps its sign
+        if (n > 127) {
+            n = 127;
+            clamped = true;
+        } else if (n < -127) {
+            n = -127;
+            clamped = true;
+        }
+        acc -= n * unit;
+        return (int8_t)n;
+    }
+
+    bool hasWholeCounts() const {
+        return abs(_accX) >= ONE || abs(_accY) >= ONE ||
+               abs(_accWheel) >= TRACKPAD_SCROLL_PX * ONE || _buttonCount > 0;
+    }
+
+    void markPending(uint32_t nowUs) {
+        if (_pending || !hasWholeCounts()) return;
+        _pending = true;
+        _pendingSince = nowUs;
+    }
+
+    void queueClick(uint8_t button, uint32_t nowUs) {
+        if (_buttonCount + 2 > (int)sizeof(_buttonQueue)) return;
+        _buttonQueue[_buttonCount++] = button;
+        _buttonQueue[_buttonCount++] = 0;
+        markPending(nowUs);
+    }
+
+public:
+    MotionCoalescer()
+        : _intervalUs(TRACKPAD_DEFAULT_INTERVAL_US), _lastReportUs(0), _reported(false),
+          _touching(false), _scrolling(false), _moved(false), _startX(0), _startY(0),
+          _lastX(0), _lastY(0), _downUs(0), _lastUs(0), _accX(0), _accY(0), _accWheel(0),
+          _pending(false), _pendingSince(0), _pendingSamples(0), _buttonCount(0) {}
+
+    // Shortest time between two reports: the connection interval on BLE,
+    // a frame on USB
+    void setInterval(uint32_t us) { _intervalUs = us; }
+
+    // Finger down on the trackpad at (x, y), fixed point; `scroll` if it is
+    // in the scroll strip
+    void begin(int32_t x, int32_t y, uint32_t nowUs, bool scroll) {
+        _touching = true;
+        _scrolling = scroll;
+        _moved = false;
+        _startX = _lastX = x;
+        _startY = _lastY = y;
+        _downUs = _lastUs = nowUs;
+        _stats.contacts++;
+    }
+
+    // Next filtered sample of the contact
+    void move(int32_t x, int32_t y, uint32_t nowUs) {
+        if (!_touching) return;
+        _stats.samples++;
+        _pendingSamples++;
+        int32_t dx = x - _lastX;
+        int32_t dy = y - _lastY;
+        uint32_t dtUs = nowUs - _lastUs;
+        _lastX = x;
+        _lastY = y;
+        _lastUs = nowUs;
+        if (abs(x - _startX) > TRACKPAD_TAP_SLOP * ONE || abs(y - _startY) > TRACKPAD_TAP_SLOP * ONE) {
+            _moved = true;
+        }
+        if (dx == 0 && dy == 0) return;
+
+        if (_scrolling) {
+            _accWheel -= dy;        // Finger up scrolls up
+        } else {
+            // Distance as max + min / 2, close enough to the hypotenuse
+            int32_t ax = abs(dx), ay = abs(dy);
+            int32_t dist = ax > ay ? ax + ay / 2 : ay + ax / 2;
+            int32_t gain = gainFor(dist, dtUs);
+            _accX += (int32_t)((int64_t)dx * gain / 256);
+            _accY += (int32_t)((int64_t)dy * gain / 256);
+        }
+        markPending(nowUs);
+    }
+
+    // Finger lifted: a tap or a still hold becomes a click
+    void end(uint32_t nowUs) {
+        if (!_touching) return;
+        _touching = false;
+        uint32_t heldUs = nowUs - _downUs;
+        _stats.touchingUs += heldUs;
+        if (_moved || _scrolling) return;
+        if (heldUs < (uint32_t)TRACKPAD_TAP_MS * 1000) {
+            _stats.clicks++;
+            queueClick(MOUSE_BUTTON_LEFT, nowUs);
+        } else if (heldUs >= (uint32_t)TRACKPAD_RIGHT_CLICK_MS * 1000) {
+            _stats.rightClicks++;
+            queueClick(MOUSE_BUTTON_RIGHT, nowUs);
+        }
+    }
+
+    // Drops the contact and anything not reported (profile switch, output
+    // change). A click half sent is finished rather than left pressed.
+    void cancel() {
+        if (_touching) _stats.touchingUs += _lastUs - _downUs;
+        _touching = false;
+        if (_accX || _accY || _accWheel) _stats.dropped++;
+        _accX = _accY = _accWheel = 0;
+        _pendingSamples = 0;
+        if (_buttonCount > 0 && _buttonQueue[0] == 0) {
+            _buttonCount = 1;       // Only the release
+        } else {
+            _buttonCount = 0;
+        }
+        _pending = _buttonCount > 0;
+    }
+
+    // The next report, if one is due and the interval since the last has
+    // passed; the caller queues it
+    bool take(uint32_t nowUs, HidReport& out) {
+        if (!_pending) return false;
+        if (_reported && nowUs - _lastReportUs < _intervalUs) return false;
+
+        uint8_t buttons = 0;
+        if (_buttonCount > 0) {
+            buttons = _buttonQueue[0];
+            _buttonCount--;
+            for (int i = 0; i < _buttonCount; i++) _buttonQueue[i] = _buttonQueue[i + 1];
+        }
+        bool clamped = false;
+        int8_t dx = drain(_accX, ONE, clamped);
+        int8_t dy = drain(_accY, ONE, clamped);
+        int8_t wheel = drain(_accWheel, TRACKPAD_SCROLL_PX * ONE, clamped);
+        out = HidReport::mouse(buttons, dx, dy, wheel);
+
+        uint32_t delayUs = nowUs - _pendingSince;
+        _stats.reports++;
+        if (clamped) _stats.carried++;
+        _stats.lastDelayUs = delayUs;
+        if (delayUs > _stats.maxDelayUs) _stats.maxDelayUs = delayUs;
+        _stats.totalDelayUs += delayUs;
+        if (_pendingSamples > _stats.maxSamplesPerReport) {
+            _stats.maxSamplesPerReport = _pendingSamples;
+        }
+        _pendingSamples = 0;
+        _lastReportUs = nowUs;
+        _reported = true;
+
+        // Carried motion or the click's release: due again from now
+        _pending = false;
+        markPending(nowUs);
+        return true;
+    }
+
+    bool isTouching() const { return _touching; }
+    bool isPending() const { return _pending; }
+    uint32_t interval() const { return _intervalUs; }
+    const MotionStats& stats() const { return _stats; }
+};
@@ -0,0 +1,351 @@
+#pragma once
+
+// ==============================================================================
+// NimBLE HID Transport
+// ==============================================================================
+// BleKeyboard built with USE_NIMBLE, on NimBLE-Arduino ([env:esp32-s3-nimble]
+// in platformio.ini). Same glue as BluedroidTransport.hpp, against NimBLE's
+// host: one GAP event listener on the NimBLE host task carries connection,
+// encryption, subscription, parameter and notification events.
+//
+// Differences from Bluedroid worth knowing:
+//   - Starting advertising has no completion event. loop() posts
+//     ADV_STARTED itself, only while nothing is advertising (state OFF), so
+//     the host task cannot be posting at the same time.
+//   - There is no per-link buffer count; sendable() is unknown and the
+//     report credits alone pace the queue. Credits return on
+//     BLE_GAP_EVENT_NOTIFY_TX.
+//   - Bonds are stored by NimBLE under its own NVS keys, so hosts paired
+//     under one stack have to pair again under the other (loadHostSlots()
+//     drops slots whose bond is gone).
+// Included by BLEConfig.hpp.
+
+#include <NimBLEDevice.h>
+
+// Current link (BLE_HS_CONN_HANDLE_NONE when there is none)
+static std::atomic<uint16_t> bleConnHandle(BLE_HS_CONN_HANDLE_NONE);
+
+// ==============================================================================
+// Stack Event Handler (NimBLE host task)
+// ==============================================================================
+
+static void fillPeer(BleLinkEvent& ev, const ble_addr_t& addr) {
+    memcpy(ev.peer, addr.val, sizeof(ev.peer));
+    ev.addrType = addr.type;
+}
+
+static int ble_gap_event_handler(ble_gap_event* event, void* arg) {
+    (void)arg;
+    ble_gap_conn_desc desc;
+
+    switch (event->type) {
+        case BLE_GAP_EVENT_CONNECT: {
+            if (event->connect.status != 0) break;
+            if (ble_gap_conn_find(event->connect.conn_handle, &desc) != 0) break;
+            Serial.println("BLE GAP: Client connected");
+            Serial.printf("  Connection handle: %d\n", event->connect.conn_handle);
+
+            bleConnHandle.store(event->connect.conn_handle);
+            bleLink.post(BLE_INPUT_CONNECTED, clockMillis());
+
+            // Parameters are negotiated from loop() once the link settles
+            BleLinkEvent ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.type = BLE_LINK_CONNECTED;
+            ev.interval = desc.conn_itvl;
+            ev.latency = desc.conn_latency;
+            ev.timeout = desc.supervision_timeout;
+            fillPeer(ev, desc.peer_ota_addr);
+            postBLELinkEvent(ev);
+            break;
+        }
+
+        case BLE_GAP_EVENT_DISCONNECT: {
+            Serial.println("BLE GAP: Client disconnected");
+            Serial.printf("  Reason: 0x%04x\n", event->disconnect.reason);
+            Serial.printf("  Connection duration: %lu ms\n",
+                clockMillis() - bleLink.enteredAt(BLE_LINK_CONNECTING));
+            bleConnHandle.store(BLE_HS_CONN_HANDLE_NONE);
+            bleLink.post(BLE_INPUT_DISCONNECTED, clockMillis());
+
+            BleLinkEvent ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.type = BLE_LINK_DISCONNECTED;
+            fillPeer(ev, event->disconnect.conn.peer_ota_addr);
+            postBLELinkEvent(ev);
+            break;
+        }
+
+        case BLE_GAP_EVENT_ENC_CHANGE: {
+            bool ok = event->enc_change.status == 0 &&
+                      ble_gap_conn_find(event->enc_change.conn_handle, &desc) == 0;
+            if (ok) {
+                // Identity address: NimBLE resolves private addresses itself
+                BleLinkEvent ev;
+                memset(&ev, 0, sizeof(ev));
+                ev.type = BLE_LINK_BONDED;
+                fillPeer(ev, desc.peer_id_addr);
+                postBLELinkEvent(ev);
+            }
+            bleLink.post(ok ? BLE_INPUT_AUTH_OK : BLE_INPUT_AUTH_FAILED, clockMillis());
+            Serial.printf("BLE: Encryption %s (status %d)\n", ok ? "enabled" : "failed",
+                event->enc_change.status);
+            break;
+        }
+
+        case BLE_GAP_EVENT_SUBSCRIBE:
+            if (event->subscribe.cur_notify && !event->subscribe.prev_notify) {
+                bleLink.post(BLE_INPUT_SUBSCRIBED, clockMillis());
+            }
+            break;
+
+        case BLE_GAP_EVENT_CONN_UPDATE: {
+            // Runs on the host task: hand the outcome to loop()
+            BleLinkEvent ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.type = BLE_LINK_PARAMS_UPDATED;
+            ev.status = event->conn_update.status == 0 ? 0 : 1;
+            if (ble_gap_conn_find(event->conn_update.conn_handle, &desc) == 0) {
+                ev.interval = desc.conn_itvl;
+                ev.latency = desc.conn_latency;
+                ev.timeout = desc.supervision_timeout;
+                fillPeer(ev, desc.peer_ota_addr);
+            }
+            postBLELinkEvent(ev);
+            break;
+        }
+
+        case BLE_GAP_EVENT_NOTIFY_TX:
+            // One per notification handed to the link layer
+            if (!event->notify_tx.indication) onHidReportSent(event->notify_tx.status == 0);
+            break;
+
+        case BLE_GAP_EVENT_ADV_COMPLETE:
+            // Duration ran out (directed advertising ends this way)
+            if (event->adv_complete.reason == BLE_HS_ETIMEOUT) {
+                bleLink.post(BLE_INPUT_ADV_STOPPED, clockMillis());
+            }
+            break;
+
+        default:
+            break;
+    }
+    return 0;
+}
+
+// ==============================================================================
+// Connection Parameters Update
+// ==============================================================================
+
+// NimBLE addresses links by handle; `peer` is the current link's
+bool updateConnectionParams(const uint8_t peer[6], const ConnParams& params) {
+    (void)peer;
+    uint16_t handle = bleConnHandle.load();
+    if (handle == BLE_HS_CONN_HANDLE_NONE) return false;
+
+    ble_gap_upd_params update;
+    memset(&update, 0, sizeof(update));
+    update.itvl_min = params.minInterval;
+    update.itvl_max = params.maxInterval;
+    update.latency = params.latency;
+    update.supervision_timeout = params.timeout;
+
+    int rc = ble_gap_update_params(handle, &update);
+    if (rc != 0) {
+        Serial.printf("BLE: Connection param request failed: %d\n", rc);
+        return false;
+    }
+    Serial.printf("BLE: Requested interval %.2f-%.2f ms, latency %d, timeout %d ms\n",
+        params.minInterval * 1.25, params.maxInterval * 1.25, params.latency,
+        params.timeout * 10);
+    return true;
+}
+
+// ConnParamPolicy's view of the stack: the peer of the current link
+class EspConnParamGap : public ConnParamGap {
+private:
+    uint8_t _peer[6];
+
+public:
+    EspConnParamGap() { memset(_peer, 0, sizeof(_peer)); }
+
+    void setPeer(const uint8_t peer[6]) { memcpy(_peer, peer, sizeof(_peer)); }
+
+    bool requestConnParams(const ConnParams& params) override {
+        return updateConnectionParams(_peer, params);
+    }
+};
+
+// ==============================================================================
+// Reconnect Advertising
+// ==============================================================================
+
+static NimBLEAddress toNimBLEAddress(const BlePeer& peer) {
+    ble_addr_t addr;
+    addr.type = peer.addrType;
+    memcpy(addr.val, peer.addr, sizeof(addr.val));
+    return NimBLEAddress(addr);
+}
+
+// ReconnectEngine's view of the stack, through the advertising object
+// BleKeyboard configured. NimBLE-Arduino's directed advertising is the low
+// duty cycle kind, at the fast interval.
+class EspAdvertisingGap : public AdvertisingGap {
+public:
+    bool startAdvertising(AdvPhase phase, const BlePeer* peer) override {
+        NimBLEAdvertising* adv = NimBLEDevice::getAdvertising();
+        if (adv->isAdvertising()) adv->stop();
+
+        while (NimBLEDevice::getWhiteListCount() > 0) {
+            NimBLEDevice::whiteListRemove(NimBLEDevice::getWhiteListAddress(0));
+        }
+
+        bool havePeer = peer != nullptr && peer->valid;
+        NimBLEAddress target;
+        if (havePeer) target = toNimBLEAddress(*peer);
+
+        bool directed = phase == ADV_PHASE_DIRECTED && havePeer;
+        adv->setAdvertisementType(directed ? BLE_GAP_CONN_MODE_DIR : BLE_GAP_CONN_MODE_UND);
+        if (phase == ADV_PHASE_SLOW) {
+            adv->setMinInterval(RECONNECT_SLOW_ADV_MIN);
+            adv->setMaxInterval(RECONNECT_SLOW_ADV_MAX);
+        } else {
+            adv->setMinInterval(RECONNECT_FAST_ADV_MIN);
+            adv->setMaxInterval(RECONNECT_FAST_ADV_MAX);
+        }
+
+        // Exclusive undirected phase: only the white-listed host may connect
+        // (anyone may still scan, so the device stays visible)
+        bool exclusive = !directed && havePeer;
+        if (exclusive) NimBLEDevice::whiteListAdd(target);
+        adv->setScanFilter(false, exclusive);
+
+        // Nothing is advertising, so the host task is not posting either
+        if (bleLink.state() == BLE_LINK_OFF) bleLink.post(BLE_INPUT_ADV_STARTED, clockMillis());
+        if (!adv->start(0, nullptr, directed ? &target : nullptr)) {
+            Serial.printf("BLE: %s advertising failed\n", advPhaseName(phase));
+            return false;
+        }
+        Serial.printf("BLE: %s advertising\n", advPhaseName(phase));
+        return true;
+    }
+};
+
+// NimBLE keeps bonds by identity address and resolves private addresses
+// itself; `addr` may be either form.
+bool resolveBondedPeer(const uint8_t addr[6], uint8_t addrType, BlePeer& out) {
+    out = BlePeer();
+    int count = NimBLEDevice::getNumBonds();
+    for (int i = 0; i < count && !out.valid; i++) {
+        NimBLEAddress bonded = NimBLEDevice::getBondedAddress(i);
+        if (memcmp(bonded.getNative(), addr, 6) != 0) continue;
+        memcpy(out.addr, bonded.getNative(), sizeof(out.addr));
+        out.addrType = bonded.getType();
+        out.valid = true;
+    }
+    (void)addrType;
+    return out.valid;
+}
+
+// Removes the stack's bond for a host given by identity address
+void removeBondedPeer(const BlePeer& peer) {
+    if (!peer.valid) return;
+    NimBLEAddress addr = toNimBLEAddress(peer);
+    if (NimBLEDevice::isBonded(addr)) NimBLEDevice::deleteBond(addr);
+}
+
+// HostSwitcher's view of the stack: the current link
+class EspHostLinkControl : public HostLinkControl {
+private:
+    uint8_t _peer[6];
+
+public:
+    EspHostLinkControl() { memset(_peer, 0, sizeof(_peer)); }
+
+    void setPeer(const uint8_t peer[6]) { memcpy(_peer, peer, sizeof(_peer)); }
+
+    bool disconnect() override {
+        uint16_t handle = bleConnHandle.load();
+        if (handle == BLE_HS_CONN_HANDLE_NONE) return false;
+        int rc = ble_gap_terminate(handle, BLE_ERR_REM_USER_CONN_TERM);
+        if (rc != 0) {
+            Serial.printf("BLE: Disconnect failed: %d\n", rc);
+            return false;
+        }
+        return true;
+    }
+};
+
+// ==============================================================================
+// HID Transport
+// ==============================================================================
+// BleKeyboard's input report characteristics over NimBLE. The library waits
+// _delay_ms after every notify in this build; the queue's credits pace the
+// reports instead, so the delay is turned off.
+class NimBLEHidTransport : public HidTransport {
+private:
+    BleKeyboard* _keyboard;
+
+protected:
+    bool sendKeyboardReport(uint8_t modifiers, const uint8_t keys[6]) override {
+        if (!_keyboard->isConnected()) return false;
+        KeyReport report;
+        report.modifiers = modifiers;
+        report.reserved = 0;
+        memcpy(report.keys, keys, sizeof(report.keys));
+        _keyboard->sendReport(&report);
+        return true;
+    }
+
+    bool sendConsumerReport(uint8_t low, uint8_t high) override {
+        if (!_keyboard->isConnected()) return false;
+        MediaKeyReport report = {low, high};
+        _keyboard->sendReport(&report);
+        return true;
+    }
+
+    uint32_t clockUs() override { return clockMicros(); }
+
+public:
+    explicit NimBLEHidTransport(BleKeyboard* keyboard) : _keyboard(keyboard) {}
+
+    const char* name() const override { return "nimble"; }
+
+    // The listener can only be registered once NimBLE is up, after
+    // BleKeyboard::begin() has started advertising
+    bool begin() override {
+        initBLELinkEvents();
+        _keyboard->setDelay(0);
+        _keyboard->begin();
+        NimBLEDevice::setCustomGapHandler(ble_gap_event_handler);
+        if (bleLink.state() == BLE_LINK_OFF) bleLink.post(BLE_INPUT_ADV_STARTED, clockMillis());
+        return true;
+    }
+
+    int sendable() override { return -1; }
+};
+
+typedef NimBLEHidTransport PlatformHidTransport;
+
+// ==============================================================================
+// Bonding Management
+// ==============================================================================
+
+void clearBLEBondingData() {
+    Serial.println("BLE: Clearing all bonding data...");
+    Serial.printf("BLE: Found %d bonded devices\n", NimBLEDevice::getNumBonds());
+    NimBLEDevice::deleteAllBonds();
+
+    // Also clear NVS
+    esp_err_t ret = nvs_flash_erase();
+    if (ret == ESP_OK) {
+        Serial.println("BLE: NVS erased");
+    }
+
+    ret = nvs_flash_init();
+    if (ret == ESP_OK) {
+        Serial.println("BLE: NVS reinitialized");
+    }
+
+    Serial.println("BLE: Bonding data cleared - please re-pair your device");
+}
@@ -0,0 +1,450 @@
+#pragma once
+
+// ==============================================================================
+// Pad Controller
+// ==============================================================================
+// The loop-level glue between the UI, the HID path and the BLE link: which
+// transport reports go to, starting, holding and replaying macros, trackpad
+// reports, link events, host switches, header gestures and live profile
+// edits. main.cpp runs it on the device; host/device_sim.cpp runs the same
+// code on a virtual clock against models of the stack and the central.
+//
+// The parts are owned by the caller and wired in by pointer. What only the
+// device has - the stack's event queue, its bond store, LittleFS - is
+// reached through PadPlatform, whose observer hooks also let the simulation
+// follow macros to the central without copying any of this.
+
+#include <stdint.h>
+#include "Macros.hpp"
+#include "MacroPadUI.hpp"
+#include "ProfileStore.hpp"
+#include "ProfileLog.hpp"
+#include "BleLinkState.hpp"
+#include "ConnParamPolicy.hpp"
+#include "ReconnectEngine.hpp"
+#include "HostSlots.hpp"
+#include "HidReportQueue.hpp"
+#include "HidTransport.hpp"
+#include "UsbTransport.hpp"
+#include "MacroExecutor.hpp"
+#include "MotionCoalescer.hpp"
+#include "BinaryLog.hpp"
+#include "Metrics.hpp"
+#include "Clock.hpp"
+
+// Touch sample read -> first HID report of the macro queued
+struct TouchToReportStats {
+    uint32_t lastUs;
+    uint32_t maxUs;
+    uint64_t totalUs;
+    uint32_t count;
+
+    TouchToReportStats() : lastUs(0), maxUs(0), totalUs(0), count(0) {}
+};
+
+class PadPlatform {
+public:
+    virtual ~PadPlatform() {}
+
+    // Next link event posted by the stack's task, if any
+    virtual bool pollLinkEvent(BleLinkEvent& ev) = 0;
+
+    // A link came up: stack requests that need the peer's address
+    virtual void onLinkConnected(const BleLinkEvent& ev) { (void)ev; }
+
+    // Bond store: identity address of a BONDED event's peer, and removal
+    virtual bool resolveBondedPeer(const BleLinkEvent& ev, BlePeer& peer) = 0;
+    virtual void removeBondedPeer(const BlePeer& peer) = 0;
+    virtual void saveHostSlots(const HostSlotTable& table) = 0;
+
+    // Double-tap on the header
+    virtual void startProfileExport() {}
+
+    // Observers. A macro was accepted; its reports follow the `queuedBefore`
+    // already queued. `pressedAtMs` is when a replayed key was pressed.
+    virtual void onMacroStarted(const Macro& macro, bool fromTouch, uint32_t pressedAtMs,
+                                uint32_t queuedBefore) {
+        (void)macro;
+        (void)fromTouch;
+        (void)pressedAtMs;
+        (void)queuedBefore;
+    }
+
+    // A hold's press or release was queued after `queuedBefore` reports,
+    // ahead of the rest of any macro still expanding
+    virtual void onHoldQueued(uint32_t queuedBefore) { (void)queuedBefore; }
+
+    // A touch's first report was queued
+    virtual void onTouchReportQueued(uint32_t latencyUs) { (void)latencyUs; }
+
+    // The executor and queue ran, or the output changed: reports may have
+    // gone out, been flushed or cancelled
+    virtual void onQueuesChanged() {}
+};
+
+class PadController {
+private:
+    PadPlatform* _platform;
+    BleLinkState* _link;
+    HidTransport* _ble;
+    UsbHidTransport* _usb;
+    HidReportQueue* _reports;
+    MacroExecutor* _executor;
+    MotionCoalescer* _trackpad;
+    ConnParamPolicy* _connParams;
+    ReconnectEngine* _reconnect;
+    PendingKeystrokes* _pendingKeys;
+    HostSlotTable* _hostSlots;
+    HostSwitcher* _hostSwitcher;
+    ProfileStore* _profiles;
+    MacroPadUI* _ui;
+    ProfileLog* _profileLog;
+
+    HidTransport* _output;      // Transport the queue is open on
+    uint32_t _linkSeen;         // Last link transition shown
+    uint32_t _profileLogChanges;
+    uint32_t _hostSwitchesDone;
+    uint32_t _hostSwitchesFailed;
+    TouchToReportStats _touchToReport;
+
+    void recordReportQueued() {
+        uint32_t latency = clockMicros() - _ui->touchSampleMicros();
+        _touchToReport.lastUs = latency;
+        _touchToReport.totalUs += latency;
+        _touchToReport.count++;
+        if (latency > _touchToReport.maxUs) _touchToReport.maxUs = latency;
+        metrics.observe(METRIC_TOUCH_TO_REPORT_US, latency);
+        _platform->onTouchReportQueued(latency);
+    }
+
+public:
+    PadController(PadPlatform* platform, BleLinkState* link, HidTransport* ble,
+                  UsbHidTransport* usb, HidReportQueue* reports, MacroExecutor* executor,
+                  MotionCoalescer* trackpad, ConnParamPolicy* connParams,
+                  ReconnectEngine* reconnect, PendingKeystrokes* pendingKeys,
+                  HostSlotTable* hostSlots, HostSwitcher* hostSwitcher, ProfileStore* profiles)
+        : _platform(platform), _link(link), _ble(ble), _usb(usb), _reports(reports),
+          _executor(executor), _trackpad(trackpad), _connParams(connParams),
+          _reconnect(reconnect), _pendingKeys(pendingKeys), _hostSlots(hostSlots),
+          _hostSwitcher(hostSwitcher), _profiles(profiles), _ui(nullptr), _profileLog(nullptr),
+          _output(nullptr), _linkSeen(0), _profileLogChanges(0), _hostSwitchesDone(0),
+          _hostSwitchesFailed(0) {}
+
+    // Set once the UI exists, before the first service call
+    void setUI(MacroPadUI* ui) { _ui = ui; }
+
+    // Edit log layered over the profiles (after each mount)
+    void setProfileLog(ProfileLog* log) {
+        _profileLog = log;
+        _profileLogChanges = log ? log->changes() : 0;
+    }
+
+    HidTransport* output() const { return _output; }
+    const TouchToReportStats& touchToReport() const { return _touchToReport; }
+
+    // ==== HID output ====
+
+    // A macro can go out now: over USB, or over a ready BLE link not mid-switch
+    bool outputReady() const {
+        return (_usb && _usb->isReady()) || (_link->isReady() && !_hostSwitcher->isSwitching());
+    }
+
+    // Reports go to USB while the host has it configured and awake, else to a
+    // ready BLE link. What is left when the output changes - queued reports and
+    // running macros - was meant for the old one and is dropped. If the old link
+    // is still up (USB plugged in over BLE), keys held there are released first.
+    void serviceHidOutput(BleLinkStateId bleState, uint32_t now) {
+        HidTransport* output = nullptr;
+        if (_usb && _usb->isReady()) {
+            output = _usb;
+        } else if (bleState == BLE_LINK_READY) {
+            output = _ble;
+        }
+        if (output == _output) return;
+
+        if (_output != nullptr) {
+            bool oldStillUp = _output == _usb ? _usb->isReady() : bleState == BLE_LINK_READY;
+            if (oldStillUp && (_executor->isBusy() || _executor->isHolding())) {
+                _output->sendReport(HidReport::release());
+                _output->sendReport(HidReport::mediaState(0, 0));
+            }
+            _executor->cancel(false);
+            _trackpad->cancel();
+            _reports->close(now);
+            _output->onLinkLost();
+            _platform->onQueuesChanged();
+        }
+        _output = output;
+        if (output != nullptr) {
+            _reports->setSink(output);
+            _reports->open();
+        }
+        if (_ui != nullptr) _ui->setPointerAvailable(output != nullptr && output->hasPointer());
+        LOG(LOG_HID_OUTPUT, output ? output->name() : "none");
+    }
+
+    // ==== Macros ====
+
+    // Runs the executor and sends what it queued; called from loop() and
+    // whenever a macro is started
+    void serviceMacros(uint32_t now) {
+        _executor->service(now);
+        _reports->service(now);
+        while (_executor->takeTouchReport()) recordReportQueued();
+        MacroJobTiming timing;
+        while (_executor->takeFinished(timing)) {
+            metrics.observe(METRIC_MACRO_WAIT_MS, timing.waitMs);
+            metrics.observe(METRIC_MACRO_RUN_MS, timing.runMs);
+        }
+        _platform->onQueuesChanged();
+    }
+
+    // Hands a macro to the executor and starts it straight away. The executor
+    // expands it into reports as the queue takes them (combo holds and sequence
+    // gaps included), so loop() keeps running while a long text macro types.
+    // `fromTouch` is false for macros replayed after a reconnect: they don't
+    // count towards touch-to-report latency. Text is typed for the showing
+    // profile's keyboard layout.
+    void sendMacro(const Macro& macro, bool fromTouch, uint32_t pressedAtMs) {
+        LOG(LOG_MACRO_EXEC, macro.label, macro.type);
+        // Output first: switching cancels what was started on the old one
+        serviceHidOutput(_link->state(), clockMillis());
+        const Profile& profile = _ui->getCurrentProfile();
+        uint32_t queued = _reports->stats().queued;
+        if (!_executor->enqueue(macro, fromTouch,
+                                TextInput(profile.keyboardLayout, profile.unicodeInput))) {
+            LOG(LOG_MACRO_DROPPED, macro.label, _executor->queued());
+            return;
+        }
+        _platform->onMacroStarted(macro, fromTouch, pressedAtMs, queued);
+        serviceMacros(clockMillis());
+    }
+
+    // UI: a button fired
+    void executeMacro(const Macro& macro, int buttonIndex) {
+        if (macro.type == MACRO_TYPE_HOST) {
+            // Local action: works with or without a link
+            switchHost(macro.keys[0]);
+            return;
+        }
+
+        _connParams->onActivity(clockMillis());
+        if (!outputReady()) {
+            // Held until the (new) host is ready, if that happens soon enough
+            _pendingKeys->push((uint16_t)_ui->getCurrentProfileIndex(), (uint8_t)buttonIndex,
+                               clockMillis());
+            LOG(LOG_MACRO_HELD, bleLinkStateName(_link->state()), macro.label);
+            return;
+        }
+        sendMacro(macro, true, clockMillis());
+    }
+
+    // FIRE_HOLD buttons: pressed on touch-down, released when the touch ends.
+    // A press that cannot go out now is dropped rather than kept for a
+    // reconnect: its release would come long before the replay.
+    void holdMacro(const Macro& macro, int buttonIndex, bool down) {
+        if (!down) {
+            uint32_t queued = _reports->stats().queued;
+            _executor->release(buttonIndex);
+            _platform->onHoldQueued(queued);
+            serviceMacros(clockMillis());
+            return;
+        }
+
+        _connParams->onActivity(clockMillis());
+        if (!outputReady()) {
+            LOG(LOG_MACRO_HOLD_DROPPED, macro.label, bleLinkStateName(_link->state()));
+            return;
+        }
+        serviceHidOutput(_link->state(), clockMillis());
+        uint32_t queued = _reports->stats().queued;
+        if (!_executor->hold(buttonIndex, macro)) {
+            LOG(LOG_MACRO_HOLD_DROPPED, macro.label, "too many keys held");
+            return;
+        }
+        _platform->onHoldQueued(queued);
+        LOG(LOG_MACRO_HOLD, macro.label, _executor->held());
+        serviceMacros(clockMillis());
+    }
+
+    // Sends macros held across a reconnect. Only presses on the profile still
+    // showing are replayed: looking up another one could evict the UI's
+    // cached profile, and the press was meant for that screen anyway.
+    void replayPendingKeys() {
+        PendingKeystroke k;
+        while (_pendingKeys->count() > 0 && outputReady()) {
+            if (!_pendingKeys->pop(clockMillis(), k)) break;
+            if (k.profile != _ui->getCurrentProfileIndex()) continue;
+            const Profile& profile = _profiles->get(k.profile);
+            if (k.button >= profile.gridRows * profile.gridCols) continue;
+            sendMacro(profile.buttons[k.button], false, k.pressedAt);
+        }
+    }
+
+    // ==== Trackpad ====
+
+    // Hands the trackpad's next mouse report to the queue. One report at most
+    // per connection event (or USB frame), and only once the queue has sent
+    // what it holds: while the link is busy, motion piles up in the coalescer
+    // instead of in the queue. Outputs without a mouse (BLE) get nothing.
+    void serviceTrackpad(uint32_t now) {
+        if (_output == nullptr || !_output->hasPointer()) {
+            if (_trackpad->isPending()) _trackpad->cancel();
+            return;
+        }
+        uint16_t interval = _connParams->interval() ? _connParams->interval() : BLE_ACTIVE_INTERVAL;
+        _trackpad->setInterval(_output == _usb ? USB_HID_POLL_US : interval * 1250u);
+        if (!_reports->isEmpty()) return;
+
+        HidReport report;
+        if (!_trackpad->take(clockMicros(), report)) return;
+        _reports->push(report);
+        _reports->service(now);
+        metrics.observe(METRIC_TRACKPAD_DELAY_US, _trackpad->stats().lastDelayUs);
+        _connParams->onActivity(now);
+    }
+
+    // ==== BLE link ====
+
+    // Feeds link events from the stack's task into the connection parameter
+    // policy, the reconnect engine and the host switcher, lets them send or
+    // retry their requests, and services the HID path for the link's state
+    void serviceBLELink() {
+        uint32_t now = clockMillis();
+        BleLinkEvent ev;
+        while (_platform->pollLinkEvent(ev)) {
+            switch (ev.type) {
+                case BLE_LINK_CONNECTED:
+                    _platform->onLinkConnected(ev);
+                    _connParams->onConnected(now, ev.interval, ev.latency, ev.timeout);
+                    break;
+                case BLE_LINK_DISCONNECTED:
+                    _connParams->onDisconnected(now);
+                    metrics.add(METRIC_BLE_DISCONNECTS);
+                    break;
+                case BLE_LINK_PARAMS_UPDATED:
+                    _connParams->onParamsUpdated(ev.status, ev.interval, ev.latency, ev.timeout, now);
+                    LOG(LOG_BLE_PARAMS, ev.status == 0 ? "updated" : "rejected",
+                        ev.interval * 1.25f, ev.latency, ev.timeout * 10);
+                    break;
+                case BLE_LINK_BONDED: {
+                    BlePeer peer, replaced;
+                    if (!_platform->resolveBondedPeer(ev, peer)) break;
+                    HostBondAction action = _hostSwitcher->onBonded(peer, replaced);
+                    if (action == HOST_BOND_REFUSED) {
+                        LOG(LOG_HOST_REFUSED, _hostSlots->find(peer) + 1);
+                    } else if (action == HOST_BOND_STORED) {
+                        _platform->saveHostSlots(*_hostSlots);
+                        if (replaced.valid) _platform->removeBondedPeer(replaced);
+                        _ui->setHostSlot(_hostSlots->active());
+                        LOG(LOG_HOST_BONDED, _hostSlots->active() + 1, peer.addr[0], peer.addr[1],
+                            peer.addr[2], peer.addr[3], peer.addr[4], peer.addr[5]);
+                    }
+                    break;
+                }
+            }
+        }
+        _connParams->service(now);
+        BleLinkStateId state = _link->state();
+
+        serviceHidOutput(state, now);
+        serviceMacros(now);
+        serviceTrackpad(now);
+
+        _reconnect->service(state, now);
+        _hostSwitcher->service(state, now);
+        replayPendingKeys();
+
+        const HostSwitchStats& hs = _hostSwitcher->stats();
+        if (hs.completed != _hostSwitchesDone) {
+            _hostSwitchesDone = hs.completed;
+            LOG(LOG_HOST_SWITCHED, _hostSlots->active() + 1, hs.lastMs);
+        }
+        if (hs.timedOut != _hostSwitchesFailed) {
+            _hostSwitchesFailed = hs.timedOut;
+            LOG(LOG_HOST_SWITCH_TIMEOUT, _hostSlots->active() + 1);
+        }
+    }
+
+    // Follows the link state machine; transitions are published by the
+    // stack's task
+    void followLinkState() {
+        uint32_t generation = _link->generation();
+        if (generation == _linkSeen) return;
+        _linkSeen = generation;
+        BleLinkSnapshot link = _link->snapshot();
+        _ui->setBluetoothConnected(link.state == BLE_LINK_READY);
+        LOG(LOG_BLE_STATE, bleLinkStateName(link.state), clockMillis() - link.enteredAt);
+        if (link.state == BLE_LINK_READY || link.state == BLE_LINK_ADVERTISING) {
+            LOG(LOG_BLE_CONNECTS, _link->connects(), _link->readies(), _link->lastReadyLatency(),
+                _link->maxReadyLatency());
+        }
+    }
+
+    // UI, a host macro or a profile button: make `slot` the active host
+    void switchHost(int slot) {
+        if (!_hostSwitcher->switchTo(slot, clockMillis())) return;
+        _pendingKeys->clear();      // Meant for the host being left
+        _platform->saveHostSlots(*_hostSlots);
+        _ui->setHostSlot(_hostSlots->active());
+        LOG(LOG_HOST_SWITCHING, slot + 1, _hostSlots->isEmpty(slot) ? "empty, pairing" : "bonded");
+    }
+
+    // ==== UI events ====
+
+    void onProfileChanged(int newProfileIndex) {
+        (void)newProfileIndex;
+        // Stuck-key guard: nothing stays held from the profile that was left
+        _executor->releaseHolds();
+        serviceMacros(clockMillis());
+        LOG(LOG_PROFILE_SWITCHED, _ui->getCurrentProfileName());
+    }
+
+    void onGesture(const GestureEvent& event) {
+        switch (event.type) {
+            case GESTURE_DOWN:
+                // Get the fast interval negotiated before the macro fires
+                _connParams->onActivity(clockMillis());
+                break;
+            case GESTURE_LONG_PRESS:
+                LOG(LOG_GESTURE_LONG, event.x, event.y);
+                // Long press on the header: stop a long text or sequence and let
+                // go of every key (jobs queued behind it still run)
+                if (event.y < HEADER_HEIGHT && !MacroPadUI::isBluetoothStatusHit(event.x, event.y) &&
+                    (_executor->isBusy() || _executor->isHolding())) {
+                    LOG(LOG_MACRO_CANCELLED, _executor->cancelRunning());
+                    serviceMacros(clockMillis());
+                }
+                break;
+            case GESTURE_TAP:
+                if (MacroPadUI::isBluetoothStatusHit(event.x, event.y)) {
+                    switchHost((_hostSlots->active() + 1) % HOST_SLOT_COUNT);
+                }
+                break;
+            case GESTURE_DOUBLE_TAP:
+                LOG(LOG_GESTURE_DOUBLE, event.x, event.y);
+                if (event.y < HEADER_HEIGHT && !MacroPadUI::isBluetoothStatusHit(event.x, event.y)) {
+                    _platform->startProfileExport();
+                }
+                break;
+            case GESTURE_SWIPE:
+                LOG(LOG_GESTURE_SWIPE, event.direction, event.velocity, event.latency);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // ==== Profile edits ====
+
+    // Advances log compaction; reloads the profiles when edits changed them
+    void serviceProfileLog() {
+        if (_profileLog == nullptr) return;
+        _profileLog->service();
+        if (_profileLog->changes() != _profileLogChanges) {
+            _profileLogChanges = _profileLog->changes();
+            _profiles->invalidate();
+            _ui->reloadProfiles();
+        }
+    }
+};
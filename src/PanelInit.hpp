@@ -0,0 +1,98 @@
+#pragma once
+
+// ==============================================================================
+// ST7701S Panel Initialization (3-Wire SPI)
+// ==============================================================================
+// The RGB panel only takes pixels; its controller is configured once at
+// boot over a 3-wire, 9-bit serial link: each word is a D/C bit (0 =
+// command, 1 = parameter) followed by 8 bits, MSB first, clocked on the
+// rising edge with SCK idling high (SPI mode 3).
+//
+// The words for one command and its parameters are packed into a bit
+// stream and sent as a single SPI master transaction, with CS held low
+// throughout, so the clocking is done by the SPI peripheral rather than
+// GPIO writes. The bus is released again afterwards.
+//
+// What remains is the panel's own timing: 120 ms after reset, 120 ms after
+// sleep out (0x11), 50 ms after display on (0x29). Those are delay()s, so
+// other tasks (BLE start-up) run meanwhile.
+
+#include <Arduino.h>
+#include <driver/spi_master.h>
+#include "DisplayConfig.hpp"
+
+// Serial clock for the init link (ST7701S write cycle >= 66 ns)
+#ifndef ST7701_SPI_HZ
+#define ST7701_SPI_HZ           4000000
+#endif
+
+#define ST7701_SPI_HOST         SPI2_HOST
+#define ST7701_MAX_PARAMS       16
+
+// 9-bit words for `cmd` and its parameters, MSB first; returns the bit count
+inline size_t st7701Pack(uint8_t cmd, const uint8_t* params, uint8_t len, uint8_t* out) {
+    size_t bits = 0;
+    memset(out, 0, ((ST7701_MAX_PARAMS + 1) * 9 + 7) / 8);
+    for (int w = 0; w <= len; w++) {
+        uint16_t word = w == 0 ? cmd : (0x100 | params[w - 1]);
+        for (int b = 8; b >= 0; b--) {
+            if (word & (1 << b)) out[bits / 8] |= 0x80 >> (bits % 8);
+            bits++;
+        }
+    }
+    return bits;
+}
+
+// Runs ST7701_INIT_SEQUENCE; false if the SPI peripheral could not be set up
+inline bool st7701Init() {
+    spi_bus_config_t bus;
+    memset(&bus, 0, sizeof(bus));
+    bus.mosi_io_num = PIN_SPI_SDA;
+    bus.miso_io_num = -1;
+    bus.sclk_io_num = PIN_SPI_SCK;
+    bus.quadwp_io_num = -1;
+    bus.quadhd_io_num = -1;
+    bus.max_transfer_sz = 32;
+    if (spi_bus_initialize(ST7701_SPI_HOST, &bus, SPI_DMA_DISABLED) != ESP_OK) return false;
+
+    spi_device_interface_config_t dev;
+    memset(&dev, 0, sizeof(dev));
+    dev.mode = 3;
+    dev.clock_speed_hz = ST7701_SPI_HZ;
+    dev.spics_io_num = PIN_SPI_CS;
+    dev.queue_size = 1;
+    dev.flags = SPI_DEVICE_HALFDUPLEX;
+    spi_device_handle_t panel;
+    if (spi_bus_add_device(ST7701_SPI_HOST, &dev, &panel) != ESP_OK) {
+        spi_bus_free(ST7701_SPI_HOST);
+        return false;
+    }
+
+    delay(120);
+
+    const uint8_t* seq = ST7701_INIT_SEQUENCE;
+    const size_t n = sizeof(ST7701_INIT_SEQUENCE);
+    size_t i = 0;
+    bool ok = true;
+    while (i + 1 < n) {
+        uint8_t cmd = seq[i++];
+        if (cmd == 0x00) break;     // End of table
+        uint8_t len = seq[i++];
+        if (len > ST7701_MAX_PARAMS || i + len > n) break;
+
+        uint8_t stream[((ST7701_MAX_PARAMS + 1) * 9 + 7) / 8];
+        spi_transaction_t t;
+        memset(&t, 0, sizeof(t));
+        t.length = st7701Pack(cmd, seq + i, len, stream);
+        t.tx_buffer = stream;
+        ok = spi_device_polling_transmit(panel, &t) == ESP_OK && ok;
+        i += len;
+
+        if (cmd == 0x11) delay(120);
+        if (cmd == 0x29) delay(50);
+    }
+
+    spi_bus_remove_device(panel);
+    spi_bus_free(ST7701_SPI_HOST);
+    return ok;
+}
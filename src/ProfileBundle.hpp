@@ -0,0 +1,434 @@
+#pragma once
+
+// ==============================================================================
+// Binary Profile Bundle
+// ==============================================================================
+// Versioned, position-independent image of a profile set, read in place
+// (zero-copy) from a memory-mapped flash partition on the device or an
+// mmap()ed file on Linux. The same reader validates both.
+//
+// Layout (little-endian, every section 4-byte aligned, offsets from bundle start):
+//
+//   BundleHeader
+//   LayoutRecord[profileCount]     one per profile: name, colors, grid
+//   MacroRecord[macroCount]        row-major button cells of every profile
+//   string pool                    NUL-terminated UTF-8, offset 0 is ""
+//
+// Records refer to strings by pool offset, never by pointer, so a bundle can
+// be mapped at any address.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "Macros.hpp"
+
+#ifdef ARDUINO
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define PROFILE_BUNDLE_MAGIC        0x4E42504D  // "MPBN"
+#define PROFILE_BUNDLE_VERSION      1
+#define PROFILE_BUNDLE_NO_STRING    0xFFFFFFFF  // nullptr (text of non-text macros)
+
+// Flash partition holding the bundle (see partitions.csv)
+#define PROFILE_BUNDLE_PARTITION    "profiles"
+#define PROFILE_BUNDLE_SUBTYPE      0x40
+
+struct BundleHeader {
+    uint32_t magic;             // PROFILE_BUNDLE_MAGIC
+    uint16_t version;           // PROFILE_BUNDLE_VERSION
+    uint16_t headerSize;        // sizeof(BundleHeader), lets later versions grow it
+    uint32_t totalSize;         // Header + records + string pool
+    uint32_t crc32;             // CRC-32 of bytes [headerSize, totalSize)
+    uint32_t profileCount;
+    uint32_t macroCount;
+    uint32_t layoutOffset;
+    uint32_t macroOffset;
+    uint32_t stringOffset;
+    uint32_t flags;             // Reserved, 0
+};
+
+struct LayoutRecord {
+    uint32_t nameOffset;        // String pool offset
+    uint32_t firstMacro;        // Index of this profile's first MacroRecord
+    uint16_t accentColor;
+    uint8_t gridRows;
+    uint8_t gridCols;
+    uint8_t macroCount;         // Cells stored (row-major), <= gridRows * gridCols
+    uint8_t keyboardLayout;     // KeyboardLayout, 0 = firmware default
+    uint8_t unicodeInput;       // UnicodeInput, 0 = firmware default
+    uint8_t trackpadRows;       // Bottom rows that are a trackpad (0 in older bundles)
+};
+
+struct MacroRecord {
+    uint32_t labelOffset;       // String pool offsets
+    uint32_t sublabelOffset;
+    uint32_t textOffset;        // PROFILE_BUNDLE_NO_STRING unless MACRO_TYPE_TEXT
+    uint8_t type;               // MacroType
+    uint8_t modifiers;
+    uint8_t keyCount;
+    uint8_t fireMode;           // FireMode
+    uint8_t keys[6];
+    uint16_t color;
+    uint16_t pressColor;
+    uint16_t reserved;          // 0
+};
+
+static_assert(sizeof(BundleHeader) == 40, "BundleHeader layout changed");
+static_assert(sizeof(LayoutRecord) == 16, "LayoutRecord layout changed");
+static_assert(sizeof(MacroRecord) == 28, "MacroRecord layout changed");
+
+enum BundleError {
+    BUNDLE_OK = 0,
+    BUNDLE_ERR_TOO_SMALL,
+    BUNDLE_ERR_BAD_MAGIC,       // Also an erased (0xFF) partition
+    BUNDLE_ERR_BAD_VERSION,
+    BUNDLE_ERR_BAD_SIZE,
+    BUNDLE_ERR_BAD_CRC,
+    BUNDLE_ERR_BAD_LAYOUT,
+    BUNDLE_ERR_BAD_MACRO,
+    BUNDLE_ERR_BAD_STRING,
+    BUNDLE_ERR_MAP_FAILED
+};
+
+inline const char* bundleErrorName(BundleError err) {
+    switch (err) {
+        case BUNDLE_OK:              return "ok";
+        case BUNDLE_ERR_TOO_SMALL:   return "too small";
+        case BUNDLE_ERR_BAD_MAGIC:   return "bad magic (empty?)";
+        case BUNDLE_ERR_BAD_VERSION: return "unsupported version";
+        case BUNDLE_ERR_BAD_SIZE:    return "bad size or offsets";
+        case BUNDLE_ERR_BAD_CRC:     return "CRC mismatch";
+        case BUNDLE_ERR_BAD_LAYOUT:  return "bad layout record";
+        case BUNDLE_ERR_BAD_MACRO:   return "bad macro record";
+        case BUNDLE_ERR_BAD_STRING:  return "bad string offset";
+        case BUNDLE_ERR_MAP_FAILED:  return "map failed";
+    }
+    return "unknown";
+}
+
+// CRC-32 (IEEE 802.3, reflected), bitwise to avoid a 1 KB table
+inline uint32_t bundleCrc32(const uint8_t* data, size_t len, uint32_t crc = 0) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+// ==============================================================================
+// Bundle Reader (zero-copy view)
+// ==============================================================================
+class ProfileBundleView {
+private:
+    const uint8_t* _base;
+    size_t _size;
+
+    const BundleHeader& header() const {
+        return *reinterpret_cast<const BundleHeader*>(_base);
+    }
+
+    static bool aligned(uint32_t offset) {
+        return (offset & 3) == 0;
+    }
+
+    uint32_t stringPoolSize() const {
+        return header().totalSize - header().stringOffset;
+    }
+
+    bool validString(uint32_t offset, bool nullable) const {
+        if (offset == PROFILE_BUNDLE_NO_STRING) return nullable;
+        return offset < stringPoolSize();
+    }
+
+public:
+    ProfileBundleView() : _base(nullptr), _size(0) {}
+
+    // Validates the whole bundle; the view is usable only if this returns BUNDLE_OK
+    BundleError open(const void* data, size_t size, bool verifyCrc = true) {
+        _base = nullptr;
+        _size = 0;
+
+        const uint8_t* base = static_cast<const uint8_t*>(data);
+        if (base == nullptr || size < sizeof(BundleHeader)) return BUNDLE_ERR_TOO_SMALL;
+
+        const BundleHeader& h = *reinterpret_cast<const BundleHeader*>(base);
+        if (h.magic != PROFILE_BUNDLE_MAGIC) return BUNDLE_ERR_BAD_MAGIC;
+        if (h.version != PROFILE_BUNDLE_VERSION) return BUNDLE_ERR_BAD_VERSION;
+
+        uint64_t layoutEnd = (uint64_t)h.layoutOffset + (uint64_t)h.profileCount * sizeof(LayoutRecord);
+        uint64_t macroEnd = (uint64_t)h.macroOffset + (uint64_t)h.macroCount * sizeof(MacroRecord);
+        if (h.headerSize < sizeof(BundleHeader) || h.totalSize > size ||
+            !aligned(h.headerSize) || !aligned(h.layoutOffset) || !aligned(h.macroOffset) ||
+            h.layoutOffset < h.headerSize || layoutEnd > h.macroOffset ||
+            macroEnd > h.stringOffset || h.stringOffset >= h.totalSize) {
+            return BUNDLE_ERR_BAD_SIZE;
+        }
+
+        // Every string offset below the pool size is then NUL-terminated in bounds
+        if (base[h.totalSize - 1] != '\0') return BUNDLE_ERR_BAD_STRING;
+
+        if (verifyCrc &&
+            bundleCrc32(base + h.headerSize, h.totalSize - h.headerSize) != h.crc32) {
+            return BUNDLE_ERR_BAD_CRC;
+        }
+
+        _base = base;
+        _size = h.totalSize;
+
+        for (uint32_t p = 0; p < h.profileCount; p++) {
+            const LayoutRecord& l = layout(p);
+            if (l.gridRows < MIN_GRID_SIZE || l.gridRows > MAX_GRID_ROWS ||
+                l.gridCols < MIN_GRID_SIZE || l.gridCols > MAX_GRID_COLS ||
+                l.macroCount > l.gridRows * l.gridCols ||
+                l.keyboardLayout >= KEYBOARD_LAYOUT_COUNT || l.unicodeInput >= UNICODE_INPUT_COUNT ||
+                l.trackpadRows > l.gridRows ||
+                (uint64_t)l.firstMacro + l.macroCount > h.macroCount) {
+                _base = nullptr;
+                return BUNDLE_ERR_BAD_LAYOUT;
+            }
+            if (!validString(l.nameOffset, false)) {
+                _base = nullptr;
+                return BUNDLE_ERR_BAD_STRING;
+            }
+        }
+
+        for (uint32_t m = 0; m < h.macroCount; m++) {
+            const MacroRecord& r = macroRecords()[m];
+            if (!validString(r.labelOffset, false) || !validString(r.sublabelOffset, false) ||
+                !validString(r.textOffset, true)) {
+                _base = nullptr;
+                return BUNDLE_ERR_BAD_STRING;
+            }
+            if (r.fireMode > FIRE_HOLD || !isValidMacro(decodeMacro(r))) {
+                _base = nullptr;
+                return BUNDLE_ERR_BAD_MACRO;
+            }
+        }
+        return BUNDLE_OK;
+    }
+
+    bool isOpen() const { return _base != nullptr; }
+    size_t size() const { return _size; }
+    uint32_t profileCount() const { return isOpen() ? header().profileCount : 0; }
+    uint32_t macroCount() const { return isOpen() ? header().macroCount : 0; }
+    uint32_t crc() const { return isOpen() ? header().crc32 : 0; }
+
+    const LayoutRecord& layout(uint32_t index) const {
+        return reinterpret_cast<const LayoutRecord*>(_base + header().layoutOffset)[index];
+    }
+
+    const MacroRecord* macroRecords() const {
+        return reinterpret_cast<const MacroRecord*>(_base + header().macroOffset);
+    }
+
+    const char* string(uint32_t offset) const {
+        if (offset == PROFILE_BUNDLE_NO_STRING) return nullptr;
+        return reinterpret_cast<const char*>(_base + header().stringOffset + offset);
+    }
+
+    // Strings stay in the mapping; the Macro points straight into it
+    Macro decodeMacro(const MacroRecord& r) const {
+        Macro m;
+        m.label = string(r.labelOffset);
+        m.sublabel = string(r.sublabelOffset);
+        m.type = (MacroType)r.type;
+        m.modifiers = r.modifiers;
+        m.keyCount = r.keyCount;
+        memcpy(m.keys, r.keys, sizeof(m.keys));
+        m.text = string(r.textOffset);
+        m.color = r.color;
+        m.pressColor = r.pressColor;
+        m.fireMode = (FireMode)r.fireMode;
+        return m;
+    }
+
+    void decodeProfile(uint32_t index, Profile& out) const {
+        const LayoutRecord& l = layout(index);
+        out = Profile(string(l.nameOffset), l.accentColor, l.gridRows, l.gridCols);
+        out.keyboardLayout = l.keyboardLayout;
+        out.unicodeInput = l.unicodeInput;
+        out.trackpadRows = l.trackpadRows;
+        const MacroRecord* records = macroRecords() + l.firstMacro;
+        for (int i = 0; i < l.macroCount; i++) {
+            out.buttons[i] = decodeMacro(records[i]);
+        }
+    }
+};
+
+// ==============================================================================
+// Bundle Writer
+// ==============================================================================
+// Used by the host compiler (host/profilec.cpp); strings are deduplicated.
+class ProfileBundleBuilder {
+private:
+    std::vector<LayoutRecord> _layouts;
+    std::vector<MacroRecord> _macros;
+    std::vector<char> _strings;
+
+    uint32_t addString(const char* s) {
+        if (s == nullptr) return PROFILE_BUNDLE_NO_STRING;
+        size_t len = strlen(s);
+        for (size_t off = 0; off + len < _strings.size(); off++) {
+            if (memcmp(&_strings[off], s, len + 1) == 0) return (uint32_t)off;
+        }
+        uint32_t off = (uint32_t)_strings.size();
+        _strings.insert(_strings.end(), s, s + len + 1);
+        return off;
+    }
+
+    static size_t align4(size_t n) {
+        return (n + 3) & ~(size_t)3;
+    }
+
+public:
+    ProfileBundleBuilder() {
+        _strings.push_back('\0');   // Offset 0 is the empty string
+    }
+
+    size_t profileCount() const { return _layouts.size(); }
+
+    void addProfile(const Profile& p) {
+        LayoutRecord l;
+        memset(&l, 0, sizeof(l));
+        l.nameOffset = addString(p.name);
+        l.firstMacro = (uint32_t)_macros.size();
+        l.accentColor = p.accentColor;
+        l.gridRows = p.gridRows;
+        l.gridCols = p.gridCols;
+        l.keyboardLayout = p.keyboardLayout;
+        l.unicodeInput = p.unicodeInput;
+        l.trackpadRows = p.trackpadRows;
+
+        // Trailing empty cells are not stored
+        int cells = p.gridRows * p.gridCols;
+        while (cells > 0 && p.buttons[cells - 1].type == MACRO_TYPE_NONE &&
+               (!p.buttons[cells - 1].label || !p.buttons[cells - 1].label[0])) {
+            cells--;
+        }
+        l.macroCount = (uint8_t)cells;
+
+        for (int i = 0; i < cells; i++) {
+            const Macro& m = p.buttons[i];
+            MacroRecord r;
+            memset(&r, 0, sizeof(r));
+            r.labelOffset = addString(m.label ? m.label : "");
+            r.sublabelOffset = addString(m.sublabel ? m.sublabel : "");
+            r.textOffset = addString(m.text);
+            r.type = (uint8_t)m.type;
+            r.modifiers = m.modifiers;
+            r.keyCount = m.keyCount;
+            r.fireMode = (uint8_t)m.fireMode;
+            memcpy(r.keys, m.keys, sizeof(r.keys));
+            r.color = m.color;
+            r.pressColor = m.pressColor;
+            _macros.push_back(r);
+        }
+        _layouts.push_back(l);
+    }
+
+    std::vector<uint8_t> build() const {
+        BundleHeader h;
+        memset(&h, 0, sizeof(h));
+        h.magic = PROFILE_BUNDLE_MAGIC;
+        h.version = PROFILE_BUNDLE_VERSION;
+        h.headerSize = sizeof(BundleHeader);
+        h.profileCount = (uint32_t)_layouts.size();
+        h.macroCount = (uint32_t)_macros.size();
+        h.layoutOffset = sizeof(BundleHeader);
+        h.macroOffset = (uint32_t)align4(h.layoutOffset + _layouts.size() * sizeof(LayoutRecord));
+        h.stringOffset = (uint32_t)align4(h.macroOffset + _macros.size() * sizeof(MacroRecord));
+        h.totalSize = h.stringOffset + (uint32_t)_strings.size();
+
+        std::vector<uint8_t> out(h.totalSize, 0);
+        if (!_layouts.empty()) {
+            memcpy(&out[h.layoutOffset], _layouts.data(), _layouts.size() * sizeof(LayoutRecord));
+        }
+        if (!_macros.empty()) {
+            memcpy(&out[h.macroOffset], _macros.data(), _macros.size() * sizeof(MacroRecord));
+        }
+        memcpy(&out[h.stringOffset], _strings.data(), _strings.size());
+
+        h.crc32 = bundleCrc32(&out[h.headerSize], h.totalSize - h.headerSize);
+        memcpy(&out[0], &h, sizeof(h));
+        return out;
+    }
+};
+
+// ==============================================================================
+// Mapped Bundle
+// ==============================================================================
+// Maps the bundle source read-only and opens a view over it: the "profiles"
+// flash partition on the device, a file on Linux.
+class MappedProfileBundle {
+private:
+    ProfileBundleView _view;
+    const void* _data;
+    size_t _length;
+#ifdef ARDUINO
+    spi_flash_mmap_handle_t _handle;
+#endif
+
+public:
+    MappedProfileBundle() : _data(nullptr), _length(0) {}
+    ~MappedProfileBundle() { unmap(); }
+
+    MappedProfileBundle(const MappedProfileBundle&) = delete;
+    MappedProfileBundle& operator=(const MappedProfileBundle&) = delete;
+
+    // `source` is a partition label on the device and a file path on Linux
+    BundleError map(const char* source = PROFILE_BUNDLE_PARTITION) {
+        unmap();
+#ifdef ARDUINO
+        const esp_partition_t* part = esp_partition_find_first(
+            ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)PROFILE_BUNDLE_SUBTYPE, source);
+        if (part == nullptr) return BUNDLE_ERR_MAP_FAILED;
+        if (esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA,
+                               &_data, &_handle) != ESP_OK) {
+            _data = nullptr;
+            return BUNDLE_ERR_MAP_FAILED;
+        }
+        _length = part->size;
+#else
+        int fd = open(source, O_RDONLY);
+        if (fd < 0) return BUNDLE_ERR_MAP_FAILED;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return BUNDLE_ERR_MAP_FAILED;
+        }
+        void* addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) return BUNDLE_ERR_MAP_FAILED;
+        _data = addr;
+        _length = (size_t)st.st_size;
+#endif
+        BundleError err = _view.open(_data, _length);
+        if (err != BUNDLE_OK) unmap();
+        return err;
+    }
+
+    void unmap() {
+        if (_data == nullptr) return;
+#ifdef ARDUINO
+        spi_flash_munmap(_handle);
+#else
+        munmap(const_cast<void*>(_data), _length);
+#endif
+        _data = nullptr;
+        _length = 0;
+        _view = ProfileBundleView();
+    }
+
+    const ProfileBundleView& view() const { return _view; }
+};
@@ -0,0 +1,1026 @@
+#pragma once
+
+// ==============================================================================
+// Streaming Profile JSON (import/export)
+// ==============================================================================
+// Fixed-memory, incremental JSON for profile bundles. The parser is SAX-style:
+// it is fed arbitrary chunks and never holds more than one token, so a bundle
+// of any size is read through a few hundred bytes of state. The writer is the
+// mirror image: it produces the document in caller-sized chunks.
+//
+// Schema (version 1):
+//   {"version":1,"profiles":[
+//     {"name":"General","color":12678,"rows":4,"cols":4,"keyboard":"de","unicode":"linux",
+//      "buttons":[
+//       {"label":"Copy","sublabel":"Ctrl+C","type":"combo","modifiers":1,
+//        "keys":[6],"color":12678,"pressColor":1869,"fire":"down"},
+//       null,                                    <- empty cell
+//       {"label":"Sig","sublabel":"Text","type":"text","text":"Regards", ...},
+//       {"label":"Laptop","type":"host","keys":[1], ...}  <- BLE host slot 1
+//     ]}
+//   ]}
+// Colors may also be written as hex strings ("0x3186"). "keyboard" (us, uk,
+// de) and "unicode" (none, windows, macos, linux) say how text macros are
+// typed (KeyboardLayout.hpp); left out, the firmware default applies.
+// "fire" is "down", "tap" or "hold" (key, combo and media buttons only).
+// "trackpad" makes that many bottom rows a trackpad (MotionCoalescer.hpp).
+// Unknown keys are skipped.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Macros.hpp"
+#include "KeyboardLayout.hpp"
+
+#define PROFILE_JSON_VERSION    1
+
+#ifndef JSON_MAX_DEPTH
+#define JSON_MAX_DEPTH          8
+#endif
+
+// Longest key or string value (after unescaping) the parser accepts
+#ifndef JSON_MAX_TOKEN
+#define JSON_MAX_TOKEN          256
+#endif
+
+// Strings of the profile being imported (names, labels, text)
+#ifndef PROFILE_JSON_ARENA_SIZE
+#define PROFILE_JSON_ARENA_SIZE 4096
+#endif
+
+// ==============================================================================
+// String Arena
+// ==============================================================================
+// Bump allocator over a fixed buffer; everything is released at once.
+template <size_t Capacity>
+class StringArena {
+private:
+    char _buffer[Capacity];
+    size_t _used;
+    size_t _peak;
+
+public:
+    StringArena() : _used(0), _peak(0) {}
+
+    const char* store(const char* s, size_t len) {
+        if (_used + len + 1 > Capacity) return nullptr;
+        char* out = _buffer + _used;
+        memcpy(out, s, len);
+        out[len] = '\0';
+        _used += len + 1;
+        if (_used > _peak) _peak = _used;
+        return out;
+    }
+
+    void reset() { _used = 0; }
+    size_t used() const { return _used; }
+    size_t peak() const { return _peak; }
+    static constexpr size_t capacity() { return Capacity; }
+};
+
+// ==============================================================================
+// SAX Parser
+// ==============================================================================
+class JsonSaxHandler {
+public:
+    virtual ~JsonSaxHandler() {}
+    virtual bool onBeginObject() = 0;
+    virtual bool onEndObject() = 0;
+    virtual bool onBeginArray() = 0;
+    virtual bool onEndArray() = 0;
+    virtual bool onKey(const char* key, size_t len) = 0;
+    virtual bool onString(const char* value, size_t len) = 0;
+    virtual bool onNumber(int32_t value) = 0;
+    virtual bool onBool(bool value) = 0;
+    virtual bool onNull() = 0;
+};
+
+enum JsonError {
+    JSON_OK = 0,
+    JSON_ERR_SYNTAX,
+    JSON_ERR_DEPTH,
+    JSON_ERR_TOKEN_TOO_LONG,
+    JSON_ERR_NUMBER,            // Only integers are used by the schema
+    JSON_ERR_HANDLER,           // Handler rejected a value (see its own error)
+    JSON_ERR_INCOMPLETE         // finish() before the document ended
+};
+
+inline const char* jsonErrorName(JsonError err) {
+    switch (err) {
+        case JSON_OK:                 return "ok";
+        case JSON_ERR_SYNTAX:         return "syntax error";
+        case JSON_ERR_DEPTH:          return "nested too deep";
+        case JSON_ERR_TOKEN_TOO_LONG: return "string too long";
+        case JSON_ERR_NUMBER:         return "bad number";
+        case JSON_ERR_HANDLER:        return "rejected by schema";
+        case JSON_ERR_INCOMPLETE:     return "unexpected end of input";
+    }
+    return "unknown";
+}
+
+class JsonSaxParser {
+private:
+    enum State : uint8_t {
+        ST_VALUE,               // Expecting any value
+        ST_VALUE_OR_END,        // After '['
+        ST_KEY_OR_END,          // After '{'
+        ST_KEY,                 // After ',' in an object
+        ST_COLON,
+        ST_COMMA_OR_END,
+        ST_STRING,
+        ST_ESCAPE,
+        ST_UNICODE,
+        ST_NUMBER,
+        ST_LITERAL,
+        ST_DONE
+    };
+
+    JsonSaxHandler* _handler;
+    State _state;
+    JsonError _error;
+    size_t _offset;             // Bytes consumed, for error reporting
+
+    uint8_t _depth;
+    uint16_t _objectBits;       // Bit per depth: 1 = object, 0 = array
+
+    bool _stringIsKey;
+    char _token[JSON_MAX_TOKEN];
+    size_t _tokenLen;
+
+    uint32_t _unicode;
+    uint8_t _unicodeDigits;
+    uint16_t _highSurrogate;
+
+    const char* _literal;
+    uint8_t _literalPos;
+
+public:
+    explicit JsonSaxParser(JsonSaxHandler* handler) : _handler(handler) { reset(); }
+
+    void reset() {
+        _state = ST_VALUE;
+        _error = JSON_OK;
+        _offset = 0;
+        _depth = 0;
+        _objectBits = 0;
+        _stringIsKey = false;
+        _tokenLen = 0;
+        _unicode = 0;
+        _unicodeDigits = 0;
+        _highSurrogate = 0;
+        _literal = nullptr;
+        _literalPos = 0;
+    }
+
+    JsonError error() const { return _error; }
+    size_t offset() const { return _offset; }
+    bool done() const { return _state == ST_DONE; }
+
+    JsonError feed(const char* data, size_t len) {
+        for (size_t i = 0; i < len && _error == JSON_OK; i++) {
+            // A number ends at the first byte that is not part of it; that byte
+            // is then parsed again in the new state
+            if (!consume(data[i])) {
+                consume(data[i]);
+            }
+            if (_error == JSON_OK) _offset++;
+        }
+        return _error;
+    }
+
+    JsonError finish() {
+        if (_error != JSON_OK) return _error;
+        if (_state == ST_NUMBER && _depth == 0) {
+            endNumber();
+        }
+        if (_error == JSON_OK && _state != ST_DONE) {
+            _error = JSON_ERR_INCOMPLETE;
+        }
+        return _error;
+    }
+
+private:
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    bool fail(JsonError err) {
+        _error = err;
+        return true;
+    }
+
+    bool call(bool ok) {
+        if (!ok) _error = JSON_ERR_HANDLER;
+        return true;
+    }
+
+    bool topIsObject() const {
+        return (_objectBits >> (_depth - 1)) & 1;
+    }
+
+    void afterValue() {
+        _state = _depth == 0 ? ST_DONE : ST_COMMA_OR_END;
+    }
+
+    bool push(bool object) {
+        if (_depth >= JSON_MAX_DEPTH) return fail(JSON_ERR_DEPTH);
+        if (object) {
+            _objectBits |= (uint16_t)(1u << _depth);
+        } else {
+            _objectBits &= (uint16_t)~(1u << _depth);
+        }
+        _depth++;
+        if (object) {
+            _state = ST_KEY_OR_END;
+            return call(_handler->onBeginObject());
+        }
+        _state = ST_VALUE_OR_END;
+        return call(_handler->onBeginArray());
+    }
+
+    bool pop(bool object) {
+        if (_depth == 0 || topIsObject() != object) return fail(JSON_ERR_SYNTAX);
+        _depth--;
+        afterValue();
+        return call(object ? _handler->onEndObject() : _handler->onEndArray());
+    }
+
+    void appendToken(char c) {
+        if (_tokenLen >= JSON_MAX_TOKEN - 1) {
+            fail(JSON_ERR_TOKEN_TOO_LONG);
+            return;
+        }
+        _token[_tokenLen++] = c;
+    }
+
+    void appendCodepoint(uint32_t cp) {
+        if (cp < 0x80) {
+            appendToken((char)cp);
+        } else if (cp < 0x800) {
+            appendToken((char)(0xC0 | (cp >> 6)));
+            appendToken((char)(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            appendToken((char)(0xE0 | (cp >> 12)));
+            appendToken((char)(0x80 | ((cp >> 6) & 0x3F)));
+            appendToken((char)(0x80 | (cp & 0x3F)));
+        } else {
+            appendToken((char)(0xF0 | (cp >> 18)));
+            appendToken((char)(0x80 | ((cp >> 12) & 0x3F)));
+            appendToken((char)(0x80 | ((cp >> 6) & 0x3F)));
+            appendToken((char)(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    void flushSurrogate() {
+        if (_highSurrogate) {
+            appendCodepoint(0xFFFD);
+            _highSurrogate = 0;
+        }
+    }
+
+    bool beginValue(char c) {
+        switch (c) {
+            case '{': return push(true);
+            case '[': return push(false);
+            case '"':
+                _stringIsKey = false;
+                _tokenLen = 0;
+                _state = ST_STRING;
+                return true;
+            case 't': _literal = "true"; break;
+            case 'f': _literal = "false"; break;
+            case 'n': _literal = "null"; break;
+            default:
+                if (c == '-' || (c >= '0' && c <= '9')) {
+                    _tokenLen = 0;
+                    appendToken(c);
+                    _state = ST_NUMBER;
+                    return true;
+                }
+                return fail(JSON_ERR_SYNTAX);
+        }
+        _literalPos = 1;
+        _state = ST_LITERAL;
+        return true;
+    }
+
+    void endNumber() {
+        _token[_tokenLen] = '\0';
+        const char* p = _token;
+        bool negative = *p == '-';
+        if (negative) p++;
+        if (*p == '\0') {
+            fail(JSON_ERR_NUMBER);
+            return;
+        }
+        int64_t value = 0;
+        for (; *p; p++) {
+            value = value * 10 + (*p - '0');
+            if (value > INT32_MAX) {
+                fail(JSON_ERR_NUMBER);
+                return;
+            }
+        }
+        afterValue();
+        call(_handler->onNumber((int32_t)(negative ? -value : value)));
+    }
+
+    void endLiteral() {
+        afterValue();
+        if (_literal[0] == 'n') {
+            call(_handler->onNull());
+        } else {
+            call(_handler->onBool(_literal[0] == 't'));
+        }
+    }
+
+    // Returns false when the byte was not consumed and must be fed again
+    bool consume(char c) {
+        switch (_state) {
+            case ST_VALUE:
+                if (isSpace(c)) return true;
+                return beginValue(c);
+
+            case ST_VALUE_OR_END:
+                if (isSpace(c)) return true;
+                if (c == ']') return pop(false);
+                return beginValue(c);
+
+            case ST_KEY_OR_END:
+            case ST_KEY:
+                if (isSpace(c)) return true;
+                if (c == '}' && _state == ST_KEY_OR_END) return pop(true);
+                if (c != '"') return fail(JSON_ERR_SYNTAX);
+                _stringIsKey = true;
+                _tokenLen = 0;
+                _state = ST_STRING;
+                return true;
+
+            case ST_COLON:
+                if (isSpace(c)) return true;
+                if (c != ':') return fail(JSON_ERR_SYNTAX);
+                _state = ST_VALUE;
+                return true;
+
+            case ST_COMMA_OR_END:
+                if (isSpace(c)) return true;
+                if (c == ',') {
+                    _state = topIsObject() ? ST_KEY : ST_VALUE;
+                    return true;
+                }
+                if (c == '}') return pop(true);
+                if (c == ']') return pop(false);
+                return fail(JSON_ERR_SYNTAX);
+
+            case ST_STRING:
+                if (c == '\\') {
+                    _state = ST_ESCAPE;
+                    return true;
+                }
+                flushSurrogate();
+                if (c == '"') {
+                    if (_stringIsKey) {
+                        _state = ST_COLON;
+                        return call(_handler->onKey(_token, _tokenLen));
+                    }
+                    afterValue();
+                    return call(_handler->onString(_token, _tokenLen));
+                }
+                if ((uint8_t)c < 0x20) return fail(JSON_ERR_SYNTAX);
+                appendToken(c);
+                return true;
+
+            case ST_ESCAPE:
+                _state = ST_STRING;
+                if (c == 'u') {
+                    _unicode = 0;
+                    _unicodeDigits = 0;
+                    _state = ST_UNICODE;
+                    return true;
+                }
+                flushSurrogate();
+                switch (c) {
+                    case '"':  appendToken('"'); break;
+                    case '\\': appendToken('\\'); break;
+                    case '/':  appendToken('/'); break;
+                    case 'b':  appendToken('\b'); break;
+                    case 'f':  appendToken('\f'); break;
+                    case 'n':  appendToken('\n'); break;
+                    case 'r':  appendToken('\r'); break;
+                    case 't':  appendToken('\t'); break;
+                    default:   return fail(JSON_ERR_SYNTAX);
+                }
+                return true;
+
+            case ST_UNICODE: {
+                int digit;
+                if (c >= '0' && c <= '9') digit = c - '0';
+                else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+                else return fail(JSON_ERR_SYNTAX);
+
+                _unicode = (_unicode << 4) | (uint32_t)digit;
+                if (++_unicodeDigits < 4) return true;
+
+                _state = ST_STRING;
+                if (_unicode >= 0xD800 && _unicode <= 0xDBFF) {
+                    flushSurrogate();
+                    _highSurrogate = (uint16_t)_unicode;
+                } else if (_unicode >= 0xDC00 && _unicode <= 0xDFFF) {
+                    if (_highSurrogate) {
+                        appendCodepoint(0x10000 + (((uint32_t)_highSurrogate - 0xD800) << 10) +
+                                        (_unicode - 0xDC00));
+                        _highSurrogate = 0;
+                    } else {
+                        appendCodepoint(0xFFFD);
+                    }
+                } else {
+                    flushSurrogate();
+                    appendCodepoint(_unicode);
+                }
+                return true;
+            }
+
+            case ST_NUMBER:
+                if (c >= '0' && c <= '9') {
+                    appendToken(c);
+                    return true;
+                }
+                if (c == '.' || c == 'e' || c == 'E' || c == '-' || c == '+') {
+                    return fail(JSON_ERR_NUMBER);
+                }
+                endNumber();
+                return _error != JSON_OK;   // Re-feed the terminator
+
+            case ST_LITERAL:
+                if (c != _literal[_literalPos]) return fail(JSON_ERR_SYNTAX);
+                if (_literal[++_literalPos] == '\0') endLiteral();
+                return true;
+
+            case ST_DONE:
+                if (isSpace(c)) return true;
+                return fail(JSON_ERR_SYNTAX);
+        }
+        return fail(JSON_ERR_SYNTAX);
+    }
+};
+
+// ==============================================================================
+// Profile JSON Reader
+// ==============================================================================
+// Maps the SAX stream onto Profiles and hands each one to the sink as soon
+// as its closing brace arrives. The profile's strings live in the reader's
+// arena and are valid only during the sink call (the arena is recycled for
+// the next profile), so sinks copy what they keep.
+typedef bool (*ProfileSink)(const Profile& profile, void* context);
+
+class ProfileJsonReader : public JsonSaxHandler {
+private:
+    enum Context : uint8_t {
+        CTX_ROOT,
+        CTX_PROFILES,
+        CTX_PROFILE,
+        CTX_BUTTONS,
+        CTX_BUTTON,
+        CTX_KEYS,
+        CTX_SKIP
+    };
+
+    enum Field : uint8_t {
+        F_NONE,
+        F_VERSION,
+        F_PROFILES,
+        F_NAME,
+        F_COLOR,
+        F_ROWS,
+        F_COLS,
+        F_KEYBOARD,
+        F_UNICODE,
+        F_TRACKPAD,
+        F_BUTTONS,
+        F_LABEL,
+        F_SUBLABEL,
+        F_TYPE,
+        F_MODIFIERS,
+        F_KEYS,
+        F_TEXT,
+        F_PRESS_COLOR,
+        F_FIRE,
+        F_UNKNOWN
+    };
+
+    JsonSaxParser _parser;
+    ProfileSink _sink;
+    void* _sinkContext;
+
+    Context _stack[JSON_MAX_DEPTH + 1];
+    uint8_t _depth;
+    Field _field;
+
+    Profile _profile;
+    Macro _macro;
+    int _buttonIndex;
+    uint32_t _profilesRead;
+
+    StringArena<PROFILE_JSON_ARENA_SIZE> _arena;
+    const char* _schemaError;
+
+    Context top() const { return _depth ? _stack[_depth - 1] : CTX_ROOT; }
+
+    bool reject(const char* message) {
+        _schemaError = message;
+        return false;
+    }
+
+    static bool keyIs(const char* key, size_t len, const char* name) {
+        return strlen(name) == len && memcmp(key, name, len) == 0;
+    }
+
+    Field lookupField(const char* key, size_t len) const {
+        switch (top()) {
+            case CTX_ROOT:
+                if (keyIs(key, len, "version")) return F_VERSION;
+                if (keyIs(key, len, "profiles")) return F_PROFILES;
+                break;
+            case CTX_PROFILE:
+                if (keyIs(key, len, "name")) return F_NAME;
+                if (keyIs(key, len, "color")) return F_COLOR;
+                if (keyIs(key, len, "rows")) return F_ROWS;
+                if (keyIs(key, len, "cols")) return F_COLS;
+                if (keyIs(key, len, "keyboard")) return F_KEYBOARD;
+                if (keyIs(key, len, "unicode")) return F_UNICODE;
+                if (keyIs(key, len, "trackpad")) return F_TRACKPAD;
+                if (keyIs(key, len, "buttons")) return F_BUTTONS;
+                break;
+            case CTX_BUTTON:
+                if (keyIs(key, len, "label")) return F_LABEL;
+                if (keyIs(key, len, "sublabel")) return F_SUBLABEL;
+                if (keyIs(key, len, "type")) return F_TYPE;
+                if (keyIs(key, len, "modifiers")) return F_MODIFIERS;
+                if (keyIs(key, len, "keys")) return F_KEYS;
+                if (keyIs(key, len, "text")) return F_TEXT;
+                if (keyIs(key, len, "color")) return F_COLOR;
+                if (keyIs(key, len, "pressColor")) return F_PRESS_COLOR;
+                if (keyIs(key, len, "fire")) return F_FIRE;
+                break;
+            default:
+                break;
+        }
+        return F_UNKNOWN;
+    }
+
+    bool enter(Context ctx) {
+        if (_depth > JSON_MAX_DEPTH) return reject("nested too deep");
+        _stack[_depth++] = ctx;
+        _field = F_NONE;
+        return true;
+    }
+
+    bool setNumber(int32_t value) {
+        if (top() == CTX_KEYS) {
+            if (_macro.keyCount >= 6 || value < 0 || value > 0xFF) return reject("bad key list");
+            _macro.keys[_macro.keyCount++] = (uint8_t)value;
+            return true;
+        }
+
+        bool inButton = top() == CTX_BUTTON;
+        switch (_field) {
+            case F_VERSION:
+                if (value != PROFILE_JSON_VERSION) return reject("unsupported schema version");
+                return true;
+            case F_COLOR:
+                if (value < 0 || value > 0xFFFF) return reject("bad color");
+                if (inButton) _macro.color = (uint16_t)value;
+                else _profile.accentColor = (uint16_t)value;
+                return true;
+            case F_PRESS_COLOR:
+                if (value < 0 || value > 0xFFFF) return reject("bad color");
+                _macro.pressColor = (uint16_t)value;
+                return true;
+            case F_ROWS:
+            case F_COLS:
+                if (value < MIN_GRID_SIZE || value > MAX_GRID_ROWS) return reject("bad grid size");
+                if (_field == F_ROWS) _profile.gridRows = (uint8_t)value;
+                else _profile.gridCols = (uint8_t)value;
+                return true;
+            case F_TRACKPAD:
+                if (value < 0 || value > MAX_GRID_ROWS) return reject("bad trackpad rows");
+                _profile.trackpadRows = (uint8_t)value;
+                return true;
+            case F_MODIFIERS:
+                if (value < 0 || value > 0x0F) return reject("bad modifiers");
+                _macro.modifiers = (uint8_t)value;
+                return true;
+            default:
+                return true;    // Unknown numeric field
+        }
+    }
+
+    bool setString(const char* value, size_t len) {
+        // Colors may be hex strings
+        if (_field == F_COLOR || _field == F_PRESS_COLOR) {
+            char buf[8];
+            if (len < 3 || len > 6 || value[0] != '0' || (value[1] != 'x' && value[1] != 'X')) {
+                return reject("bad color");
+            }
+            memcpy(buf, value, len);
+            buf[len] = '\0';
+            return setNumber((int32_t)strtol(buf, nullptr, 16));
+        }
+
+        const char** target = nullptr;
+        switch (_field) {
+            case F_NAME:     target = &_profile.name; break;
+            case F_LABEL:    target = &_macro.label; break;
+            case F_SUBLABEL: target = &_macro.sublabel; break;
+            case F_TEXT:     target = &_macro.text; break;
+
+            case F_TYPE:
+                if (keyIs(value, len, "none")) _macro.type = MACRO_TYPE_NONE;
+                else if (keyIs(value, len, "key")) _macro.type = MACRO_TYPE_KEY;
+                else if (keyIs(value, len, "combo")) _macro.type = MACRO_TYPE_COMBO;
+                else if (keyIs(value, len, "sequence")) _macro.type = MACRO_TYPE_SEQUENCE;
+                else if (keyIs(value, len, "text")) _macro.type = MACRO_TYPE_TEXT;
+                else if (keyIs(value, len, "media")) _macro.type = MACRO_TYPE_MEDIA;
+                else if (keyIs(value, len, "host")) _macro.type = MACRO_TYPE_HOST;
+                else return reject("unknown macro type");
+                return true;
+
+            case F_FIRE:
+                if (keyIs(value, len, "down")) _macro.fireMode = FIRE_ON_DOWN;
+                else if (keyIs(value, len, "tap")) _macro.fireMode = FIRE_ON_TAP;
+                else if (keyIs(value, len, "hold")) _macro.fireMode = FIRE_HOLD;
+                else return reject("unknown fire mode");
+                return true;
+
+            case F_KEYBOARD:
+                for (uint8_t i = 0; i < KEYBOARD_LAYOUT_COUNT; i++) {
+                    if (!keyIs(value, len, keyboardLayoutName(i))) continue;
+                    _profile.keyboardLayout = i;
+                    return true;
+                }
+                return reject("unknown keyboard layout");
+
+            case F_UNICODE:
+                for (uint8_t i = 0; i < UNICODE_INPUT_COUNT; i++) {
+                    if (!keyIs(value, len, unicodeInputName(i))) continue;
+                    _profile.unicodeInput = i;
+                    return true;
+                }
+                return reject("unknown unicode input");
+
+            default:
+                return true;    // Unknown string field
+        }
+
+        *target = _arena.store(value, len);
+        return *target != nullptr || reject("profile strings exceed arena");
+    }
+
+public:
+    ProfileJsonReader(ProfileSink sink, void* context)
+        : _parser(this), _sink(sink), _sinkContext(context) {
+        reset();
+    }
+
+    void reset() {
+        _parser.reset();
+        _depth = 0;
+        _field = F_NONE;
+        _buttonIndex = 0;
+        _profilesRead = 0;
+        _arena.reset();
+        _schemaError = nullptr;
+    }
+
+    // Feed the next chunk of the document (any size, any boundary)
+    JsonError feed(const char* data, size_t len) { return _parser.feed(data, len); }
+    JsonError finish() { return _parser.finish(); }
+
+    uint32_t profilesRead() const { return _profilesRead; }
+    size_t offset() const { return _parser.offset(); }
+    size_t arenaPeak() const { return _arena.peak(); }
+
+    const char* errorMessage() const {
+        if (_schemaError) return _schemaError;
+        return jsonErrorName(_parser.error());
+    }
+
+    bool onBeginObject() override {
+        Context parent = _depth ? top() : CTX_SKIP;
+        if (_depth == 0) return enter(CTX_ROOT);
+
+        if (parent == CTX_PROFILES) {
+            _profile = Profile("", PROFILE_COLOR_GENERAL);
+            _buttonIndex = 0;
+            _arena.reset();
+            return enter(CTX_PROFILE);
+        }
+        if (parent == CTX_BUTTONS) {
+            _macro = Macro();
+            return enter(CTX_BUTTON);
+        }
+        return enter(CTX_SKIP);
+    }
+
+    bool onEndObject() override {
+        Context ctx = top();
+        _depth--;
+        _field = F_NONE;
+
+        if (ctx == CTX_BUTTON) {
+            if (_buttonIndex >= BUTTON_COUNT) return reject("too many buttons");
+            if (!isValidMacro(_macro)) return reject("invalid macro");
+            _profile.buttons[_buttonIndex++] = _macro;
+        } else if (ctx == CTX_PROFILE) {
+            if (!isValidProfile(_profile)) return reject("invalid profile");
+            _profilesRead++;
+            if (_sink && !_sink(_profile, _sinkContext)) return reject("profile rejected by sink");
+        }
+        return true;
+    }
+
+    bool onBeginArray() override {
+        Context ctx = top();
+        if (_depth > 0 && ctx == CTX_ROOT && _field == F_PROFILES) return enter(CTX_PROFILES);
+        if (ctx == CTX_PROFILE && _field == F_BUTTONS) return enter(CTX_BUTTONS);
+        if (ctx == CTX_BUTTON && _field == F_KEYS) {
+            _macro.keyCount = 0;
+            return enter(CTX_KEYS);
+        }
+        return enter(CTX_SKIP);
+    }
+
+    bool onEndArray() override {
+        _depth--;
+        _field = F_NONE;
+        return true;
+    }
+
+    bool onKey(const char* key, size_t len) override {
+        _field = lookupField(key, len);
+        return true;
+    }
+
+    bool onString(const char* value, size_t len) override {
+        if (top() == CTX_SKIP || _field == F_UNKNOWN) return true;
+        return setString(value, len);
+    }
+
+    bool onNumber(int32_t value) override {
+        if (top() == CTX_SKIP || (_field == F_UNKNOWN && top() != CTX_KEYS)) return true;
+        return setNumber(value);
+    }
+
+    bool onBool(bool) override {
+        return true;
+    }
+
+    bool onNull() override {
+        if (top() == CTX_BUTTONS) {
+            // Empty cell
+            if (_buttonIndex >= BUTTON_COUNT) return reject("too many buttons");
+            _profile.buttons[_buttonIndex++] = Macro();
+        }
+        return true;
+    }
+};
+
+// ==============================================================================
+// Profile JSON Writer
+// ==============================================================================
+// Pull-style: each read() fills the caller's buffer with the next piece of the
+// document. Only a small fragment buffer and the current position are kept.
+typedef const Profile* (*ProfileGetter)(int index, void* context);
+
+class ProfileJsonWriter {
+private:
+    enum Stage : uint8_t {
+        W_HEADER,
+        W_PROFILE_BEGIN,
+        W_PROFILE_FIELDS,
+        W_BUTTON_BEGIN,
+        W_BUTTON_SUBLABEL,
+        W_BUTTON_FIELDS,
+        W_BUTTON_END,
+        W_DONE
+    };
+
+    ProfileGetter _getter;
+    void* _context;
+    int _count;
+
+    Stage _stage;
+    int _profileIndex;
+    int _buttonIndex;
+    int _cells;
+    const Profile* _current;
+
+    char _pending[96];
+    size_t _pendingLen;
+    size_t _pendingPos;
+    const char* _string;        // String being escaped into the output
+    size_t _written;
+
+    static const char* typeName(MacroType type) {
+        switch (type) {
+            case MACRO_TYPE_NONE:     return "none";
+            case MACRO_TYPE_KEY:      return "key";
+            case MACRO_TYPE_COMBO:    return "combo";
+            case MACRO_TYPE_SEQUENCE: return "sequence";
+            case MACRO_TYPE_TEXT:     return "text";
+            case MACRO_TYPE_MEDIA:    return "media";
+            case MACRO_TYPE_HOST:     return "host";
+        }
+        return "none";
+    }
+
+    static bool isEmptyCell(const Macro& m) {
+        return m.type == MACRO_TYPE_NONE && (!m.label || !m.label[0]);
+    }
+
+    void append(const char* s) {
+        size_t len = strlen(s);
+        memcpy(_pending + _pendingLen, s, len);
+        _pendingLen += len;
+    }
+
+    template <typename... Args>
+    void appendf(const char* fmt, Args... args) {
+        int n = snprintf(_pending + _pendingLen, sizeof(_pending) - _pendingLen, fmt, args...);
+        if (n > 0) _pendingLen += (size_t)n;
+    }
+
+    void beginString(const char* s) {
+        if (s == nullptr) {
+            append("null");
+            return;
+        }
+        append("\"");
+        _string = s;
+    }
+
+    // Escapes as much of _string as fits into the fragment buffer
+    void escapeString() {
+        while (*_string && _pendingLen + 6 < sizeof(_pending)) {
+            uint8_t c = (uint8_t)*_string++;
+            switch (c) {
+                case '"':  append("\\\""); break;
+                case '\\': append("\\\\"); break;
+                case '\n': append("\\n"); break;
+                case '\r': append("\\r"); break;
+                case '\t': append("\\t"); break;
+                default:
+                    if (c < 0x20) {
+                        appendf("\\u%04x", c);
+                    } else {
+                        _pending[_pendingLen++] = (char)c;
+                    }
+            }
+        }
+        if (*_string == '\0') {
+            append("\"");
+            _string = nullptr;
+        }
+    }
+
+    void nextFragment() {
+        const Macro* m = (_current && _buttonIndex < _cells) ? &_current->buttons[_buttonIndex] : nullptr;
+
+        switch (_stage) {
+            case W_HEADER:
+                appendf("{\"version\":%d,\"profiles\":[", PROFILE_JSON_VERSION);
+                _stage = W_PROFILE_BEGIN;
+                break;
+
+            case W_PROFILE_BEGIN:
+                _current = _profileIndex < _count ? _getter(_profileIndex, _context) : nullptr;
+                if (_current == nullptr) {
+                    append("\n]}\n");
+                    _stage = W_DONE;
+                    break;
+                }
+                append(_profileIndex ? ",\n{\"name\":" : "\n{\"name\":");
+                beginString(_current->name);
+                _stage = W_PROFILE_FIELDS;
+                break;
+
+            case W_PROFILE_FIELDS:
+                appendf(",\"color\":%u,\"rows\":%u,\"cols\":%u",
+                    _current->accentColor, _current->gridRows, _current->gridCols);
+                if (_current->keyboardLayout != KEYBOARD_LAYOUT_DEFAULT) {
+                    appendf(",\"keyboard\":\"%s\"", keyboardLayoutName(_current->keyboardLayout));
+                }
+                if (_current->unicodeInput != UNICODE_INPUT_DEFAULT) {
+                    appendf(",\"unicode\":\"%s\"", unicodeInputName(_current->unicodeInput));
+                }
+                if (_current->trackpadRows != 0) {
+                    appendf(",\"trackpad\":%u", _current->trackpadRows);
+                }
+                append(",\"buttons\":[");
+                _buttonIndex = 0;
+                _cells = _current->gridRows * _current->gridCols;
+                while (_cells > 0 && isEmptyCell(_current->buttons[_cells - 1])) _cells--;
+                _stage = W_BUTTON_BEGIN;
+                break;
+
+            case W_BUTTON_BEGIN:
+                if (m == nullptr) {
+                    append("]}");
+                    _profileIndex++;
+                    _stage = W_PROFILE_BEGIN;
+                    break;
+                }
+                append(_buttonIndex ? ",\n " : "\n ");
+                if (isEmptyCell(*m)) {
+                    append("null");
+                    _buttonIndex++;
+                    break;
+                }
+                append("{\"label\":");
+                beginString(m->label ? m->label : "");
+                _stage = W_BUTTON_SUBLABEL;
+                break;
+
+            case W_BUTTON_SUBLABEL:
+                append(",\"sublabel\":");
+                beginString(m->sublabel ? m->sublabel : "");
+                _stage = W_BUTTON_FIELDS;
+                break;
+
+            case W_BUTTON_FIELDS:
+                appendf(",\"type\":\"%s\",\"modifiers\":%u,\"keys\":[", typeName(m->type), m->modifiers);
+                for (int k = 0; k < m->keyCount; k++) {
+                    appendf(k ? ",%u" : "%u", m->keys[k]);
+                }
+                append("]");
+                if (m->text) {
+                    append(",\"text\":");
+                    beginString(m->text);
+                }
+                _stage = W_BUTTON_END;
+                break;
+
+            case W_BUTTON_END:
+                appendf(",\"color\":%u,\"pressColor\":%u,\"fire\":\"%s\"}", m->color, m->pressColor,
+                    m->fireMode == FIRE_ON_TAP ? "tap"
+                        : m->fireMode == FIRE_HOLD ? "hold" : "down");
+                _buttonIndex++;
+                _stage = W_BUTTON_BEGIN;
+                break;
+
+            case W_DONE:
+                break;
+        }
+    }
+
+public:
+    ProfileJsonWriter(ProfileGetter getter, void* context, int count)
+        : _getter(getter), _context(context), _count(count) {
+        reset();
+    }
+
+    void reset() {
+        _stage = W_HEADER;
+        _profileIndex = 0;
+        _buttonIndex = 0;
+        _cells = 0;
+        _current = nullptr;
+        _pendingLen = 0;
+        _pendingPos = 0;
+        _string = nullptr;
+        _written = 0;
+    }
+
+    bool done() const { return _stage == W_DONE && _pendingPos == _pendingLen && !_string; }
+    size_t written() const { return _written; }
+    int profilesWritten() const { return _profileIndex; }
+
+    // Fills up to `capacity` bytes; returns 0 once the document is complete
+    size_t read(char* out, size_t capacity) {
+        size_t n = 0;
+        while (n < capacity) {
+            if (_pendingPos == _pendingLen) {
+                _pendingLen = 0;
+                _pendingPos = 0;
+                if (_string) {
+                    escapeString();
+                } else if (_stage != W_DONE) {
+                    nextFragment();
+                } else {
+                    break;
+                }
+                continue;
+            }
+            size_t chunk = _pendingLen - _pendingPos;
+            if (chunk > capacity - n) chunk = capacity - n;
+            memcpy(out + n, _pending + _pendingPos, chunk);
+            _pendingPos += chunk;
+            n += chunk;
+        }
+        _written += n;
+        return n;
+    }
+};
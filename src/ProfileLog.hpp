@@ -0,0 +1,655 @@
+#pragma once
+
+// ==============================================================================
+// Profile Edit Log (crash-safe A/B storage)
+// ==============================================================================
+// Button edits are stored as small delta records on top of the base profiles
+// (bundle or built-ins), in their own "proflog" partition so that erasing NVS
+// (clearBLEBondingData) or re-flashing the bundle never touches them.
+//
+// The partition holds two slots, A and B. Each slot is
+//
+//   LogSlotHeader          generation, base identity, CRC
+//   LogRecord...           appended per edit: header + LogMacro + strings, CRC
+//   0xFF...                erased space
+//
+// Only the slot with a valid header and the highest generation is live. Edits
+// are appended to it; when it fills, the merged state (latest record per
+// button) is compacted into the other slot in the background, and the new
+// header is written last. A power cut therefore leaves either the old slot or
+// the complete new one live, and a torn append is detected by its CRC and
+// dropped on the next mount.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "Macros.hpp"
+#include "ProfileBundle.hpp"
+#include "ProfileStore.hpp"
+#include "FlashRegion.hpp"
+
+#define PROFILE_LOG_MAGIC           0x474F4C50  // "PLOG"
+#define PROFILE_LOG_VERSION         1
+#define PROFILE_LOG_RECORD_MAGIC    0x5244      // "DR"
+
+// Flash partition holding the log (see partitions.csv)
+#define PROFILE_LOG_PARTITION       "proflog"
+#define PROFILE_LOG_SUBTYPE         0x41
+
+// Edited buttons kept in RAM (and in a compacted slot)
+#ifndef PROFILE_LOG_MAX_OVERRIDES
+#define PROFILE_LOG_MAX_OVERRIDES   128
+#endif
+
+// label + sublabel + text of one edited button, NUL-terminated
+#ifndef PROFILE_LOG_STRING_BYTES
+#define PROFILE_LOG_STRING_BYTES    96
+#endif
+
+// Start compacting in the background once the live slot is this full
+#ifndef PROFILE_LOG_COMPACT_PERCENT
+#define PROFILE_LOG_COMPACT_PERCENT 75
+#endif
+
+// ==============================================================================
+// On-flash Records
+// ==============================================================================
+struct LogSlotHeader {
+    uint32_t magic;             // PROFILE_LOG_MAGIC
+    uint16_t version;
+    uint16_t headerSize;        // sizeof(LogSlotHeader)
+    uint32_t generation;        // Higher wins (wrap-aware)
+    uint32_t baseId;            // ProfileSource::identity() the edits apply to
+    uint32_t records;           // Records written by the compaction
+    uint32_t reserved[2];
+    uint32_t crc;               // CRC-32 of the fields above
+};
+
+enum LogRecordKind : uint8_t {
+    LOG_RECORD_SET = 1,         // Button replaced
+    LOG_RECORD_CLEAR = 2        // Button reverted to the base profile
+};
+
+struct LogRecordHeader {
+    uint16_t magic;             // PROFILE_LOG_RECORD_MAGIC; 0xFFFF = end of log
+    uint16_t length;            // Payload bytes (LogMacro + strings), 4-byte padded
+    uint16_t profile;
+    uint8_t button;
+    uint8_t kind;               // LogRecordKind
+    uint32_t crc;               // CRC-32 of the fields above and the payload
+};
+
+#define LOG_MACRO_HAS_TEXT 0x01
+
+struct LogMacro {
+    uint8_t type;
+    uint8_t modifiers;
+    uint8_t keyCount;
+    uint8_t fireMode;
+    uint8_t keys[6];
+    uint8_t flags;              // LOG_MACRO_HAS_TEXT
+    uint8_t reserved;
+    uint16_t color;
+    uint16_t pressColor;
+    // Followed by label\0 sublabel\0 [text\0]
+};
+
+static_assert(sizeof(LogSlotHeader) == 32, "LogSlotHeader layout changed");
+static_assert(sizeof(LogRecordHeader) == 12, "LogRecordHeader layout changed");
+static_assert(sizeof(LogMacro) == 16, "LogMacro layout changed");
+
+#define PROFILE_LOG_MAX_RECORD \
+    ((sizeof(LogRecordHeader) + sizeof(LogMacro) + PROFILE_LOG_STRING_BYTES + 3) & ~(size_t)3)
+
+// ==============================================================================
+// Statistics
+// ==============================================================================
+struct ProfileLogStats {
+    uint32_t edits;             // setButton()/clearButton() calls accepted
+    uint32_t logicalBytes;      // Size of those edits as records
+    uint32_t appends;           // Records appended to the live slot
+    uint32_t compactions;       // Completed slot switches
+    uint32_t compactionBytes;   // Bytes written by compactions
+    uint32_t tornRecords;       // Invalid log tails found at mount
+    uint32_t flashErrors;
+
+    ProfileLogStats() : edits(0), logicalBytes(0), appends(0), compactions(0),
+                        compactionBytes(0), tornRecords(0), flashErrors(0) {}
+};
+
+// ==============================================================================
+// Profile Log
+// ==============================================================================
+class ProfileLog {
+private:
+    // One edited button. editSeq counts edits; the entry is durable when the
+    // live slot holds the record for the latest one (flushedSeq == editSeq).
+    struct Override {
+        bool inUse;
+        bool cleared;           // Pending CLEAR record, freed once durable
+        bool compacted;         // Written (or skipped) by the running compaction
+        uint8_t button;
+        uint16_t profile;
+        uint16_t editSeq;
+        uint16_t flushedSeq;
+        uint16_t compactedSeq;
+        LogMacro macro;
+        uint8_t stringBytes;
+        char strings[PROFILE_LOG_STRING_BYTES];
+    };
+
+    enum CompactState : uint8_t {
+        COMPACT_IDLE,
+        COMPACT_ERASE,
+        COMPACT_COPY,
+        COMPACT_COMMIT
+    };
+
+    FlashRegion* _region;
+    size_t _slotSize;
+    int _active;                // Live slot, -1 while none is valid
+    uint32_t _generation;
+    uint32_t _baseId;
+    size_t _writeOffset;        // Append position in the live slot
+
+    Override _overrides[PROFILE_LOG_MAX_OVERRIDES];
+    uint32_t _changes;          // Bumped on every edit (cache invalidation)
+
+    CompactState _compact;
+    int _target;
+    size_t _compactOffset;
+    int _compactCursor;
+    uint32_t _compactRecords;
+
+    ProfileLogStats _stats;
+
+    size_t slotBase(int slot) const { return (size_t)slot * _slotSize; }
+
+    static uint32_t headerCrc(const LogSlotHeader& h) {
+        return bundleCrc32((const uint8_t*)&h, offsetof(LogSlotHeader, crc));
+    }
+
+    bool readHeader(int slot, LogSlotHeader& h) const {
+        if (!_region->read(slotBase(slot), &h, sizeof(h))) return false;
+        return h.magic == PROFILE_LOG_MAGIC && h.version == PROFILE_LOG_VERSION &&
+               h.headerSize == sizeof(LogSlotHeader) && h.crc == headerCrc(h);
+    }
+
+    // ---- Overrides --------------------------------------------------------
+
+    Override* find(int profile, int button) {
+        for (int i = 0; i < PROFILE_LOG_MAX_OVERRIDES; i++) {
+            Override& o = _overrides[i];
+            if (o.inUse && o.profile == profile && o.button == button) return &o;
+        }
+        return nullptr;
+    }
+
+    Override* findOrAllocate(int profile, int button) {
+        Override* o = find(profile, button);
+        if (o) return o;
+        for (int i = 0; i < PROFILE_LOG_MAX_OVERRIDES; i++) {
+            if (!_overrides[i].inUse) {
+                o = &_overrides[i];
+                memset(o, 0, sizeof(*o));
+                o->inUse = true;
+                o->profile = (uint16_t)profile;
+                o->button = (uint8_t)button;
+                return o;
+            }
+        }
+        return nullptr;
+    }
+
+    static bool isDirty(const Override& o) { return o.editSeq != o.flushedSeq; }
+
+    // Packs a macro into an override; false if its strings do not fit
+    static bool pack(Override& o, const Macro& m) {
+        const char* strs[3] = {m.label ? m.label : "", m.sublabel ? m.sublabel : "", m.text};
+        size_t total = 0;
+        for (int i = 0; i < 3; i++) {
+            if (strs[i]) total += strlen(strs[i]) + 1;
+        }
+        if (total > PROFILE_LOG_STRING_BYTES) return false;
+
+        memset(&o.macro, 0, sizeof(o.macro));
+        o.macro.type = (uint8_t)m.type;
+        o.macro.modifiers = m.modifiers;
+        o.macro.keyCount = m.keyCount;
+        o.macro.fireMode = (uint8_t)m.fireMode;
+        memcpy(o.macro.keys, m.keys, sizeof(o.macro.keys));
+        o.macro.flags = m.text ? LOG_MACRO_HAS_TEXT : 0;
+        o.macro.color = m.color;
+        o.macro.pressColor = m.pressColor;
+
+        size_t pos = 0;
+        for (int i = 0; i < 3; i++) {
+            if (!strs[i]) continue;
+            size_t len = strlen(strs[i]) + 1;
+            memcpy(o.strings + pos, strs[i], len);
+            pos += len;
+        }
+        o.stringBytes = (uint8_t)pos;
+        return true;
+    }
+
+    static void unpack(const Override& o, Macro& m) {
+        m.type = (MacroType)o.macro.type;
+        m.modifiers = o.macro.modifiers;
+        m.keyCount = o.macro.keyCount;
+        m.fireMode = (FireMode)o.macro.fireMode;
+        memcpy(m.keys, o.macro.keys, sizeof(m.keys));
+        m.color = o.macro.color;
+        m.pressColor = o.macro.pressColor;
+        m.label = o.strings;
+        m.sublabel = m.label + strlen(m.label) + 1;
+        m.text = (o.macro.flags & LOG_MACRO_HAS_TEXT) ? m.sublabel + strlen(m.sublabel) + 1
+                                                      : nullptr;
+    }
+
+    // ---- Records ----------------------------------------------------------
+
+    static size_t recordSize(const Override& o) {
+        size_t payload = o.cleared ? 0 : sizeof(LogMacro) + o.stringBytes;
+        return sizeof(LogRecordHeader) + ((payload + 3) & ~(size_t)3);
+    }
+
+    // Serializes the record for `o` into `buf`; returns its size
+    static size_t encode(const Override& o, uint8_t* buf) {
+        size_t size = recordSize(o);
+        memset(buf, 0, size);
+
+        LogRecordHeader h;
+        h.magic = PROFILE_LOG_RECORD_MAGIC;
+        h.length = (uint16_t)(size - sizeof(LogRecordHeader));
+        h.profile = o.profile;
+        h.button = o.button;
+        h.kind = o.cleared ? LOG_RECORD_CLEAR : LOG_RECORD_SET;
+        h.crc = 0;
+
+        if (!o.cleared) {
+            memcpy(buf + sizeof(h), &o.macro, sizeof(LogMacro));
+            memcpy(buf + sizeof(h) + sizeof(LogMacro), o.strings, o.stringBytes);
+        }
+        uint32_t crc = bundleCrc32((const uint8_t*)&h, offsetof(LogRecordHeader, crc));
+        h.crc = bundleCrc32(buf + sizeof(h), h.length, crc);
+        memcpy(buf, &h, sizeof(h));
+        return size;
+    }
+
+    // Reads and applies the record at `offset` of the live slot; returns its
+    // size, 0 at the end of the log, -1 for a torn or corrupt record
+    long replayRecord(size_t offset) {
+        LogRecordHeader h;
+        if (offset + sizeof(h) > _slotSize) return 0;
+        if (!_region->read(slotBase(_active) + offset, &h, sizeof(h))) return -1;
+        if (h.magic == 0xFFFF && h.length == 0xFFFF) return 0;
+
+        if (h.magic != PROFILE_LOG_RECORD_MAGIC || h.length > PROFILE_LOG_MAX_RECORD ||
+            (h.length & 3) || offset + sizeof(h) + h.length > _slotSize ||
+            h.button >= BUTTON_COUNT) {
+            return -1;
+        }
+
+        uint8_t payload[PROFILE_LOG_MAX_RECORD];
+        if (!_region->read(slotBase(_active) + offset + sizeof(h), payload, h.length)) return -1;
+        uint32_t crc = bundleCrc32((const uint8_t*)&h, offsetof(LogRecordHeader, crc));
+        if (bundleCrc32(payload, h.length, crc) != h.crc) return -1;
+
+        if (h.kind == LOG_RECORD_CLEAR) {
+            Override* o = find(h.profile, h.button);
+            if (o) o->inUse = false;
+        } else if (h.kind == LOG_RECORD_SET) {
+            if (h.length < sizeof(LogMacro)) return -1;
+            Override* o = findOrAllocate(h.profile, h.button);
+            if (o == nullptr) return -1;
+            memcpy(&o->macro, payload, sizeof(LogMacro));
+            size_t strBytes = h.length - sizeof(LogMacro);
+            if (strBytes > PROFILE_LOG_STRING_BYTES) strBytes = PROFILE_LOG_STRING_BYTES;
+            memcpy(o->strings, payload + sizeof(LogMacro), strBytes);
+            o->strings[PROFILE_LOG_STRING_BYTES - 1] = '\0';
+            o->stringBytes = (uint8_t)strBytes;
+        } else {
+            return -1;
+        }
+        return (long)(sizeof(h) + h.length);
+    }
+
+    bool append(Override& o) {
+        uint8_t buf[PROFILE_LOG_MAX_RECORD];
+        size_t size = encode(o, buf);
+        if (_writeOffset + size > _slotSize) return false;
+
+        uint16_t seq = o.editSeq;
+        if (!_region->write(slotBase(_active) + _writeOffset, buf, size)) {
+            // Whatever landed is garbage now: move on to a fresh slot
+            _stats.flashErrors++;
+            _writeOffset = _slotSize;
+            return false;
+        }
+        _writeOffset += size;
+        _stats.appends++;
+        o.flushedSeq = seq;
+        if (o.cleared) o.inUse = false;
+        return true;
+    }
+
+    // Appends every pending edit; compaction takes over when the slot is full
+    void flush() {
+        if (_compact != COMPACT_IDLE) return;
+        if (_active < 0) {
+            startCompaction();
+            return;
+        }
+        for (int i = 0; i < PROFILE_LOG_MAX_OVERRIDES; i++) {
+            Override& o = _overrides[i];
+            if (!o.inUse || !isDirty(o)) continue;
+            if (!append(o)) {
+                startCompaction();
+                return;
+            }
+        }
+        if (_writeOffset * 100 >= _slotSize * PROFILE_LOG_COMPACT_PERCENT) {
+            startCompaction();
+        }
+    }
+
+    // ---- Compaction -------------------------------------------------------
+
+    void startCompaction() {
+        if (_compact != COMPACT_IDLE) return;
+        _target = _active < 0 ? 0 : 1 - _active;
+        if (_active < 0) {
+            // Don't overwrite the newest stale slot first; it may be the only
+            // copy if the base comes back (e.g. a failed import)
+            LogSlotHeader h0, h1;
+            bool v0 = readHeader(0, h0);
+            bool v1 = readHeader(1, h1);
+            if (v0 && (!v1 || (int32_t)(h0.generation - h1.generation) > 0)) _target = 1;
+        }
+        _compactOffset = 0;
+        _compactCursor = 0;
+        _compactRecords = 0;
+        for (int i = 0; i < PROFILE_LOG_MAX_OVERRIDES; i++) {
+            _overrides[i].compacted = false;
+        }
+        _compact = COMPACT_ERASE;
+    }
+
+    void abortCompaction() {
+        _stats.flashErrors++;
+        _compact = COMPACT_IDLE;
+    }
+
+    void commitCompaction() {
+        LogSlotHeader h;
+        memset(&h, 0, sizeof(h));
+        h.magic = PROFILE_LOG_MAGIC;
+        h.version = PROFILE_LOG_VERSION;
+        h.headerSize = sizeof(LogSlotHeader);
+        h.generation = _generation + 1;
+        h.baseId = _baseId;
+        h.records = _compactRecords;
+        h.crc = headerCrc(h);
+
+        // The switch: until these bytes land, the old slot stays live
+        if (!_region->write(slotBase(_target), &h, sizeof(h))) {
+            abortCompaction();
+            return;
+        }
+
+        _active = _target;
+        _generation = h.generation;
+        _writeOffset = _compactOffset;
+        _compact = COMPACT_IDLE;
+        _stats.compactions++;
+
+        for (int i = 0; i < PROFILE_LOG_MAX_OVERRIDES; i++) {
+            Override& o = _overrides[i];
+            if (!o.inUse || !o.compacted) continue;
+            o.flushedSeq = o.compactedSeq;
+            if (o.cleared && !isDirty(o)) o.inUse = false;
+        }
+
+        // Edits made while compacting; a nearly full result is not re-compacted
+        for (int i = 0; i < PROFILE_LOG_MAX_OVERRIDES; i++) {
+            Override& o = _overrides[i];
+            if (o.inUse && isDirty(o) && !append(o)) break;
+        }
+    }
+
+    void stepCompaction() {
+        switch (_compact) {
+            case COMPACT_IDLE:
+                break;
+
+            case COMPACT_ERASE:
+                if (!_region->erase(slotBase(_target) + _compactOffset, FLASH_SECTOR_SIZE)) {
+                    abortCompaction();
+                    break;
+                }
+                _compactOffset += FLASH_SECTOR_SIZE;
+                if (_compactOffset >= _slotSize) {
+                    _compactOffset = sizeof(LogSlotHeader);
+                    _compact = COMPACT_COPY;
+                }
+                break;
+
+            case COMPACT_COPY: {
+                // One live entry per step
+                while (_compactCursor < PROFILE_LOG_MAX_OVERRIDES) {
+                    Override& o = _overrides[_compactCursor++];
+                    if (!o.inUse) continue;
+                    o.compacted = true;
+                    o.compactedSeq = o.editSeq;
+                    if (o.cleared) continue;
+
+                    uint8_t buf[PROFILE_LOG_MAX_RECORD];
+                    size_t size = encode(o, buf);
+                    if (_compactOffset + size > _slotSize ||
+                        !_region->write(slotBase(_target) + _compactOffset, buf, size)) {
+                        abortCompaction();
+                        return;
+                    }
+                    _compactOffset += size;
+                    _compactRecords++;
+                    _stats.compactionBytes += size;
+                    return;
+                }
+                _compact = COMPACT_COMMIT;
+                break;
+            }
+
+            case COMPACT_COMMIT:
+                commitCompaction();
+                break;
+        }
+    }
+
+public:
+    explicit ProfileLog(FlashRegion* region)
+        : _region(region), _slotSize(0), _active(-1), _generation(0), _baseId(0),
+          _writeOffset(0), _changes(0), _compact(COMPACT_IDLE), _target(0),
+          _compactOffset(0), _compactCursor(0), _compactRecords(0) {
+        memset(_overrides, 0, sizeof(_overrides));
+    }
+
+    // Loads the live slot's edits for the given base profiles. A log written
+    // for a different base is ignored (and replaced in the background).
+    bool mount(uint32_t baseId) {
+        _slotSize = (_region->size() / 2) & ~(size_t)(FLASH_SECTOR_SIZE - 1);
+        if (_slotSize < FLASH_SECTOR_SIZE) return false;
+
+        memset(_overrides, 0, sizeof(_overrides));
+        _compact = COMPACT_IDLE;
+        _baseId = baseId;
+        _active = -1;
+        _generation = 0;
+        _writeOffset = 0;
+        _changes++;
+
+        LogSlotHeader h[2];
+        bool valid[2] = {readHeader(0, h[0]), readHeader(1, h[1])};
+        int newest = -1;
+        for (int s = 0; s < 2; s++) {
+            if (!valid[s]) continue;
+            if (newest < 0 || (int32_t)(h[s].generation - h[newest].generation) > 0) newest = s;
+        }
+        if (newest >= 0) _generation = h[newest].generation;
+        if (newest < 0 || h[newest].baseId != baseId) {
+            startCompaction();
+            return true;
+        }
+
+        _active = newest;
+        size_t offset = sizeof(LogSlotHeader);
+        long size;
+        while ((size = replayRecord(offset)) > 0) {
+            offset += (size_t)size;
+        }
+        _writeOffset = offset;
+
+        if (size < 0) {
+            // Torn tail: its bytes can't be rewritten in place, so carry the
+            // good records over to the other slot before the next append
+            _stats.tornRecords++;
+            _writeOffset = _slotSize;
+            startCompaction();
+        }
+        return true;
+    }
+
+    // Replaces one button of a profile; persisted by the next flush/service()
+    bool setButton(int profile, int button, const Macro& macro) {
+        if (profile < 0 || profile > 0xFFFF || button < 0 || button >= BUTTON_COUNT ||
+            !isValidMacro(macro)) {
+            return false;
+        }
+        bool existed = find(profile, button) != nullptr;
+        Override* o = findOrAllocate(profile, button);
+        if (o == nullptr) return false;
+
+        Override packed = *o;
+        if (!pack(packed, macro)) {
+            if (!existed) o->inUse = false;
+            return false;
+        }
+        packed.cleared = false;
+        packed.editSeq++;
+        *o = packed;
+        recordEdit(*o);
+        return true;
+    }
+
+    // Reverts one button to the base profile
+    bool clearButton(int profile, int button) {
+        Override* o = find(profile, button);
+        if (o == nullptr || o->cleared) return false;
+        o->cleared = true;
+        o->editSeq++;
+        recordEdit(*o);
+        return true;
+    }
+
+    // Overlays the edits for `profile` onto its decoded base
+    void apply(int profile, Profile& p) const {
+        for (int i = 0; i < PROFILE_LOG_MAX_OVERRIDES; i++) {
+            const Override& o = _overrides[i];
+            if (o.inUse && !o.cleared && o.profile == profile) {
+                unpack(o, p.buttons[o.button]);
+            }
+        }
+    }
+
+    bool hasEdits(int profile) const {
+        for (int i = 0; i < PROFILE_LOG_MAX_OVERRIDES; i++) {
+            const Override& o = _overrides[i];
+            if (o.inUse && !o.cleared && o.profile == profile) return true;
+        }
+        return false;
+    }
+
+    // Advances a background compaction by one sector or record; call from loop()
+    void service() {
+        if (_compact != COMPACT_IDLE) {
+            stepCompaction();
+        } else {
+            flush();
+        }
+    }
+
+    // Runs compaction/flush to completion (host tools, shutdown)
+    void sync() {
+        for (int guard = 0; guard < 100000; guard++) {
+            service();
+            if (_compact == COMPACT_IDLE && isDurable()) return;
+        }
+    }
+
+    bool isDurable() const {
+        if (_active < 0) return false;
+        for (int i = 0; i < PROFILE_LOG_MAX_OVERRIDES; i++) {
+            if (_overrides[i].inUse && isDirty(_overrides[i])) return false;
+        }
+        return true;
+    }
+
+    bool isCompacting() const { return _compact != COMPACT_IDLE; }
+    int activeSlot() const { return _active; }
+    uint32_t generation() const { return _generation; }
+    size_t used() const { return _writeOffset; }
+    size_t slotSize() const { return _slotSize; }
+    uint32_t changes() const { return _changes; }
+    const ProfileLogStats& stats() const { return _stats; }
+
+    int editCount() const {
+        int n = 0;
+        for (int i = 0; i < PROFILE_LOG_MAX_OVERRIDES; i++) {
+            if (_overrides[i].inUse && !_overrides[i].cleared) n++;
+        }
+        return n;
+    }
+
+private:
+    void recordEdit(const Override& o) {
+        _changes++;
+        _stats.edits++;
+        _stats.logicalBytes += recordSize(o);
+        flush();
+    }
+};
+
+// ==============================================================================
+// Logged Profile Source
+// ==============================================================================
+// Base profiles with the log's edits applied on load.
+class LoggedProfileSource : public ProfileSource {
+private:
+    const ProfileSource* _base;
+    const ProfileLog* _log;
+
+public:
+    LoggedProfileSource() : _base(nullptr), _log(nullptr) {}
+
+    void attach(const ProfileSource* base, const ProfileLog* log) {
+        _base = base;
+        _log = log;
+    }
+
+    const ProfileSource* base() const { return _base; }
+
+    int count() const override { return _base ? _base->count() : 0; }
+    const char* name() const override { return _base ? _base->name() : "none"; }
+    uint32_t identity() const override { return _base ? _base->identity() : 0; }
+
+    bool load(int index, Profile& out) const override {
+        if (!_base || !_base->load(index, out)) return false;
+        _log->apply(index, out);
+        return true;
+    }
+
+    const Profile* resident(int index) const override {
+        if (!_base || _log->hasEdits(index)) return nullptr;
+        return _base->resident(index);
+    }
+};
@@ -0,0 +1,281 @@
+#pragma once
+
+// ==============================================================================
+// Profile Store
+// ==============================================================================
+// Profiles are decoded on demand from a ProfileSource into a small LRU cache
+// (PSRAM on the device), so RAM use no longer grows with the number of
+// stored profiles. After every switch the previous and next profiles are
+// queued for prefetch; service() decodes one of them per loop() pass, so a
+// swipe normally lands on a cache hit.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include "Macros.hpp"
+#include "ProfileBundle.hpp"
+#include "Clock.hpp"
+
+// Decoded profiles kept in RAM: current, both neighbours and one spare
+#ifndef PROFILE_CACHE_SLOTS
+#define PROFILE_CACHE_SLOTS 4
+#endif
+
+static_assert(PROFILE_CACHE_SLOTS >= 3, "Cache must hold the current profile and its neighbours");
+
+// ==============================================================================
+// Profile Sources
+// ==============================================================================
+class ProfileSource {
+public:
+    virtual ~ProfileSource() {}
+    virtual int count() const = 0;
+    virtual const char* name() const = 0;
+
+    // Changes whenever the stored profiles change (edits are keyed to it)
+    virtual uint32_t identity() const = 0;
+
+    // Decodes profile `index` into `out`; strings may point into the source
+    virtual bool load(int index, Profile& out) const = 0;
+
+    // Profiles that are already addressable as Profile structs (flash tables)
+    // bypass the cache
+    virtual const Profile* resident(int) const { return nullptr; }
+};
+
+// Built-in constexpr tables, read straight from flash
+class BuiltinProfileSource : public ProfileSource {
+public:
+    int count() const override { return PROFILE_COUNT; }
+    const char* name() const override { return "built-in"; }
+
+    // CRC over the tables' content, so a firmware with different built-ins
+    // does not inherit edits made to the old ones
+    uint32_t identity() const override {
+        uint32_t crc = 0;
+        for (int i = 0; i < PROFILE_COUNT; i++) {
+            const Profile& p = BUILTIN_PROFILES[i];
+            crc = bundleCrc32((const uint8_t*)p.name, strlen(p.name), crc);
+            crc = bundleCrc32(&p.gridRows, 1, crc);
+            crc = bundleCrc32(&p.gridCols, 1, crc);
+            for (int b = 0; b < p.gridRows * p.gridCols; b++) {
+                const Macro& m = p.buttons[b];
+                uint8_t fields[4] = {(uint8_t)m.type, m.modifiers, m.keyCount, (uint8_t)m.fireMode};
+                crc = bundleCrc32(fields, sizeof(fields), crc);
+                crc = bundleCrc32(m.keys, sizeof(m.keys), crc);
+                crc = bundleCrc32((const uint8_t*)m.label, strlen(m.label), crc);
+            }
+        }
+        return crc;
+    }
+
+    bool load(int index, Profile& out) const override {
+        if (index < 0 || index >= PROFILE_COUNT) return false;
+        out = BUILTIN_PROFILES[index];
+        return true;
+    }
+
+    const Profile* resident(int index) const override {
+        return (index >= 0 && index < PROFILE_COUNT) ? &BUILTIN_PROFILES[index] : nullptr;
+    }
+};
+
+// Profile bundle mapped from flash; strings stay in the mapping
+class BundleProfileSource : public ProfileSource {
+private:
+    const ProfileBundleView* _view;
+
+public:
+    BundleProfileSource() : _view(nullptr) {}
+
+    void attach(const ProfileBundleView* view) { _view = view; }
+    void detach() { _view = nullptr; }
+
+    int count() const override {
+        return (_view && _view->isOpen()) ? (int)_view->profileCount() : 0;
+    }
+
+    const char* name() const override { return "bundle"; }
+    uint32_t identity() const override { return _view ? _view->crc() : 0; }
+
+    bool load(int index, Profile& out) const override {
+        if (index < 0 || index >= count()) return false;
+        out = Profile();
+        _view->decodeProfile((uint32_t)index, out);
+        return true;
+    }
+};
+
+// ==============================================================================
+// Store Statistics
+// ==============================================================================
+struct ProfileStoreStats {
+    uint32_t hits;              // get() served from the cache (or a resident table)
+    uint32_t misses;            // get() had to decode synchronously
+    uint32_t prefetches;        // Profiles decoded ahead of time by service()
+    uint32_t evictions;
+    uint32_t loads;             // All decodes (misses + prefetches)
+    uint32_t totalLoadUs;
+    uint32_t maxLoadUs;
+
+    ProfileStoreStats() : hits(0), misses(0), prefetches(0), evictions(0), loads(0),
+                          totalLoadUs(0), maxLoadUs(0) {}
+};
+
+// ==============================================================================
+// Profile Store (LRU cache over a source)
+// ==============================================================================
+class ProfileStore {
+private:
+    const ProfileSource* _source;
+    Profile* _slots;
+    int _slotIndex[PROFILE_CACHE_SLOTS];    // Profile held by each slot, -1 if free
+    uint32_t _slotUse[PROFILE_CACHE_SLOTS]; // LRU clock value of the last access
+    uint32_t _clock;
+    int _pinned;                            // Slot returned by the last get()
+    int _prefetch[2];                       // Queued neighbour indices, -1 if none
+    ProfileStoreStats _stats;
+
+    int findSlot(int index) const {
+        for (int s = 0; s < PROFILE_CACHE_SLOTS; s++) {
+            if (_slotIndex[s] == index) return s;
+        }
+        return -1;
+    }
+
+    // Free slot, else the least recently used one that is not pinned
+    int victimSlot() const {
+        int victim = -1;
+        for (int s = 0; s < PROFILE_CACHE_SLOTS; s++) {
+            if (s == _pinned) continue;
+            if (_slotIndex[s] < 0) return s;
+            if (victim < 0 || _slotUse[s] < _slotUse[victim]) victim = s;
+        }
+        return victim;
+    }
+
+    int loadIntoCache(int index) {
+        int slot = victimSlot();
+        if (_slotIndex[slot] >= 0) _stats.evictions++;
+        _slotIndex[slot] = -1;
+
+        uint32_t start = clockMicros();
+        if (!_source->load(index, _slots[slot])) return -1;
+        uint32_t elapsed = clockMicros() - start;
+
+        _slotIndex[slot] = index;
+        _stats.loads++;
+        _stats.totalLoadUs += elapsed;
+        if (elapsed > _stats.maxLoadUs) _stats.maxLoadUs = elapsed;
+        return slot;
+    }
+
+public:
+    ProfileStore() : _source(nullptr), _slots(nullptr), _clock(0), _pinned(-1) {
+        _prefetch[0] = _prefetch[1] = -1;
+        for (int s = 0; s < PROFILE_CACHE_SLOTS; s++) {
+            _slotIndex[s] = -1;
+            _slotUse[s] = 0;
+        }
+    }
+
+    ~ProfileStore() {
+        free(_slots);
+    }
+
+    ProfileStore(const ProfileStore&) = delete;
+    ProfileStore& operator=(const ProfileStore&) = delete;
+
+    // Allocates the cache (PSRAM when available); false if out of memory
+    bool begin(const ProfileSource* source) {
+        if (_slots == nullptr) {
+#ifdef ARDUINO
+            _slots = (Profile*)ps_malloc(sizeof(Profile) * PROFILE_CACHE_SLOTS);
+            if (_slots == nullptr) {
+                _slots = (Profile*)malloc(sizeof(Profile) * PROFILE_CACHE_SLOTS);
+            }
+#else
+            _slots = (Profile*)malloc(sizeof(Profile) * PROFILE_CACHE_SLOTS);
+#endif
+            if (_slots == nullptr) return false;
+            for (int s = 0; s < PROFILE_CACHE_SLOTS; s++) {
+                new (&_slots[s]) Profile();
+            }
+        }
+        setSource(source);
+        return true;
+    }
+
+    // Switches the backing storage; every cached profile is dropped
+    void setSource(const ProfileSource* source) {
+        _source = source;
+        invalidate();
+    }
+
+    void invalidate() {
+        for (int s = 0; s < PROFILE_CACHE_SLOTS; s++) {
+            _slotIndex[s] = -1;
+        }
+        _pinned = -1;
+        _prefetch[0] = _prefetch[1] = -1;
+    }
+
+    const ProfileSource* source() const { return _source; }
+    int count() const { return _source ? _source->count() : 0; }
+    const ProfileStoreStats& stats() const { return _stats; }
+
+    // Returns profile `index`; the reference stays valid until the next get()
+    // (the most recently returned profile is never evicted by prefetching).
+    // Out-of-range indices and load failures return a default empty profile.
+    const Profile& get(int index) {
+        static const Profile empty;
+        if (_source == nullptr || index < 0 || index >= _source->count()) return empty;
+
+        const Profile* resident = _source->resident(index);
+        if (resident) {
+            _stats.hits++;
+            _pinned = -1;
+            return *resident;
+        }
+
+        int slot = findSlot(index);
+        if (slot >= 0) {
+            _stats.hits++;
+        } else {
+            _stats.misses++;
+            slot = loadIntoCache(index);
+            if (slot < 0) return empty;
+        }
+
+        _slotUse[slot] = ++_clock;
+        _pinned = slot;
+        return _slots[slot];
+    }
+
+    // Queue the neighbours of `index` (with wrap-around) for prefetch
+    void prefetchAround(int index) {
+        int n = count();
+        if (n <= 1) return;
+        _prefetch[0] = (index + 1) % n;
+        _prefetch[1] = (index - 1 + n) % n;
+    }
+
+    // Decodes at most one queued profile; call once per loop()
+    void service() {
+        for (int i = 0; i < 2; i++) {
+            int index = _prefetch[i];
+            if (index < 0) continue;
+            _prefetch[i] = -1;
+
+            if (_source->resident(index) || findSlot(index) >= 0) continue;
+            int slot = loadIntoCache(index);
+            if (slot >= 0) {
+                _stats.prefetches++;
+                // Older than the profile on screen, newer than earlier views
+                _slotUse[slot] = _clock - 1;
+            }
+            return;
+        }
+    }
+};
@@ -0,0 +1,246 @@
+#pragma once
+
+// ==============================================================================
+// Profile Import/Export Jobs
+// ==============================================================================
+// Incremental LittleFS <-> profile transfers, driven from loop(): every poll()
+// moves at most PROFILE_TRANSFER_CHUNK bytes (or erases one flash sector), so
+// touch and BLE keep being serviced while a large profile set streams through.
+//
+//   import: /import.json -> ProfileJsonReader -> ProfileBundleBuilder -> bundle
+//   flash:  bundle -> "profiles" partition (one sector / chunk per poll)
+//   export: ProfileSource -> ProfileJsonWriter -> /profiles.json
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <esp_partition.h>
+#include <vector>
+#include "ProfileJson.hpp"
+#include "ProfileBundle.hpp"
+#include "ProfileStore.hpp"
+#include "Clock.hpp"
+
+#define PROFILE_IMPORT_PATH     "/import.json"
+#define PROFILE_EXPORT_PATH     "/profiles.json"
+
+// Bytes read, written or flashed per poll()
+#ifndef PROFILE_TRANSFER_CHUNK
+#define PROFILE_TRANSFER_CHUNK  512
+#endif
+
+#define PROFILE_FLASH_SECTOR    4096
+
+enum TransferState : uint8_t {
+    TRANSFER_IDLE = 0,
+    TRANSFER_RUNNING,
+    TRANSFER_DONE,
+    TRANSFER_FAILED
+};
+
+// ==============================================================================
+// Import: JSON file -> bundle image in RAM
+// ==============================================================================
+class ProfileImportJob {
+private:
+    File _file;
+    ProfileJsonReader _reader;
+    ProfileBundleBuilder _builder;
+    std::vector<uint8_t> _bundle;
+    TransferState _state;
+    uint32_t _startTime;
+    uint32_t _polls;
+
+    static bool addToBundle(const Profile& profile, void* context) {
+        static_cast<ProfileImportJob*>(context)->_builder.addProfile(profile);
+        return true;
+    }
+
+    void fail() {
+        Serial.printf("Import: failed at byte %u: %s\n",
+            (unsigned)_reader.offset(), _reader.errorMessage());
+        _file.close();
+        _builder = ProfileBundleBuilder();
+        _state = TRANSFER_FAILED;
+    }
+
+public:
+    ProfileImportJob() : _reader(addToBundle, this), _state(TRANSFER_IDLE),
+                         _startTime(0), _polls(0) {}
+
+    bool begin(const char* path = PROFILE_IMPORT_PATH) {
+        if (_state == TRANSFER_RUNNING) return false;
+        _file = LittleFS.open(path, "r");
+        if (!_file) return false;
+
+        _reader.reset();
+        _builder = ProfileBundleBuilder();
+        _bundle.clear();
+        _state = TRANSFER_RUNNING;
+        _startTime = clockMillis();
+        _polls = 0;
+        Serial.printf("Import: %s (%u bytes)\n", path, (unsigned)_file.size());
+        return true;
+    }
+
+    TransferState state() const { return _state; }
+    bool isRunning() const { return _state == TRANSFER_RUNNING; }
+
+    // Finished bundle; valid once state() is TRANSFER_DONE
+    const std::vector<uint8_t>& bundle() const { return _bundle; }
+
+    // Releases the bundle image after it has been flashed
+    void clear() {
+        std::vector<uint8_t>().swap(_bundle);
+        _state = TRANSFER_IDLE;
+    }
+
+    void poll() {
+        if (_state != TRANSFER_RUNNING) return;
+        _polls++;
+
+        char chunk[PROFILE_TRANSFER_CHUNK];
+        int n = _file.read((uint8_t*)chunk, sizeof(chunk));
+        if (n > 0) {
+            if (_reader.feed(chunk, (size_t)n) != JSON_OK) fail();
+            return;
+        }
+
+        _file.close();
+        if (_reader.finish() != JSON_OK || _builder.profileCount() == 0) {
+            fail();
+            return;
+        }
+
+        _bundle = _builder.build();
+        _builder = ProfileBundleBuilder();
+        _state = TRANSFER_DONE;
+        Serial.printf("Import: %u profiles -> %u byte bundle in %lu ms over %lu polls, "
+                      "arena peak %u/%u bytes\n",
+            (unsigned)_reader.profilesRead(), (unsigned)_bundle.size(),
+            clockMillis() - _startTime, (unsigned long)_polls,
+            (unsigned)_reader.arenaPeak(), (unsigned)PROFILE_JSON_ARENA_SIZE);
+    }
+};
+
+// ==============================================================================
+// Flash: bundle image -> "profiles" partition
+// ==============================================================================
+// The caller must unmap the partition (and stop using profiles decoded from
+// it) before begin(), and remap it once the job is done.
+class BundleFlashJob {
+private:
+    const esp_partition_t* _partition;
+    const uint8_t* _data;
+    size_t _size;
+    size_t _eraseEnd;
+    size_t _erased;
+    size_t _written;
+    TransferState _state;
+
+public:
+    BundleFlashJob() : _partition(nullptr), _data(nullptr), _size(0), _eraseEnd(0),
+                       _erased(0), _written(0), _state(TRANSFER_IDLE) {}
+
+    bool begin(const uint8_t* data, size_t size) {
+        _partition = esp_partition_find_first(
+            ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)PROFILE_BUNDLE_SUBTYPE,
+            PROFILE_BUNDLE_PARTITION);
+        if (_partition == nullptr || size > _partition->size) {
+            Serial.println("Flash: no room for bundle in profiles partition");
+            _state = TRANSFER_FAILED;
+            return false;
+        }
+        _data = data;
+        _size = size;
+        _eraseEnd = (size + PROFILE_FLASH_SECTOR - 1) & ~(size_t)(PROFILE_FLASH_SECTOR - 1);
+        _erased = 0;
+        _written = 0;
+        _state = TRANSFER_RUNNING;
+        return true;
+    }
+
+    TransferState state() const { return _state; }
+    bool isRunning() const { return _state == TRANSFER_RUNNING; }
+
+    void poll() {
+        if (_state != TRANSFER_RUNNING) return;
+
+        esp_err_t err;
+        if (_erased < _eraseEnd) {
+            err = esp_partition_erase_range(_partition, _erased, PROFILE_FLASH_SECTOR);
+            _erased += PROFILE_FLASH_SECTOR;
+        } else if (_written < _size) {
+            size_t n = _size - _written;
+            if (n > PROFILE_TRANSFER_CHUNK) n = PROFILE_TRANSFER_CHUNK;
+            err = esp_partition_write(_partition, _written, _data + _written, n);
+            _written += n;
+        } else {
+            _state = TRANSFER_DONE;
+            Serial.printf("Flash: wrote %u byte bundle\n", (unsigned)_size);
+            return;
+        }
+
+        if (err != ESP_OK) {
+            Serial.printf("Flash: failed at %u: %s\n", (unsigned)_written, esp_err_to_name(err));
+            _state = TRANSFER_FAILED;
+        }
+    }
+};
+
+// ==============================================================================
+// Export: profiles -> JSON file
+// ==============================================================================
+class ProfileExportJob {
+private:
+    File _file;
+    const ProfileSource* _source;
+    Profile _profile;           // Decoded one at a time, bypassing the UI cache
+    ProfileJsonWriter _writer;
+    TransferState _state;
+    uint32_t _startTime;
+
+    static const Profile* profileAt(int index, void* context) {
+        ProfileExportJob* job = static_cast<ProfileExportJob*>(context);
+        return job->_source->load(index, job->_profile) ? &job->_profile : nullptr;
+    }
+
+public:
+    ProfileExportJob() : _source(nullptr), _writer(profileAt, this, 0),
+                         _state(TRANSFER_IDLE), _startTime(0) {}
+
+    // `source` must stay valid until the job is done
+    bool begin(const ProfileSource* source, const char* path = PROFILE_EXPORT_PATH) {
+        if (_state == TRANSFER_RUNNING) return false;
+        _file = LittleFS.open(path, "w");
+        if (!_file) return false;
+
+        _source = source;
+        _writer = ProfileJsonWriter(profileAt, this, source->count());
+        _state = TRANSFER_RUNNING;
+        _startTime = clockMillis();
+        return true;
+    }
+
+    TransferState state() const { return _state; }
+    bool isRunning() const { return _state == TRANSFER_RUNNING; }
+
+    void poll() {
+        if (_state != TRANSFER_RUNNING) return;
+
+        char chunk[PROFILE_TRANSFER_CHUNK];
+        size_t n = _writer.read(chunk, sizeof(chunk));
+        if (n > 0) {
+            if (_file.write((const uint8_t*)chunk, n) != n) {
+                Serial.println("Export: write failed (filesystem full?)");
+                _file.close();
+                _state = TRANSFER_FAILED;
+            }
+            return;
+        }
+
+        _file.close();
+        _state = TRANSFER_DONE;
+        Serial.printf("Export: %d profiles, %u bytes in %lu ms\n",
+            _writer.profilesWritten(), (unsigned)_writer.written(), clockMillis() - _startTime);
+    }
+};
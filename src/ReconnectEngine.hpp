@@ -0,0 +1,325 @@
+#pragma once
+
+// ==============================================================================
+// BLE Reconnect Engine
+// ==============================================================================
+// Brings a bonded host back as fast as the radio allows after boot or link
+// loss, instead of waiting for it to notice generic advertising:
+//
+//   DIRECTED  high-duty directed advertising to the last bonded host
+//             (1.28 s, the limit the spec allows for one burst)
+//   FAST      undirected, 20-30 ms interval, for RECONNECT_FAST_MS
+//   SLOW      undirected, ~1 s interval, until someone connects
+//
+// Without a remembered host the engine starts at FAST. While switching hosts
+// (HostSlots.hpp) the undirected phases can be made exclusive: only the
+// target may connect, so the host just left cannot take the link back.
+//
+// The engine follows the link through BleLinkState (service() is given the
+// current state every pass), so it needs no events of its own, and it drives
+// the radio only through AdvertisingGap, so it runs on the host
+// (host/reconnect_sim.cpp).
+//
+// Macros fired while the link is not ready are held in PendingKeystrokes and
+// replayed once it is, unless they are older than RECONNECT_KEY_MAX_AGE_MS:
+// a shortcut that arrives seconds after the press does more harm than good.
+
+#include <stdint.h>
+#include <string.h>
+#include "BleLinkState.hpp"
+
+// Length of the directed burst (high duty cycle is capped at 1.28 s)
+#ifndef RECONNECT_DIRECTED_MS
+#define RECONNECT_DIRECTED_MS       1280
+#endif
+
+// Fast undirected advertising before dropping to the slow interval
+#ifndef RECONNECT_FAST_MS
+#define RECONNECT_FAST_MS           30000
+#endif
+
+// Advertising intervals (0.625 ms units)
+#define RECONNECT_FAST_ADV_MIN      0x20    // 20 ms
+#define RECONNECT_FAST_ADV_MAX      0x30    // 30 ms
+#define RECONNECT_SLOW_ADV_MIN      0x640   // 1 s
+#define RECONNECT_SLOW_ADV_MAX      0x800   // 1.28 s
+
+// Keystrokes held while the link is down
+#ifndef RECONNECT_KEY_BUFFER
+#define RECONNECT_KEY_BUFFER        8
+#endif
+#ifndef RECONNECT_KEY_MAX_AGE_MS
+#define RECONNECT_KEY_MAX_AGE_MS    2000
+#endif
+
+enum AdvPhase : uint8_t {
+    ADV_PHASE_NONE = 0,         // Connected, or not advertising on our behalf
+    ADV_PHASE_DIRECTED,
+    ADV_PHASE_FAST,
+    ADV_PHASE_SLOW,
+    ADV_PHASE_COUNT
+};
+
+inline const char* advPhaseName(AdvPhase phase) {
+    switch (phase) {
+        case ADV_PHASE_DIRECTED: return "directed";
+        case ADV_PHASE_FAST:     return "fast";
+        case ADV_PHASE_SLOW:     return "slow";
+        default:                 return "none";
+    }
+}
+
+// A bonded host's identity address
+struct BlePeer {
+    uint8_t addr[6];
+    uint8_t addrType;           // esp_ble_addr_type_t
+    bool valid;
+
+    BlePeer() : addrType(0), valid(false) { memset(addr, 0, sizeof(addr)); }
+
+    bool sameAs(const BlePeer& other) const {
+        return valid == other.valid && addrType == other.addrType &&
+               memcmp(addr, other.addr, sizeof(addr)) == 0;
+    }
+};
+
+// Radio access: the device restarts advertising with esp_ble_gap_*()
+class AdvertisingGap {
+public:
+    virtual ~AdvertisingGap() {}
+    // Replaces whatever advertising is running. `peer` is the target for
+    // DIRECTED; for FAST/SLOW a peer means only it may connect (white list).
+    virtual bool startAdvertising(AdvPhase phase, const BlePeer* peer) = 0;
+};
+
+// Why the engine is looking for a host; only boot and link loss count
+// towards ReconnectStats (host switches are timed by HostSwitcher)
+enum SearchCause : uint8_t {
+    SEARCH_BOOT = 0,
+    SEARCH_LINK_LOSS,
+    SEARCH_SWITCH
+};
+
+struct ReconnectStats {
+    uint32_t bootToReadyMs;     // 0 until the first connection after boot
+    uint32_t reconnects;        // Link loss -> ready again
+    uint32_t lastReconnectMs;
+    uint32_t maxReconnectMs;
+    uint64_t totalReconnectMs;
+    uint32_t byPhase[ADV_PHASE_COUNT];  // Phase the successful connection came in on
+    uint32_t advStarts;
+    uint32_t advFailures;
+
+    ReconnectStats() : bootToReadyMs(0), reconnects(0), lastReconnectMs(0), maxReconnectMs(0),
+                       totalReconnectMs(0), advStarts(0), advFailures(0) {
+        memset(byPhase, 0, sizeof(byPhase));
+    }
+};
+
+class ReconnectEngine {
+private:
+    AdvertisingGap* _gap;
+    BlePeer _peer;              // Last bonded host
+
+    AdvPhase _phase;
+    uint32_t _phaseAt;
+    AdvPhase _connectedOn;      // Phase running when the link came up
+
+    bool _searching;            // Between losing (or booting without) a link and READY
+    SearchCause _cause;
+    uint32_t _searchStartedAt;
+    bool _exclusive;            // Undirected phases only admit _peer
+
+    bool _linkUp;
+    bool _ready;
+
+    ReconnectStats _stats;
+
+    static bool linkUp(BleLinkStateId state) {
+        return state == BLE_LINK_CONNECTING || state == BLE_LINK_ENCRYPTED ||
+               state == BLE_LINK_READY;
+    }
+
+    void enterPhase(AdvPhase phase, uint32_t now) {
+        _phase = phase;
+        _phaseAt = now;
+        _stats.advStarts++;
+        bool targeted = phase == ADV_PHASE_DIRECTED || _exclusive;
+        if (!_gap->startAdvertising(phase, targeted ? &_peer : nullptr)) {
+            _stats.advFailures++;
+        }
+    }
+
+    AdvPhase firstPhase() const {
+        return _peer.valid ? ADV_PHASE_DIRECTED : ADV_PHASE_FAST;
+    }
+
+    void recordReady(uint32_t now) {
+        uint32_t elapsed = now - _searchStartedAt;
+        _searching = false;
+        if (_cause == SEARCH_SWITCH) return;
+        _stats.byPhase[_connectedOn]++;
+        if (_cause == SEARCH_BOOT) {
+            _stats.bootToReadyMs = elapsed;
+        } else {
+            _stats.reconnects++;
+            _stats.lastReconnectMs = elapsed;
+            _stats.totalReconnectMs += elapsed;
+            if (elapsed > _stats.maxReconnectMs) _stats.maxReconnectMs = elapsed;
+        }
+    }
+
+public:
+    explicit ReconnectEngine(AdvertisingGap* gap)
+        : _gap(gap), _phase(ADV_PHASE_NONE), _phaseAt(0), _connectedOn(ADV_PHASE_NONE),
+          _searching(false), _cause(SEARCH_BOOT), _searchStartedAt(0), _exclusive(false),
+          _linkUp(false), _ready(false) {}
+
+    // Call once the HID service is up. `bootAt` is when the search started
+    // from the user's point of view (power-on: 0).
+    void begin(const BlePeer& peer, uint32_t bootAt, uint32_t now) {
+        _peer = peer;
+        _searching = true;
+        _cause = SEARCH_BOOT;
+        _searchStartedAt = bootAt;
+        enterPhase(firstPhase(), now);
+    }
+
+    // Looks for `peer` instead (an invalid peer: anyone, for pairing). With
+    // a link up, the search starts when the caller's disconnect lands.
+    void retarget(const BlePeer& peer, bool exclusive, uint32_t now) {
+        _peer = peer;
+        _exclusive = exclusive && peer.valid;
+        _searching = true;
+        _cause = SEARCH_SWITCH;
+        _searchStartedAt = now;
+        if (!_linkUp) enterPhase(firstPhase(), now);
+    }
+
+    // Lifts (or imposes) the white list; a running undirected phase restarts
+    void setExclusive(bool exclusive, uint32_t now) {
+        exclusive = exclusive && _peer.valid;
+        if (exclusive == _exclusive) return;
+        _exclusive = exclusive;
+        if (!_linkUp && (_phase == ADV_PHASE_FAST || _phase == ADV_PHASE_SLOW)) {
+            enterPhase(_phase, now);
+        }
+    }
+
+    // A host bonded (or re-encrypted). Returns true if it differs from the
+    // remembered one, i.e. it should be persisted.
+    bool setPeer(const BlePeer& peer) {
+        if (peer.sameAs(_peer)) return false;
+        _peer = peer;
+        return true;
+    }
+
+    void forgetPeer() { _peer = BlePeer(); }
+
+    // Follows the link state and advances the advertising phases; call from loop()
+    void service(BleLinkStateId state, uint32_t now) {
+        bool up = linkUp(state);
+
+        if (up && !_linkUp) {
+            // The controller stops advertising when a central connects
+            _connectedOn = _phase;
+            _phase = ADV_PHASE_NONE;
+        } else if (!up && _linkUp) {
+            // Lost the link (or it never got ready): a failed attempt keeps
+            // the original start time so the metric covers the whole outage
+            if (!_searching) {
+                _searching = true;
+                _cause = SEARCH_LINK_LOSS;
+                _searchStartedAt = now;
+            }
+            enterPhase(firstPhase(), now);
+        }
+        _linkUp = up;
+
+        bool ready = state == BLE_LINK_READY;
+        if (ready && !_ready && _searching) recordReady(now);
+        _ready = ready;
+
+        if (up) return;
+        if (_phase == ADV_PHASE_DIRECTED && now - _phaseAt >= RECONNECT_DIRECTED_MS) {
+            enterPhase(ADV_PHASE_FAST, now);
+        } else if (_phase == ADV_PHASE_FAST && now - _phaseAt >= RECONNECT_FAST_MS) {
+            enterPhase(ADV_PHASE_SLOW, now);
+        }
+    }
+
+    AdvPhase phase() const { return _phase; }
+    bool isExclusive() const { return _exclusive; }
+    bool isSearching() const { return _searching; }
+    uint32_t searchingFor(uint32_t now) const { return _searching ? now - _searchStartedAt : 0; }
+    const BlePeer& peer() const { return _peer; }
+    const ReconnectStats& stats() const { return _stats; }
+};
+
+// ==============================================================================
+// Keystrokes held across a reconnect
+// ==============================================================================
+// Entries refer to a button, not a copy of its macro: the macro is looked up
+// again at replay time through the profile store.
+struct PendingKeystroke {
+    uint16_t profile;
+    uint8_t button;
+    uint32_t pressedAt;
+};
+
+struct PendingKeystrokeStats {
+    uint32_t buffered;
+    uint32_t replayed;
+    uint32_t expired;           // Too old when the link came back
+    uint32_t dropped;           // Buffer full: the oldest entry gave way
+
+    PendingKeystrokeStats() : buffered(0), replayed(0), expired(0), dropped(0) {}
+};
+
+class PendingKeystrokes {
+private:
+    PendingKeystroke _ring[RECONNECT_KEY_BUFFER];
+    uint8_t _head;
+    uint8_t _count;
+    PendingKeystrokeStats _stats;
+
+public:
+    PendingKeystrokes() : _head(0), _count(0) {}
+
+    void push(uint16_t profile, uint8_t button, uint32_t now) {
+        if (_count == RECONNECT_KEY_BUFFER) {
+            _head = (_head + 1) % RECONNECT_KEY_BUFFER;
+            _count--;
+            _stats.dropped++;
+        }
+        PendingKeystroke& k = _ring[(_head + _count) % RECONNECT_KEY_BUFFER];
+        k.profile = profile;
+        k.button = button;
+        k.pressedAt = now;
+        _count++;
+        _stats.buffered++;
+    }
+
+    // Next keystroke still young enough to send, oldest first
+    bool pop(uint32_t now, PendingKeystroke& out) {
+        while (_count > 0) {
+            out = _ring[_head];
+            _head = (_head + 1) % RECONNECT_KEY_BUFFER;
+            _count--;
+            if (now - out.pressedAt <= RECONNECT_KEY_MAX_AGE_MS) {
+                _stats.replayed++;
+                return true;
+            }
+            _stats.expired++;
+        }
+        return false;
+    }
+
+    void clear() {
+        _stats.expired += _count;
+        _head = _count = 0;
+    }
+
+    int count() const { return _count; }
+    const PendingKeystrokeStats& stats() const { return _stats; }
+};
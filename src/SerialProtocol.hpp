@@ -0,0 +1,535 @@
+#pragma once
+
+// ==============================================================================
+// Serial Profile Protocol
+// ==============================================================================
+// Binary request/response protocol on the USB serial port, alongside the
+// text log. Every frame is
+//
+//   0x00 | COBS( type | seq | payload... | CRC-32 LE ) | 0x00
+//
+// COBS removes every 0x00 from the body, so 0x00 always marks a frame boundary.
+// The leading delimiter also closes any log text printed since the last frame;
+// receivers treat segments that fail COBS or CRC as text and skip them.
+//
+// Each request is answered by FRAME_ACK carrying the same seq. The host keeps up
+// to SERIAL_PROTOCOL_WINDOW requests in flight and resends the ones not acked
+// within its timeout. Bundle chunks carry their offset, so duplicates and
+// resends are harmless.
+//
+// Requests (payload, little-endian):
+//   FRAME_PING          -
+//   FRAME_INFO          -                          -> FRAME_INFO_REPLY
+//   FRAME_METRICS       first metric u8            -> FRAME_METRICS_REPLY (Metrics.hpp)
+//   FRAME_BUNDLE_BEGIN  size u32, crc32 u32        (CRC of the whole image)
+//   FRAME_BUNDLE_DATA   offset u32, bytes...       (offset a multiple of SERIAL_BUNDLE_CHUNK)
+//   FRAME_BUNDLE_END    -                          validated, then installed
+//   FRAME_BUTTON_SET    profile u16, button u8, LogMacro, label\0 sublabel\0 [text\0]
+//   FRAME_BUTTON_CLEAR  profile u16, button u8
+// Responses:
+//   FRAME_ACK           status u8, request type u8, device time us u32
+//   FRAME_INFO_REPLY    ProtocolInfo
+//   FRAME_METRICS_REPLY one page of the metrics snapshot
+// Unsolicited (device to host, seq 0):
+//   FRAME_LOG           dropped u32, log records... (BinaryLog.hpp)
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "Macros.hpp"
+#include "ProfileBundle.hpp"
+#include "ProfileLog.hpp"
+
+#define SERIAL_PROTOCOL_VERSION     2
+
+// Line rate for the log and the protocol (monitor_speed in platformio.ini)
+#ifndef SERIAL_PROTOCOL_BAUD
+#define SERIAL_PROTOCOL_BAUD        921600
+#endif
+
+// Largest request payload; bundle chunks use all of it
+#define SERIAL_PROTOCOL_MAX_PAYLOAD 240
+
+// Image bytes per FRAME_BUNDLE_DATA (after the offset); offsets are multiples
+#define SERIAL_BUNDLE_CHUNK         (SERIAL_PROTOCOL_MAX_PAYLOAD - 4)
+
+// Requests the host may have outstanding (device RX buffer must hold them)
+#define SERIAL_PROTOCOL_WINDOW      8
+
+#define SERIAL_FRAME_OVERHEAD       (2 + 4)     // type, seq, CRC
+#define SERIAL_FRAME_MAX_BODY       (SERIAL_PROTOCOL_MAX_PAYLOAD + SERIAL_FRAME_OVERHEAD)
+#define SERIAL_FRAME_MAX_ENCODED    (SERIAL_FRAME_MAX_BODY + SERIAL_FRAME_MAX_BODY / 254 + 3)
+
+// Largest bundle the device accepts (the "profiles" partition)
+#ifndef SERIAL_PROTOCOL_MAX_BUNDLE
+#define SERIAL_PROTOCOL_MAX_BUNDLE  0x20000
+#endif
+
+enum FrameType : uint8_t {
+    FRAME_PING          = 0x01,
+    FRAME_INFO          = 0x02,
+    FRAME_METRICS       = 0x03,
+    FRAME_BUNDLE_BEGIN  = 0x10,
+    FRAME_BUNDLE_DATA   = 0x11,
+    FRAME_BUNDLE_END    = 0x12,
+    FRAME_BUTTON_SET    = 0x20,
+    FRAME_BUTTON_CLEAR  = 0x21,
+    FRAME_ACK           = 0x80,
+    FRAME_INFO_REPLY    = 0x81,
+    FRAME_METRICS_REPLY = 0x82,
+    FRAME_LOG           = 0x90
+};
+
+enum FrameStatus : uint8_t {
+    STATUS_OK = 0,
+    STATUS_BAD_REQUEST,         // Malformed payload or unknown type
+    STATUS_BAD_STATE,           // e.g. data without BUNDLE_BEGIN
+    STATUS_NO_MEMORY,
+    STATUS_BAD_BUNDLE,          // Upload incomplete or failed validation
+    STATUS_REJECTED,            // Valid request the device could not apply
+    STATUS_BUSY                 // An install is still running
+};
+
+inline const char* frameStatusName(uint8_t status) {
+    switch (status) {
+        case STATUS_OK:          return "ok";
+        case STATUS_BAD_REQUEST: return "bad request";
+        case STATUS_BAD_STATE:   return "bad state";
+        case STATUS_NO_MEMORY:   return "out of memory";
+        case STATUS_BAD_BUNDLE:  return "invalid bundle";
+        case STATUS_REJECTED:    return "rejected";
+        case STATUS_BUSY:        return "busy";
+    }
+    return "unknown";
+}
+
+struct ProtocolInfo {
+    uint8_t version;            // SERIAL_PROTOCOL_VERSION
+    uint8_t window;             // SERIAL_PROTOCOL_WINDOW
+    uint16_t maxPayload;        // SERIAL_PROTOCOL_MAX_PAYLOAD
+    uint16_t profileCount;
+    uint16_t currentProfile;
+    uint32_t bundleCrc;         // 0 when running the built-ins
+    uint32_t maxBundle;
+    uint16_t editedButtons;
+    uint16_t reserved;
+};
+
+static_assert(sizeof(ProtocolInfo) == 20, "ProtocolInfo layout changed");
+
+// ==============================================================================
+// COBS
+// ==============================================================================
+// `out` must hold len + len / 254 + 1 bytes
+inline size_t cobsEncode(const uint8_t* in, size_t len, uint8_t* out) {
+    size_t codePos = 0;
+    size_t pos = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] == 0) {
+            out[codePos] = code;
+            codePos = pos++;
+            code = 1;
+            continue;
+        }
+        out[pos++] = in[i];
+        if (++code == 0xFF) {
+            out[codePos] = code;
+            codePos = pos++;
+            code = 1;
+        }
+    }
+    out[codePos] = code;
+    return pos;
+}
+
+// Returns the decoded length, 0 if the input is not valid COBS
+inline size_t cobsDecode(const uint8_t* in, size_t len, uint8_t* out) {
+    size_t pos = 0;
+    size_t i = 0;
+    while (i < len) {
+        uint8_t code = in[i++];
+        if (code == 0 || i + code - 1 > len) return 0;
+        for (uint8_t k = 1; k < code; k++) {
+            out[pos++] = in[i++];
+        }
+        if (code != 0xFF && i < len) out[pos++] = 0;
+    }
+    return pos;
+}
+
+// ==============================================================================
+// Frame Encoding / Decoding
+// ==============================================================================
+// Writes the delimited frame into `out` (SERIAL_FRAME_MAX_ENCODED bytes);
+// returns its length
+inline size_t encodeFrame(uint8_t type, uint8_t seq, const void* payload, size_t len,
+                          uint8_t* out) {
+    uint8_t body[SERIAL_FRAME_MAX_BODY];
+    if (len > SERIAL_PROTOCOL_MAX_PAYLOAD) return 0;
+    body[0] = type;
+    body[1] = seq;
+    if (len) memcpy(body + 2, payload, len);
+    uint32_t crc = bundleCrc32(body, len + 2);
+    memcpy(body + 2 + len, &crc, 4);
+
+    out[0] = 0;
+    size_t n = cobsEncode(body, len + SERIAL_FRAME_OVERHEAD, out + 1);
+    out[1 + n] = 0;
+    return n + 2;
+}
+
+struct FrameDecoderStats {
+    uint32_t frames;
+    uint32_t crcErrors;         // Includes log text between frames on the host
+    uint32_t overflows;
+
+    FrameDecoderStats() : frames(0), crcErrors(0), overflows(0) {}
+};
+
+// Byte-at-a-time receiver; feed() returns true when a valid frame is ready
+class FrameDecoder {
+private:
+    uint8_t _raw[SERIAL_FRAME_MAX_ENCODED];
+    size_t _rawLen;
+    bool _overflow;
+    uint8_t _body[SERIAL_FRAME_MAX_ENCODED];
+    size_t _bodyLen;
+    FrameDecoderStats _stats;
+
+public:
+    FrameDecoder() : _rawLen(0), _overflow(false), _bodyLen(0) {}
+
+    bool feed(uint8_t byte) {
+        if (byte != 0) {
+            if (_rawLen < sizeof(_raw)) {
+                _raw[_rawLen++] = byte;
+            } else {
+                _overflow = true;
+            }
+            return false;
+        }
+
+        // Delimiter: decode what has accumulated
+        size_t rawLen = _rawLen;
+        bool overflow = _overflow;
+        _rawLen = 0;
+        _overflow = false;
+        if (rawLen == 0) return false;
+        if (overflow) {
+            _stats.overflows++;
+            return false;
+        }
+
+        size_t n = cobsDecode(_raw, rawLen, _body);
+        if (n < SERIAL_FRAME_OVERHEAD) {
+            _stats.crcErrors++;
+            return false;
+        }
+        uint32_t crc;
+        memcpy(&crc, _body + n - 4, 4);
+        if (bundleCrc32(_body, n - 4) != crc) {
+            _stats.crcErrors++;
+            return false;
+        }
+        _bodyLen = n - 4;
+        _stats.frames++;
+        return true;
+    }
+
+    // Bytes collected since the last delimiter (log text on the host)
+    const uint8_t* pending() const { return _raw; }
+    size_t pendingLength() const { return _rawLen; }
+
+    uint8_t type() const { return _body[0]; }
+    uint8_t seq() const { return _body[1]; }
+    const uint8_t* payload() const { return _body + 2; }
+    size_t length() const { return _bodyLen - 2; }
+    const FrameDecoderStats& stats() const { return _stats; }
+};
+
+// ==============================================================================
+// Payload Helpers
+// ==============================================================================
+inline uint32_t readU32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint16_t readU16(const uint8_t* p) {
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return v;
+}
+
+// Button payload shared by both ends: profile, button, LogMacro, strings
+inline size_t encodeButtonPayload(uint16_t profile, uint8_t button, const Macro& m, uint8_t* out,
+                                  size_t capacity) {
+    const char* label = m.label ? m.label : "";
+    const char* sublabel = m.sublabel ? m.sublabel : "";
+    size_t labelLen = strlen(label) + 1;
+    size_t sublabelLen = strlen(sublabel) + 1;
+    size_t textLen = m.text ? strlen(m.text) + 1 : 0;
+    size_t total = 3 + sizeof(LogMacro) + labelLen + sublabelLen + textLen;
+    if (total > capacity) return 0;
+
+    LogMacro lm;
+    memset(&lm, 0, sizeof(lm));
+    lm.type = (uint8_t)m.type;
+    lm.modifiers = m.modifiers;
+    lm.keyCount = m.keyCount;
+    lm.fireMode = (uint8_t)m.fireMode;
+    memcpy(lm.keys, m.keys, sizeof(lm.keys));
+    lm.flags = m.text ? LOG_MACRO_HAS_TEXT : 0;
+    lm.color = m.color;
+    lm.pressColor = m.pressColor;
+
+    memcpy(out, &profile, 2);
+    out[2] = button;
+    memcpy(out + 3, &lm, sizeof(lm));
+    size_t pos = 3 + sizeof(lm);
+    memcpy(out + pos, label, labelLen);
+    pos += labelLen;
+    memcpy(out + pos, sublabel, sublabelLen);
+    pos += sublabelLen;
+    if (textLen) {
+        memcpy(out + pos, m.text, textLen);
+        pos += textLen;
+    }
+    return pos;
+}
+
+// Decodes a button payload; strings point into `payload`
+inline bool decodeButtonPayload(const uint8_t* payload, size_t len, uint16_t& profile,
+                                uint8_t& button, Macro& m) {
+    if (len < 3 + sizeof(LogMacro) + 2) return false;
+    profile = readU16(payload);
+    button = payload[2];
+
+    LogMacro lm;
+    memcpy(&lm, payload + 3, sizeof(lm));
+    m = Macro();
+    m.type = (MacroType)lm.type;
+    m.modifiers = lm.modifiers;
+    m.keyCount = lm.keyCount;
+    m.fireMode = (FireMode)lm.fireMode;
+    memcpy(m.keys, lm.keys, sizeof(m.keys));
+    m.color = lm.color;
+    m.pressColor = lm.pressColor;
+
+    // Every string must be terminated inside the payload
+    const char* p = (const char*)payload + 3 + sizeof(lm);
+    const char* end = (const char*)payload + len;
+    const char* strs[3] = {nullptr, nullptr, nullptr};
+    int needed = (lm.flags & LOG_MACRO_HAS_TEXT) ? 3 : 2;
+    for (int i = 0; i < needed; i++) {
+        const char* nul = (const char*)memchr(p, 0, end - p);
+        if (nul == nullptr) return false;
+        strs[i] = p;
+        p = nul + 1;
+    }
+    m.label = strs[0];
+    m.sublabel = strs[1];
+    m.text = strs[2];
+    return button < BUTTON_COUNT;
+}
+
+// ==============================================================================
+// Bundle Upload
+// ==============================================================================
+// Reassembles an uploaded bundle image; chunks may arrive more than once.
+class BundleUpload {
+private:
+    std::vector<uint8_t> _image;
+    std::vector<uint8_t> _received;     // Bit per SERIAL_BUNDLE_CHUNK
+    uint32_t _crc;
+    uint32_t _receivedBytes;
+    bool _active;
+
+public:
+    BundleUpload() : _crc(0), _receivedBytes(0), _active(false) {}
+
+    bool isActive() const { return _active; }
+    uint32_t receivedBytes() const { return _receivedBytes; }
+    uint32_t size() const { return (uint32_t)_image.size(); }
+    std::vector<uint8_t>& image() { return _image; }
+
+    FrameStatus begin(uint32_t size, uint32_t crc) {
+        if (size == 0 || size > SERIAL_PROTOCOL_MAX_BUNDLE) return STATUS_BAD_REQUEST;
+        reset();
+        size_t chunks = (size + SERIAL_BUNDLE_CHUNK - 1) / SERIAL_BUNDLE_CHUNK;
+        _image.resize(size);
+        _received.assign((chunks + 7) / 8, 0);
+        if (_image.size() != size) return STATUS_NO_MEMORY;
+        _crc = crc;
+        _active = true;
+        return STATUS_OK;
+    }
+
+    // Chunks must start on a SERIAL_BUNDLE_CHUNK boundary
+    FrameStatus data(uint32_t offset, const uint8_t* bytes, size_t len) {
+        if (!_active) return STATUS_BAD_STATE;
+        if (offset % SERIAL_BUNDLE_CHUNK || len == 0 || len > SERIAL_BUNDLE_CHUNK ||
+            (uint64_t)offset + len > _image.size()) {
+            return STATUS_BAD_REQUEST;
+        }
+        size_t chunk = offset / SERIAL_BUNDLE_CHUNK;
+        uint8_t bit = (uint8_t)(1u << (chunk & 7));
+        memcpy(&_image[offset], bytes, len);
+        if (!(_received[chunk >> 3] & bit)) {
+            _received[chunk >> 3] |= bit;
+            _receivedBytes += (uint32_t)len;
+        }
+        return STATUS_OK;
+    }
+
+    // Checks completeness, the image CRC and the bundle itself
+    FrameStatus finish() {
+        if (!_active) return STATUS_BAD_STATE;
+        _active = false;
+        if (_receivedBytes != _image.size() ||
+            bundleCrc32(_image.data(), _image.size()) != _crc) {
+            return STATUS_BAD_BUNDLE;
+        }
+        ProfileBundleView view;
+        if (view.open(_image.data(), _image.size()) != BUNDLE_OK) return STATUS_BAD_BUNDLE;
+        return STATUS_OK;
+    }
+
+    void reset() {
+        std::vector<uint8_t>().swap(_image);
+        std::vector<uint8_t>().swap(_received);
+        _receivedBytes = 0;
+        _active = false;
+    }
+};
+
+// ==============================================================================
+// Device Side
+// ==============================================================================
+class SerialProtocolHandler {
+public:
+    virtual ~SerialProtocolHandler() {}
+    virtual FrameStatus onBundleBegin(uint32_t size, uint32_t crc) = 0;
+    virtual FrameStatus onBundleData(uint32_t offset, const uint8_t* data, size_t len) = 0;
+    virtual FrameStatus onBundleEnd() = 0;
+    virtual FrameStatus onButtonSet(uint16_t profile, uint8_t button, const Macro& macro) = 0;
+    virtual FrameStatus onButtonClear(uint16_t profile, uint8_t button) = 0;
+    virtual void onInfo(ProtocolInfo& info) = 0;
+    // Writes one metrics page (Metrics.hpp); 0 = no such page
+    virtual size_t onMetrics(uint8_t first, uint8_t* out, size_t cap) {
+        (void)first;
+        (void)out;
+        (void)cap;
+        return 0;
+    }
+};
+
+typedef void (*FrameWriter)(const uint8_t* data, size_t len, void* context);
+typedef uint32_t (*MicrosClock)();
+
+class SerialProtocolServer {
+private:
+    FrameDecoder _decoder;
+    SerialProtocolHandler* _handler;
+    FrameWriter _write;
+    void* _writeContext;
+    MicrosClock _clock;
+    uint32_t _requests;
+    uint32_t _rejected;
+
+    void reply(uint8_t type, uint8_t seq, const void* payload, size_t len) {
+        uint8_t frame[SERIAL_FRAME_MAX_ENCODED];
+        size_t n = encodeFrame(type, seq, payload, len, frame);
+        if (n) _write(frame, n, _writeContext);
+    }
+
+    void dispatch(uint32_t start) {
+        uint8_t type = _decoder.type();
+        const uint8_t* p = _decoder.payload();
+        size_t len = _decoder.length();
+        FrameStatus status = STATUS_BAD_REQUEST;
+        _requests++;
+
+        switch (type) {
+            case FRAME_PING:
+                status = STATUS_OK;
+                break;
+
+            case FRAME_INFO: {
+                ProtocolInfo info;
+                memset(&info, 0, sizeof(info));
+                info.version = SERIAL_PROTOCOL_VERSION;
+                info.window = SERIAL_PROTOCOL_WINDOW;
+                info.maxPayload = SERIAL_PROTOCOL_MAX_PAYLOAD;
+                info.maxBundle = SERIAL_PROTOCOL_MAX_BUNDLE;
+                _handler->onInfo(info);
+                reply(FRAME_INFO_REPLY, _decoder.seq(), &info, sizeof(info));
+                return;
+            }
+
+            case FRAME_METRICS: {
+                uint8_t page[SERIAL_PROTOCOL_MAX_PAYLOAD];
+                size_t n = len == 1 ? _handler->onMetrics(p[0], page, sizeof(page)) : 0;
+                if (n == 0) break;
+                reply(FRAME_METRICS_REPLY, _decoder.seq(), page, n);
+                return;
+            }
+
+            case FRAME_BUNDLE_BEGIN:
+                if (len == 8) status = _handler->onBundleBegin(readU32(p), readU32(p + 4));
+                break;
+
+            case FRAME_BUNDLE_DATA:
+                if (len > 4) status = _handler->onBundleData(readU32(p), p + 4, len - 4);
+                break;
+
+            case FRAME_BUNDLE_END:
+                status = _handler->onBundleEnd();
+                break;
+
+            case FRAME_BUTTON_SET: {
+                uint16_t profile;
+                uint8_t button;
+                Macro macro;
+                if (decodeButtonPayload(p, len, profile, button, macro)) {
+                    status = _handler->onButtonSet(profile, button, macro);
+                }
+                break;
+            }
+
+            case FRAME_BUTTON_CLEAR:
+                if (len == 3) status = _handler->onButtonClear(readU16(p), p[2]);
+                break;
+        }
+
+        if (status != STATUS_OK) _rejected++;
+        uint8_t ack[6];
+        ack[0] = status;
+        ack[1] = type;
+        uint32_t elapsed = _clock() - start;
+        memcpy(ack + 2, &elapsed, 4);
+        reply(FRAME_ACK, _decoder.seq(), ack, sizeof(ack));
+    }
+
+public:
+    SerialProtocolServer(SerialProtocolHandler* handler, FrameWriter write, void* writeContext,
+                         MicrosClock clock)
+        : _handler(handler), _write(write), _writeContext(writeContext), _clock(clock),
+          _requests(0), _rejected(0) {}
+
+    // Feed received bytes; requests are handled (and acked) as they complete
+    void feed(const uint8_t* data, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            if (_decoder.feed(data[i])) {
+                dispatch(_clock());
+            }
+        }
+    }
+
+    uint32_t requests() const { return _requests; }
+    uint32_t rejected() const { return _rejected; }
+    const FrameDecoderStats& decoderStats() const { return _decoder.stats(); }
+};
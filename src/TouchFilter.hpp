@@ -0,0 +1,300 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// ==============================================================================
+// Touch Filter Settings
+// ==============================================================================
+
+// IIR smoothing weight for new (median-filtered) samples, as a power of two:
+// filtered += (sample - filtered) >> TOUCH_IIR_SHIFT
+#ifndef TOUCH_IIR_SHIFT
+#define TOUCH_IIR_SHIFT         1
+#endif
+
+// A committed button stays committed while the contact is within its rect
+// grown by this many pixels (wider than BUTTON_SPACING_X/Y)
+#ifndef TOUCH_HYSTERESIS_PX
+#define TOUCH_HYSTERESIS_PX     10
+#endif
+
+// A sample this far inside a button commits to it immediately
+#ifndef TOUCH_EDGE_MARGIN_PX
+#define TOUCH_EDGE_MARGIN_PX    4
+#endif
+
+// How far ahead (ms) the first samples' trajectory is extrapolated. The IIR
+// halves the first step, so this reaches about half as far along the
+// finger's own path: two polls, one before the sample limit would commit.
+#ifndef TOUCH_PREDICT_MS
+#define TOUCH_PREDICT_MS        40
+#endif
+
+// Ambiguous (edge/gap) contacts are resolved to the nearest button after this many samples
+#ifndef TOUCH_COMMIT_MAX_SAMPLES
+#define TOUCH_COMMIT_MAX_SAMPLES 3
+#endif
+
+#define TOUCH_FIXED_SHIFT 4     // Sub-pixel precision of filtered coordinates
+
+// ==============================================================================
+// Touch Filter (median-of-3 + IIR)
+// ==============================================================================
+// The first sample of a contact passes through unfiltered so touch-down is
+// never delayed; later samples are median-filtered to reject single-sample
+// spikes, then IIR-smoothed.
+class TouchFilter {
+private:
+    int32_t _histX[3];
+    int32_t _histY[3];
+    uint8_t _count;
+    uint8_t _slot;          // Next history slot; _count saturates, so it cannot pick one
+
+    int32_t _fx;            // Filtered position, TOUCH_FIXED_SHIFT fixed point
+    int32_t _fy;
+    int32_t _prevFx;
+    int32_t _prevFy;
+    uint32_t _time;
+    uint32_t _prevTime;
+
+    static int32_t median3(int32_t a, int32_t b, int32_t c) {
+        if (a > b) { int32_t t = a; a = b; b = t; }
+        if (b > c) { b = c; }
+        return a > b ? a : b;
+    }
+
+public:
+    TouchFilter() { reset(); }
+
+    void reset() {
+        _count = 0;
+        _slot = 0;
+        _fx = _fy = _prevFx = _prevFy = 0;
+        _time = _prevTime = 0;
+    }
+
+    bool hasSample() const { return _count > 0; }
+    uint8_t sampleCount() const { return _count; }
+
+    void push(int32_t x, int32_t y, uint32_t now) {
+        _histX[_slot] = x;
+        _histY[_slot] = y;
+        _slot = _slot == 2 ? 0 : _slot + 1;
+
+        int32_t mx = x;
+        int32_t my = y;
+        if (_count >= 2) {
+            mx = median3(_histX[0], _histX[1], _histX[2]);
+            my = median3(_histY[0], _histY[1], _histY[2]);
+        }
+
+        _prevFx = _fx;
+        _prevFy = _fy;
+        _prevTime = _time;
+        _time = now;
+
+        if (_count == 0) {
+            _fx = _prevFx = mx << TOUCH_FIXED_SHIFT;
+            _fy = _prevFy = my << TOUCH_FIXED_SHIFT;
+            _prevTime = now;
+        } else {
+            _fx += ((mx << TOUCH_FIXED_SHIFT) - _fx) >> TOUCH_IIR_SHIFT;
+            _fy += ((my << TOUCH_FIXED_SHIFT) - _fy) >> TOUCH_IIR_SHIFT;
+        }
+
+        if (_count < 255) _count++;
+    }
+
+    int32_t x() const { return (_fx + (1 << (TOUCH_FIXED_SHIFT - 1))) >> TOUCH_FIXED_SHIFT; }
+    int32_t y() const { return (_fy + (1 << (TOUCH_FIXED_SHIFT - 1))) >> TOUCH_FIXED_SHIFT; }
+
+    // Unrounded, TOUCH_FIXED_SHIFT fixed point (trackpad motion)
+    int32_t fixedX() const { return _fx; }
+    int32_t fixedY() const { return _fy; }
+
+    // Position extrapolated `aheadMs` along the last filtered step
+    void predict(uint32_t aheadMs, int32_t& px, int32_t& py) const {
+        uint32_t dt = _time - _prevTime;
+        if (dt == 0) {
+            px = x();
+            py = y();
+            return;
+        }
+        int32_t vx = (_fx - _prevFx) * (int32_t)aheadMs / (int32_t)dt;
+        int32_t vy = (_fy - _prevFy) * (int32_t)aheadMs / (int32_t)dt;
+        px = (_fx + vx + (1 << (TOUCH_FIXED_SHIFT - 1))) >> TOUCH_FIXED_SHIFT;
+        py = (_fy + vy + (1 << (TOUCH_FIXED_SHIFT - 1))) >> TOUCH_FIXED_SHIFT;
+    }
+};
+
+// ==============================================================================
+// Grid Geometry
+// ==============================================================================
+// Button rectangles of the active profile, shared by hit-testing and the
+// tap resolver.
+struct GridGeometry {
+    int16_t startX;
+    int16_t startY;
+    int16_t buttonW;
+    int16_t buttonH;
+    int16_t pitchX;         // buttonW + spacing
+    int16_t pitchY;
+    uint8_t rows;
+    uint8_t cols;
+    uint64_t enabledMask;   // Bit per button; empty cells are not targets
+
+    bool isEnabled(int index) const {
+        return index >= 0 && index < rows * cols && ((enabledMask >> index) & 1);
+    }
+
+    // Exact hit test; -1 in spacing or on empty cells
+    int hitTest(int32_t x, int32_t y) const {
+        if (x < startX || y < startY) return -1;
+        int col = (x - startX) / pitchX;
+        int row = (y - startY) / pitchY;
+        if (col >= cols || row >= rows) return -1;
+        if ((x - startX) % pitchX >= buttonW || (y - startY) % pitchY >= buttonH) return -1;
+        int index = row * cols + col;
+        return isEnabled(index) ? index : -1;
+    }
+
+    // Signed distance from the point to the nearest edge of a button:
+    // positive inside, negative outside
+    int32_t edgeDistance(int index, int32_t x, int32_t y) const {
+        int32_t left = startX + (index % cols) * pitchX;
+        int32_t top = startY + (index / cols) * pitchY;
+        int32_t right = left + buttonW - 1;
+        int32_t bottom = top + buttonH - 1;
+
+        if (x >= left && x <= right && y >= top && y <= bottom) {
+            int32_t d = x - left;
+            if (right - x < d) d = right - x;
+            if (y - top < d) d = y - top;
+            if (bottom - y < d) d = bottom - y;
+            return d;
+        }
+
+        int32_t ox = x < left ? left - x : (x > right ? x - right : 0);
+        int32_t oy = y < top ? top - y : (y > bottom ? y - bottom : 0);
+        return -(ox > oy ? ox : oy);
+    }
+
+    // Nearest enabled button whose rect grown by `margin` contains the point
+    int nearest(int32_t x, int32_t y, int32_t margin) const {
+        if (x < startX - margin || y < startY - margin) return -1;
+
+        // Only the cell under the point and its neighbours can qualify
+        int col = (x - startX) / pitchX;
+        int row = (y - startY) / pitchY;
+        int best = -1;
+        int32_t bestDistance = -margin - 1;
+        for (int r = row - 1; r <= row + 1; r++) {
+            for (int c = col - 1; c <= col + 1; c++) {
+                if (r < 0 || c < 0 || r >= rows || c >= cols) continue;
+                int index = r * cols + c;
+                if (!isEnabled(index)) continue;
+                int32_t d = edgeDistance(index, x, y);
+                if (d > bestDistance) {
+                    bestDistance = d;
+                    best = index;
+                }
+            }
+        }
+        return best;
+    }
+};
+
+// ==============================================================================
+// Tap Resolver
+// ==============================================================================
+// Decides which button a contact belongs to from its first few filtered
+// samples. Clear hits commit on the first sample; contacts that land on an
+// edge or in a gap commit as soon as their extrapolated trajectory enters a
+// button core, or to the nearest button after TOUCH_COMMIT_MAX_SAMPLES.
+enum TapResolution : int8_t {
+    TAP_PENDING = -2,
+    TAP_NO_TARGET = -1
+    // >= 0: committed button index
+};
+
+class TapResolver {
+private:
+    const GridGeometry* _grid;
+    uint8_t _samples;
+    int _committed;
+    uint32_t _startTime;
+    uint32_t _commitTime;
+
+    bool inCore(int index, int32_t x, int32_t y) const {
+        return index >= 0 && _grid->edgeDistance(index, x, y) >= TOUCH_EDGE_MARGIN_PX;
+    }
+
+public:
+    TapResolver() : _grid(nullptr), _samples(0), _committed(TAP_PENDING),
+                    _startTime(0), _commitTime(0) {}
+
+    void begin(const GridGeometry* grid, uint32_t now) {
+        _grid = grid;
+        _samples = 0;
+        _committed = TAP_PENDING;
+        _startTime = now;
+        _commitTime = now;
+    }
+
+    void cancel() {
+        _grid = nullptr;
+        _committed = TAP_NO_TARGET;
+    }
+
+    bool isPending() const { return _grid != nullptr && _committed == TAP_PENDING; }
+    int committed() const { return _committed; }
+    uint32_t timeToCommit() const { return _commitTime - _startTime; }
+    uint8_t samplesToCommit() const { return _samples; }
+
+    // Feed one filtered sample; returns the resolution so far
+    int update(const TouchFilter& filter, uint32_t now) {
+        if (!isPending()) return _committed;
+        _samples++;
+
+        int32_t x = filter.x();
+        int32_t y = filter.y();
+
+        int hit = _grid->hitTest(x, y);
+        if (inCore(hit, x, y)) {
+            return commit(hit, now);
+        }
+
+        if (filter.sampleCount() >= 2) {
+            int32_t px, py;
+            filter.predict(TOUCH_PREDICT_MS, px, py);
+            int predicted = _grid->hitTest(px, py);
+            if (inCore(predicted, px, py)) {
+                return commit(predicted, now);
+            }
+        }
+
+        if (_samples >= TOUCH_COMMIT_MAX_SAMPLES) {
+            return commit(_grid->nearest(x, y, TOUCH_HYSTERESIS_PX), now);
+        }
+        return TAP_PENDING;
+    }
+
+    // Contact ended before the resolver made up its mind
+    int finish(const TouchFilter& filter, uint32_t now) {
+        if (!isPending()) return _committed;
+        return commit(_grid->nearest(filter.x(), filter.y(), TOUCH_HYSTERESIS_PX), now);
+    }
+
+    // Hysteresis: a committed button is kept until the contact clearly leaves it
+    bool stillOnTarget(int32_t x, int32_t y) const {
+        return _committed >= 0 && _grid->edgeDistance(_committed, x, y) >= -TOUCH_HYSTERESIS_PX;
+    }
+
+private:
+    int commit(int index, uint32_t now) {
+        _committed = index;
+        _commitTime = now;
+        return _committed;
+    }
+};
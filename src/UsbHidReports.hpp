@@ -0,0 +1,78 @@
+#pragma once
+
+// ==============================================================================
+// USB HID Report Encoding
+// ==============================================================================
+// Wire format of HidReports on the USB HID interface (UsbTransport.hpp),
+// which uses the Arduino core's boot keyboard and consumer control report
+// descriptors:
+//
+//   keyboard (report ID 1)   modifiers, reserved, 6 key usages      8 bytes
+//   mouse    (report ID 2)   buttons, x, y, wheel, pan (signed)     5 bytes
+//   consumer (report ID 4)   one 16-bit consumer usage, LE          2 bytes
+//
+// The IDs are the core's HID_REPORT_ID enum (USBHID.h), where gamepad takes
+// 3; UsbTransport.hpp checks them against it.
+//
+// BLE consumer reports are BleKeyboard's bitmap (one bit per media key);
+// USB sends the usage itself, so the bitmap is mapped back here. Kept free
+// of USB headers so host/usbhid_sim.cpp can check it.
+
+#include <stdint.h>
+#include <string.h>
+#include "HidReportQueue.hpp"
+
+// Report IDs the core's descriptors use (HID_REPORT_ID_KEYBOARD/_MOUSE/_CONSUMER_CONTROL)
+#define USB_REPORT_ID_KEYBOARD      1
+#define USB_REPORT_ID_MOUSE         2
+#define USB_REPORT_ID_CONSUMER      4
+
+#define USB_KEYBOARD_REPORT_BYTES   8
+#define USB_MOUSE_REPORT_BYTES      5
+#define USB_CONSUMER_REPORT_BYTES   2
+
+// Consumer page usages (HID Usage Tables, 0x0C)
+#define USB_CONSUMER_NEXT           0x00B5
+#define USB_CONSUMER_PREV           0x00B6
+#define USB_CONSUMER_STOP           0x00B7
+#define USB_CONSUMER_PLAY_PAUSE     0x00CD
+#define USB_CONSUMER_MUTE           0x00E2
+#define USB_CONSUMER_VOLUME_UP      0x00E9
+#define USB_CONSUMER_VOLUME_DOWN    0x00EA
+
+inline void usbKeyboardReport(uint8_t modifiers, const uint8_t keys[6],
+                              uint8_t out[USB_KEYBOARD_REPORT_BYTES]) {
+    out[0] = modifiers;
+    out[1] = 0;
+    memcpy(out + 2, keys, 6);
+}
+
+// Horizontal scroll (pan) is not used
+inline void usbMouseReport(uint8_t buttons, int8_t dx, int8_t dy, int8_t wheel,
+                           uint8_t out[USB_MOUSE_REPORT_BYTES]) {
+    out[0] = buttons;
+    out[1] = (uint8_t)dx;
+    out[2] = (uint8_t)dy;
+    out[3] = (uint8_t)wheel;
+    out[4] = 0;
+}
+
+// Usage for a BleKeyboard consumer bitmap (mediaKeyBits()); 0 = released.
+// The report holds one usage, so the lowest set bit wins.
+inline uint16_t usbConsumerUsage(uint8_t low, uint8_t high) {
+    static const uint16_t USAGES[7] = {
+        USB_CONSUMER_NEXT, USB_CONSUMER_PREV, USB_CONSUMER_STOP, USB_CONSUMER_PLAY_PAUSE,
+        USB_CONSUMER_MUTE, USB_CONSUMER_VOLUME_UP, USB_CONSUMER_VOLUME_DOWN
+    };
+    (void)high;     // Bits 8-15 are browser/app keys no macro produces
+    for (int bit = 0; bit < 7; bit++) {
+        if (low & (1 << bit)) return USAGES[bit];
+    }
+    return 0;
+}
+
+inline void usbConsumerReport(uint8_t low, uint8_t high, uint8_t out[USB_CONSUMER_REPORT_BYTES]) {
+    uint16_t usage = usbConsumerUsage(low, high);
+    out[0] = (uint8_t)(usage & 0xFF);
+    out[1] = (uint8_t)(usage >> 8);
+}
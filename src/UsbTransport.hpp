@@ -0,0 +1,132 @@
+#pragma once
+
+// ==============================================================================
+// USB HID Transport
+// ==============================================================================
+// Wired keyboard, consumer and mouse reports over the ESP32-S3's native USB port
+// (TinyUSB, ARDUINO_USB_MODE=0 in platformio.ini). The core's HID interface
+// asks the host to poll every 1 ms, so a report reaches the host within a
+// frame of being sent, against 7.5-30 ms over BLE.
+//
+// While the host has the device configured and awake, loop() sends through
+// this transport instead of BLE (isReady()); the BLE link stays up and takes
+// over again when the cable is pulled.
+//
+// USBHID::SendReport() returns once the host has collected the report (or
+// after USB_HID_SEND_TIMEOUT_MS), so completion is known in the call: no
+// credit is taken (completesOnSend()) and the send-to-collect time is the
+// report's latency. loop() blocks for at most a frame per report this way,
+// which is how the queue paces USB.
+//
+// Builds without TinyUSB HID get a stub that is never ready.
+
+#include <Arduino.h>
+#include "HidTransport.hpp"
+#include "UsbHidReports.hpp"
+#include "Clock.hpp"
+
+#if defined(ARDUINO_USB_MODE) && ARDUINO_USB_MODE == 0 && CONFIG_TINYUSB_HID_ENABLED
+#define HID_USB_AVAILABLE 1
+#else
+#define HID_USB_AVAILABLE 0
+#endif
+
+#if HID_USB_AVAILABLE
+#include <USB.h>
+#include <USBHIDKeyboard.h>
+#include <USBHIDConsumerControl.h>
+#include <USBHIDMouse.h>
+
+// UsbHidReports.hpp stays free of USB headers for the host tests, so its
+// report IDs are checked against the core's descriptors here
+static_assert(USB_REPORT_ID_KEYBOARD == HID_REPORT_ID_KEYBOARD, "keyboard report ID");
+static_assert(USB_REPORT_ID_MOUSE == HID_REPORT_ID_MOUSE, "mouse report ID");
+static_assert(USB_REPORT_ID_CONSUMER == HID_REPORT_ID_CONSUMER_CONTROL, "consumer report ID");
+#endif
+
+// Longest wait for the host to collect one report
+#define USB_HID_SEND_TIMEOUT_MS     10
+
+// Interrupt IN polling interval the core's descriptor asks for
+#define USB_HID_POLL_US             1000
+
+class UsbHidTransport : public HidTransport {
+private:
+#if HID_USB_AVAILABLE
+    USBHID _hid;
+    // Registered for their report descriptors; reports go through _hid
+    USBHIDKeyboard _keyboard;
+    USBHIDConsumerControl _consumer;
+    USBHIDMouse _mouse;
+#endif
+
+    bool sendRaw(uint8_t reportId, const uint8_t* data, size_t len) {
+#if HID_USB_AVAILABLE
+        if (!isReady()) return false;
+        return _hid.SendReport(reportId, data, len, USB_HID_SEND_TIMEOUT_MS);
+#else
+        (void)reportId;
+        (void)data;
+        (void)len;
+        return false;
+#endif
+    }
+
+protected:
+    bool sendKeyboardReport(uint8_t modifiers, const uint8_t keys[6]) override {
+        uint8_t raw[USB_KEYBOARD_REPORT_BYTES];
+        usbKeyboardReport(modifiers, keys, raw);
+        return sendRaw(USB_REPORT_ID_KEYBOARD, raw, sizeof(raw));
+    }
+
+    bool sendConsumerReport(uint8_t low, uint8_t high) override {
+        uint8_t raw[USB_CONSUMER_REPORT_BYTES];
+        usbConsumerReport(low, high, raw);
+        return sendRaw(USB_REPORT_ID_CONSUMER, raw, sizeof(raw));
+    }
+
+    bool sendMouseReport(uint8_t buttons, int8_t dx, int8_t dy, int8_t wheel) override {
+        uint8_t raw[USB_MOUSE_REPORT_BYTES];
+        usbMouseReport(buttons, dx, dy, wheel, raw);
+        return sendRaw(USB_REPORT_ID_MOUSE, raw, sizeof(raw));
+    }
+
+    uint32_t clockUs() override { return clockMicros(); }
+
+public:
+    UsbHidTransport() {}
+
+    const char* name() const override { return "usb"; }
+
+    bool begin() override {
+#if HID_USB_AVAILABLE
+        _keyboard.begin();
+        _consumer.begin();
+        _mouse.begin();
+        USB.productName("MacroPad");
+        return USB.begin();
+#else
+        return false;
+#endif
+    }
+
+    // Host has configured the device and is not suspended
+    bool isReady() const {
+#if HID_USB_AVAILABLE
+        return tud_mounted() && !tud_suspended();
+#else
+        return false;
+#endif
+    }
+
+    // Collected by the time SendReport() returns
+    bool sendReport(const HidReport& report) override {
+        if (!HidTransport::sendReport(report)) return false;
+        onCompleted();
+        return true;
+    }
+
+    int sendable() override { return -1; }
+    bool completesOnSend() const override { return true; }
+    bool hasPointer() const override { return HID_USB_AVAILABLE != 0; }
+};
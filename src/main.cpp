@@ -2,11 +2,26 @@
 #include <Wire.h>
 #include <BleKeyboard.h>
 #include <esp_task_wdt.h>
+#include <soc/soc.h>
 #include "DisplayConfig.hpp"
+#include "PanelInit.hpp"
+#include "BootTimeline.hpp"
 #include "LGFX_Setup.hpp"
 #include "Macros.hpp"
 #include "MacroPadUI.hpp"
 #include "BLEConfig.hpp"
+#include "MacroExecutor.hpp"
+#include "MotionCoalescer.hpp"
+#include "UsbTransport.hpp"
+#include "ProfileBundle.hpp"
+#include "ProfileTransfer.hpp"
+#include "ProfileLog.hpp"
+#include "SerialProtocol.hpp"
+#include "BinaryLog.hpp"
+#include "Metrics.hpp"
+#include "PadController.hpp"
+#include "Clock.hpp"
+#include <new>
 
 // ==============================================================================
 // Configuration
@@ -15,8 +30,19 @@
 // Set to true to clear bonding data on next boot
 #define CLEAR_BONDING_ON_BOOT false
 
-// Connection debounce to prevent rapid connect/disconnect spam
-#define CONNECTION_DEBOUNCE_MS 1000
+// Serial RX buffer: must hold a full window of protocol frames
+#define SERIAL_RX_BUFFER_SIZE 4096
+
+// Protocol bytes consumed per loop() pass
+#define SERIAL_PROTOCOL_POLL_BYTES 1024
+
+// Start BLE on core 0 while setup() brings up the panel on core 1. Set to
+// 0 to start it after the UI instead: slower boot, but the BLE heap figure
+// in the status log is then BLE's alone.
+#define BOOT_PARALLEL_BLE 1
+
+// Heap gauges are sampled this often (queue depths every loop() pass)
+#define METRICS_SAMPLE_MS 100
 
 // ==============================================================================
 // Global Instances
@@ -24,39 +50,96 @@
 LGFX tft;
 BleKeyboard bleKeyboard("MacroPad", "ESP32-S3", 100);
 
-// Media key reports (avoid name collisions with HID macros)
-static const MediaKeyReport MEDIA_PLAY_PAUSE = {8, 0};
-static const MediaKeyReport MEDIA_STOP = {4, 0};
-static const MediaKeyReport MEDIA_PREV = {2, 0};
-static const MediaKeyReport MEDIA_NEXT = {1, 0};
-static const MediaKeyReport MEDIA_VOL_UP = {32, 0};
-static const MediaKeyReport MEDIA_VOL_DOWN = {64, 0};
-static const MediaKeyReport MEDIA_MUTE = {16, 0};
+// Macros become HID reports (MacroExecutor.hpp), which go out through a
+// credit-limited queue (HidReportQueue.hpp) and a transport (HidTransport.hpp):
+// USB when the host has it configured, else the selected BLE stack
+PlatformHidTransport bleTransport(&bleKeyboard);
+UsbHidTransport usbTransport;
+HidReportQueue hidReports(&bleTransport);
+MacroExecutor macroExecutor(&hidReports);
+
+// Trackpad rows of the showing profile: touch motion, coalesced into mouse
+// reports (MotionCoalescer.hpp)
+MotionCoalescer trackpad;
+
+void onHidReportSent(bool ok) {
+    bleTransport.onCompleted();
+    hidReports.onSent(ok);
+}
+
+MappedProfileBundle profileBundle;
+BuiltinProfileSource builtinSource;
+BundleProfileSource bundleSource;
+ProfileStore profileStore;
 
-Profile* profiles = nullptr;
+// Button edits, layered over the base profiles (own partition, A/B slots)
+PartitionFlashRegion profileLogRegion;
+ProfileLog* profileLog = nullptr;
+LoggedProfileSource loggedSource;
 MacroPadUI* ui = nullptr;
 
-// Connection tracking
-bool bleConnected = false;
-uint32_t lastStatusUpdate = 0;
-uint32_t lastConnectionChange = 0;
-uint32_t bleConnectedSince = 0;
-uint32_t bleDisconnectedSince = 0;
-int bleConnectCount = 0;
-
-// Simple BLE status (avoid custom BLE stack callbacks)
-void printBLEStatusSimple() {
-    Serial.println("\n--- BLE Status ---");
-    Serial.printf("Connected: %s\n", bleKeyboard.isConnected() ? "YES" : "NO");
-    Serial.printf("Connect count: %d\n", bleConnectCount);
-    if (bleKeyboard.isConnected() && bleConnectedSince > 0) {
-        Serial.printf("Connected for: %lu ms\n", millis() - bleConnectedSince);
-    } else if (bleDisconnectedSince > 0) {
-        Serial.printf("Last disconnect: %lu ms ago\n",
-            millis() - bleDisconnectedSince);
+// Connection interval policy (fast while in use, relaxed when idle)
+EspConnParamGap connParamGap;
+ConnParamPolicy connParams(&connParamGap);
+
+// Directed/fast/slow advertising after boot or link loss, and the macros
+// pressed meanwhile
+EspAdvertisingGap advertisingGap;
+ReconnectEngine reconnect(&advertisingGap);
+PendingKeystrokes pendingKeys;
+
+// Bonded hosts and switching between them
+HostSlotTable hostSlots;
+EspHostLinkControl hostLinkControl;
+HostSwitcher hostSwitcher(&hostSlots, &reconnect, &hostLinkControl);
+
+// The stack's event queue, bond store and LittleFS, for the loop glue
+void startProfileExport();
+
+class DevicePlatform : public PadPlatform {
+public:
+    bool pollLinkEvent(BleLinkEvent& ev) override { return pollBLELinkEvent(ev); }
+
+    void onLinkConnected(const BleLinkEvent& ev) override {
+        connParamGap.setPeer(ev.peer);
+        hostLinkControl.setPeer(ev.peer);
     }
-    Serial.println("------------------\n");
-}
+
+    bool resolveBondedPeer(const BleLinkEvent& ev, BlePeer& peer) override {
+        return ::resolveBondedPeer(ev.peer, ev.addrType, peer);
+    }
+
+    void removeBondedPeer(const BlePeer& peer) override { ::removeBondedPeer(peer); }
+    void saveHostSlots(const HostSlotTable& table) override { ::saveHostSlots(table); }
+    void startProfileExport() override { ::startProfileExport(); }
+};
+
+// Loop-level glue between the UI, the HID path and the link (PadController.hpp)
+DevicePlatform devicePlatform;
+PadController pad(&devicePlatform, &bleLink, &bleTransport, &usbTransport, &hidReports,
+                  &macroExecutor, &trackpad, &connParams, &reconnect, &pendingKeys, &hostSlots,
+                  &hostSwitcher, &profileStore);
+
+// Profile import/export (LittleFS), serviced from loop()
+bool filesystemReady = false;
+ProfileImportJob importJob;
+BundleFlashJob flashJob;
+ProfileExportJob exportJob;
+
+uint32_t lastStatusUpdate = 0;
+
+// Metrics (Metrics.hpp) fed from loop()
+uint32_t lastLoopMicros = 0;
+uint32_t lastMetricsSample = 0;
+uint32_t reconnectsSeen = 0;
+
+// BLE stack footprint and start-up, for comparing the transports
+uint32_t bleHeapUsed = 0;
+uint32_t bleHeapAfterInit = 0;
+
+// Boot phases (BootTimeline.hpp); the BLE start task sets bleStarted
+BootTimeline bootTimeline;
+std::atomic<bool> bleStarted(false);
 
 // ==============================================================================
 // Watchdog Timer Management
@@ -90,318 +173,400 @@ void feedWatchdog() {
 }
 
 // ==============================================================================
-// ST7701S Manual Initialization (3-Wire SPI)
+// UI Callbacks
+// ==============================================================================
+// The UI takes plain function pointers; the work is done by the pad controller
+void executeMacro(const Macro& macro, int buttonIndex) {
+    pad.executeMacro(macro, buttonIndex);
+}
+
+void holdMacro(const Macro& macro, int buttonIndex, bool down) {
+    pad.holdMacro(macro, buttonIndex, down);
+}
+
+void onProfileChanged(int newProfileIndex) {
+    pad.onProfileChanged(newProfileIndex);
+}
+
+void onGesture(const GestureEvent& event) {
+    pad.onGesture(event);
+}
+
+// ==============================================================================
+// Profile Memory Report
 // ==============================================================================
-void st7701_send(uint8_t data, bool is_cmd) {
-    digitalWrite(PIN_SPI_CS, LOW);
-
-    // 9-bit SPI: 1st bit is D/C (0=Cmd, 1=Data)
-    digitalWrite(PIN_SPI_SCK, LOW);
-    digitalWrite(PIN_SPI_SDA, is_cmd ? LOW : HIGH);
-    delayMicroseconds(1);
-    digitalWrite(PIN_SPI_SCK, HIGH);
-    delayMicroseconds(1);
-
-    for (int i = 0; i < 8; i++) {
-        digitalWrite(PIN_SPI_SCK, LOW);
-        if (data & 0x80) digitalWrite(PIN_SPI_SDA, HIGH);
-        else             digitalWrite(PIN_SPI_SDA, LOW);
-        delayMicroseconds(1);
-        digitalWrite(PIN_SPI_SCK, HIGH);
-        delayMicroseconds(1);
-        data <<= 1;
+// Built-in profiles are constexpr tables in .rodata: they cost flash only.
+// Before, each one was constructed at boot and copied into a static RAM array.
+void printProfileMemory() {
+    uint32_t flash = 0, saved = 0;
+    for (int i = 0; i < PROFILE_COUNT; i++) {
+        const Profile* p = &BUILTIN_PROFILES[i];
+        ProfileFootprint f = profileFootprint(*p);
+        uintptr_t addr = (uintptr_t)p;
+        bool inFlash = addr >= SOC_DROM_LOW && addr < SOC_DROM_HIGH;
+        uint32_t ram = inFlash ? 0 : f.legacyRamBytes;
+        Serial.printf("Profile %-10s flash %lu bytes (table %lu + strings %lu, %u cells used), "
+                      "SRAM %lu bytes (was %lu)\n", p->name, (unsigned long)f.flashBytes,
+            (unsigned long)sizeof(Profile), (unsigned long)f.stringBytes, f.usedCells,
+            (unsigned long)ram, (unsigned long)f.legacyRamBytes);
+        flash += f.flashBytes;
+        saved += f.legacyRamBytes - ram;
     }
-    digitalWrite(PIN_SPI_CS, HIGH);
-    delayMicroseconds(1);
+    Serial.printf("Profiles: %lu bytes of flash used, %lu bytes of SRAM saved, "
+                  "zero boot-time construction\n", (unsigned long)flash, (unsigned long)saved);
 }
 
-void st7701_write_command(uint8_t c) {
-    st7701_send(c, true);
+// ==============================================================================
+// Profile Loading
+// ==============================================================================
+// Profiles come from the bundle in the "profiles" partition when it holds a
+// valid one, otherwise from the built-in flash tables. Either way only the
+// profiles in the store's LRU cache are decoded into RAM.
+const ProfileSource* selectProfileSource() {
+    BundleError err = profileBundle.map();
+    if (err == BUNDLE_OK && profileBundle.view().profileCount() > 0) {
+        const ProfileBundleView& view = profileBundle.view();
+        bundleSource.attach(&view);
+        Serial.printf("Profiles: %u from bundle (%u bytes, crc %08X), %d cached\n",
+            view.profileCount(), (unsigned)view.size(), view.crc(), PROFILE_CACHE_SLOTS);
+        return &bundleSource;
+    }
+
+    Serial.printf("Profiles: no bundle (%s), using built-ins\n", bundleErrorName(err));
+    printProfileMemory();
+    return &builtinSource;
 }
 
-void st7701_write_data(uint8_t d) {
-    st7701_send(d, false);
+// Layers the edit log over the chosen base; edits made against a different
+// base (e.g. before an import) are discarded by the log itself
+const ProfileSource* withProfileLog(const ProfileSource* base) {
+    if (profileLog == nullptr) return base;
+    profileLog->mount(base->identity());
+    pad.setProfileLog(profileLog);
+    loggedSource.attach(base, profileLog);
+    Serial.printf("Profile log: slot %d, generation %lu, %d edited buttons, %u/%u bytes\n",
+        profileLog->activeSlot(), (unsigned long)profileLog->generation(),
+        profileLog->editCount(), (unsigned)profileLog->used(), (unsigned)profileLog->slotSize());
+    return &loggedSource;
 }
 
-void run_init_sequence() {
-    Serial.println("ST7701: Starting Manual Init...");
-    pinMode(PIN_SPI_CS, OUTPUT);
-    pinMode(PIN_SPI_SDA, OUTPUT);
-    pinMode(PIN_SPI_SCK, OUTPUT);
-
-    digitalWrite(PIN_SPI_CS, HIGH);
-    digitalWrite(PIN_SPI_SCK, HIGH);
-    digitalWrite(PIN_SPI_SDA, HIGH);
-
-    delay(120);
-
-    const size_t n = sizeof(ST7701_INIT_SEQUENCE);
-    size_t i = 0;
-    while (i < n) {
-        const uint8_t cmd = ST7701_INIT_SEQUENCE[i++];
-        if (cmd == 0x00 && i >= n) break; // EOF
-
-        if (cmd == 0xFF) {
-            st7701_write_command(cmd);
-            if (i >= n) break;
-            uint8_t len = ST7701_INIT_SEQUENCE[i++];
-            for (uint8_t j = 0; j < len; j++) {
-                if (i >= n) break;
-                st7701_write_data(ST7701_INIT_SEQUENCE[i++]);
-            }
-            continue;
-        }
+void initProfileLog() {
+    if (!profileLogRegion.begin(PROFILE_LOG_PARTITION, PROFILE_LOG_SUBTYPE)) {
+        Serial.println("Profile log: no proflog partition, edits disabled");
+        return;
+    }
+    // ~16 KB of override state: keep it out of internal RAM
+    void* mem = ps_malloc(sizeof(ProfileLog));
+    if (mem == nullptr) mem = malloc(sizeof(ProfileLog));
+    if (mem == nullptr) return;
+    profileLog = new (mem) ProfileLog(&profileLogRegion);
+}
 
-        if (cmd == 0x00) {
-             break;
-        }
+// ==============================================================================
+// Profile Import/Export
+// ==============================================================================
+// Dropping /import.json onto LittleFS imports it on the next boot; a
+// double-tap on the header exports the current set to /profiles.json.
+// Bundles uploaded over the serial protocol take the same flash path.
+void releaseSerialUpload();
+
+bool installFromImport = false;
+
+// Flashes a validated bundle image; `image` must stay valid until the job ends
+bool startBundleInstall(const std::vector<uint8_t>& image, bool fromImport) {
+    if (flashJob.isRunning()) return false;
+
+    // The partition is about to be rewritten: nothing may point into it
+    profileStore.setSource(&builtinSource);
+    ui->reloadProfiles();
+    bundleSource.detach();
+    profileBundle.unmap();
+    installFromImport = fromImport;
+    return flashJob.begin(image.data(), image.size());
+}
+
+bool isBundleInstallBusy() {
+    return importJob.isRunning() || importJob.state() == TRANSFER_DONE || flashJob.isRunning();
+}
 
-        st7701_write_command(cmd);
-        if (i >= n) break;
-        uint8_t len = ST7701_INIT_SEQUENCE[i++];
+void serviceProfileTransfers() {
+    importJob.poll();
 
-        for (uint8_t j = 0; j < len; j++) {
-            if (i >= n) break;
-            st7701_write_data(ST7701_INIT_SEQUENCE[i++]);
+    if (importJob.state() == TRANSFER_DONE && !flashJob.isRunning()) {
+        startBundleInstall(importJob.bundle(), true);
+    } else if (importJob.state() == TRANSFER_FAILED) {
+        LittleFS.rename(PROFILE_IMPORT_PATH, PROFILE_IMPORT_PATH ".bad");
+        importJob.clear();
+    }
+
+    flashJob.poll();
+
+    if (flashJob.state() == TRANSFER_DONE || flashJob.state() == TRANSFER_FAILED) {
+        bool flashed = flashJob.state() == TRANSFER_DONE;
+        flashJob = BundleFlashJob();
+        if (installFromImport) {
+            importJob.clear();
+            LittleFS.rename(PROFILE_IMPORT_PATH, flashed ? PROFILE_IMPORT_PATH ".done"
+                                                         : PROFILE_IMPORT_PATH ".bad");
+        } else {
+            releaseSerialUpload();
         }
 
-        if (cmd == 0x11) delay(120);
-        if (cmd == 0x29) delay(50);
-        if (cmd == 0xFF) delay(10);
+        if (!flashed) {
+            // Built-ins are already showing; don't map a half-written partition
+            return;
+        }
+        profileStore.setSource(withProfileLog(selectProfileSource()));
+        ui->reloadProfiles();
+    }
+
+    exportJob.poll();
+}
+
+void startProfileExport() {
+    if (!filesystemReady || importJob.isRunning() || flashJob.isRunning()) return;
+    if (exportJob.begin(profileStore.source())) {
+        LOG(LOG_PROFILE_EXPORT, profileStore.count(), PROFILE_EXPORT_PATH);
     }
-    Serial.println("ST7701: Manual Init Done.");
 }
 
 // ==============================================================================
-// HID Key Conversion
+// Serial Profile Protocol
 // ==============================================================================
-uint8_t hidToBleKey(uint8_t hidKey) {
-    // Non-printing HID keys (F-keys, arrows, etc.) need +0x88 offset for BleKeyboard
-    if ((hidKey >= KEY_F1 && hidKey <= KEY_F24) ||
-        (hidKey >= KEY_INSERT && hidKey <= KEY_PAGE_DOWN) ||
-        (hidKey >= KEY_RIGHT && hidKey <= KEY_UP) ||
-        hidKey == KEY_ENTER || hidKey == KEY_ESC || hidKey == KEY_BACKSPACE || hidKey == KEY_TAB) {
-        return hidKey + 0x88;
+// Bundle uploads and button patches from the host (host/macropadctl.cpp).
+// Patches go through the edit log, so serviceProfileLog() redraws them live
+// and they survive a reboot; uploads are flashed like an import.
+class DeviceProtocolHandler : public SerialProtocolHandler {
+private:
+    BundleUpload _upload;
+
+public:
+    FrameStatus onBundleBegin(uint32_t size, uint32_t crc) override {
+        if (isBundleInstallBusy()) return STATUS_BUSY;
+        FrameStatus status = _upload.begin(size, crc);
+        if (status == STATUS_OK) {
+            LOG(LOG_PROFILE_UPLOAD, size);
+        }
+        return status;
+    }
+
+    FrameStatus onBundleData(uint32_t offset, const uint8_t* data, size_t len) override {
+        return _upload.data(offset, data, len);
     }
 
-    if (hidKey >= KEY_A && hidKey <= KEY_Z) {
-        return 'a' + (hidKey - KEY_A);
+    FrameStatus onBundleEnd() override {
+        if (isBundleInstallBusy()) return STATUS_BUSY;
+        FrameStatus status = _upload.finish();
+        if (status != STATUS_OK) {
+            LOG(LOG_PROFILE_UPLOAD_FAILED, frameStatusName(status));
+            _upload.reset();
+            return status;
+        }
+        if (!startBundleInstall(_upload.image(), false)) {
+            _upload.reset();
+            return STATUS_REJECTED;
+        }
+        return STATUS_OK;
     }
-    if (hidKey >= KEY_1 && hidKey <= KEY_9) {
-        return '1' + (hidKey - KEY_1);
+
+    FrameStatus onButtonSet(uint16_t profile, uint8_t button, const Macro& macro) override {
+        if (profileLog == nullptr || isBundleInstallBusy()) return STATUS_BUSY;
+        if (profile >= profileStore.count()) return STATUS_BAD_REQUEST;
+        return profileLog->setButton(profile, button, macro) ? STATUS_OK : STATUS_REJECTED;
     }
-    if (hidKey == KEY_0) {
-        return '0';
+
+    FrameStatus onButtonClear(uint16_t profile, uint8_t button) override {
+        if (profileLog == nullptr || isBundleInstallBusy()) return STATUS_BUSY;
+        if (profile >= profileStore.count()) return STATUS_BAD_REQUEST;
+        return profileLog->clearButton(profile, button) ? STATUS_OK : STATUS_REJECTED;
     }
 
-    switch (hidKey) {
-        case KEY_ENTER: return hidKey + 0x88;
-        case KEY_ESC: return hidKey + 0x88;
-        case KEY_BACKSPACE: return hidKey + 0x88;
-        case KEY_TAB: return hidKey + 0x88;
-        case KEY_SPACE: return ' ';
-        case KEY_MINUS: return '-';
-        case KEY_EQUAL: return '=';
-        case KEY_LEFT_BRACE: return '[';
-        case KEY_RIGHT_BRACE: return ']';
-        case KEY_BACKSLASH: return '\\';
-        case KEY_SEMICOLON: return ';';
-        case KEY_QUOTE: return '\'';
-        case KEY_TILDE: return '`';
-        case KEY_COMMA: return ',';
-        case KEY_PERIOD: return '.';
-        case KEY_SLASH: return '/';
-
-        case KEY_F1: return hidKey + 0x88;
-        case KEY_F2: return hidKey + 0x88;
-        case KEY_F3: return hidKey + 0x88;
-        case KEY_F4: return hidKey + 0x88;
-        case KEY_F5: return hidKey + 0x88;
-        case KEY_F6: return hidKey + 0x88;
-        case KEY_F7: return hidKey + 0x88;
-        case KEY_F8: return hidKey + 0x88;
-        case KEY_F9: return hidKey + 0x88;
-        case KEY_F10: return hidKey + 0x88;
-        case KEY_F11: return hidKey + 0x88;
-        case KEY_F12: return hidKey + 0x88;
-        case KEY_F13: return hidKey + 0x88;
-        case KEY_F14: return hidKey + 0x88;
-        case KEY_F15: return hidKey + 0x88;
-        case KEY_F16: return hidKey + 0x88;
-        case KEY_F17: return hidKey + 0x88;
-        case KEY_F18: return hidKey + 0x88;
-        case KEY_F19: return hidKey + 0x88;
-        case KEY_F20: return hidKey + 0x88;
-        case KEY_F21: return hidKey + 0x88;
-        case KEY_F22: return hidKey + 0x88;
-        case KEY_F23: return hidKey + 0x88;
-        case KEY_F24: return hidKey + 0x88;
-
-        case KEY_INSERT: return hidKey + 0x88;
-        case KEY_HOME: return hidKey + 0x88;
-        case KEY_PAGE_UP: return hidKey + 0x88;
-        case KEY_DELETE: return hidKey + 0x88;
-        case KEY_END: return hidKey + 0x88;
-        case KEY_PAGE_DOWN: return hidKey + 0x88;
-        case KEY_RIGHT: return hidKey + 0x88;
-        case KEY_LEFT: return hidKey + 0x88;
-        case KEY_DOWN: return hidKey + 0x88;
-        case KEY_UP: return hidKey + 0x88;
-
-        default: return 0;
+    void onInfo(ProtocolInfo& info) override {
+        info.profileCount = (uint16_t)profileStore.count();
+        info.currentProfile = (uint16_t)ui->getCurrentProfileIndex();
+        info.bundleCrc = profileBundle.view().profileCount() ? profileBundle.view().crc() : 0;
+        info.editedButtons = profileLog ? (uint16_t)profileLog->editCount() : 0;
     }
-}
 
-// ==============================================================================
-// Macro Execution
-// ==============================================================================
-void executeMacro(const Macro& macro, int buttonIndex) {
-    if (!bleKeyboard.isConnected()) {
-        Serial.println("BLE not connected, cannot send macro");
-        return;
+    size_t onMetrics(uint8_t first, uint8_t* out, size_t cap) override {
+        return metrics.encodePage(first, clockMillis(), out, cap);
     }
 
-    Serial.printf("Executing macro: %s (type=%d)\n", macro.label, macro.type);
-
-    switch (macro.type) {
-        case MACRO_TYPE_KEY:
-            if (macro.keyCount > 0 && macro.keys[0] != KEY_NONE) {
-                uint8_t key = hidToBleKey(macro.keys[0]);
-                if (key != 0) {
-                    bleKeyboard.write(key);
-                    Serial.printf("Sent key: 0x%02X\n", key);
-                }
-            }
-            break;
-
-        case MACRO_TYPE_COMBO:
-            {
-                uint8_t key = hidToBleKey(macro.keys[0]);
-                if (key != 0) {
-                    if (macro.modifiers & MODIFIER_CTRL) {
-                        bleKeyboard.press(KEY_LEFT_CTRL);
-                    }
-                    if (macro.modifiers & MODIFIER_SHIFT) {
-                        bleKeyboard.press(KEY_LEFT_SHIFT);
-                    }
-                    if (macro.modifiers & MODIFIER_ALT) {
-                        bleKeyboard.press(KEY_LEFT_ALT);
-                    }
-                    if (macro.modifiers & MODIFIER_GUI) {
-                        bleKeyboard.press(KEY_LEFT_GUI);
-                    }
-
-                    bleKeyboard.press(key);
-                    delay(50);
-                    bleKeyboard.releaseAll();
-
-                    Serial.printf("Sent combo: modifiers=0x%02X key=0x%02X\n",
-                                  macro.modifiers, key);
-                }
-            }
-            break;
-
-        case MACRO_TYPE_SEQUENCE:
-            {
-                for (int i = 0; i < macro.keyCount; i++) {
-                    uint8_t key = hidToBleKey(macro.keys[i]);
-                    if (key != 0) {
-                        bleKeyboard.write(key);
-                        delay(30);
-                    }
-                }
-                Serial.printf("Sent sequence of %d keys\n", macro.keyCount);
-            }
-            break;
-
-        case MACRO_TYPE_TEXT:
-            if (macro.text != nullptr) {
-                bleKeyboard.print(macro.text);
-                Serial.printf("Sent text: %s\n", macro.text);
-            }
-            break;
-
-        case MACRO_TYPE_MEDIA:
-            if (macro.keyCount > 0) {
-                uint8_t mediaKey = macro.keys[0];
-                switch (mediaKey) {
-                    case KEY_MEDIA_PLAY_PAUSE:
-                        bleKeyboard.write(MEDIA_PLAY_PAUSE);
-                        break;
-                    case KEY_MEDIA_STOP:
-                        bleKeyboard.write(MEDIA_STOP);
-                        break;
-                    case KEY_MEDIA_PREV:
-                        bleKeyboard.write(MEDIA_PREV);
-                        break;
-                    case KEY_MEDIA_NEXT:
-                        bleKeyboard.write(MEDIA_NEXT);
-                        break;
-                    case KEY_MEDIA_VOLUME_UP:
-                        bleKeyboard.write(MEDIA_VOL_UP);
-                        break;
-                    case KEY_MEDIA_VOLUME_DOWN:
-                        bleKeyboard.write(MEDIA_VOL_DOWN);
-                        break;
-                    case KEY_MEDIA_MUTE:
-                        bleKeyboard.write(MEDIA_MUTE);
-                        break;
-                }
-                Serial.printf("Sent media key: 0x%02X\n", mediaKey);
-            }
-            break;
-
-        default:
-            Serial.println("Unknown macro type");
-            break;
+    void release() { _upload.reset(); }
+};
+
+void writeSerialFrame(const uint8_t* data, size_t len, void*) {
+    Serial.write(data, len);
+}
+
+uint32_t protocolMicros() {
+    return clockMicros();
+}
+
+DeviceProtocolHandler protocolHandler;
+SerialProtocolServer protocolServer(&protocolHandler, writeSerialFrame, nullptr, protocolMicros);
+
+void releaseSerialUpload() {
+    protocolHandler.release();
+}
+
+void serviceSerialProtocol() {
+    uint8_t buf[256];
+    for (int budget = SERIAL_PROTOCOL_POLL_BYTES; budget > 0; ) {
+        int n = Serial.available();
+        if (n <= 0) break;
+        if (n > (int)sizeof(buf)) n = sizeof(buf);
+        n = Serial.read(buf, n);
+        protocolServer.feed(buf, n);
+        budget -= n;
     }
 }
 
 // ==============================================================================
-// Profile Change Handler
+// Log Drain
 // ==============================================================================
-void onProfileChanged(int newProfileIndex) {
-    Serial.printf("Switched to profile: %s\n", profiles[newProfileIndex].name);
+// Moves LOG() records (BinaryLog.hpp) onto the serial port as FRAME_LOG
+// frames. Lowest priority above idle, on core 0: it runs while loop() and
+// the BLE stack have nothing to do, and it is this task, not the one that
+// logged, that waits for the UART.
+#define LOG_DRAIN_INTERVAL_MS 10
+
+void logDrainTask(void*) {
+    uint8_t payload[SERIAL_PROTOCOL_MAX_PAYLOAD];
+    for (;;) {
+        size_t n = binaryLog.takeBatch(payload, sizeof(payload));
+        if (n == 0) {
+            vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+            continue;
+        }
+        #if LOG_TEXT
+        char text[192];
+        for (size_t at = 4; at < n;) {
+            size_t used = logFormatRecord(payload + at, n - at, text, sizeof(text));
+            if (used == 0) break;
+            Serial.println(text);
+            at += used;
+        }
+        #else
+        uint8_t frame[SERIAL_FRAME_MAX_ENCODED];
+        size_t len = encodeFrame(FRAME_LOG, 0, payload, n, frame);
+        Serial.write(frame, len);
+        #endif
+    }
 }
 
 // ==============================================================================
 // Setup and Loop
 // ==============================================================================
+// Stack up, HID service registered, advertising started
+void startBLE() {
+    bootTimeline.mark(BOOT_BLE_START, clockMicros());
+    Serial.printf("Starting BLE Keyboard (%s)...\n", bleTransport.name());
+    uint32_t heapBefore = ESP.getFreeHeap();
+    bleTransport.begin();
+    bleHeapAfterInit = ESP.getFreeHeap();
+    bleHeapUsed = heapBefore > bleHeapAfterInit ? heapBefore - bleHeapAfterInit : 0;
+    bootTimeline.mark(BOOT_BLE_DONE, clockMicros());
+    Serial.printf("BLE Keyboard started in %lu ms, %lu bytes of heap\n",
+        (unsigned long)(bootTimeline.spanUs(BOOT_BLE_START, BOOT_BLE_DONE) / 1000),
+        (unsigned long)bleHeapUsed);
+    bleStarted.store(true);
+}
+
+// Core 0, next to the BT controller
+void bleStartTask(void*) {
+    startBLE();
+    vTaskDelete(nullptr);
+}
+
+void printBootTimeline() {
+    Serial.printf("Boot: first frame %lu ms, advertising %lu ms\n",
+        (unsigned long)bootTimeline.atMs(BOOT_FIRST_FRAME),
+        (unsigned long)bootTimeline.atMs(BOOT_ADVERTISING));
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        BootPhase phase = (BootPhase)i;
+        if (!bootTimeline.reached(phase)) continue;
+        uint32_t us = bootTimeline.atUs(phase);
+        Serial.printf("  %-12s %5lu.%03lu ms\n", bootPhaseName(phase),
+            (unsigned long)(us / 1000), (unsigned long)(us % 1000));
+    }
+}
+
 void setup() {
-    Serial.begin(115200);
-    delay(1000);
+    bootTimeline.mark(BOOT_SETUP, clockMicros());
+    Serial.setRxBufferSize(SERIAL_RX_BUFFER_SIZE);
+    Serial.begin(SERIAL_PROTOCOL_BAUD);
     Serial.println("\n================================");
     Serial.println("Bluetooth Macro Pad Starting...");
     Serial.println("================================");
     Serial.printf("PSRAM Size: %d bytes\n", ESP.getPsramSize());
+    xTaskCreatePinnedToCore(logDrainTask, "logDrain", 3072, nullptr, tskIDLE_PRIORITY + 1,
+        nullptr, 0);
 
     // 1. Initialize watchdog
     initWatchdog();
 
-    // 2. Run Manual Init for ST7701S
+    // 2. Start BLE alongside the display (its start-up is mostly waiting
+    //    on the controller, the panel's mostly fixed delays)
+    #if BOOT_PARALLEL_BLE
+    if (xTaskCreatePinnedToCore(bleStartTask, "bleStart", 8192, nullptr, 1, nullptr, 0) != pdPASS) {
+        startBLE();
+    }
+    #endif
+
+    // 3. Configure the ST7701S over its 3-wire SPI link
     Serial.println("Initializing display...");
-    run_init_sequence();
+    bootTimeline.mark(BOOT_PANEL_START, clockMicros());
+    if (!st7701Init()) {
+        Serial.println("ST7701: SPI setup failed");
+    }
+    bootTimeline.mark(BOOT_PANEL_DONE, clockMicros());
 
-    // 3. Initialize LGFX
+    // 4. Initialize LGFX, backlight off until the first frame is drawn
     Serial.println("Starting TFT...");
+    tft.setBrightness(0);
     tft.init();
-    tft.setBrightness(255);
+    bootTimeline.mark(BOOT_TFT_DONE, clockMicros());
 
-    // 4. Initialize profiles
+    // 5. Initialize profiles
     Serial.println("Loading profiles...");
-    profiles = getAllProfiles();
+    initProfileLog();
+    if (!profileStore.begin(withProfileLog(selectProfileSource()))) {
+        Serial.println("Profiles: cache allocation failed");
+    }
+
+    filesystemReady = LittleFS.begin(true);
+    if (!filesystemReady) {
+        Serial.println("LittleFS: mount failed, profile import/export disabled");
+    } else if (LittleFS.exists(PROFILE_IMPORT_PATH)) {
+        importJob.begin(PROFILE_IMPORT_PATH);
+    }
+    bootTimeline.mark(BOOT_PROFILES_DONE, clockMicros());
 
-    // 5. Create UI
+    // 6. Create UI
     Serial.println("Creating UI...");
-    ui = new MacroPadUI(&tft, profiles, PROFILE_COUNT);
+    ui = new MacroPadUI(&tft, &profileStore);
+    pad.setUI(ui);
     ui->setMacroCallback(executeMacro);
+    ui->setHoldCallback(holdMacro);
     ui->setProfileChangeCallback(onProfileChanged);
+    ui->setGestureCallback(onGesture);
+    ui->setTrackpad(&trackpad);
     ui->init();
+    tft.setBrightness(255);
+    bootTimeline.mark(BOOT_FIRST_FRAME, clockMicros());
+
+    // 7. Start USB HID (used instead of BLE while a host has it configured)
+    if (usbTransport.begin()) {
+        Serial.println("USB HID started");
+    }
 
-    // 6. Start BLE Keyboard
-    Serial.println("Starting BLE Keyboard...");
-    bleKeyboard.begin();
-    Serial.println("BLE Keyboard started");
+    // 8. BLE must be up before the bonds can be looked at
+    #if BOOT_PARALLEL_BLE
+    while (!bleStarted.load()) delay(1);
+    #else
+    startBLE();
+    #endif
 
     // Optionally clear bonds AFTER BLE stack is up
     #if CLEAR_BONDING_ON_BOOT
@@ -409,58 +574,168 @@ void setup() {
     clearBLEBondingData();
     #endif
 
+    // Directed advertising to the active host first, measured from power-on
+    loadHostSlots(hostSlots);
+    ui->setHostSlot(hostSlots.active());
+    reconnect.begin(hostSlots.activePeer(), 0, clockMillis());
+    bootTimeline.mark(BOOT_SETUP_DONE, clockMicros());
+
     Serial.println("\n================================");
     Serial.println("Setup complete!");
     Serial.println("Waiting for BLE connection...");
     Serial.println("================================\n");
 
-    printBLEStatusSimple();
+    printBLEStatus();
+}
+
+void sampleMetrics(uint32_t now) {
+    metrics.set(METRIC_HID_QUEUE_DEPTH, hidReports.depth());
+    metrics.set(METRIC_MACRO_QUEUE_DEPTH, macroExecutor.queued());
+    metrics.set(METRIC_LOG_RING_BYTES, binaryLog.used());
+
+    const ReconnectStats& rs = reconnect.stats();
+    if (rs.reconnects != reconnectsSeen) {
+        reconnectsSeen = rs.reconnects;
+        metrics.observe(METRIC_BLE_RECONNECT_MS, rs.lastReconnectMs);
+    }
+
+    if (now - lastMetricsSample < METRICS_SAMPLE_MS) return;
+    lastMetricsSample = now;
+    metrics.set(METRIC_HEAP_FREE, ESP.getFreeHeap());
+    metrics.set(METRIC_HEAP_LOW_WATER, ESP.getMinFreeHeap());
+    metrics.set(METRIC_PSRAM_FREE, ESP.getFreePsram());
+    metrics.set(METRIC_PSRAM_LOW_WATER, ESP.getMinFreePsram());
 }
 
 void loop() {
+    uint32_t loopStart = clockMicros();
+    if (lastLoopMicros != 0) metrics.observe(METRIC_LOOP_PERIOD_US, loopStart - lastLoopMicros);
+    lastLoopMicros = loopStart;
+
     // Feed watchdog
     feedWatchdog();
 
     // Update UI (handles touch input)
     ui->update();
 
-    uint32_t now = millis();
-
-    // Check BLE connection status with debounce
-    bool currentlyConnected = bleKeyboard.isConnected();
-    if (currentlyConnected != bleConnected) {
-        if (now - lastConnectionChange > CONNECTION_DEBOUNCE_MS) {
-            lastConnectionChange = now;
-            bleConnected = currentlyConnected;
-            ui->setBluetoothConnected(bleConnected);
-
-            if (bleConnected) {
-                bleConnectedSince = now;
-                bleConnectCount++;
-                Serial.println("\n*** BLE CONNECTED ***");
-                printBLEStatusSimple();
-            } else {
-                bleDisconnectedSince = now;
-                Serial.println("\n*** BLE DISCONNECTED ***");
-                printBLEStatusSimple();
-            }
-        }
+    // Handle host requests and BLE link events, prefetch a neighbouring
+    // profile, advance log compaction and any import/export by one step
+    serviceSerialProtocol();
+    pad.serviceBLELink();
+    profileStore.service();
+    pad.serviceProfileLog();
+    serviceProfileTransfers();
+
+    uint32_t now = clockMillis();
+    sampleMetrics(now);
+
+    // Boot timeline, once the first advertising has been seen (the link may
+    // already have moved on to connecting)
+    if (!bootTimeline.reached(BOOT_ADVERTISING) && bleLink.enteredAt(BLE_LINK_ADVERTISING) != 0) {
+        bootTimeline.mark(BOOT_ADVERTISING, bleLink.enteredAt(BLE_LINK_ADVERTISING) * 1000);
     }
+    if (bootTimeline.takeReport()) printBootTimeline();
+
+    // Follow the link state machine; transitions are published by the stack's task
+    pad.followLinkState();
 
-    // Periodic status update (every 10 seconds)
+    // Periodic status update (every 10 seconds), as log records: formatted
+    // on the host, so none of it waits for the UART here
     if (now - lastStatusUpdate > 10000) {
         lastStatusUpdate = now;
 
-        if (bleConnected && bleConnectedSince > 0) {
-            Serial.printf("BLE: Stable connection, uptime: %lu ms\n",
-                now - bleConnectedSince);
+        if (bleLink.isReady()) {
+            LOG(LOG_STATUS_BLE_READY, getBLEConnectedTime());
         } else {
-            Serial.println("BLE: Waiting for connection...");
+            LOG(LOG_STATUS_BLE_WAITING, bleLinkStateName(bleLink.state()));
+        }
+
+        const ReconnectStats& rs = reconnect.stats();
+        const PendingKeystrokeStats& ks = pendingKeys.stats();
+        LOG(LOG_STATUS_RECONNECT, rs.bootToReadyMs, rs.reconnects, rs.lastReconnectMs,
+            (uint32_t)(rs.reconnects ? rs.totalReconnectMs / rs.reconnects : 0), rs.maxReconnectMs,
+            rs.byPhase[ADV_PHASE_DIRECTED], rs.byPhase[ADV_PHASE_FAST], rs.byPhase[ADV_PHASE_SLOW],
+            ks.buffered, ks.replayed, ks.expired + ks.dropped);
+
+        const HostSwitchStats& hs = hostSwitcher.stats();
+        if (hs.switches) {
+            LOG(LOG_STATUS_HOSTS, hostSlots.active() + 1, hs.switches, hs.completed, hs.timedOut,
+                hs.refused, hs.lastMs, (uint32_t)(hs.completed ? hs.totalMs / hs.completed : 0), hs.maxMs);
         }
 
-        // Also print memory status periodically
-        Serial.printf("Heap: %d free, PSRAM: %d free\n",
-            ESP.getFreeHeap(), ESP.getFreePsram());
+        const HidReportQueueStats& hq = hidReports.stats();
+        LOG(LOG_STATUS_HID_QUEUE, hq.sent, hidReports.depth(), hq.maxDepth, hq.dropped, hq.flushed,
+            hq.stackErrors, hq.stalls, hq.lastStallMs, hq.maxStallMs, (uint32_t)hq.totalStallMs);
+
+        const MacroExecStats& me = macroExecutor.stats();
+        LOG(LOG_STATUS_MACROS, me.completed, me.cancelled, me.rejected, me.truncated,
+            me.unmapped, macroExecutor.queued());
+        LOG(LOG_STATUS_MACRO_TIMING, me.preempted, me.lastWaitMs, me.maxWaitMs,
+            (uint32_t)(me.completed ? me.totalWaitMs / me.completed : 0), me.lastRunMs, me.maxRunMs,
+            (uint32_t)(me.completed ? me.totalRunMs / me.completed : 0));
+        LOG(LOG_STATUS_HOLDS, me.holds, me.holdReports, me.forcedReleases, macroExecutor.held());
+
+        HidTransportStats ht = bleTransport.stats();
+        LOG(LOG_STATUS_BLE_HID, bleTransport.name(), bleHeapAfterInit, bleHeapUsed,
+            bootTimeline.atMs(BOOT_ADVERTISING), ht.reports, ht.failures, ht.lastLatencyUs,
+            (uint32_t)(ht.completions ? ht.totalLatencyUs / ht.completions : 0), ht.maxLatencyUs);
+        if (HID_USB_AVAILABLE) {
+            HidTransportStats us = usbTransport.stats();
+            LOG(LOG_STATUS_USB_HID, usbTransport.isReady() ? "attached" : "detached",
+                pad.output() ? pad.output()->name() : "none", us.reports, us.failures, us.lastLatencyUs,
+                (uint32_t)(us.completions ? us.totalLatencyUs / us.completions : 0),
+                us.maxLatencyUs);
+        }
+
+        const ConnParamStats& cs = connParams.stats();
+        LOG(LOG_STATUS_BLE_PARAMS, connParamModeName(connParams.appliedMode()),
+            connParams.interval() * 1.25f, connParams.latency(), cs.requests, cs.accepted,
+            cs.compromised, cs.rejected, cs.timeouts, (uint32_t)(cs.activeMs / 1000),
+            (uint32_t)(cs.idleMs / 1000));
+
+        LOG(LOG_HEAP, ESP.getFreeHeap(), ESP.getFreePsram());
+        BinaryLogStats bl = binaryLog.stats();
+        LOG(LOG_LOG_STATS, bl.records, bl.dropped, bl.maxUsed, LOG_RING_BYTES);
+
+        LOG(LOG_STATUS_GESTURES, ui->gestures().maxDecisionLatency(),
+            ui->gestures().budgetOverruns(), GESTURE_DECISION_BUDGET_MS);
+
+        const TouchToReportStats& tr = pad.touchToReport();
+        LOG(LOG_STATUS_TOUCH_TO_REPORT, HID_FIRST_ORDERING ? "HID-first" : "draw-first",
+            tr.lastUs, (uint32_t)(tr.count ? tr.totalUs / tr.count : 0), tr.maxUs, tr.count);
+
+        const TouchStats& ts = ui->touchStats();
+        LOG(LOG_STATUS_TOUCH, ts.commits, ts.immediateCommits,
+            ts.commits ? ts.totalCommitMs / ts.commits : 0, ts.maxCommitMs,
+            ts.hysteresisReleases, ts.highlightRedraws);
+
+        const MotionStats& mt = trackpad.stats();
+        if (mt.contacts) {
+            LOG(LOG_STATUS_TRACKPAD, mt.contacts, mt.samples, mt.reports,
+                (uint32_t)(mt.touchingUs ? mt.reports * 1000000ull / mt.touchingUs : 0),
+                mt.maxSamplesPerReport, mt.lastDelayUs,
+                (uint32_t)(mt.reports ? mt.totalDelayUs / mt.reports : 0), mt.maxDelayUs,
+                mt.clicks, mt.rightClicks, mt.carried);
+        }
+
+        const ProfileStoreStats& ps = profileStore.stats();
+        uint32_t lookups = ps.hits + ps.misses;
+        LOG(LOG_STATUS_PROFILE_CACHE, lookups ? ps.hits * 100 / lookups : 0, ps.hits, lookups,
+            ps.prefetches, ps.evictions, (uint32_t)(ps.loads ? ps.totalLoadUs / ps.loads : 0),
+            ps.maxLoadUs);
+
+        if (profileLog) {
+            const ProfileLogStats& ls = profileLog->stats();
+            const FlashRegionStats& fs = profileLogRegion.stats();
+            LOG(LOG_STATUS_PROFILE_LOG, ls.edits, ls.logicalBytes, fs.bytesWritten, fs.bytesErased,
+                ls.compactions, ls.tornRecords, ls.flashErrors);
+        }
+
+        const FrameDecoderStats& fs = protocolServer.decoderStats();
+        if (fs.frames) {
+            LOG(LOG_STATUS_SERIAL, protocolServer.requests(), protocolServer.rejected(),
+                fs.crcErrors, fs.overflows);
+        }
     }
 
     delay(5);